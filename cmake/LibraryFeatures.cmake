@@ -35,6 +35,17 @@ if(strip-chopping)
     endif()
 endif()
 
+# Worker threads, used to compress strips/tiles in parallel (native threads
+# are always used on Windows)
+option(threads "use POSIX threads for parallel strip/tile compression" ON)
+if(threads AND NOT WIN32)
+    set(THREADS_PREFER_PTHREAD_FLAG ON)
+    find_package(Threads)
+    if(CMAKE_USE_PTHREADS_INIT)
+        set(HAVE_PTHREAD 1)
+    endif()
+endif()
+
 set(TIFF_MAX_DIR_COUNT 1048576 CACHE STRING "Maximum number of TIFF directories that libtiff can browse through")
 
 # Defer loading of strip/tile offsets
@@ -39,5 +39,8 @@ endif()
 # Check for mmap
 check_symbol_exists(mmap "sys/mman.h" HAVE_MMAP)
 
+# Check for pwrite
+check_symbol_exists(pwrite "unistd.h" HAVE_PWRITE)
+
 # Check for setmode
 check_symbol_exists(setmode "unistd.h" HAVE_SETMODE)
@@ -104,6 +104,7 @@ man_pages = [
     ('tools/tiff2ps', 'tiff2ps', 'convert TIFF image to PostScript™', author, 1),
     ('tools/tiff2rgba', 'tiff2rgba', 'convert a TIFF image to RGBA color space', author, 1),
     ('tools/tiffcmp', 'tiffcmp', 'compare two TIFF files', author, 1),
+    ('tools/tiffcompact', 'tiffcompact', 'reclaim the space left unused in a TIFF file', author, 1),
     ('tools/tiffcp', 'tiffcp', 'copy (and possibly convert) a TIFF file', author, 1),
     ('tools/tiffcrop', 'tiffcrop', 'select, copy, crop, convert, extract, and/or process one or more TIFF files', author, 1),
     ('tools/tiffdither', 'tiffdither', 'convert a greyscale TIFF image to bilevel using dithering', author, 1),
@@ -117,10 +118,13 @@ man_pages = [
     ('functions/_TIFFauxiliary', '_TIFFauxiliary', 'auxiliary functions', author, '3tiff'),
     ('functions/_TIFFRewriteField', '_TIFFRewriteField', 'rewrite a field in the directory on disk', author, '3tiff'),
     ('functions/TIFFAccessTagMethods', 'TIFFAccessTagMethods', 'provides read/write access to the TIFFTagMethods', author, '3tiff'),
+    ('functions/TIFFAsyncWriter', 'TIFFAsyncWriter', 'compress strips and tiles on several threads', author, '3tiff'),
     ('functions/TIFFbuffer', 'TIFFbuffer', 'I/O buffering control routines', author, '3tiff'),
     ('functions/TIFFClientInfo', 'TIFFClientInfo', 'provides a method to hand over user defined data from one routine to another', author, '3tiff'),
     ('functions/TIFFClose', 'TIFFClose', 'close a previously opened TIFF file', author, '3tiff'),
     ('functions/TIFFcodec', 'TIFFcodec', 'codec-related utility routines', author, '3tiff'),
+    ('functions/TIFFCOGWriter', 'TIFFCOGWriter', 'write a pyramid with a cloud optimized layout in a single pass', author, '3tiff'),
+    ('functions/TIFFCompact', 'TIFFCompact', 'copy a file without the space left unused by rewrites', author, '3tiff'),
     ('functions/TIFFcolor', 'TIFFcolor', 'color conversion routines', author, '3tiff'),
     ('functions/TIFFCreateDirectory', 'TIFFCreateDirectory', 'routines to create a directory and retrieve information about directories', author, '3tiff'),
     ('functions/TIFFCustomDirectory', 'TIFFCustomDirectory', 'routines to create a custom directory', author, '3tiff'),
@@ -154,9 +158,11 @@ man_pages = [
     ('functions/TIFFReadRGBATile', 'TIFFReadRGBATile', 'read and decode an image tile into a fixed-format raster', author, '3tiff'),
     ('functions/TIFFReadScanline', 'TIFFReadScanline', 'read and decode a scanline of data from an open TIFF file', author, '3tiff'),
     ('functions/TIFFReadTile', 'TIFFReadTile', 'read and decode a tile of data from an open TIFF file', author, '3tiff'),
+    ('functions/TIFFReserveStrile', 'TIFFReserveStrile', 'reserve file space for strips and tiles written later', author, '3tiff'),
     ('functions/TIFFRGBAImage', 'TIFFRGBAImage', 'read and decode an image into a raster', author, '3tiff'),
     ('functions/TIFFSetDirectory', 'TIFFSetDirectory', 'set the current directory for an open TIFF file', author, '3tiff'),
     ('functions/TIFFSetField', 'TIFFSetField', 'set the value(s) of a tag in a TIFF file open for writing', author, '3tiff'),
+    ('functions/TIFFSetFields', 'TIFFSetFields', 'set the values of several tags at once', author, '3tiff'),
     ('functions/TIFFSetTagExtender', 'TIFFSetTagExtender', 'register the merge function for user defined tags as an extender callback with libtiff', author, '3tiff'),
     ('functions/TIFFsize', 'TIFFsize', 'return the size of various items associated with an open TIFF file', author, '3tiff'),
     ('functions/TIFFStrileQuery', 'TIFFStrileQuery', 'get strile byte count and offset', author, '3tiff'),
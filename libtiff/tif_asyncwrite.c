@@ -0,0 +1,554 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * TIFF Library.
+ *
+ * Asynchronous Strip/Tile Write Support
+ *
+ * Strips and tiles submitted to a TIFFAsyncWriter are compressed by a pool
+ * of worker threads.  Each worker owns a private TIFF handle writing to
+ * memory, set up with the directory fields and codec settings of the
+ * image being written, so that codec states are never shared.  Encoded
+ * data is then written to the real file by the thread of the caller, in
+ * submission order, exactly as TIFFWriteEncodedStrip() and
+ * TIFFWriteEncodedTile() would have written it: the file produced does
+ * not depend on the number of threads.
+ */
+#include "tiffiop.h"
+
+/*
+ * Memory file of an encoder.
+ */
+typedef struct
+{
+    uint8_t *data;
+    uint64_t size;
+    uint64_t alloc;
+    uint64_t pos;
+} TIFFAsyncSink;
+
+typedef struct
+{
+    TIFF *tif;
+    TIFFAsyncSink sink;
+    uint64_t base; /* size of the header */
+} TIFFAsyncEncoder;
+
+typedef struct
+{
+    TIFFAsyncWriter *writer;
+    uint32_t strile;
+    uint8_t *data; /* raw data to encode */
+    tmsize_t datasize;
+    tmsize_t dataalloc;
+    uint8_t *encoded;
+    tmsize_t encodedsize;
+    tmsize_t encodedalloc;
+    uint32_t fallback_striles; /* TIFFTAG_STOREDFALLBACK statistics */
+    uint32_t fallback_stored;
+    int status; /* 0: pending, 1: encoded, -1: failed */
+} TIFFAsyncJob;
+
+struct _TIFFAsyncWriter
+{
+    TIFF *tif;
+    TIFFThreadPool *pool;
+    TIFFAsyncEncoder *encoders;
+    int nencoders;
+    TIFFAsyncJob *jobs; /* circular, indexed by sequence number */
+    int njobs;
+    int64_t submitted;
+    int64_t committed;
+    int error;
+};
+
+static tmsize_t _tiffAsyncSinkReadProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    TIFFAsyncSink *sink = (TIFFAsyncSink *)fd;
+    if (sink->pos >= sink->size)
+        return 0;
+    if ((uint64_t)size > sink->size - sink->pos)
+        size = (tmsize_t)(sink->size - sink->pos);
+    _TIFFmemcpy(buf, sink->data + sink->pos, size);
+    sink->pos += (uint64_t)size;
+    return size;
+}
+
+static tmsize_t _tiffAsyncSinkWriteProc(thandle_t fd, void *buf,
+                                        tmsize_t size)
+{
+    TIFFAsyncSink *sink = (TIFFAsyncSink *)fd;
+    uint64_t end = sink->pos + (uint64_t)size;
+    if (end > sink->alloc)
+    {
+        uint64_t alloc = sink->alloc < 65536 ? 65536 : sink->alloc;
+        uint8_t *data;
+        while (alloc < end)
+            alloc *= 2;
+        if ((uint64_t)(tmsize_t)alloc != alloc)
+            return -1;
+        data = (uint8_t *)_TIFFreallocExt(NULL, sink->data, (tmsize_t)alloc);
+        if (data == NULL)
+            return -1;
+        sink->data = data;
+        sink->alloc = alloc;
+    }
+    if (sink->pos > sink->size)
+        _TIFFmemset(sink->data + sink->size, 0,
+                    (tmsize_t)(sink->pos - sink->size));
+    _TIFFmemcpy(sink->data + sink->pos, buf, size);
+    sink->pos = end;
+    if (end > sink->size)
+        sink->size = end;
+    return size;
+}
+
+static toff_t _tiffAsyncSinkSeekProc(thandle_t fd, toff_t off, int whence)
+{
+    TIFFAsyncSink *sink = (TIFFAsyncSink *)fd;
+    switch (whence)
+    {
+        case SEEK_SET:
+            sink->pos = off;
+            break;
+        case SEEK_CUR:
+            sink->pos += off;
+            break;
+        case SEEK_END:
+            sink->pos = sink->size + off;
+            break;
+        default:
+            return (toff_t)-1;
+    }
+    return sink->pos;
+}
+
+static int _tiffAsyncSinkCloseProc(thandle_t fd)
+{
+    (void)fd;
+    return 0;
+}
+
+static toff_t _tiffAsyncSinkSizeProc(thandle_t fd)
+{
+    return ((TIFFAsyncSink *)fd)->size;
+}
+
+/*
+ * Copy the codec settings (pseudo-tags and predictor) of tif to enc, a
+ * private handle used to encode or decode the same image.
+ */
+void _TIFFCopyCodecFields(TIFF *enc, TIFF *tif)
+{
+    uint32_t i;
+
+    for (i = 0; i < tif->tif_nfields; i++)
+    {
+        const TIFFField *fip = tif->tif_fields[i];
+        int ivalue;
+        uint16_t svalue;
+        uint32_t lvalue;
+        double dvalue;
+
+        if (fip->field_bit != FIELD_PSEUDO &&
+            !(fip->field_bit >= FIELD_CODEC &&
+              TIFFFieldSet(tif, fip->field_bit)))
+            continue;
+        switch (fip->set_get_field_type)
+        {
+            case TIFF_SETGET_INT:
+                if (TIFFGetField(tif, fip->field_tag, &ivalue))
+                    TIFFSetField(enc, fip->field_tag, ivalue);
+                break;
+            case TIFF_SETGET_UINT16:
+                if (TIFFGetField(tif, fip->field_tag, &svalue))
+                    TIFFSetField(enc, fip->field_tag, svalue);
+                break;
+            case TIFF_SETGET_UINT32:
+                if (TIFFGetField(tif, fip->field_tag, &lvalue))
+                    TIFFSetField(enc, fip->field_tag, lvalue);
+                break;
+            case TIFF_SETGET_DOUBLE:
+                if (TIFFGetField(tif, fip->field_tag, &dvalue))
+                    TIFFSetField(enc, fip->field_tag, dvalue);
+                break;
+            default:
+                /* tables and functions are derived from the above */
+                break;
+        }
+    }
+}
+
+/*
+ * Create the private handle of an encoder, with the fields of the
+ * directory being written that matter to the encoding.
+ */
+static int TIFFAsyncOpenEncoder(TIFFAsyncWriter *w, TIFFAsyncEncoder *e)
+{
+    TIFF *tif = w->tif;
+    TIFFDirectory *td = &tif->tif_dir;
+    TIFFOpenOptions *opts;
+    const uint32_t flags = TIFF_FILLORDER | TIFF_NOBITREV | TIFF_STOREDFALLBACK;
+    char mode[3];
+    TIFF *enc;
+
+    mode[0] = 'w';
+    mode[1] = tif->tif_header.common.tiff_magic == TIFF_BIGENDIAN ? 'b' : 'l';
+    mode[2] = '\0';
+    opts = TIFFOpenOptionsAlloc();
+    if (opts == NULL)
+        return 0;
+    TIFFOpenOptionsSetErrorHandlerExtR(opts, tif->tif_errorhandler,
+                                       tif->tif_errorhandler_user_data);
+    TIFFOpenOptionsSetWarningHandlerExtR(opts, tif->tif_warnhandler,
+                                         tif->tif_warnhandler_user_data);
+    enc = TIFFClientOpenExt(tif->tif_name, mode, (thandle_t)&e->sink,
+                            _tiffAsyncSinkReadProc, _tiffAsyncSinkWriteProc,
+                            _tiffAsyncSinkSeekProc, _tiffAsyncSinkCloseProc,
+                            _tiffAsyncSinkSizeProc, NULL, NULL, opts);
+    TIFFOpenOptionsFree(opts);
+    if (enc == NULL)
+        return 0;
+    e->tif = enc;
+    e->base = e->sink.size;
+    enc->tif_flags = (enc->tif_flags & ~flags) | (tif->tif_flags & flags);
+
+    TIFFSetField(enc, TIFFTAG_IMAGEWIDTH, td->td_imagewidth);
+    TIFFSetField(enc, TIFFTAG_IMAGELENGTH, td->td_imagelength);
+    TIFFSetField(enc, TIFFTAG_IMAGEDEPTH, td->td_imagedepth);
+    TIFFSetField(enc, TIFFTAG_BITSPERSAMPLE, td->td_bitspersample);
+    TIFFSetField(enc, TIFFTAG_SAMPLESPERPIXEL, td->td_samplesperpixel);
+    TIFFSetField(enc, TIFFTAG_SAMPLEFORMAT, td->td_sampleformat);
+    if (td->td_extrasamples > 0)
+        TIFFSetField(enc, TIFFTAG_EXTRASAMPLES, td->td_extrasamples,
+                     td->td_sampleinfo);
+    TIFFSetField(enc, TIFFTAG_PLANARCONFIG, td->td_planarconfig);
+    if (TIFFFieldSet(tif, FIELD_PHOTOMETRIC))
+        TIFFSetField(enc, TIFFTAG_PHOTOMETRIC, td->td_photometric);
+    TIFFSetField(enc, TIFFTAG_FILLORDER, td->td_fillorder);
+    if (TIFFFieldSet(tif, FIELD_YCBCRSUBSAMPLING))
+        TIFFSetField(enc, TIFFTAG_YCBCRSUBSAMPLING, td->td_ycbcrsubsampling[0],
+                     td->td_ycbcrsubsampling[1]);
+    if (isTiled(tif))
+    {
+        TIFFSetField(enc, TIFFTAG_TILEWIDTH, td->td_tilewidth);
+        TIFFSetField(enc, TIFFTAG_TILELENGTH, td->td_tilelength);
+        TIFFSetField(enc, TIFFTAG_TILEDEPTH, td->td_tiledepth);
+    }
+    else
+        TIFFSetField(enc, TIFFTAG_ROWSPERSTRIP, td->td_rowsperstrip);
+    if (!TIFFSetField(enc, TIFFTAG_COMPRESSION, td->td_compression))
+        return 0;
+    _TIFFCopyCodecFields(enc, tif);
+    return 1;
+}
+
+/*
+ * Task run by the workers: encode a strip/tile with the handle of the
+ * worker and keep a copy of the result.
+ */
+static void TIFFAsyncEncode(void *arg, int worker)
+{
+    TIFFAsyncJob *job = (TIFFAsyncJob *)arg;
+    TIFFAsyncWriter *w = job->writer;
+    TIFFAsyncEncoder *e = &w->encoders[worker];
+    TIFF *enc = e->tif;
+    TIFFDirectory *td = &enc->tif_dir;
+    uint32_t striles = enc->tif_fallback_striles;
+    uint32_t stored = enc->tif_fallback_stored;
+    int status = -1;
+
+    /* start from an empty file where the strip/tile was never written, and
+     * where it is appended right after the header */
+    e->sink.size = e->sink.pos = e->base;
+    enc->tif_logical_eof = e->base;
+    if (td->td_stripoffset_p != NULL && job->strile < td->td_nstrips)
+    {
+        td->td_stripoffset_p[job->strile] = 0;
+        td->td_stripbytecount_p[job->strile] = 0;
+    }
+    if ((isTiled(enc) ? TIFFWriteEncodedTile(enc, job->strile, job->data,
+                                             job->datasize)
+                      : TIFFWriteEncodedStrip(enc, job->strile, job->data,
+                                              job->datasize)) >= 0)
+    {
+        uint64_t offset = td->td_stripoffset_p[job->strile];
+        uint64_t size = td->td_stripbytecount_p[job->strile];
+
+        status = 1;
+        if ((tmsize_t)size > job->encodedalloc)
+        {
+            _TIFFfreeExt(NULL, job->encoded);
+            job->encoded = (uint8_t *)_TIFFmallocExt(NULL, (tmsize_t)size);
+            job->encodedalloc = job->encoded ? (tmsize_t)size : 0;
+            if (job->encoded == NULL)
+            {
+                TIFFErrorExtR(enc, "TIFFAsyncEncode", "Out of memory");
+                status = -1;
+            }
+        }
+        if (status > 0)
+        {
+            if (size > 0)
+                _TIFFmemcpy(job->encoded, e->sink.data + offset,
+                            (tmsize_t)size);
+            job->encodedsize = (tmsize_t)size;
+            job->fallback_striles = enc->tif_fallback_striles - striles;
+            job->fallback_stored = enc->tif_fallback_stored - stored;
+        }
+    }
+    _TIFFThreadPoolDone(w->pool, &job->status, status);
+}
+
+/*
+ * Write encoded strips/tiles to the file in submission order, until the
+ * one of sequence number seq is written (if seq >= 0) and then as long as
+ * the next ones are already encoded.
+ */
+static void TIFFAsyncCommit(TIFFAsyncWriter *w, int64_t seq)
+{
+    TIFF *tif = w->tif;
+
+    while (w->committed < w->submitted)
+    {
+        TIFFAsyncJob *job = &w->jobs[w->committed % w->njobs];
+        int status =
+            _TIFFThreadPoolWait(w->pool, &job->status, w->committed <= seq);
+        if (status == 0)
+            break;
+        if (status < 0)
+            w->error = 1;
+        else if (!w->error)
+        {
+            if (!_TIFFWriteEncodedStrile(tif, job->strile, job->encoded,
+                                         job->encodedsize))
+                w->error = 1;
+            tif->tif_fallback_striles += job->fallback_striles;
+            tif->tif_fallback_stored += job->fallback_stored;
+        }
+        job->status = 0;
+        w->committed++;
+    }
+}
+
+/*
+ * Start asynchronous writing of the strips or tiles of the current
+ * directory, compressing them with nthreads threads (the number of
+ * processors if nthreads <= 0).  The directory fields and codec settings
+ * must be set, and must not change until TIFFAsyncWriterClose().
+ */
+TIFFAsyncWriter *TIFFAsyncWriterOpen(TIFF *tif, int nthreads)
+{
+    static const char module[] = "TIFFAsyncWriterOpen";
+    TIFFAsyncWriter *w;
+    int i;
+
+    if (!(tif->tif_flags & TIFF_BEENWRITING) &&
+        !TIFFWriteCheck(tif, isTiled(tif), module))
+        return NULL;
+    /* the main handle writes the codec tables (e.g. JPEGTables) if any */
+    if ((tif->tif_flags & TIFF_CODERSETUP) == 0)
+    {
+        if (!(*tif->tif_setupencode)(tif))
+            return NULL;
+        tif->tif_flags |= TIFF_CODERSETUP;
+    }
+
+    w = (TIFFAsyncWriter *)_TIFFcallocExt(tif, 1, sizeof(TIFFAsyncWriter));
+    if (w == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return NULL;
+    }
+    w->tif = tif;
+    w->pool = _TIFFThreadPoolCreate(tif, nthreads);
+    if (w->pool == NULL)
+        goto bad;
+    w->nencoders = _TIFFThreadPoolSize(w->pool);
+    /* enough jobs to keep all workers busy while the caller commits */
+    w->njobs = 2 * w->nencoders;
+    w->encoders = (TIFFAsyncEncoder *)_TIFFcallocExt(tif, w->nencoders,
+                                                     sizeof(TIFFAsyncEncoder));
+    w->jobs =
+        (TIFFAsyncJob *)_TIFFcallocExt(tif, w->njobs, sizeof(TIFFAsyncJob));
+    if (w->encoders == NULL || w->jobs == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        goto bad;
+    }
+    for (i = 0; i < w->nencoders; i++)
+    {
+        if (!TIFFAsyncOpenEncoder(w, &w->encoders[i]))
+        {
+            TIFFErrorExtR(tif, module, "Cannot set up encoder");
+            goto bad;
+        }
+    }
+    for (i = 0; i < w->njobs; i++)
+        w->jobs[i].writer = w;
+    return w;
+bad:
+    TIFFAsyncWriterClose(w);
+    return NULL;
+}
+
+static int64_t TIFFAsyncWriteEncoded(TIFFAsyncWriter *w, uint32_t strile,
+                                     const void *data, tmsize_t cc,
+                                     int tiles, const char *module)
+{
+    TIFF *tif = w->tif;
+    TIFFAsyncJob *job;
+
+    if (tiles ^ isTiled(tif))
+    {
+        TIFFErrorExtR(tif, module,
+                      tiles ? "Can not write tiles to a striped image"
+                            : "Can not write strips to a tiled image");
+        return -1;
+    }
+    if (strile >= tif->tif_dir.td_nstrips)
+    {
+        TIFFErrorExtR(tif, module, "%s %lu out of range, max %lu",
+                      tiles ? "Tile" : "Strip", (unsigned long)strile,
+                      (unsigned long)tif->tif_dir.td_nstrips);
+        return -1;
+    }
+    if (tiles && (cc < 1 || cc > tif->tif_tilesize))
+        cc = tif->tif_tilesize;
+    if (cc < 0)
+    {
+        TIFFErrorExtR(tif, module, "Invalid size");
+        return -1;
+    }
+
+    /* wait for a free job */
+    if (w->submitted - w->committed == w->njobs)
+        TIFFAsyncCommit(w, w->committed);
+
+    job = &w->jobs[w->submitted % w->njobs];
+    if (cc > job->dataalloc)
+    {
+        _TIFFfreeExt(tif, job->data);
+        job->data = (uint8_t *)_TIFFmallocExt(tif, cc);
+        job->dataalloc = job->data ? cc : 0;
+        if (job->data == NULL)
+        {
+            TIFFErrorExtR(tif, module, "Out of memory");
+            return -1;
+        }
+    }
+    if (cc > 0)
+        _TIFFmemcpy(job->data, data, cc);
+    job->datasize = cc;
+    job->strile = strile;
+    job->status = 0;
+    if (!_TIFFThreadPoolSubmit(w->pool, TIFFAsyncEncode, job))
+    {
+        TIFFErrorExtR(tif, module, "Cannot queue %s", tiles ? "tile" : "strip");
+        return -1;
+    }
+    w->submitted++;
+    TIFFAsyncCommit(w, -1);
+    return w->submitted - 1;
+}
+
+/*
+ * Queue a strip for compression.  The data is copied, so that the buffer
+ * can be reused as soon as the function returns.  The sequence number of
+ * the strip (0 for the first one submitted) is returned, or -1 on error.
+ */
+int64_t TIFFAsyncWriteEncodedStrip(TIFFAsyncWriter *w, uint32_t strip,
+                                   const void *data, tmsize_t cc)
+{
+    return TIFFAsyncWriteEncoded(w, strip, data, cc, 0,
+                                 "TIFFAsyncWriteEncodedStrip");
+}
+
+/*
+ * Queue a tile for compression, as TIFFAsyncWriteEncodedStrip().
+ */
+int64_t TIFFAsyncWriteEncodedTile(TIFFAsyncWriter *w, uint32_t tile,
+                                  const void *data, tmsize_t cc)
+{
+    return TIFFAsyncWriteEncoded(w, tile, data, cc, 1,
+                                 "TIFFAsyncWriteEncodedTile");
+}
+
+/*
+ * Write the strips/tiles already encoded and return how many were
+ * written to the file so far.  Does not block.
+ */
+int64_t TIFFAsyncWriterCompleted(TIFFAsyncWriter *w)
+{
+    TIFFAsyncCommit(w, -1);
+    return w->committed;
+}
+
+/*
+ * Wait until the strip/tile of sequence number seq (all of them if seq is
+ * negative) is written to the file.  Returns 0 if any strip/tile failed to
+ * be encoded or written.
+ */
+int TIFFAsyncWriterWait(TIFFAsyncWriter *w, int64_t seq)
+{
+    TIFFAsyncCommit(w, seq < 0 ? w->submitted - 1 : seq);
+    return !w->error;
+}
+
+/*
+ * Write all remaining strips/tiles and release the writer.  Returns 0 if
+ * any strip/tile failed to be encoded or written.
+ */
+int TIFFAsyncWriterClose(TIFFAsyncWriter *w)
+{
+    TIFF *tif = w->tif;
+    int ok;
+    int i;
+
+    if (w->pool != NULL)
+    {
+        TIFFAsyncCommit(w, w->submitted - 1);
+        _TIFFThreadPoolDestroy(w->pool);
+    }
+    ok = !w->error;
+    if (w->encoders != NULL)
+    {
+        for (i = 0; i < w->nencoders; i++)
+        {
+            if (w->encoders[i].tif != NULL)
+                TIFFClose(w->encoders[i].tif);
+            _TIFFfreeExt(NULL, w->encoders[i].sink.data);
+        }
+        _TIFFfreeExt(tif, w->encoders);
+    }
+    if (w->jobs != NULL)
+    {
+        for (i = 0; i < w->njobs; i++)
+        {
+            _TIFFfreeExt(tif, w->jobs[i].data);
+            _TIFFfreeExt(NULL, w->jobs[i].encoded);
+        }
+        _TIFFfreeExt(tif, w->jobs);
+    }
+    _TIFFfreeExt(tif, w);
+    return ok;
+}
@@ -47,7 +47,35 @@ void TIFFCleanup(TIFF *tif)
      * Flush buffered data and directory (if dirty).
      */
     if (tif->tif_mode != O_RDONLY)
+    {
         TIFFFlush(tif);
+        /* In case TIFFFlush() failed before getting to it */
+        (void)_TIFFFlushWriteBuffer(tif);
+    }
+    if (tif->tif_wbuf)
+    {
+        _TIFFfreeExt(tif, tif->tif_wbuf);
+        tif->tif_wbuf = NULL;
+    }
+    if (tif->tif_directcloseproc)
+    {
+        /* Remove the padding of the last block written directly */
+        uint64_t size = 0;
+        if (tif->tif_mode != O_RDONLY && tif->tif_directend > 0)
+        {
+            uint64_t end = _TIFFGetDataEnd(tif);
+            if (tif->tif_directend > end)
+                size = end;
+        }
+        (void)(*tif->tif_directcloseproc)(tif->tif_directhandle, size);
+        tif->tif_directcloseproc = NULL;
+        tif->tif_directwriteproc = NULL;
+    }
+    if (tif->tif_directbufbase)
+    {
+        _TIFFfreeExt(tif, tif->tif_directbufbase);
+        tif->tif_directbufbase = NULL;
+    }
     TIFFFreeDirectory(tif);
 
     _TIFFCleanupIFDOffsetAndNumberMaps(tif);
@@ -109,6 +137,8 @@ void TIFFCleanup(TIFF *tif)
         _TIFFfreeExt(tif, tif->tif_fieldscompat);
     }
 
+    _TIFFArenaDestroy(tif);
+
     if (tif->tif_cur_cumulated_mem_alloc != 0)
     {
         TIFFErrorExtR(tif, "TIFFCleanup",
@@ -117,7 +147,7 @@ void TIFFCleanup(TIFF *tif)
                       (uint64_t)tif->tif_cur_cumulated_mem_alloc);
     }
 
-    _TIFFfreeExt(NULL, tif);
+    _TIFFFreeHandle(tif);
 }
 
 /************************************************************************/
@@ -0,0 +1,419 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * TIFF Library.
+ *
+ * Single-pass Writing of Cloud Optimized Layouts
+ *
+ * The directories of all the levels of a pyramid (the full resolution
+ * image and its reduced resolution versions, chained or as SubIFDs) are
+ * declared first and written at the beginning of the file, with their
+ * strip/tile arrays deferred.  Space for all the arrays is then reserved
+ * right after the directories, and the strips/tiles of each level are
+ * appended in the order the levels are selected, normally the smallest
+ * one first.  The arrays of a level are patched in place when switching
+ * to another level, so that only the arrays of the level being written
+ * are held in memory and neither the directories nor the arrays are ever
+ * moved.
+ */
+#include "tiffiop.h"
+
+/*
+ * Value of a codec pseudo-tag (e.g. TIFFTAG_ZIPQUALITY) of a level.
+ * Those are not stored in the directory, so they must be set again
+ * when the directory of the level is read back.
+ */
+typedef struct
+{
+    uint32_t tag;
+    TIFFSetGetFieldType type;
+    union
+    {
+        int i;
+        uint16_t s;
+        uint32_t l;
+        double d;
+    } value;
+} TIFFCOGCodecField;
+
+typedef struct
+{
+    uint64_t diroff;
+    TIFFCOGCodecField *fields;
+    uint32_t nfields;
+} TIFFCOGLevel;
+
+struct _TIFFCOGWriter
+{
+    TIFF *tif;
+    TIFFCOGLevel *levels;
+    int nlevels;
+    int reserved; /* strile arrays written */
+    int current;  /* level being written, -1 if none */
+};
+
+/*
+ * Start the single-pass writing of a pyramid to tif, that must be open
+ * for writing and to which no directory has been written yet.
+ */
+TIFFCOGWriter *TIFFCOGWriterOpen(TIFF *tif)
+{
+    static const char module[] = "TIFFCOGWriterOpen";
+    TIFFCOGWriter *w;
+    uint64_t firstdir;
+
+    if (tif->tif_mode == O_RDONLY)
+    {
+        TIFFErrorExtR(tif, module, "File opened in read-only mode");
+        return NULL;
+    }
+    if (tif->tif_flags & TIFF_BIGTIFF)
+        firstdir = tif->tif_header.big.tiff_diroff;
+    else
+        firstdir = tif->tif_header.classic.tiff_diroff;
+    if (firstdir != 0 || tif->tif_diroff != 0)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Directories have already been written to the file");
+        return NULL;
+    }
+
+    w = (TIFFCOGWriter *)_TIFFcallocExt(tif, 1, sizeof(TIFFCOGWriter));
+    if (w == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return NULL;
+    }
+    w->tif = tif;
+    w->current = -1;
+    return w;
+}
+
+/*
+ * Remember the codec pseudo-tags of the current directory.
+ */
+static int TIFFCOGSaveCodecFields(TIFF *tif, TIFFCOGLevel *level)
+{
+    uint32_t i;
+
+    level->fields = (TIFFCOGCodecField *)_TIFFcallocExt(
+        tif, tif->tif_nfields > 0 ? tif->tif_nfields : 1,
+        sizeof(TIFFCOGCodecField));
+    if (level->fields == NULL)
+        return 0;
+    for (i = 0; i < tif->tif_nfields; i++)
+    {
+        const TIFFField *fip = tif->tif_fields[i];
+        TIFFCOGCodecField *f = &level->fields[level->nfields];
+        int ok = 0;
+
+        if (fip->field_bit != FIELD_PSEUDO)
+            continue;
+        switch (fip->set_get_field_type)
+        {
+            case TIFF_SETGET_INT:
+                ok = TIFFGetField(tif, fip->field_tag, &f->value.i);
+                break;
+            case TIFF_SETGET_UINT16:
+                ok = TIFFGetField(tif, fip->field_tag, &f->value.s);
+                break;
+            case TIFF_SETGET_UINT32:
+                ok = TIFFGetField(tif, fip->field_tag, &f->value.l);
+                break;
+            case TIFF_SETGET_DOUBLE:
+                ok = TIFFGetField(tif, fip->field_tag, &f->value.d);
+                break;
+            default:
+                /* tables and functions are derived from the above */
+                break;
+        }
+        if (ok)
+        {
+            f->tag = fip->field_tag;
+            f->type = fip->set_get_field_type;
+            level->nfields++;
+        }
+    }
+    return 1;
+}
+
+static void TIFFCOGRestoreCodecFields(TIFF *tif, const TIFFCOGLevel *level)
+{
+    const uint32_t dirty = tif->tif_flags & TIFF_DIRTYDIRECT;
+    uint32_t i;
+
+    for (i = 0; i < level->nfields; i++)
+    {
+        const TIFFCOGCodecField *f = &level->fields[i];
+
+        switch (f->type)
+        {
+            case TIFF_SETGET_INT:
+                TIFFSetField(tif, f->tag, f->value.i);
+                break;
+            case TIFF_SETGET_UINT16:
+                TIFFSetField(tif, f->tag, f->value.s);
+                break;
+            case TIFF_SETGET_UINT32:
+                TIFFSetField(tif, f->tag, f->value.l);
+                break;
+            case TIFF_SETGET_DOUBLE:
+                TIFFSetField(tif, f->tag, f->value.d);
+                break;
+            default:
+                break;
+        }
+    }
+    /* the directory on disk is unchanged */
+    tif->tif_flags = (tif->tif_flags & ~TIFF_DIRTYDIRECT) | dirty;
+}
+
+/*
+ * Write the directory set up in tif as the next level of the pyramid.
+ * The fields must be complete, and the strip/tile arrays are left to be
+ * written later.  Returns the index of the level, or -1 on error.
+ */
+int TIFFCOGWriterAddLevel(TIFFCOGWriter *w)
+{
+    static const char module[] = "TIFFCOGWriterAddLevel";
+    TIFF *tif = w->tif;
+    TIFFCOGLevel *levels;
+    TIFFCOGLevel *level;
+
+    if (w->reserved)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Levels must be declared before any data is written");
+        return -1;
+    }
+    if (!TIFFDeferStrileArrayWriting(tif) ||
+        !TIFFWriteCheck(tif, isTiled(tif), module))
+        return -1;
+    /* the directory must hold the codec tables (e.g. JPEGTables) if any */
+    if ((tif->tif_flags & TIFF_CODERSETUP) == 0)
+    {
+        if (!(*tif->tif_setupencode)(tif))
+            return -1;
+        tif->tif_flags |= TIFF_CODERSETUP;
+    }
+
+    levels = (TIFFCOGLevel *)_TIFFreallocExt(
+        tif, w->levels, (tmsize_t)(w->nlevels + 1) * sizeof(TIFFCOGLevel));
+    if (levels == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return -1;
+    }
+    w->levels = levels;
+    level = &levels[w->nlevels];
+    _TIFFmemset(level, 0, sizeof(TIFFCOGLevel));
+    if (!TIFFCOGSaveCodecFields(tif, level))
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return -1;
+    }
+    w->nlevels++;
+
+    if (!TIFFWriteDirectory(tif))
+        return -1;
+    return w->nlevels - 1;
+}
+
+/*
+ * Write zeroed strip/tile arrays for the current directory, recorded as
+ * the next level.
+ */
+static int TIFFCOGReserveLevel(TIFFCOGWriter *w, int *n)
+{
+    static const char module[] = "TIFFCOGWriterSetLevel";
+    TIFF *tif = w->tif;
+
+    if (*n >= w->nlevels)
+    {
+        TIFFErrorExtR(tif, module,
+                      "File has more directories than declared levels");
+        return 0;
+    }
+    w->levels[*n].diroff = tif->tif_diroff;
+    (*n)++;
+    return TIFFForceStrileArrayWriting(tif);
+}
+
+/*
+ * Reserve the strip/tile arrays of all levels after the directories.
+ * The levels are found in the order they were written, which is the
+ * order of declaration: each main directory followed by its SubIFDs.
+ */
+static int TIFFCOGReserveStriles(TIFFCOGWriter *w)
+{
+    static const char module[] = "TIFFCOGWriterSetLevel";
+    TIFF *tif = w->tif;
+    uint64_t firstdir;
+    int n = 0;
+
+    if (w->nlevels == 0)
+    {
+        TIFFErrorExtR(tif, module, "No level declared");
+        return 0;
+    }
+    if (tif->tif_dir.td_imagewidth != 0 || tif->tif_dir.td_imagelength != 0)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Fields set on a directory that was not declared as a "
+                      "level");
+        return 0;
+    }
+    w->reserved = 1;
+    /* not TIFFSetDirectory(tif, 0): SubIFDs are numbered 0 as well */
+    if (tif->tif_flags & TIFF_BIGTIFF)
+        firstdir = tif->tif_header.big.tiff_diroff;
+    else
+        firstdir = tif->tif_header.classic.tiff_diroff;
+    if (!TIFFSetSubDirectory(tif, firstdir))
+        return 0;
+    for (;;)
+    {
+        const uint64_t nextdiroff = tif->tif_nextdiroff;
+        uint16_t nsubifd = 0;
+        uint64_t *subifd = NULL;
+        uint64_t *subifds = NULL;
+        uint16_t i;
+
+        if (TIFFGetField(tif, TIFFTAG_SUBIFD, &nsubifd, &subifd) &&
+            nsubifd > 0)
+        {
+            subifds = (uint64_t *)_TIFFmallocExt(
+                tif, (tmsize_t)nsubifd * sizeof(uint64_t));
+            if (subifds == NULL)
+            {
+                TIFFErrorExtR(tif, module, "Out of memory");
+                return 0;
+            }
+            _TIFFmemcpy(subifds, subifd, (tmsize_t)nsubifd * sizeof(uint64_t));
+        }
+        if (!TIFFCOGReserveLevel(w, &n))
+        {
+            _TIFFfreeExt(tif, subifds);
+            return 0;
+        }
+        for (i = 0; i < nsubifd; i++)
+        {
+            if (!TIFFSetSubDirectory(tif, subifds[i]) ||
+                !TIFFCOGReserveLevel(w, &n))
+            {
+                _TIFFfreeExt(tif, subifds);
+                return 0;
+            }
+        }
+        _TIFFfreeExt(tif, subifds);
+        if (nextdiroff == 0)
+            break;
+        if (!TIFFSetSubDirectory(tif, nextdiroff))
+            return 0;
+    }
+    if (n != w->nlevels)
+    {
+        TIFFErrorExtR(tif, module,
+                      "File has fewer directories than declared levels");
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Patch the strip/tile arrays of the level being written.
+ */
+static int TIFFCOGFlushLevel(TIFFCOGWriter *w, const char *module)
+{
+    TIFF *tif = w->tif;
+
+    if (w->current < 0)
+        return 1;
+    if (tif->tif_flags & TIFF_DIRTYDIRECT)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Fields of level %d changed after it was declared",
+                      w->current);
+        return 0;
+    }
+    if (!TIFFFlushData(tif))
+        return 0;
+    if ((tif->tif_flags & TIFF_DIRTYSTRIP) && !TIFFForceStrileArrayWriting(tif))
+        return 0;
+    return 1;
+}
+
+/*
+ * Make the given level the current directory of tif, so that its
+ * strips/tiles can be written with the usual functions.  The first call
+ * ends the declaration of the levels.
+ */
+int TIFFCOGWriterSetLevel(TIFFCOGWriter *w, int level)
+{
+    static const char module[] = "TIFFCOGWriterSetLevel";
+    TIFF *tif = w->tif;
+
+    if (level < 0 || level >= w->nlevels)
+    {
+        TIFFErrorExtR(tif, module, "Level %d out of range, max %d", level,
+                      w->nlevels - 1);
+        return 0;
+    }
+    if (level == w->current)
+        return 1;
+    if (!w->reserved)
+    {
+        if (!TIFFCOGReserveStriles(w))
+            return 0;
+    }
+    else if (!TIFFCOGFlushLevel(w, module))
+        return 0;
+
+    w->current = -1;
+    if (!TIFFSetSubDirectory(tif, w->levels[level].diroff))
+        return 0;
+    TIFFCOGRestoreCodecFields(tif, &w->levels[level]);
+    w->current = level;
+    return 1;
+}
+
+/*
+ * Patch the strip/tile arrays of the last level written and release the
+ * writer.  Levels never selected keep empty strips/tiles.
+ */
+int TIFFCOGWriterClose(TIFFCOGWriter *w)
+{
+    static const char module[] = "TIFFCOGWriterClose";
+    TIFF *tif = w->tif;
+    int ok;
+    int i;
+
+    if (!w->reserved)
+        ok = w->nlevels == 0 || TIFFCOGReserveStriles(w);
+    else
+        ok = TIFFCOGFlushLevel(w, module);
+    for (i = 0; i < w->nlevels; i++)
+        _TIFFfreeExt(tif, w->levels[i].fields);
+    _TIFFfreeExt(tif, w->levels);
+    _TIFFfreeExt(tif, w);
+    return ok;
+}
@@ -0,0 +1,812 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * TIFF Library.
+ *
+ * Directory Compaction Support
+ *
+ * The directories of a file are copied to a new file entry by entry,
+ * without interpreting their values, so that every tag (including tags
+ * unknown to the library and codec tables) is kept byte for byte.  Each
+ * directory is followed by its out-of-line values, its strip/tile arrays
+ * and its strips/tiles, which are copied raw, without recompression.
+ * Space left unused by rewritten directories or strips/tiles in the
+ * source file is thereby reclaimed.
+ */
+#include "tiffiop.h"
+#include "tif_hash_set.h"
+
+#include <stdlib.h>
+
+#define COMPACT_COPY_SIZE (1024 * 1024) /* strile copy buffer size */
+#define COMPACT_MAX_DEPTH 16            /* nesting of SubIFDs, EXIF... */
+#define COMPACT_MAX_BLOBS 3             /* old-style JPEG tables per tag */
+
+enum
+{
+    COMPACT_COPY,    /* value copied as is */
+    COMPACT_DROP,    /* entry not copied */
+    COMPACT_STRILES, /* strip/tile offsets, rewritten */
+    COMPACT_IFDS,    /* offsets of sub-directories, rewritten */
+    COMPACT_BLOBS    /* offsets of old-style JPEG streams or tables */
+};
+
+typedef struct
+{
+    const uint8_t *raw; /* entry as read from the source */
+    uint16_t tag;
+    uint16_t type;
+    uint64_t count;
+    uint64_t size; /* size of the value in bytes */
+    uint64_t inoff; /* offset of the value in the source, if not inline */
+    uint64_t outoff; /* offset of the value in the copy, if not inline */
+    int kind;
+    int nblobs;
+    uint64_t blobinoff[COMPACT_MAX_BLOBS]; /* data the value points to */
+    uint64_t blobsize[COMPACT_MAX_BLOBS];
+    uint64_t bloboutoff;
+} TIFFCompactEntry;
+
+typedef struct
+{
+    TIFF *in;
+    TIFF *out;
+    uint64_t insize;
+    uint8_t *buf;
+    TIFFHashSet *seen; /* offsets of the source directories copied */
+} TIFFCompactState;
+
+static unsigned long TIFFCompactHash(const void *elt)
+{
+    const uint64_t off = *(const uint64_t *)elt;
+    return (unsigned long)((uint32_t)(off >> 32) ^ (uint32_t)off);
+}
+
+static bool TIFFCompactEqual(const void *elt1, const void *elt2)
+{
+    return *(const uint64_t *)elt1 == *(const uint64_t *)elt2;
+}
+
+static uint64_t TIFFCompactGet(TIFF *tif, const uint8_t *p, tmsize_t width)
+{
+    uint16_t v16;
+    uint32_t v32;
+    uint64_t v64;
+
+    switch (width)
+    {
+        case 2:
+            memcpy(&v16, p, 2);
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabShort(&v16);
+            return v16;
+        case 4:
+            memcpy(&v32, p, 4);
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabLong(&v32);
+            return v32;
+        default:
+            memcpy(&v64, p, 8);
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabLong8(&v64);
+            return v64;
+    }
+}
+
+static void TIFFCompactPut(TIFF *tif, uint8_t *p, tmsize_t width, uint64_t v)
+{
+    uint16_t v16;
+    uint32_t v32;
+
+    switch (width)
+    {
+        case 2:
+            v16 = (uint16_t)v;
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabShort(&v16);
+            memcpy(p, &v16, 2);
+            break;
+        case 4:
+            v32 = (uint32_t)v;
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabLong(&v32);
+            memcpy(p, &v32, 4);
+            break;
+        default:
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabLong8(&v);
+            memcpy(p, &v, 8);
+            break;
+    }
+}
+
+static int TIFFCompactRead(TIFFCompactState *s, uint64_t off, void *buf,
+                           uint64_t size)
+{
+    TIFF *in = s->in;
+
+    if (off > s->insize || size > s->insize - off)
+    {
+        TIFFErrorExtR(in, "TIFFCompact",
+                      "Data at offset %" PRIu64 " beyond end of file", off);
+        return 0;
+    }
+    if (size == 0)
+        return 1;
+    if (!SeekOK(in, off) || !ReadOK(in, buf, (tmsize_t)size))
+    {
+        TIFFErrorExtR(in, "TIFFCompact",
+                      "Cannot read %" PRIu64 " bytes at offset %" PRIu64, size,
+                      off);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Locate the old-style JPEG tables the entry points to: 64 bytes for a
+ * quantization table, 16 code counts followed by the values for a Huffman
+ * table.  Returns 0 if they cannot be copied.
+ */
+static int TIFFCompactTables(TIFFCompactState *s, TIFFCompactEntry *e,
+                             const uint8_t *value)
+{
+    uint8_t counts[16];
+    int i, j;
+
+    if (e->count == 0 || e->count > COMPACT_MAX_BLOBS)
+        return 0;
+    e->nblobs = (int)e->count;
+    for (i = 0; i < e->nblobs; i++)
+    {
+        e->blobinoff[i] = TIFFCompactGet(s->in, value + i * 4, 4);
+        if (e->tag == TIFFTAG_JPEGQTABLES)
+            e->blobsize[i] = 64;
+        else
+        {
+            if (e->blobinoff[i] > s->insize ||
+                16 > s->insize - e->blobinoff[i] ||
+                !SeekOK(s->in, e->blobinoff[i]) ||
+                !ReadOK(s->in, counts, 16))
+                return 0;
+            e->blobsize[i] = 16;
+            for (j = 0; j < 16; j++)
+                e->blobsize[i] += counts[j];
+        }
+        if (e->blobinoff[i] > s->insize ||
+            e->blobsize[i] > s->insize - e->blobinoff[i])
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Copy size bytes at offset inoff of the source to offset outoff of the
+ * copy.
+ */
+static int TIFFCompactCopy(TIFFCompactState *s, uint64_t inoff,
+                           uint64_t outoff, uint64_t size)
+{
+    while (size > 0)
+    {
+        const tmsize_t n = size > COMPACT_COPY_SIZE ? COMPACT_COPY_SIZE
+                                                    : (tmsize_t)size;
+        if (!TIFFCompactRead(s, inoff, s->buf, (uint64_t)n))
+            return 0;
+        if (!_TIFFWriteAt(s->out, outoff, s->buf, n))
+        {
+            TIFFErrorExtR(s->out, "TIFFCompact",
+                          "Cannot write %" TIFF_SSIZE_FORMAT
+                          " bytes at offset %" PRIu64,
+                          n, outoff);
+            return 0;
+        }
+        _TIFFExtendLogicalEOF(s->out, outoff + (uint64_t)n);
+        inoff += (uint64_t)n;
+        outoff += (uint64_t)n;
+        size -= (uint64_t)n;
+    }
+    return 1;
+}
+
+static int TIFFCompactChain(TIFFCompactState *s, uint64_t inoff,
+                            uint64_t *outoff, int depth);
+
+/*
+ * Copy the directory at offset inoff of the source, with its values,
+ * strips/tiles and sub-directories, at the end of the copy.  The offset of
+ * the next directory of the source is returned in nextinoff, and the
+ * directory written points to the end of the copy for it.
+ */
+static int TIFFCompactDirectory(TIFFCompactState *s, uint64_t inoff,
+                                uint64_t *nextinoff, int depth)
+{
+    static const char module[] = "TIFFCompact";
+    TIFF *in = s->in;
+    TIFF *out = s->out;
+    const int big = (in->tif_flags & TIFF_BIGTIFF) != 0;
+    const tmsize_t countsize = big ? 8 : 2;
+    const tmsize_t entrysize = big ? 20 : 12;
+    const tmsize_t inlinesize = big ? 8 : 4;
+    uint8_t countbuf[8];
+    uint8_t *rawdir = NULL;
+    uint8_t *block = NULL;
+    TIFFCompactEntry *entries = NULL;
+    uint64_t *offsets = NULL;
+    uint64_t *bytecounts = NULL;
+    uint64_t *newoffsets = NULL;
+    uint64_t ndir, nout, nstriles = 0;
+    uint64_t pos, dataend, valueend, ifdsize, i, k;
+    uint16_t offtype = 0;
+    int stroff = -1, strbc = -1, jpegif = -1, jpegifbc = -1;
+    int ok = 0;
+
+    /* read the directory */
+    if (!TIFFCompactRead(s, inoff, countbuf, (uint64_t)countsize))
+        return 0;
+    ndir = TIFFCompactGet(in, countbuf, countsize);
+    if (ndir == 0 || ndir > 4096)
+    {
+        TIFFErrorExtR(in, module,
+                      "Sanity check on directory count failed at offset "
+                      "%" PRIu64,
+                      inoff);
+        return 0;
+    }
+    rawdir = (uint8_t *)_TIFFmallocExt(
+        in, (tmsize_t)(ndir * entrysize + inlinesize));
+    entries = (TIFFCompactEntry *)_TIFFcallocExt(in, (tmsize_t)ndir,
+                                                 sizeof(TIFFCompactEntry));
+    if (rawdir == NULL || entries == NULL)
+    {
+        TIFFErrorExtR(in, module, "Out of memory");
+        goto done;
+    }
+    if (!TIFFCompactRead(s, inoff + countsize, rawdir,
+                         ndir * entrysize + inlinesize))
+        goto done;
+    *nextinoff = TIFFCompactGet(in, rawdir + ndir * entrysize, inlinesize);
+
+    /* classify the entries */
+    nout = 0;
+    for (i = 0; i < ndir; i++)
+    {
+        TIFFCompactEntry *e = &entries[i];
+        tmsize_t width;
+
+        e->raw = rawdir + i * entrysize;
+        e->tag = (uint16_t)TIFFCompactGet(in, e->raw, 2);
+        e->type = (uint16_t)TIFFCompactGet(in, e->raw + 2, 2);
+        e->count = TIFFCompactGet(in, e->raw + 4, big ? 8 : 4);
+        e->kind = COMPACT_COPY;
+        width = TIFFDataWidth((TIFFDataType)e->type);
+        if (width == 0)
+        {
+            TIFFWarningExtR(in, module,
+                            "Unknown type %" PRIu16 " of tag %" PRIu16
+                            ", tag dropped",
+                            e->type, e->tag);
+            e->kind = COMPACT_DROP;
+            continue;
+        }
+        if (e->count > UINT64_MAX / (uint64_t)width)
+        {
+            TIFFErrorExtR(in, module, "Invalid count for tag %" PRIu16,
+                          e->tag);
+            goto done;
+        }
+        e->size = e->count * (uint64_t)width;
+        if (e->size > (uint64_t)inlinesize)
+            e->inoff = TIFFCompactGet(in, e->raw + 4 + inlinesize, inlinesize);
+
+        switch (e->tag)
+        {
+            case TIFFTAG_FREEOFFSETS:
+            case TIFFTAG_FREEBYTECOUNTS:
+                /* describes free space of the source */
+                e->kind = COMPACT_DROP;
+                break;
+            case TIFFTAG_STRIPOFFSETS:
+            case TIFFTAG_TILEOFFSETS:
+                e->kind = COMPACT_STRILES;
+                stroff = (int)i;
+                break;
+            case TIFFTAG_STRIPBYTECOUNTS:
+            case TIFFTAG_TILEBYTECOUNTS:
+                strbc = (int)i;
+                break;
+            case TIFFTAG_JPEGIFOFFSET:
+                e->kind = COMPACT_BLOBS;
+                jpegif = (int)i;
+                break;
+            case TIFFTAG_JPEGQTABLES:
+            case TIFFTAG_JPEGDCTABLES:
+            case TIFFTAG_JPEGACTABLES:
+                e->kind = COMPACT_BLOBS;
+                break;
+            case TIFFTAG_JPEGIFBYTECOUNT:
+                jpegifbc = (int)i;
+                break;
+            case TIFFTAG_SUBIFD:
+            case TIFFTAG_EXIFIFD:
+            case TIFFTAG_GPSIFD:
+            case TIFFTAG_INTEROPERABILITYIFD:
+                e->kind = COMPACT_IFDS;
+                break;
+            default:
+                if (e->type == TIFF_IFD || e->type == TIFF_IFD8)
+                    e->kind = COMPACT_IFDS;
+                break;
+        }
+        if (e->size > (uint64_t)inlinesize &&
+            (e->inoff > s->insize || e->size > s->insize - e->inoff))
+        {
+            TIFFErrorExtR(in, module,
+                          "Value of tag %" PRIu16 " beyond end of file",
+                          e->tag);
+            goto done;
+        }
+        if ((e->kind == COMPACT_STRILES &&
+             !(e->type == TIFF_SHORT || e->type == TIFF_LONG ||
+               e->type == TIFF_LONG8)) ||
+            (e->kind == COMPACT_BLOBS &&
+             !(e->type == TIFF_LONG || e->type == TIFF_IFD)))
+        {
+            TIFFErrorExtR(in, module, "Invalid type for tag %" PRIu16,
+                          e->tag);
+            goto done;
+        }
+        if (e->kind == COMPACT_BLOBS && e->tag != TIFFTAG_JPEGIFOFFSET)
+        {
+            uint8_t value[4 * COMPACT_MAX_BLOBS];
+            int valid = e->count <= COMPACT_MAX_BLOBS;
+
+            if (valid && e->size > (uint64_t)inlinesize)
+                valid = TIFFCompactRead(s, e->inoff, value, e->size);
+            else if (valid)
+                memcpy(value, e->raw + 4 + inlinesize, (size_t)e->size);
+            if (!valid || !TIFFCompactTables(s, e, value))
+            {
+                TIFFWarningExtR(in, module,
+                                "Invalid old-style JPEG table offsets in tag "
+                                "%" PRIu16 ", tag dropped",
+                                e->tag);
+                e->kind = COMPACT_DROP;
+                continue;
+            }
+        }
+        if (e->kind == COMPACT_IFDS &&
+            !(e->type == TIFF_LONG || e->type == TIFF_LONG8 ||
+              e->type == TIFF_IFD || e->type == TIFF_IFD8))
+            e->kind = COMPACT_COPY;
+        if (e->kind != COMPACT_DROP)
+            nout++;
+    }
+
+    /* strip/tile arrays */
+    if (stroff >= 0)
+    {
+        const TIFFCompactEntry *eo = &entries[stroff];
+        const TIFFCompactEntry *eb = strbc >= 0 ? &entries[strbc] : NULL;
+        const tmsize_t wo = TIFFDataWidth((TIFFDataType)eo->type);
+        tmsize_t wb;
+
+        if (eb == NULL || eb->count != eo->count ||
+            (eb->type != TIFF_SHORT && eb->type != TIFF_LONG &&
+             eb->type != TIFF_LONG8))
+        {
+            TIFFErrorExtR(in, module,
+                          "Missing or inconsistent strip/tile byte counts");
+            goto done;
+        }
+        wb = TIFFDataWidth((TIFFDataType)eb->type);
+        nstriles = eo->count;
+        if (nstriles > s->insize)
+        {
+            TIFFErrorExtR(in, module, "Too many strips/tiles");
+            goto done;
+        }
+        offsets = (uint64_t *)_TIFFCheckMalloc(in, (tmsize_t)nstriles,
+                                               3 * sizeof(uint64_t),
+                                               "for strip/tile arrays");
+        block = (uint8_t *)_TIFFCheckMalloc(
+            in, (tmsize_t)nstriles, wo > wb ? wo : wb, "for strip/tile arrays");
+        if (offsets == NULL || block == NULL)
+            goto done;
+        bytecounts = offsets + nstriles;
+        newoffsets = bytecounts + nstriles;
+        if (eo->size > (uint64_t)inlinesize)
+        {
+            if (!TIFFCompactRead(s, eo->inoff, block, eo->size))
+                goto done;
+        }
+        else
+            memcpy(block, eo->raw + 4 + inlinesize, (size_t)eo->size);
+        for (k = 0; k < nstriles; k++)
+            offsets[k] = TIFFCompactGet(in, block + k * wo, wo);
+        if (eb->size > (uint64_t)inlinesize)
+        {
+            if (!TIFFCompactRead(s, eb->inoff, block, eb->size))
+                goto done;
+        }
+        else
+            memcpy(block, eb->raw + 4 + inlinesize, (size_t)eb->size);
+        for (k = 0; k < nstriles; k++)
+        {
+            bytecounts[k] = TIFFCompactGet(in, block + k * wb, wb);
+            if (offsets[k] == 0 || bytecounts[k] == 0)
+                offsets[k] = bytecounts[k] = 0;
+            else if (offsets[k] > s->insize ||
+                     bytecounts[k] > s->insize - offsets[k])
+            {
+                TIFFErrorExtR(in, module,
+                              "Strip/tile %" PRIu64 " beyond end of file", k);
+                goto done;
+            }
+        }
+        _TIFFfreeExt(in, block);
+        block = NULL;
+        offtype = eo->type;
+    }
+    if (jpegif >= 0)
+    {
+        TIFFCompactEntry *e = &entries[jpegif];
+        const TIFFCompactEntry *eb = jpegifbc >= 0 ? &entries[jpegifbc] : NULL;
+
+        if (e->count == 1 && eb != NULL && eb->count == 1 &&
+            (eb->type == TIFF_SHORT || eb->type == TIFF_LONG ||
+             eb->type == TIFF_LONG8))
+        {
+            e->nblobs = 1;
+            e->blobinoff[0] = TIFFCompactGet(in, e->raw + 4 + inlinesize, 4);
+            e->blobsize[0] =
+                TIFFCompactGet(in, eb->raw + 4 + inlinesize,
+                               TIFFDataWidth((TIFFDataType)eb->type));
+        }
+        if (e->nblobs == 0 || e->blobsize[0] == 0 ||
+            e->blobinoff[0] > s->insize ||
+            e->blobsize[0] > s->insize - e->blobinoff[0])
+        {
+            TIFFWarningExtR(in, module,
+                            "JPEGInterchangeFormat without length, tag "
+                            "dropped");
+            e->kind = COMPACT_DROP;
+            nout--;
+        }
+    }
+
+    /*
+     * Lay out the directory, its values and its strips/tiles, widening the
+     * type of the strip/tile offsets if they do not fit.
+     */
+    pos = (_TIFFGetLogicalEOF(out) + 1) & ~((uint64_t)1);
+    ifdsize = (uint64_t)countsize + nout * entrysize + inlinesize;
+    for (;;)
+    {
+        uint64_t cur = pos + ifdsize;
+        uint64_t maxoff = 0;
+
+        for (i = 0; i < ndir; i++)
+        {
+            TIFFCompactEntry *e = &entries[i];
+            uint64_t size = e->size;
+
+            e->outoff = 0;
+            if (e->kind == COMPACT_DROP)
+                continue;
+            if (e->kind == COMPACT_STRILES)
+                size = nstriles * TIFFDataWidth((TIFFDataType)offtype);
+            if (size > (uint64_t)inlinesize)
+            {
+                cur = (cur + 1) & ~((uint64_t)1);
+                e->outoff = cur;
+                cur += size;
+            }
+            if (e->nblobs > 0)
+            {
+                int j;
+
+                cur = (cur + 1) & ~((uint64_t)1);
+                e->bloboutoff = cur;
+                for (j = 0; j < e->nblobs; j++)
+                    cur += e->blobsize[j];
+            }
+        }
+        valueend = cur;
+        for (k = 0; k < nstriles; k++)
+        {
+            newoffsets[k] = bytecounts[k] != 0 ? cur : 0;
+            cur += bytecounts[k];
+            if (newoffsets[k] > maxoff)
+                maxoff = newoffsets[k];
+        }
+        dataend = cur;
+        if (!big && dataend > UINT32_MAX)
+        {
+            TIFFErrorExtR(out, module, "Maximum classic TIFF size exceeded");
+            goto done;
+        }
+        if (offtype == TIFF_SHORT && maxoff > UINT16_MAX)
+            offtype = TIFF_LONG;
+        else if (offtype == TIFF_LONG && maxoff > UINT32_MAX)
+            offtype = TIFF_LONG8;
+        else
+            break;
+    }
+
+    /* build the directory and its values */
+    block = (uint8_t *)_TIFFcallocExt(out, (tmsize_t)(valueend - pos), 1);
+    if (block == NULL)
+    {
+        TIFFErrorExtR(out, module, "Out of memory");
+        goto done;
+    }
+    TIFFCompactPut(in, block, countsize, nout);
+    k = 0;
+    for (i = 0; i < ndir; i++)
+    {
+        TIFFCompactEntry *e = &entries[i];
+        uint8_t *dst = block + countsize + k * entrysize;
+        uint8_t *value = dst + 4 + inlinesize;
+
+        if (e->kind == COMPACT_DROP)
+            continue;
+        k++;
+        memcpy(dst, e->raw, (size_t)entrysize);
+        if (e->outoff != 0)
+        {
+            TIFFCompactPut(in, value, inlinesize, e->outoff);
+            value = block + (e->outoff - pos);
+        }
+        switch (e->kind)
+        {
+            case COMPACT_STRILES:
+            {
+                const tmsize_t w = TIFFDataWidth((TIFFDataType)offtype);
+                uint64_t j;
+
+                TIFFCompactPut(in, dst + 2, 2, offtype);
+                if (e->outoff == 0)
+                    memset(value, 0, (size_t)inlinesize);
+                for (j = 0; j < nstriles; j++)
+                    TIFFCompactPut(in, value + j * w, w, newoffsets[j]);
+                break;
+            }
+            case COMPACT_BLOBS:
+            {
+                uint64_t off = e->bloboutoff;
+                int j;
+
+                /* the data pointed to follows the value */
+                for (j = 0; j < e->nblobs; j++)
+                {
+                    TIFFCompactPut(in, value + j * 4, 4, off);
+                    if (!TIFFCompactRead(s, e->blobinoff[j], block + (off - pos),
+                                         e->blobsize[j]))
+                        goto done;
+                    off += e->blobsize[j];
+                }
+                break;
+            }
+            default:
+                if (e->outoff != 0 &&
+                    !TIFFCompactRead(s, e->inoff, value, e->size))
+                    goto done;
+                break;
+        }
+    }
+
+    /* the strips/tiles follow the values */
+    _TIFFExtendLogicalEOF(out, valueend);
+    for (k = 0; k < nstriles; k++)
+    {
+        if (bytecounts[k] != 0 &&
+            !TIFFCompactCopy(s, offsets[k], newoffsets[k], bytecounts[k]))
+            goto done;
+    }
+    _TIFFExtendLogicalEOF(out, dataend);
+
+    /* then the sub-directories */
+    k = 0;
+    for (i = 0; i < ndir; i++)
+    {
+        TIFFCompactEntry *e = &entries[i];
+        uint8_t *dst = block + countsize + k * entrysize;
+        uint8_t *value =
+            e->outoff != 0 ? block + (e->outoff - pos) : dst + 4 + inlinesize;
+        const tmsize_t w = TIFFDataWidth((TIFFDataType)e->type);
+        uint64_t j;
+
+        if (e->kind == COMPACT_DROP)
+            continue;
+        k++;
+        if (e->kind != COMPACT_IFDS)
+            continue;
+        for (j = 0; j < e->count; j++)
+        {
+            uint64_t off = TIFFCompactGet(in, value + j * w, w);
+
+            if (off == 0)
+                continue;
+            if (!TIFFCompactChain(s, off, &off, depth + 1))
+                goto done;
+            if (w == 4 && off > UINT32_MAX)
+            {
+                TIFFErrorExtR(out, module,
+                              "Offset of sub-directory of tag %" PRIu16
+                              " exceeds 32 bits",
+                              e->tag);
+                goto done;
+            }
+            TIFFCompactPut(in, value + j * w, w, off);
+        }
+    }
+
+    /* the next directory is copied right after this one */
+    TIFFCompactPut(in, block + countsize + nout * entrysize, inlinesize,
+                   *nextinoff != 0
+                       ? (_TIFFGetLogicalEOF(out) + 1) & ~((uint64_t)1)
+                       : 0);
+    if (!_TIFFWriteAt(out, pos, block, (tmsize_t)(valueend - pos)))
+    {
+        TIFFErrorExtR(out, module, "Cannot write directory");
+        goto done;
+    }
+    ok = 1;
+done:
+    _TIFFfreeExt(in, rawdir);
+    _TIFFfreeExt(in, entries);
+    _TIFFfreeExt(in, offsets);
+    _TIFFfreeExt(out, block);
+    return ok;
+}
+
+/*
+ * Copy the chain of directories starting at offset inoff of the source.
+ * outoff receives the offset of the first directory in the copy.
+ */
+static int TIFFCompactChain(TIFFCompactState *s, uint64_t inoff,
+                            uint64_t *outoff, int depth)
+{
+    static const char module[] = "TIFFCompact";
+
+    *outoff = (_TIFFGetLogicalEOF(s->out) + 1) & ~((uint64_t)1);
+    if (depth > COMPACT_MAX_DEPTH)
+    {
+        TIFFErrorExtR(s->in, module, "Too many nested sub-directories");
+        return 0;
+    }
+    while (inoff != 0)
+    {
+        uint64_t *seen;
+
+        if (TIFFHashSetLookup(s->seen, &inoff) != NULL)
+        {
+            TIFFErrorExtR(s->in, module,
+                          "Directory at offset %" PRIu64
+                          " referenced twice (IFD loop?)",
+                          inoff);
+            return 0;
+        }
+        seen = (uint64_t *)malloc(sizeof(uint64_t));
+        if (seen == NULL)
+        {
+            TIFFErrorExtR(s->in, module, "Out of memory");
+            return 0;
+        }
+        *seen = inoff;
+        TIFFHashSetInsert(s->seen, seen);
+        if (!TIFFCompactDirectory(s, inoff, &inoff, depth))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Copy all the directories of in, with their strips/tiles, to out so
+ * that each directory, its values, its strip/tile arrays and its data are
+ * contiguous.  out must be a file just created, with the byte order and
+ * format (classic TIFF or BigTIFF) of in.  The number of bytes saved is
+ * returned in reclaimed if not NULL.  Returns 1 on success, 0 on error.
+ */
+int TIFFCompact(TIFF *in, TIFF *out, uint64_t *reclaimed)
+{
+    static const char module[] = "TIFFCompact";
+    TIFFCompactState s;
+    uint64_t first, newfirst = 0, outsize;
+    int ok;
+
+    if (out->tif_mode == O_RDONLY)
+    {
+        TIFFErrorExtR(out, module, "File opened in read-only mode");
+        return 0;
+    }
+    if (((in->tif_flags ^ out->tif_flags) & (TIFF_BIGTIFF | TIFF_SWAB)) != 0)
+    {
+        TIFFErrorExtR(out, module,
+                      "Output must have the byte order and format of the "
+                      "input");
+        return 0;
+    }
+    if (out->tif_flags & TIFF_BIGTIFF)
+        first = out->tif_header.big.tiff_diroff;
+    else
+        first = out->tif_header.classic.tiff_diroff;
+    if (first != 0 || out->tif_diroff != 0 ||
+        (out->tif_flags & TIFF_DIRTYDIRECT))
+    {
+        TIFFErrorExtR(out, module, "Output file is not empty");
+        return 0;
+    }
+    if (in->tif_mode != O_RDONLY && !TIFFFlush(in))
+        return 0;
+
+    if (in->tif_flags & TIFF_BIGTIFF)
+        first = in->tif_header.big.tiff_diroff;
+    else
+        first = in->tif_header.classic.tiff_diroff;
+    s.in = in;
+    s.out = out;
+    s.insize = TIFFGetFileSize(in);
+    s.buf = (uint8_t *)_TIFFmallocExt(out, COMPACT_COPY_SIZE);
+    s.seen = TIFFHashSetNew(TIFFCompactHash, TIFFCompactEqual, free);
+    if (s.buf == NULL || s.seen == NULL)
+    {
+        TIFFErrorExtR(out, module, "Out of memory");
+        ok = 0;
+    }
+    else
+        ok = TIFFCompactChain(&s, first, &newfirst, 0);
+    _TIFFfreeExt(out, s.buf);
+    if (s.seen != NULL)
+        TIFFHashSetDestroy(s.seen);
+
+    if (ok && first != 0)
+    {
+        uint8_t link[8];
+
+        if (out->tif_flags & TIFF_BIGTIFF)
+        {
+            TIFFCompactPut(out, link, 8, newfirst);
+            ok = _TIFFWriteAt(out, 8, link, 8);
+            out->tif_header.big.tiff_diroff = newfirst;
+        }
+        else
+        {
+            TIFFCompactPut(out, link, 4, newfirst);
+            ok = _TIFFWriteAt(out, 4, link, 4);
+            out->tif_header.classic.tiff_diroff = (uint32_t)newfirst;
+        }
+        if (!ok)
+            TIFFErrorExtR(out, module, "Error writing TIFF header");
+        /*
+         * Make the first directory of the copy the current one.  Not with
+         * TIFFSetDirectory(out, 0), which may select a SubIFD copied
+         * before it.
+         */
+        ok = ok && TIFFSetSubDirectory(out, newfirst);
+    }
+    outsize = _TIFFGetLogicalEOF(out);
+    if (reclaimed)
+        *reclaimed = s.insize > outsize ? s.insize - outsize : 0;
+    return ok;
+}
@@ -28,6 +28,7 @@
  * Compression Scheme Configuration Support.
  */
 #include "tiffiop.h"
+#include <math.h>
 
 static int TIFFNoEncode(TIFF *tif, const char *method)
 {
@@ -132,6 +133,89 @@ int _TIFFNoPreCode(TIFF *tif, uint16_t s)
     return (1);
 }
 
+/*
+ * Support for TIFFTAG_STOREDFALLBACK: estimate whether the data is worth
+ * compressing from the order-0 entropy of a sample of its bytes. When it is
+ * close to 8 bits per byte, there is nothing for entropy coding to gain,
+ * and noisy data such as the low bits of scientific measurements has no
+ * repeated strings either, so LZ77 and LZW would only spend CPU to produce
+ * an output at least as large as the input.
+ */
+#define FALLBACK_MIN_SIZE 4096   /* smaller samples look less random */
+#define FALLBACK_BLOCK_SIZE 256  /* the sample is made of blocks... */
+#define FALLBACK_BLOCK_COUNT 64  /* ...spread over the data */
+#define FALLBACK_MAX_ENTROPY 7.8 /* in bits per byte */
+
+static int TIFFIsIncompressible(const uint8_t *bp, tmsize_t cc)
+{
+    uint32_t hist[256];
+    tmsize_t n = 0;
+    double entropy;
+    int i;
+
+    if (cc < FALLBACK_MIN_SIZE)
+        return 0;
+    memset(hist, 0, sizeof(hist));
+    if (cc <= FALLBACK_BLOCK_SIZE * FALLBACK_BLOCK_COUNT)
+    {
+        for (; n < cc; n++)
+            hist[bp[n]]++;
+    }
+    else
+    {
+        tmsize_t step = (cc - FALLBACK_BLOCK_SIZE) / (FALLBACK_BLOCK_COUNT - 1);
+        int k, j;
+        for (k = 0; k < FALLBACK_BLOCK_COUNT; k++)
+        {
+            const uint8_t *p = bp + step * k;
+            for (j = 0; j < FALLBACK_BLOCK_SIZE; j++)
+                hist[p[j]]++;
+        }
+        n = FALLBACK_BLOCK_SIZE * FALLBACK_BLOCK_COUNT;
+    }
+    /* entropy = log2(n) - sum(c * log2(c)) / n */
+    entropy = 0;
+    for (i = 0; i < 256; i++)
+    {
+        if (hist[i] > 1)
+            entropy += hist[i] * log((double)hist[i]);
+    }
+    entropy = (log((double)n) - entropy / (double)n) / log(2.0);
+    return entropy >= FALLBACK_MAX_ENTROPY;
+}
+
+/*
+ * Called by the codecs supporting TIFFTAG_STOREDFALLBACK with the first
+ * data of each strip or tile they encode, which is the whole strip or tile
+ * with TIFFWriteEncodedStrip() and TIFFWriteEncodedTile(). Returns 1 if it
+ * should be stored in the simplest form allowed by the codec, rather than
+ * compressed.
+ */
+int _TIFFStoredFallback(TIFF *tif, const uint8_t *bp, tmsize_t cc)
+{
+    if (!(tif->tif_flags & TIFF_STOREDFALLBACK))
+        return 0;
+    tif->tif_fallback_striles++;
+    if (!TIFFIsIncompressible(bp, cc))
+        return 0;
+    tif->tif_fallback_stored++;
+    return 1;
+}
+
+/*
+ * Return the number of strips or tiles of the directory being (or last)
+ * written that were checked with TIFFTAG_STOREDFALLBACK set, and how many
+ * of them were stored rather than compressed.
+ */
+void TIFFGetStoredFallbackCounts(TIFF *tif, uint32_t *striles,
+                                 uint32_t *stored)
+{
+    if (striles)
+        *striles = tif->tif_fallback_striles;
+    if (stored)
+        *stored = tif->tif_fallback_stored;
+}
+
 static int _TIFFtrue(TIFF *tif)
 {
     (void)tif;
@@ -163,18 +247,42 @@ void _TIFFSetDefaultCompressionState(TIFF *tif)
     tif->tif_flags &= ~(TIFF_NOBITREV | TIFF_NOREADRAW);
 }
 
+static int isBuiltinCODEC(const TIFFCodec *c)
+{
+    const TIFFCodec *b;
+
+    for (b = _TIFFBuiltinCODECS; b->name; b++)
+        if (b == c)
+            return 1;
+    return 0;
+}
+
 int TIFFSetCompressionScheme(TIFF *tif, int scheme)
 {
     const TIFFCodec *c = TIFFFindCODEC((uint16_t)scheme);
+    TIFFVSetMethod vsetparent = tif->tif_tagmethods.vsetfield;
+    int status;
 
     _TIFFSetDefaultCompressionState(tif);
+    /*
+     * Record the fields merged by the codec init and the tag set
+     * routine it installs, for TIFFSetFields() to know the settings
+     * of the codec and the fields it handles.
+     */
+    tif->tif_ncodecfields = 0;
+    tif->tif_incodecinit = 1;
     /*
      * Don't treat an unknown compression scheme as an error.
      * This permits applications to open files with data that
      * the library does not have builtin support for, but which
      * may still be meaningful.
      */
-    return (c ? (*c->init)(tif, scheme) : 1);
+    status = c ? (*c->init)(tif, scheme) : 1;
+    tif->tif_incodecinit = 0;
+    tif->tif_codecvsetparent = vsetparent;
+    tif->tif_codecvsetfield =
+        c == NULL || isBuiltinCODEC(c) ? tif->tif_tagmethods.vsetfield : NULL;
+    return status;
 }
 
 /*
@@ -31,6 +31,7 @@
 #include "tiffiop.h"
 #include <float.h> /*--: for Rational2Double */
 #include <limits.h>
+#include <stdlib.h>
 
 /*
  * These are used in the backwards compatibility code...
@@ -129,6 +130,42 @@ static void setDoubleArrayOneValue(TIFF *tif, double **vpp, double value,
     }
 }
 
+/*
+ * Offset of the values in a TIFFValueArena block, suitably aligned for
+ * any of them.
+ */
+#define VALUE_ARENA_HEADER_SIZE                                                \
+    ((tmsize_t)TIFFroundup_64(sizeof(TIFFValueArena), 8))
+
+/*
+ * Free the value of a custom field.  Values stored by TIFFSetFields() are
+ * part of a block that is freed with the last of them.
+ */
+static void freeCustomValue(TIFF *tif, void *value)
+{
+    TIFFValueArena **parena;
+
+    if (value == NULL)
+        return;
+    for (parena = &tif->tif_dir.td_customValueArenas; *parena != NULL;
+         parena = &(*parena)->next)
+    {
+        TIFFValueArena *arena = *parena;
+        const char *base = (const char *)arena + VALUE_ARENA_HEADER_SIZE;
+        if ((const char *)value >= base &&
+            (const char *)value < base + arena->size)
+        {
+            if (--arena->nvalues == 0)
+            {
+                *parena = arena->next;
+                _TIFFfreeExt(tif, arena);
+            }
+            return;
+        }
+    }
+    _TIFFfreeExt(tif, value);
+}
+
 /*
  * Install extra samples information.
  */
@@ -661,6 +698,13 @@ static int _TIFFVSetField(TIFF *tif, uint32_t tag, va_list ap)
             else
                 tif->tif_flags &= ~TIFF_PERSAMPLE;
             break;
+        case TIFFTAG_STOREDFALLBACK:
+            v = (uint16_t)va_arg(ap, uint16_vap);
+            if (v == STOREDFALLBACK_AUTO)
+                tif->tif_flags |= TIFF_STOREDFALLBACK;
+            else
+                tif->tif_flags &= ~TIFF_STOREDFALLBACK;
+            break;
         default:
         {
             TIFFTagValue *tv;
@@ -707,11 +751,8 @@ static int _TIFFVSetField(TIFF *tif, uint32_t tag, va_list ap)
                 if (td->td_customValues[iCustom].info->field_tag == tag)
                 {
                     tv = td->td_customValues + iCustom;
-                    if (tv->value != NULL)
-                    {
-                        _TIFFfreeExt(tif, tv->value);
-                        tv->value = NULL;
-                    }
+                    freeCustomValue(tif, tv->value);
+                    tv->value = NULL;
                     break;
                 }
             }
@@ -1079,11 +1120,8 @@ badvalueifd8long8:
     if (tv2 != NULL)
     {
         /* Remove custom field from custom list */
-        if (tv2->value != NULL)
-        {
-            _TIFFfreeExt(tif, tv2->value);
-            tv2->value = NULL;
-        }
+        freeCustomValue(tif, tv2->value);
+        tv2->value = NULL;
         /* Shorten list and close gap in customValues list.
          * Re-allocation of td_customValues not necessary here. */
         td->td_customValueCount--;
@@ -1110,9 +1148,8 @@ badvalueifd8long8:
  * has commenced, unless its value has no effect
  * on the format of the data that is written.
  */
-static int OkToChangeTag(TIFF *tif, uint32_t tag)
+static int OkToChangeField(TIFF *tif, uint32_t tag, const TIFFField *fip)
 {
-    const TIFFField *fip = TIFFFindField(tif, tag, TIFF_ANY);
     if (!fip)
     { /* unknown tag */
         TIFFErrorExtR(tif, "TIFFSetField", "%s: Unknown %stag %" PRIu32,
@@ -1136,6 +1173,11 @@ static int OkToChangeTag(TIFF *tif, uint32_t tag)
     return (1);
 }
 
+static int OkToChangeTag(TIFF *tif, uint32_t tag)
+{
+    return OkToChangeField(tif, tag, TIFFFindField(tif, tag, TIFF_ANY));
+}
+
 /*
  * Record the value of a field in the
  * internal directory structure.  The
@@ -1182,7 +1224,7 @@ int TIFFUnsetField(TIFF *tif, uint32_t tag)
 
         if (i < td->td_customValueCount)
         {
-            _TIFFfreeExt(tif, tv->value);
+            freeCustomValue(tif, tv->value);
             for (; i < td->td_customValueCount - 1; i++)
             {
                 td->td_customValues[i] = td->td_customValues[i + 1];
@@ -1209,6 +1251,1495 @@ int TIFFVSetField(TIFF *tif, uint32_t tag, va_list ap)
                : 0;
 }
 
+/*
+ * Support for TIFFSetFields().
+ *
+ * Values are converted from the C type chosen by the caller to the type of
+ * the field (TIFFFieldSetGetSize()), so that all of them can be checked
+ * before any field is set.
+ */
+
+typedef struct
+{
+    const TIFFFieldValue *fv;
+    const TIFFField *fip;
+    uint32_t index; /* position in the caller's array */
+    uint32_t count; /* number of values of the field */
+    TIFFDataType dsttype;
+    int store;  /* how the field is stored, one of SETFIELDS_* */
+    int custom; /* index of the current value in td_customValues, or -1 */
+    void *core; /* member of the directory holding the value, or NULL */
+    uint32_t coresize; /* size of the member */
+    union
+    {
+        uint16_t u16[2];
+        uint32_t u32;
+        float f;
+    } value; /* converted value, if core is not NULL */
+} TIFFSetFieldsEntry;
+
+#define SETFIELDS_METHODS 0 /* through the tag methods */
+#define SETFIELDS_CUSTOM 1  /* in td_customValues */
+#define SETFIELDS_CORE 2    /* in a member of the directory */
+
+/* Batches up to this size need no memory allocation for their handling */
+#define SETFIELDS_LOCAL 16
+
+/*
+ * Return the type of the values of a field, as passed to TIFFSetField(),
+ * or TIFF_NOTYPE if it cannot be determined.
+ */
+static TIFFDataType setGetElementType(const TIFFField *fip)
+{
+    switch (fip->set_get_field_type)
+    {
+        case TIFF_SETGET_ASCII:
+        case TIFF_SETGET_C0_ASCII:
+        case TIFF_SETGET_C16_ASCII:
+        case TIFF_SETGET_C32_ASCII:
+            return TIFF_ASCII;
+        case TIFF_SETGET_UINT8:
+        case TIFF_SETGET_C0_UINT8:
+        case TIFF_SETGET_C16_UINT8:
+        case TIFF_SETGET_C32_UINT8:
+            return TIFF_BYTE;
+        case TIFF_SETGET_SINT8:
+        case TIFF_SETGET_C0_SINT8:
+        case TIFF_SETGET_C16_SINT8:
+        case TIFF_SETGET_C32_SINT8:
+            return TIFF_SBYTE;
+        case TIFF_SETGET_UINT16:
+        case TIFF_SETGET_UINT16_PAIR:
+        case TIFF_SETGET_C0_UINT16:
+        case TIFF_SETGET_C16_UINT16:
+        case TIFF_SETGET_C32_UINT16:
+            return TIFF_SHORT;
+        case TIFF_SETGET_SINT16:
+        case TIFF_SETGET_C0_SINT16:
+        case TIFF_SETGET_C16_SINT16:
+        case TIFF_SETGET_C32_SINT16:
+            return TIFF_SSHORT;
+        case TIFF_SETGET_UINT32:
+        case TIFF_SETGET_C0_UINT32:
+        case TIFF_SETGET_C16_UINT32:
+        case TIFF_SETGET_C32_UINT32:
+            return TIFF_LONG;
+        case TIFF_SETGET_INT:
+        case TIFF_SETGET_SINT32:
+        case TIFF_SETGET_C0_SINT32:
+        case TIFF_SETGET_C16_SINT32:
+        case TIFF_SETGET_C32_SINT32:
+            return TIFF_SLONG;
+        case TIFF_SETGET_UINT64:
+        case TIFF_SETGET_IFD8:
+        case TIFF_SETGET_C0_UINT64:
+        case TIFF_SETGET_C0_IFD8:
+        case TIFF_SETGET_C16_UINT64:
+        case TIFF_SETGET_C16_IFD8:
+        case TIFF_SETGET_C32_UINT64:
+        case TIFF_SETGET_C32_IFD8:
+            return TIFF_LONG8;
+        case TIFF_SETGET_SINT64:
+        case TIFF_SETGET_C0_SINT64:
+        case TIFF_SETGET_C16_SINT64:
+        case TIFF_SETGET_C32_SINT64:
+            return TIFF_SLONG8;
+        case TIFF_SETGET_FLOAT:
+        case TIFF_SETGET_C0_FLOAT:
+        case TIFF_SETGET_C16_FLOAT:
+        case TIFF_SETGET_C32_FLOAT:
+            return TIFF_FLOAT;
+        case TIFF_SETGET_DOUBLE:
+        case TIFF_SETGET_C0_DOUBLE:
+        case TIFF_SETGET_C16_DOUBLE:
+        case TIFF_SETGET_C32_DOUBLE:
+            return TIFF_DOUBLE;
+        case TIFF_SETGET_OTHER:
+            /* ColorMap and TransferFunction */
+            if (fip->field_type == TIFF_SHORT)
+                return TIFF_SHORT;
+            return TIFF_NOTYPE;
+        default:
+            return TIFF_NOTYPE;
+    }
+}
+
+/*
+ * Return the C type of values given to TIFFSetFields() with the given
+ * type, or TIFF_NOTYPE if it is not supported.
+ */
+static TIFFDataType setFieldsSourceType(TIFFDataType type)
+{
+    switch (type)
+    {
+        case TIFF_ASCII:
+        case TIFF_BYTE:
+        case TIFF_SBYTE:
+        case TIFF_SHORT:
+        case TIFF_SSHORT:
+        case TIFF_LONG:
+        case TIFF_SLONG:
+        case TIFF_LONG8:
+        case TIFF_SLONG8:
+        case TIFF_FLOAT:
+        case TIFF_DOUBLE:
+            return type;
+        case TIFF_UNDEFINED:
+            return TIFF_BYTE;
+        case TIFF_IFD:
+            return TIFF_LONG;
+        case TIFF_IFD8:
+            return TIFF_LONG8;
+        default:
+            return TIFF_NOTYPE;
+    }
+}
+
+static int isFloatType(TIFFDataType type)
+{
+    return type == TIFF_FLOAT || type == TIFF_DOUBLE;
+}
+
+/*
+ * Convert the count values of e from the caller's type to the type of the
+ * field, into dst.  With dst == NULL, the values are only checked.
+ */
+static int convertSetFieldsValues(TIFF *tif, const TIFFSetFieldsEntry *e,
+                                  void *dst)
+{
+    static const char module[] = "TIFFSetFields";
+    TIFFDataType srctype = setFieldsSourceType(e->fv->type);
+    const void *src = e->fv->value;
+    uint32_t i;
+
+    if (srctype == TIFF_ASCII || srctype == e->dsttype)
+    {
+        if (dst != NULL && e->count > 0)
+            _TIFFmemcpy(dst, src,
+                        (tmsize_t)e->count * TIFFDataWidth(e->dsttype));
+        if (e->store == SETFIELDS_CUSTOM &&
+            !(tif->tif_flags & TIFF_BIGTIFF) && srctype != TIFF_ASCII)
+            goto checkclassic;
+        return 1;
+    }
+
+    for (i = 0; i < e->count; i++)
+    {
+        int64_t sv = 0; /* value of a signed integer */
+        uint64_t uv = 0; /* value of a non negative integer */
+        int negative = 0;
+        double dv = 0;
+
+        switch (srctype)
+        {
+            case TIFF_BYTE:
+                uv = ((const uint8_t *)src)[i];
+                break;
+            case TIFF_SBYTE:
+                sv = ((const int8_t *)src)[i];
+                break;
+            case TIFF_SHORT:
+                uv = ((const uint16_t *)src)[i];
+                break;
+            case TIFF_SSHORT:
+                sv = ((const int16_t *)src)[i];
+                break;
+            case TIFF_LONG:
+                uv = ((const uint32_t *)src)[i];
+                break;
+            case TIFF_SLONG:
+                sv = ((const int32_t *)src)[i];
+                break;
+            case TIFF_LONG8:
+                uv = ((const uint64_t *)src)[i];
+                break;
+            case TIFF_SLONG8:
+                sv = ((const int64_t *)src)[i];
+                break;
+            case TIFF_FLOAT:
+                dv = ((const float *)src)[i];
+                break;
+            case TIFF_DOUBLE:
+                dv = ((const double *)src)[i];
+                break;
+            default:
+                return 0;
+        }
+        if (srctype == TIFF_SBYTE || srctype == TIFF_SSHORT ||
+            srctype == TIFF_SLONG || srctype == TIFF_SLONG8)
+        {
+            if (sv < 0)
+                negative = 1;
+            else
+                uv = (uint64_t)sv;
+        }
+        if (!isFloatType(srctype))
+            dv = negative ? (double)sv : (double)uv;
+
+        switch (e->dsttype)
+        {
+            case TIFF_BYTE:
+                if (negative || uv > 0xFF)
+                    goto badvalue;
+                if (dst)
+                    ((uint8_t *)dst)[i] = (uint8_t)uv;
+                break;
+            case TIFF_SBYTE:
+                if (negative ? sv < -128 : uv > 127)
+                    goto badvalue;
+                if (dst)
+                    ((int8_t *)dst)[i] = (int8_t)(negative ? sv : (int64_t)uv);
+                break;
+            case TIFF_SHORT:
+                if (negative || uv > 0xFFFF)
+                    goto badvalue;
+                if (dst)
+                    ((uint16_t *)dst)[i] = (uint16_t)uv;
+                break;
+            case TIFF_SSHORT:
+                if (negative ? sv < -32768 : uv > 32767)
+                    goto badvalue;
+                if (dst)
+                    ((int16_t *)dst)[i] =
+                        (int16_t)(negative ? sv : (int64_t)uv);
+                break;
+            case TIFF_LONG:
+                if (negative || uv > 0xFFFFFFFFU)
+                    goto badvalue;
+                if (dst)
+                    ((uint32_t *)dst)[i] = (uint32_t)uv;
+                break;
+            case TIFF_SLONG:
+                if (negative ? sv < (-2147483647 - 1) : uv > 2147483647)
+                    goto badvalue;
+                if (dst)
+                    ((int32_t *)dst)[i] =
+                        (int32_t)(negative ? sv : (int64_t)uv);
+                break;
+            case TIFF_LONG8:
+                if (negative)
+                    goto badvalue;
+                if (dst)
+                    ((uint64_t *)dst)[i] = uv;
+                break;
+            case TIFF_SLONG8:
+                if (!negative && uv > (uint64_t)INT64_MAX)
+                    goto badvalue;
+                if (dst)
+                    ((int64_t *)dst)[i] = negative ? sv : (int64_t)uv;
+                break;
+            case TIFF_FLOAT:
+                if (dst)
+                    ((float *)dst)[i] = _TIFFClampDoubleToFloat(dv);
+                break;
+            case TIFF_DOUBLE:
+                if (dst)
+                    ((double *)dst)[i] = dv;
+                break;
+            default:
+                return 0;
+        }
+        continue;
+    badvalue:
+        TIFFErrorExtR(tif, module,
+                      "%s: Value at index %" PRIu32
+                      " of tag \"%s\" is out of range",
+                      tif->tif_name, i, e->fip->field_name);
+        return 0;
+    }
+    if (e->store != SETFIELDS_CUSTOM || (tif->tif_flags & TIFF_BIGTIFF))
+        return 1;
+
+checkclassic:
+    /* Same restriction as in _TIFFVSetField() for custom fields */
+    for (i = 0; i < e->count; i++)
+    {
+        int64_t v;
+        if (e->fip->field_type == TIFF_LONG8 ||
+            e->fip->field_type == TIFF_IFD8)
+        {
+            if (srctype == TIFF_LONG8 &&
+                ((const uint64_t *)src)[i] > 0xFFFFFFFFU)
+                goto badclassic;
+            if (srctype == TIFF_SLONG8 &&
+                (uint64_t)((const int64_t *)src)[i] > 0xFFFFFFFFU)
+                goto badclassic;
+        }
+        else if (e->fip->field_type == TIFF_SLONG8 &&
+                 (srctype == TIFF_LONG8 || srctype == TIFF_SLONG8))
+        {
+            v = ((const int64_t *)src)[i];
+            if (srctype == TIFF_LONG8 &&
+                ((const uint64_t *)src)[i] > (uint64_t)INT64_MAX)
+                goto badclassic;
+            if (v > 2147483647 || v < (-2147483647 - 1))
+                goto badclassic;
+        }
+    }
+    return 1;
+badclassic:
+    TIFFErrorExtR(tif, module,
+                  "%s: Value at index %" PRIu32
+                  " of tag \"%s\" is out of range for ClassicTIFF",
+                  tif->tif_name, i, e->fip->field_name);
+    return 0;
+}
+
+/*
+ * Return whether a custom field can be stored by TIFFSetFields() without
+ * going through the tag methods: this is the case of the fields of the
+ * library tables, of the ones registered with TIFFMergeFieldInfo() and of
+ * unknown tags, while codecs may handle their own fields.
+ */
+static int isDirectCustomField(TIFF *tif, const TIFFField *fip)
+{
+    const TIFFFieldArray *arrays[3];
+    size_t i;
+
+    if (fip->field_bit != FIELD_CUSTOM)
+        return 0;
+    if (fip->field_anonymous)
+        return 1;
+    arrays[0] = _TIFFGetFields();
+    arrays[1] = _TIFFGetExifFields();
+    arrays[2] = _TIFFGetGpsFields();
+    for (i = 0; i < 3; i++)
+    {
+        if (fip >= arrays[i]->fields &&
+            fip < arrays[i]->fields + arrays[i]->count)
+            return 1;
+    }
+    for (i = 0; i < tif->tif_nfieldscompat; i++)
+    {
+        const TIFFFieldArray *fa = &tif->tif_fieldscompat[i];
+        if (fip >= fa->fields && fip < fa->fields + fa->count)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Return the member of the directory holding the value of a field of one
+ * value, or a pair, and its size, or NULL.  *direct tells whether
+ * TIFFSetFields() stores the value in it without going through the tag
+ * methods: this is the case of the fields that _TIFFVSetField() only
+ * checks and stores, while the values set by a batch are checked by
+ * checkSetFieldsCore().  The other ones are only saved from their member.
+ * This requires the tag methods to be the ones of the library, the builtin
+ * codecs passing these fields to _TIFFVSetField() and _TIFFVGetField().
+ */
+static void *setFieldsCoreMember(TIFF *tif, const TIFFField *fip,
+                                 uint32_t *size, int *direct)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    void *member;
+
+    if (fip->field_bit == FIELD_CUSTOM || fip->field_bit == FIELD_PSEUDO ||
+        tif->tif_codecvsetparent != _TIFFVSetField ||
+        tif->tif_tagmethods.vsetfield != tif->tif_codecvsetfield)
+        return NULL;
+    *direct = 0;
+    switch (fip->field_tag)
+    {
+        case TIFFTAG_BITSPERSAMPLE:
+            *size = 2;
+            return &td->td_bitspersample;
+        case TIFFTAG_PHOTOMETRIC:
+            *size = 2;
+            return &td->td_photometric;
+        case TIFFTAG_SAMPLESPERPIXEL:
+            *size = 2;
+            return &td->td_samplesperpixel;
+        case TIFFTAG_SAMPLEFORMAT:
+            *size = 2;
+            return &td->td_sampleformat;
+        case TIFFTAG_ROWSPERSTRIP:
+            *size = 4;
+            return &td->td_rowsperstrip;
+        case TIFFTAG_TILEWIDTH:
+            *size = 4;
+            return &td->td_tilewidth;
+        case TIFFTAG_TILELENGTH:
+            *size = 4;
+            return &td->td_tilelength;
+        case TIFFTAG_YCBCRSUBSAMPLING:
+            *size = 4;
+            return td->td_ycbcrsubsampling;
+        default:
+            break;
+    }
+    *direct = 1;
+    switch (fip->field_tag)
+    {
+        case TIFFTAG_SUBFILETYPE:
+            member = &td->td_subfiletype;
+            break;
+        case TIFFTAG_IMAGEWIDTH:
+            member = &td->td_imagewidth;
+            break;
+        case TIFFTAG_IMAGELENGTH:
+            member = &td->td_imagelength;
+            break;
+        case TIFFTAG_IMAGEDEPTH:
+            member = &td->td_imagedepth;
+            break;
+        case TIFFTAG_TILEDEPTH:
+            member = &td->td_tiledepth;
+            break;
+        case TIFFTAG_XRESOLUTION:
+            member = &td->td_xresolution;
+            break;
+        case TIFFTAG_YRESOLUTION:
+            member = &td->td_yresolution;
+            break;
+        case TIFFTAG_XPOSITION:
+            member = &td->td_xposition;
+            break;
+        case TIFFTAG_YPOSITION:
+            member = &td->td_yposition;
+            break;
+        case TIFFTAG_PAGENUMBER:
+            member = td->td_pagenumber;
+            break;
+        case TIFFTAG_HALFTONEHINTS:
+            member = td->td_halftonehints;
+            break;
+        case TIFFTAG_THRESHHOLDING:
+            *size = 2;
+            return &td->td_threshholding;
+        case TIFFTAG_FILLORDER:
+            *size = 2;
+            return &td->td_fillorder;
+        case TIFFTAG_ORIENTATION:
+            *size = 2;
+            return &td->td_orientation;
+        case TIFFTAG_MINSAMPLEVALUE:
+            *size = 2;
+            return &td->td_minsamplevalue;
+        case TIFFTAG_MAXSAMPLEVALUE:
+            *size = 2;
+            return &td->td_maxsamplevalue;
+        case TIFFTAG_PLANARCONFIG:
+            *size = 2;
+            return &td->td_planarconfig;
+        case TIFFTAG_RESOLUTIONUNIT:
+            *size = 2;
+            return &td->td_resolutionunit;
+        case TIFFTAG_YCBCRPOSITIONING:
+            *size = 2;
+            return &td->td_ycbcrpositioning;
+        default:
+            return NULL;
+    }
+    *size = 4;
+    return member;
+}
+
+/*
+ * Check the converted value of a field stored in the member returned by
+ * setFieldsCoreMember() as _TIFFVSetField() does.
+ */
+static int checkSetFieldsCore(TIFF *tif, const TIFFSetFieldsEntry *e)
+{
+    static const char module[] = "TIFFSetFields";
+    const uint16_t *u16 = e->value.u16;
+    int ok;
+
+    switch (e->fv->tag)
+    {
+        case TIFFTAG_FILLORDER:
+            ok = u16[0] == FILLORDER_LSB2MSB || u16[0] == FILLORDER_MSB2LSB;
+            break;
+        case TIFFTAG_ORIENTATION:
+            ok = u16[0] >= ORIENTATION_TOPLEFT && u16[0] <= ORIENTATION_LEFTBOT;
+            break;
+        case TIFFTAG_PLANARCONFIG:
+            ok = u16[0] == PLANARCONFIG_CONTIG ||
+                 u16[0] == PLANARCONFIG_SEPARATE;
+            break;
+        case TIFFTAG_RESOLUTIONUNIT:
+            ok = u16[0] >= RESUNIT_NONE && u16[0] <= RESUNIT_CENTIMETER;
+            break;
+        case TIFFTAG_TILEDEPTH:
+            ok = e->value.u32 != 0;
+            break;
+        case TIFFTAG_XRESOLUTION:
+        case TIFFTAG_YRESOLUTION:
+            if (e->value.f != e->value.f || e->value.f < 0)
+            {
+                TIFFErrorExtR(tif, module, "%s: Bad value %f for \"%s\" tag",
+                              tif->tif_name, (double)e->value.f,
+                              e->fip->field_name);
+                return 0;
+            }
+            return 1;
+        default:
+            return 1;
+    }
+    if (!ok)
+        TIFFErrorExtR(tif, module,
+                      "%s: Bad value %" PRIu32 " for \"%s\" tag",
+                      tif->tif_name,
+                      e->fv->tag == TIFFTAG_TILEDEPTH ? e->value.u32
+                                                      : (uint32_t)u16[0],
+                      e->fip->field_name);
+    return ok;
+}
+
+static int setFieldsCompare(const void *a, const void *b)
+{
+    const TIFFSetFieldsEntry *ea = (const TIFFSetFieldsEntry *)a;
+    const TIFFSetFieldsEntry *eb = (const TIFFSetFieldsEntry *)b;
+    if (ea->fv->tag != eb->fv->tag)
+        return ea->fv->tag < eb->fv->tag ? -1 : 1;
+    return ea->index < eb->index ? -1 : (ea->index > eb->index ? 1 : 0);
+}
+
+/*
+ * Return whether the values of a field set through the tag methods must be
+ * copied to the scratch buffer: when they have to be converted, and for
+ * ExtraSamples, whose values may be fixed up in place by setExtraSamples().
+ */
+static int setFieldsNeedsCopy(const TIFFSetFieldsEntry *e)
+{
+    if (e->dsttype == TIFF_ASCII)
+        return 0;
+    return setFieldsSourceType(e->fv->type) != e->dsttype ||
+           (e->fv->tag == TIFFTAG_EXTRASAMPLES &&
+            e->fip->field_bit != FIELD_CUSTOM);
+}
+
+/*
+ * Call the tag set routine, without checking the tag again.
+ */
+static int setFieldsVSet(TIFF *tif, uint32_t tag, ...)
+{
+    va_list ap;
+    int status;
+
+    va_start(ap, tag);
+    status = (*tif->tif_tagmethods.vsetfield)(tif, tag, ap);
+    va_end(ap);
+    return (status);
+}
+
+/*
+ * Set a field through the tag methods, passing its values the way
+ * TIFFSetField() expects them.  Values that need a conversion are
+ * converted in scratch, if checkSetFieldsEntry() did not already.
+ */
+static int setFieldsThroughMethods(TIFF *tif, const TIFFSetFieldsEntry *e,
+                                   void *scratch)
+{
+    const TIFFField *fip = e->fip;
+    uint32_t tag = e->fv->tag;
+    const void *p = e->fv->value;
+
+    if (e->core != NULL)
+        p = &e->value;
+    else if (setFieldsNeedsCopy(e))
+    {
+        if (!convertSetFieldsValues(tif, e, scratch))
+            return 0;
+        p = scratch;
+    }
+
+    switch (fip->set_get_field_type)
+    {
+        case TIFF_SETGET_ASCII:
+            return setFieldsVSet(tif, tag, (const char *)p);
+        case TIFF_SETGET_UINT8:
+            return setFieldsVSet(tif, tag, (int)*(const uint8_t *)p);
+        case TIFF_SETGET_SINT8:
+            return setFieldsVSet(tif, tag, (int)*(const int8_t *)p);
+        case TIFF_SETGET_UINT16:
+            return setFieldsVSet(tif, tag, (uint16_vap) * (const uint16_t *)p);
+        case TIFF_SETGET_SINT16:
+            return setFieldsVSet(tif, tag, (int)*(const int16_t *)p);
+        case TIFF_SETGET_UINT32:
+            return setFieldsVSet(tif, tag, *(const uint32_t *)p);
+        case TIFF_SETGET_INT:
+        case TIFF_SETGET_SINT32:
+            return setFieldsVSet(tif, tag, *(const int32_t *)p);
+        case TIFF_SETGET_UINT64:
+        case TIFF_SETGET_IFD8:
+            return setFieldsVSet(tif, tag, *(const uint64_t *)p);
+        case TIFF_SETGET_SINT64:
+            return setFieldsVSet(tif, tag, *(const int64_t *)p);
+        case TIFF_SETGET_FLOAT:
+            return setFieldsVSet(tif, tag, (double)*(const float *)p);
+        case TIFF_SETGET_DOUBLE:
+            /* SMinSampleValue and SMaxSampleValue with PERSAMPLE_MULTI */
+            if (e->count > 1)
+                return setFieldsVSet(tif, tag, (const double *)p);
+            return setFieldsVSet(tif, tag, *(const double *)p);
+        case TIFF_SETGET_UINT16_PAIR:
+            return setFieldsVSet(tif, tag, (uint16_vap)((const uint16_t *)p)[0],
+                                 (uint16_vap)((const uint16_t *)p)[1]);
+        case TIFF_SETGET_OTHER:
+        {
+            /* ColorMap and TransferFunction: one or three arrays */
+            const uint16_t *a = (const uint16_t *)p;
+            uint32_t n = 1U << tif->tif_dir.td_bitspersample;
+            if (e->count == n)
+                return setFieldsVSet(tif, tag, a, a, a);
+            return setFieldsVSet(tif, tag, a, a + n, a + 2 * n);
+        }
+        default:
+            break;
+    }
+    if (TIFFFieldSetGetCountSize(fip) == 2)
+        return setFieldsVSet(tif, tag, (int)e->count, p);
+    if (TIFFFieldSetGetCountSize(fip) == 4)
+        return setFieldsVSet(tif, tag, e->count, p);
+    return setFieldsVSet(tif, tag, p);
+}
+
+/*
+ * Previous values of a field set through the tag methods by a batch, to
+ * restore them if the batch fails.
+ */
+typedef struct
+{
+    TIFFSetFieldsEntry e; /* entry setting the saved values back */
+    TIFFFieldValue fv;
+    int set;      /* whether the field was set */
+    int hasvalue; /* whether there are values to set back */
+    union
+    {
+        uint8_t u8[16];
+        uint16_t u16[8];
+        uint32_t u32[4];
+        uint64_t u64[2];
+        float f[4];
+        double d[2];
+    } scalar;   /* values of scalar fields */
+    void *data; /* copy of array values, followed by room to convert them */
+    void *core; /* member of the directory of a field stored directly */
+} TIFFSetFieldsUndo;
+
+/*
+ * Call the tag get routine, whether the field is set or not: the values
+ * of the fields of the directory that are not set are their defaults.
+ */
+static int setFieldsVGet(TIFF *tif, uint32_t tag, ...)
+{
+    va_list ap;
+    int status;
+
+    va_start(ap, tag);
+    status = (*tif->tif_tagmethods.vgetfield)(tif, tag, ap);
+    va_end(ap);
+    return (status);
+}
+
+/*
+ * Save the values of a field before it is set through the tag methods.
+ */
+static int setFieldsSave(TIFF *tif, const TIFFField *fip,
+                         TIFFSetFieldsUndo *u)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    uint32_t tag = fip->field_tag;
+    const void *p = &u->scalar;
+    uint32_t count = 1;
+    tmsize_t size;
+    int i;
+
+    memset(u, 0, sizeof(*u));
+    u->fv.tag = tag;
+    u->fv.type = setGetElementType(fip);
+    u->e.fv = &u->fv;
+    u->e.fip = fip;
+    u->e.dsttype = u->fv.type;
+    u->e.custom = -1;
+    if (fip->field_bit == FIELD_CUSTOM)
+    {
+        for (i = 0; i < td->td_customValueCount && !u->set; i++)
+        {
+            if (td->td_customValues[i].info->field_tag == tag)
+            {
+                u->set = 1;
+                count = (uint32_t)td->td_customValues[i].count;
+            }
+        }
+        if (!u->set)
+            return 1; /* unset again */
+    }
+    else
+        u->set = fip->field_bit == FIELD_PSEUDO ||
+                 TIFFFieldSet(tif, fip->field_bit);
+
+    switch (fip->set_get_field_type)
+    {
+        case TIFF_SETGET_ASCII:
+        {
+            const char *v = NULL;
+            if (!setFieldsVGet(tif, tag, &v))
+                return 0;
+            p = v;
+            count = v ? (uint32_t)strlen(v) + 1 : 0;
+            break;
+        }
+        case TIFF_SETGET_UINT8:
+        case TIFF_SETGET_SINT8:
+        case TIFF_SETGET_UINT16:
+        case TIFF_SETGET_SINT16:
+        case TIFF_SETGET_UINT32:
+        case TIFF_SETGET_INT:
+        case TIFF_SETGET_SINT32:
+        case TIFF_SETGET_UINT64:
+        case TIFF_SETGET_IFD8:
+        case TIFF_SETGET_SINT64:
+        case TIFF_SETGET_FLOAT:
+            if (!setFieldsVGet(tif, tag, &u->scalar))
+                return 0;
+            break;
+        case TIFF_SETGET_DOUBLE:
+            if (fip->field_bit != FIELD_CUSTOM &&
+                (tag == TIFFTAG_SMINSAMPLEVALUE ||
+                 tag == TIFFTAG_SMAXSAMPLEVALUE))
+            {
+                const double *v = NULL;
+                /* the values may not be allocated if not set */
+                if (!u->set)
+                    return 1;
+                if (tif->tif_flags & TIFF_PERSAMPLE)
+                {
+                    if (!setFieldsVGet(tif, tag, &v))
+                        return 0;
+                    p = v;
+                    count = td->td_samplesperpixel;
+                    break;
+                }
+            }
+            if (!setFieldsVGet(tif, tag, &u->scalar))
+                return 0;
+            break;
+        case TIFF_SETGET_UINT16_PAIR:
+            if (!setFieldsVGet(tif, tag, &u->scalar.u16[0],
+                               &u->scalar.u16[1]))
+                return 0;
+            count = 2;
+            break;
+        case TIFF_SETGET_OTHER:
+        {
+            /* ColorMap and TransferFunction, copied as one array */
+            const uint16_t *v[3] = {NULL, NULL, NULL};
+            tmsize_t n = (tmsize_t)1 << td->td_bitspersample;
+            if (td->td_bitspersample > 16 ||
+                !setFieldsVGet(tif, tag, &v[0], &v[1], &v[2]) ||
+                v[0] == NULL)
+                return 1;
+            count = (uint32_t)(v[1] != NULL ? 3 * n : n);
+            u->data = _TIFFmallocExt(tif, (tmsize_t)count * 2);
+            if (u->data == NULL)
+                return 0;
+            for (i = 0; i < (v[1] != NULL ? 3 : 1); i++)
+                _TIFFmemcpy((uint16_t *)u->data + i * n, v[i], n * 2);
+            u->fv.value = u->data;
+            u->fv.count = u->e.count = count;
+            u->hasvalue = 1;
+            return 1;
+        }
+        default:
+        {
+            const void *v = NULL;
+            if (fip->field_bit != FIELD_CUSTOM && tag == TIFFTAG_INKNAMES)
+            {
+                if (!setFieldsVGet(tif, tag, &v))
+                    return 0;
+                count = td->td_inknameslen;
+            }
+            else if (TIFFFieldSetGetCountSize(fip) == 2)
+            {
+                uint16_t count16 = 0;
+                if (!setFieldsVGet(tif, tag, &count16, &v))
+                    return 0;
+                count = count16;
+            }
+            else if (TIFFFieldSetGetCountSize(fip) == 4)
+            {
+                if (!setFieldsVGet(tif, tag, &count, &v))
+                    return 0;
+            }
+            else
+            {
+                if (!setFieldsVGet(tif, tag, &v))
+                    return 0;
+                if (fip->field_bit != FIELD_CUSTOM)
+                    count = fip->field_readcount == TIFF_SPP
+                                ? td->td_samplesperpixel
+                                : (uint32_t)fip->field_readcount;
+            }
+            p = v;
+            break;
+        }
+    }
+    /* values that do not exist, the field being unset */
+    if (p == NULL && (count > 0 || u->e.dsttype == TIFF_ASCII))
+        return 1;
+    if (p != (const void *)&u->scalar && count > 0)
+    {
+        size = (tmsize_t)count * TIFFDataWidth(u->e.dsttype);
+        u->data = _TIFFmallocExt(tif, 2 * size);
+        if (u->data == NULL)
+            return 0;
+        _TIFFmemcpy(u->data, p, size);
+        p = u->data;
+    }
+    u->fv.value = p == (const void *)&u->scalar ? (const void *)&u->scalar
+                                                : u->data;
+    u->fv.count = u->e.count = count;
+    u->hasvalue = 1;
+    return 1;
+}
+
+/*
+ * Save the values of a field from its member of the directory, before it is
+ * set through the tag methods.
+ */
+static void setFieldsSaveMember(TIFF *tif, const TIFFSetFieldsEntry *e,
+                                TIFFSetFieldsUndo *u)
+{
+    u->fv.tag = e->fv->tag;
+    u->fv.type = e->dsttype;
+    u->fv.count = e->count;
+    u->fv.value = &u->scalar;
+    u->e.fv = &u->fv;
+    u->e.fip = e->fip;
+    u->e.count = e->count;
+    u->e.dsttype = e->dsttype;
+    u->e.core = NULL;
+    u->set = TIFFFieldSet(tif, e->fip->field_bit);
+    u->hasvalue = 1;
+    u->data = NULL;
+    u->core = NULL;
+    memcpy(&u->scalar, e->core, e->coresize);
+}
+
+/*
+ * Save the values of a field, then store its new ones directly in the
+ * member of the directory.
+ */
+static void setFieldsStoreCore(TIFF *tif, const TIFFSetFieldsEntry *e,
+                               TIFFSetFieldsUndo *u)
+{
+    u->e.fip = e->fip;
+    u->e.coresize = e->coresize;
+    u->set = TIFFFieldSet(tif, e->fip->field_bit);
+    u->hasvalue = 0;
+    u->data = NULL;
+    u->core = e->core;
+    if (e->coresize == 2)
+    {
+        memcpy(&u->scalar, e->core, 2);
+        memcpy(e->core, &e->value, 2);
+    }
+    else
+    {
+        memcpy(&u->scalar, e->core, 4);
+        memcpy(e->core, &e->value, 4);
+    }
+    TIFFSetFieldBit(tif, e->fip->field_bit);
+    tif->tif_flags |= TIFF_DIRTYDIRECT;
+}
+
+/*
+ * Set a field back to its saved values, and release them.
+ */
+static void setFieldsRestore(TIFF *tif, TIFFSetFieldsUndo *u)
+{
+    const TIFFField *fip = u->e.fip;
+
+    if (u->core != NULL)
+        _TIFFmemcpy(u->core, &u->scalar, u->e.coresize);
+    else if (u->hasvalue)
+    {
+        char *scratch = (char *)u->data;
+        if (scratch != NULL)
+            scratch += (tmsize_t)u->e.count * TIFFDataWidth(u->e.dsttype);
+        setFieldsThroughMethods(tif, &u->e, scratch);
+    }
+    if (!u->set)
+    {
+        if (fip->field_bit == FIELD_CUSTOM)
+            TIFFUnsetField(tif, fip->field_tag);
+        else
+            TIFFClrFieldBit(tif, fip->field_bit);
+    }
+    _TIFFfreeExt(tif, u->data);
+    u->data = NULL;
+}
+
+/*
+ * Save the settings of the codec of tif before its compression scheme is
+ * changed, to undo *nundo.  tif may still know the fields of the codecs it
+ * used before, whose values cannot be read any more, so only the fields
+ * merged by the init of the current codec are saved.
+ */
+static int setFieldsSaveCodec(TIFF *tif, TIFFSetFieldsUndo *undo,
+                              uint32_t *nundo)
+{
+    const TIFFFieldArray *base = _TIFFGetFields();
+    int i;
+    uint32_t j;
+
+    if (tif->tif_ncodecfields > TIFF_MAX_CODEC_FIELDS)
+    {
+        TIFFErrorExtR(tif, "TIFFSetFields",
+                      "%s: Cannot save the settings of the codec",
+                      tif->tif_name);
+        return 0;
+    }
+    for (i = 0; i < tif->tif_ncodecfields; i++)
+    {
+        const TIFFFieldArray *fa = &tif->tif_codecfields[i];
+
+        for (j = 0; j < fa->count; j++)
+        {
+            const TIFFField *fip = &fa->fields[j];
+
+            if (setGetElementType(fip) == TIFF_NOTYPE)
+                continue;
+            fip = TIFFFindField(tif, fip->field_tag, TIFF_ANY);
+            if (fip == NULL ||
+                (fip >= base->fields && fip < base->fields + base->count))
+                continue;
+            if (!setFieldsSave(tif, fip, &undo[*nundo]))
+            {
+                _TIFFfreeExt(tif, undo[*nundo].data);
+                return 0;
+            }
+            (*nundo)++;
+        }
+    }
+    return 1;
+}
+
+/*
+ * State of the directory while the fields of a batch are checked, for the
+ * fields whose number of values depends on other fields.
+ */
+typedef struct
+{
+    uint32_t bitspersample;
+    uint32_t samplesperpixel;
+    uint32_t extrasamples;
+    int persample;
+} TIFFSetFieldsState;
+
+/*
+ * Check a field of a batch given its definition, and update the state.
+ */
+static int checkSetFieldsEntry(TIFF *tif, TIFFSetFieldsEntry *e,
+                               const TIFFField *fip, TIFFSetFieldsState *st)
+{
+    static const char module[] = "TIFFSetFields";
+    const TIFFFieldValue *fv = e->fv;
+    TIFFDataType srctype = setFieldsSourceType(fv->type);
+    int countsize, direct;
+    uint32_t expected = 0;
+
+    if (!OkToChangeField(tif, fv->tag, fip))
+        return 0;
+    e->fip = fip;
+    e->dsttype = setGetElementType(fip);
+    if (fip->field_bit == FIELD_IGNORE || e->dsttype == TIFF_NOTYPE)
+    {
+        TIFFErrorExtR(tif, module,
+                      "%s: Tag \"%s\" cannot be set with TIFFSetFields",
+                      tif->tif_name, fip->field_name);
+        return 0;
+    }
+    if (srctype == TIFF_NOTYPE ||
+        (srctype == TIFF_ASCII) != (e->dsttype == TIFF_ASCII) ||
+        (isFloatType(srctype) && !isFloatType(e->dsttype)))
+    {
+        TIFFErrorExtR(tif, module,
+                      "%s: Values of type %d given for tag \"%s\" of type %d",
+                      tif->tif_name, (int)fv->type, fip->field_name,
+                      (int)fip->field_type);
+        return 0;
+    }
+    if (fv->count > 0 && fv->value == NULL)
+    {
+        TIFFErrorExtR(tif, module, "%s: NULL value for tag \"%s\"",
+                      tif->tif_name, fip->field_name);
+        return 0;
+    }
+
+    /* One value, or a pair, held in a member of the directory */
+    e->core = setFieldsCoreMember(tif, fip, &e->coresize, &direct);
+    if (e->core != NULL)
+    {
+        expected = fip->set_get_field_type == TIFF_SETGET_UINT16_PAIR ? 2 : 1;
+        if (fv->count != expected)
+            goto badcount;
+        if (srctype == e->dsttype)
+            memcpy(&e->value, fv->value, e->coresize == 2 ? 2 : 4);
+        else if (!convertSetFieldsValues(tif, e, &e->value))
+            return 0;
+        if (direct)
+        {
+            e->store = SETFIELDS_CORE;
+            return checkSetFieldsCore(tif, e);
+        }
+        if (fip->field_bit == FIELD_BITSPERSAMPLE)
+            st->bitspersample = e->value.u16[0];
+        else if (fip->field_bit == FIELD_SAMPLESPERPIXEL)
+            st->samplesperpixel = e->value.u16[0];
+        return 1;
+    }
+
+    /* Number of values expected, 0 if given by the caller */
+    countsize = TIFFFieldSetGetCountSize(fip);
+    if (countsize == 2 && fv->count > 0xFFFF)
+        expected = 0xFFFF;
+    else if (countsize != 0)
+        expected = 0;
+    else if (fip->set_get_field_type == TIFF_SETGET_ASCII)
+    {
+        const char *s = (const char *)fv->value;
+        const char *nul = s ? (const char *)memchr(s, '\0', fv->count) : NULL;
+        if (nul == NULL)
+        {
+            TIFFErrorExtR(tif, module,
+                          "%s: Value of tag \"%s\" is not null-terminated",
+                          tif->tif_name, fip->field_name);
+            return 0;
+        }
+        /* Same as the strlen() done by TIFFSetField() */
+        e->count = (uint32_t)(nul - s) + 1;
+    }
+    else if (fip->set_get_field_type == TIFF_SETGET_OTHER)
+    {
+        if (st->bitspersample > 16)
+            expected = 0xFFFFFFFFU;
+        else if (fv->tag == TIFFTAG_TRANSFERFUNCTION &&
+                 st->samplesperpixel - st->extrasamples <= 1)
+            expected = 1U << st->bitspersample;
+        else
+            expected = 3U << st->bitspersample;
+    }
+    else if (fip->set_get_field_type == TIFF_SETGET_UINT16_PAIR)
+        expected = 2;
+    else if (fip->set_get_field_type < TIFF_SETGET_C0_ASCII)
+    {
+        if (fip->field_bit != FIELD_CUSTOM &&
+            (fv->tag == TIFFTAG_SMINSAMPLEVALUE ||
+             fv->tag == TIFFTAG_SMAXSAMPLEVALUE) &&
+            st->persample)
+            expected = st->samplesperpixel;
+        else
+            expected = 1;
+    }
+    else if (fip->field_writecount == TIFF_SPP)
+        expected = st->samplesperpixel;
+    else if (fip->field_writecount > 0)
+        expected = (uint32_t)fip->field_writecount;
+    else
+        expected = 1;
+    if (expected != 0 && fv->count != expected)
+        goto badcount;
+    if (_TIFFMultiplySSize(tif, e->count, TIFFDataWidth(e->dsttype),
+                           module) == 0 &&
+        e->count > 0)
+        return 0;
+
+    if (isDirectCustomField(tif, fip))
+        e->store = SETFIELDS_CUSTOM;
+    if (!convertSetFieldsValues(tif, e, NULL))
+        return 0;
+
+    if (fip->field_bit == FIELD_BITSPERSAMPLE ||
+        fip->field_bit == FIELD_SAMPLESPERPIXEL ||
+        fv->tag == TIFFTAG_PERSAMPLE)
+    {
+        uint16_t v16 = 0;
+        convertSetFieldsValues(tif, e, &v16);
+        if (fip->field_bit == FIELD_BITSPERSAMPLE)
+            st->bitspersample = v16;
+        else if (fip->field_bit == FIELD_SAMPLESPERPIXEL)
+            st->samplesperpixel = v16;
+        else
+            st->persample = v16 == PERSAMPLE_MULTI;
+    }
+    else if (fip->field_bit == FIELD_EXTRASAMPLES &&
+             fv->tag == TIFFTAG_EXTRASAMPLES)
+        st->extrasamples = fv->count;
+    return 1;
+badcount:
+    TIFFErrorExtR(tif, module,
+                  "%s: Wrong number of values %" PRIu32 " for tag \"%s\"",
+                  tif->tif_name, fv->count, fip->field_name);
+    return 0;
+}
+
+/*
+ * Record the values of several fields at once.  All the values are checked
+ * before any field is set, and the fields are handled by increasing tag
+ * number, so that values depending on other fields (e.g. ColorMap on
+ * BitsPerSample) may be given in any order.  The compression scheme is set
+ * first, then the other fields, the ones of one value or a pair only
+ * checked by _TIFFVSetField() being stored directly, and the values of
+ * custom fields last, in a single block of memory freed with the last of
+ * them.  If a field cannot be set, the fields already set are set back to
+ * their previous values, as are the compression scheme and the settings of
+ * its codec, so that a batch is set entirely or not at all.
+ */
+int TIFFSetFields(TIFF *tif, const TIFFFieldValue *values, uint32_t n)
+{
+    static const char module[] = "TIFFSetFields";
+    TIFFDirectory *td = &tif->tif_dir;
+    TIFFSetFieldsEntry localentries[SETFIELDS_LOCAL];
+    TIFFSetFieldsUndo localundo[SETFIELDS_LOCAL];
+    uint64_t localscratch[4];
+    TIFFSetFieldsEntry *entries = localentries;
+    TIFFSetFieldsUndo *undo = localundo;
+    void *scratch = localscratch;
+    TIFFSetFieldsState st;
+    TIFFValueArena *arena = NULL;
+    tmsize_t scratchsize = 0, arenasize = 0, arenaoff;
+    const uint32_t flags = TIFF_ISTILED | TIFF_DIRTYDIRECT;
+    const uint32_t savedflags = tif->tif_flags & flags;
+    uint32_t i, ncustom = 0, nnew = 0, nundo = 0, firstundo = 0;
+    size_t ifield;
+
+    if (n == 0)
+        return 1;
+    if (values == NULL)
+    {
+        TIFFErrorExtR(tif, module, "%s: NULL array of values", tif->tif_name);
+        return 0;
+    }
+    if (n > SETFIELDS_LOCAL)
+    {
+        entries = (TIFFSetFieldsEntry *)_TIFFCheckMalloc(
+            tif, n, sizeof(TIFFSetFieldsEntry), module);
+        undo = (TIFFSetFieldsUndo *)_TIFFCheckMalloc(
+            tif, n, sizeof(TIFFSetFieldsUndo), module);
+        if (entries == NULL || undo == NULL)
+            goto bad;
+    }
+    for (i = 0; i < n; i++)
+    {
+        entries[i].fv = &values[i];
+        entries[i].fip = NULL;
+        entries[i].index = i;
+        entries[i].count = values[i].count;
+        entries[i].dsttype = TIFF_NOTYPE;
+        entries[i].store = SETFIELDS_METHODS;
+        entries[i].custom = -1;
+    }
+    if (n <= 64)
+    {
+        /* Batches are small and often mostly sorted already */
+        for (i = 1; i < n; i++)
+        {
+            TIFFSetFieldsEntry e;
+            uint32_t j = i;
+            if (entries[i - 1].fv->tag <= entries[i].fv->tag)
+                continue;
+            e = entries[i];
+            while (j > 0 && entries[j - 1].fv->tag > e.fv->tag)
+            {
+                entries[j] = entries[j - 1];
+                j--;
+            }
+            entries[j] = e;
+        }
+    }
+    else
+        qsort(entries, n, sizeof(TIFFSetFieldsEntry), setFieldsCompare);
+    for (i = 1; i < n; i++)
+    {
+        if (entries[i - 1].fv->tag == entries[i].fv->tag)
+        {
+            TIFFErrorExtR(tif, module, "%s: Tag %" PRIu32 " given twice",
+                          tif->tif_name, entries[i].fv->tag);
+            goto bad;
+        }
+    }
+
+    st.bitspersample = td->td_bitspersample;
+    st.samplesperpixel = td->td_samplesperpixel;
+    st.extrasamples = td->td_extrasamples;
+    st.persample = (tif->tif_flags & TIFF_PERSAMPLE) != 0;
+
+    /*
+     * The compression scheme determines the fields known to the codec,
+     * such as its pseudo-tags, so it is set before the others are checked.
+     * If it changes, it is saved first, followed by the settings of the
+     * previous codec, so that they are set back in this order.
+     */
+    for (i = 0; i < n && entries[i].fv->tag <= TIFFTAG_COMPRESSION; i++)
+    {
+        TIFFSetFieldsEntry *e = &entries[i];
+        const TIFFField *fip;
+        uint64_t scratch;
+        uint16_t compression = 0;
+
+        if (e->fv->tag != TIFFTAG_COMPRESSION)
+            continue;
+        fip = TIFFFindField(tif, TIFFTAG_COMPRESSION, TIFF_ANY);
+        if (fip == NULL || fip->field_bit != FIELD_COMPRESSION)
+            break;
+        if (!checkSetFieldsEntry(tif, e, fip, &st))
+            goto bad;
+        convertSetFieldsValues(tif, e, &compression);
+        if (!TIFFFieldSet(tif, FIELD_COMPRESSION) ||
+            td->td_compression != compression)
+        {
+            const int savecodec = TIFFFieldSet(tif, FIELD_COMPRESSION) &&
+                                  td->td_compression != COMPRESSION_NONE;
+            if (savecodec)
+            {
+                /* Nothing is saved yet, so the log is replaced */
+                uint32_t nsaved = n;
+                int j;
+                for (j = 0; j < tif->tif_ncodecfields &&
+                            j < TIFF_MAX_CODEC_FIELDS;
+                     j++)
+                    nsaved += tif->tif_codecfields[j].count;
+                if (undo != localundo)
+                    _TIFFfreeExt(tif, undo);
+                undo = (TIFFSetFieldsUndo *)_TIFFCheckMalloc(
+                    tif, nsaved, sizeof(TIFFSetFieldsUndo), module);
+                if (undo == NULL)
+                    goto bad;
+            }
+            undo[0].data = NULL;
+            nundo = 1;
+            if ((savecodec && !setFieldsSaveCodec(tif, undo, &nundo)) ||
+                !setFieldsSave(tif, fip, &undo[0]))
+                goto bad;
+            firstundo = nundo;
+        }
+        if (!setFieldsThroughMethods(tif, e, &scratch))
+            goto rollback;
+        e->fip = NULL; /* done */
+    }
+
+    /*
+     * Check everything else.  As the field definitions are sorted by tag
+     * too, each one is searched after the previous one, close to it in
+     * batches of consecutive fields: the search range is doubled until it
+     * holds the field.
+     */
+    for (i = 0, ifield = 0; i < n; i++)
+    {
+        TIFFSetFieldsEntry *e = &entries[i];
+        const TIFFField *fip;
+        size_t hi, step = 1;
+        tmsize_t size;
+
+        if (e->dsttype != TIFF_NOTYPE)
+            continue; /* Compression, already set */
+        while (ifield + step < tif->tif_nfields &&
+               tif->tif_fields[ifield + step]->field_tag < e->fv->tag)
+            step *= 2;
+        hi = ifield + step < tif->tif_nfields ? ifield + step
+                                              : tif->tif_nfields;
+        ifield += step / 2;
+        while (ifield < hi)
+        {
+            size_t mid = ifield + (hi - ifield) / 2;
+            if (tif->tif_fields[mid]->field_tag < e->fv->tag)
+                ifield = mid + 1;
+            else
+                hi = mid;
+        }
+        if (ifield < tif->tif_nfields &&
+            tif->tif_fields[ifield]->field_tag == e->fv->tag)
+            fip = tif->tif_fields[ifield];
+        else
+            fip = TIFFFindField(tif, e->fv->tag, TIFF_ANY);
+        if (!checkSetFieldsEntry(tif, e, fip, &st))
+            goto rollback;
+        if (e->core != NULL)
+            continue;
+
+        size = (tmsize_t)e->count * TIFFDataWidth(e->dsttype);
+        if (e->store == SETFIELDS_CUSTOM)
+        {
+            arenasize += (tmsize_t)TIFFroundup_64((uint64_t)size, 8);
+            ncustom++;
+        }
+        else if (e->store == SETFIELDS_METHODS && setFieldsNeedsCopy(e) &&
+                 size > scratchsize)
+            scratchsize = size;
+    }
+
+    /*
+     * Allocate the memory needed: the scratch buffer for conversions, if
+     * the local one is too small, and a new arena for the values of custom
+     * fields.
+     */
+    if (scratchsize > (tmsize_t)sizeof(localscratch))
+    {
+        scratch = _TIFFCheckMalloc(tif, 1, scratchsize, module);
+        if (scratch == NULL)
+            goto rollback;
+    }
+    if (arenasize > 0)
+    {
+        arena = (TIFFValueArena *)_TIFFCheckMalloc(
+            tif, 1, VALUE_ARENA_HEADER_SIZE + arenasize, "custom tag values");
+        if (arena == NULL)
+            goto rollback;
+        arena->size = arenasize;
+        arena->nvalues = 0;
+    }
+
+    /*
+     * Set the fields of the directory, saving the previous values first.
+     * The ones handled by the tag methods may still reject their values.
+     */
+    for (i = 0; i < n; i++)
+    {
+        const TIFFSetFieldsEntry *e = &entries[i];
+
+        if (e->store == SETFIELDS_CUSTOM || e->fip == NULL)
+            continue;
+        if (e->store == SETFIELDS_CORE)
+        {
+            setFieldsStoreCore(tif, e, &undo[nundo++]);
+            continue;
+        }
+        /* Spare the tag methods another lookup of the field */
+        tif->tif_foundfield = e->fip;
+        if (e->core != NULL)
+            setFieldsSaveMember(tif, e, &undo[nundo]);
+        else if (!setFieldsSave(tif, e->fip, &undo[nundo]))
+        {
+            _TIFFfreeExt(tif, undo[nundo].data);
+            goto rollback;
+        }
+        nundo++;
+        if (!setFieldsThroughMethods(tif, e, scratch))
+            goto rollback;
+    }
+
+    /*
+     * Then store the custom values, which cannot fail once the list of
+     * custom values is grown.
+     */
+    for (i = 0; ncustom > 0 && i < n; i++)
+    {
+        TIFFSetFieldsEntry *e = &entries[i];
+        int iCustom;
+
+        if (e->store != SETFIELDS_CUSTOM)
+            continue;
+        for (iCustom = 0; iCustom < td->td_customValueCount; iCustom++)
+        {
+            if (td->td_customValues[iCustom].info->field_tag == e->fv->tag)
+            {
+                e->custom = iCustom;
+                break;
+            }
+        }
+        if (e->custom < 0)
+            nnew++;
+    }
+    if (nnew > 0)
+    {
+        TIFFTagValue *new_customValues = (TIFFTagValue *)_TIFFreallocExt(
+            tif, td->td_customValues,
+            sizeof(TIFFTagValue) * (td->td_customValueCount + nnew));
+        if (new_customValues == NULL)
+        {
+            TIFFErrorExtR(tif, module,
+                          "%s: Failed to allocate space for list of custom "
+                          "values",
+                          tif->tif_name);
+            goto rollback;
+        }
+        td->td_customValues = new_customValues;
+    }
+    if (arena != NULL)
+    {
+        arena->next = td->td_customValueArenas;
+        td->td_customValueArenas = arena;
+    }
+    arenaoff = VALUE_ARENA_HEADER_SIZE;
+    for (i = 0; ncustom > 0 && i < n; i++)
+    {
+        const TIFFSetFieldsEntry *e = &entries[i];
+        TIFFTagValue *tv;
+
+        if (e->store != SETFIELDS_CUSTOM)
+            continue;
+        if (e->custom >= 0)
+        {
+            tv = td->td_customValues + e->custom;
+            freeCustomValue(tif, tv->value);
+        }
+        else
+            tv = td->td_customValues + td->td_customValueCount++;
+        tv->info = e->fip;
+        tv->count = (int)e->count;
+        tv->value = NULL;
+        if (e->count > 0)
+        {
+            tv->value = (char *)arena + arenaoff;
+            arena->nvalues++;
+            convertSetFieldsValues(tif, e, tv->value);
+            arenaoff += (tmsize_t)TIFFroundup_64(
+                (uint64_t)e->count * TIFFDataWidth(e->dsttype), 8);
+        }
+        TIFFSetFieldBit(tif, FIELD_CUSTOM);
+        tif->tif_flags |= TIFF_DIRTYDIRECT;
+    }
+
+    for (i = 0; i < nundo; i++)
+    {
+        if (undo[i].data != NULL)
+            _TIFFfreeExt(tif, undo[i].data);
+    }
+    if (undo != localundo)
+        _TIFFfreeExt(tif, undo);
+    if (entries != localentries)
+        _TIFFfreeExt(tif, entries);
+    if (scratch != localscratch)
+        _TIFFfreeExt(tif, scratch);
+    return 1;
+
+rollback:
+    /*
+     * The fields of the batch in the reverse order they were set, as some
+     * of them share a field bit.  The fields of the new codec, if the
+     * compression scheme was changed, go away with it.  Then the
+     * compression scheme and the settings of the previous codec, in the
+     * order they were saved.
+     */
+    for (i = nundo; i-- > firstundo;)
+    {
+        int codecfield = undo[i].e.fip->field_bit == FIELD_PSEUDO ||
+                         undo[i].e.fip->field_bit >= FIELD_CUSTOM;
+        if (firstundo > 0 && codecfield)
+            _TIFFfreeExt(tif, undo[i].data);
+        else
+            setFieldsRestore(tif, &undo[i]);
+    }
+    for (i = 0; i < firstundo; i++)
+        setFieldsRestore(tif, &undo[i]);
+    nundo = 0;
+    tif->tif_flags = (tif->tif_flags & ~flags) | savedflags;
+    _TIFFfreeExt(tif, arena);
+bad:
+    for (i = 0; i < nundo; i++)
+        _TIFFfreeExt(tif, undo[i].data);
+    if (undo != localundo)
+        _TIFFfreeExt(tif, undo);
+    if (entries != localentries)
+        _TIFFfreeExt(tif, entries);
+    if (scratch != localscratch)
+        _TIFFfreeExt(tif, scratch);
+    return 0;
+}
+
 static int _TIFFVGetField(TIFF *tif, uint32_t tag, va_list ap)
 {
     TIFFDirectory *td = &tif->tif_dir;
@@ -1417,6 +2948,11 @@ static int _TIFFVGetField(TIFF *tif, uint32_t tag, va_list ap)
         case TIFFTAG_NUMBEROFINKS:
             *va_arg(ap, uint16_t *) = td->td_numberofinks;
             break;
+        case TIFFTAG_STOREDFALLBACK:
+            *va_arg(ap, uint16_t *) = (tif->tif_flags & TIFF_STOREDFALLBACK)
+                                          ? STOREDFALLBACK_AUTO
+                                          : STOREDFALLBACK_NONE;
+            break;
         default:
         {
             int i;
@@ -1643,13 +3179,11 @@ void TIFFFreeDirectory(TIFF *tif)
 
     /* Cleanup custom tag values */
     for (i = 0; i < td->td_customValueCount; i++)
-    {
-        if (td->td_customValues[i].value)
-            _TIFFfreeExt(tif, td->td_customValues[i].value);
-    }
+        freeCustomValue(tif, td->td_customValues[i].value);
 
     td->td_customValueCount = 0;
     CleanupField(td_customValues);
+    assert(td->td_customValueArenas == NULL);
 
     _TIFFmemset(&(td->td_stripoffset_entry), 0, sizeof(TIFFDirEntry));
     _TIFFmemset(&(td->td_stripbytecount_entry), 0, sizeof(TIFFDirEntry));
@@ -1664,6 +3198,9 @@ void TIFFFreeDirectory(TIFF *tif)
         tif->tif_dir.td_dirdatasize_Noffsets = 0;
     }
     tif->tif_dir.td_iswrittentofile = FALSE;
+
+    /* Everything the directory allocated from the arena is released now */
+    _TIFFArenaReset(tif);
 }
 #undef CleanupField
 
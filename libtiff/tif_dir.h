@@ -39,6 +39,18 @@ typedef struct
     void *value;
 } TIFFTagValue;
 
+/*
+ * Block of memory holding the values of several custom fields set at once
+ * by TIFFSetFields().  The values follow the header, and the block is freed
+ * when none of them is used anymore.
+ */
+typedef struct _TIFFValueArena
+{
+    struct _TIFFValueArena *next;
+    tmsize_t size;    /* size of the values */
+    uint32_t nvalues; /* number of values still in use */
+} TIFFValueArena;
+
 /*
  * TIFF Image File Directories are comprised of a table of field
  * descriptors of the form shown below.  The table is sorted in
@@ -141,6 +153,7 @@ typedef struct
 
     int td_customValueCount;
     TIFFTagValue *td_customValues;
+    TIFFValueArena *td_customValueArenas; /* see TIFFSetFields() */
 
     unsigned char
         td_deferstrilearraywriting; /* see TIFFDeferStrileArrayWriting() */
@@ -242,6 +242,7 @@ static const TIFFField tiffFields[] = {
     {TIFFTAG_CURRENTICCPROFILE, -1, -1, TIFF_UNDEFINED, 0, TIFF_SETGET_C16_UINT8,  FIELD_CUSTOM, 1, 1, "CurrentICCProfile", NULL},
     {TIFFTAG_CURRENTPREPROFILEMATRIX, -1, -1, TIFF_SRATIONAL, 0, TIFF_SETGET_C16_FLOAT,  FIELD_CUSTOM, 1, 1, "CurrentPreProfileMatrix", NULL},
     {TIFFTAG_PERSAMPLE, 0, 0, TIFF_SHORT, 0, TIFF_SETGET_UNDEFINED,  FIELD_PSEUDO, TRUE, FALSE, "PerSample", NULL},
+    {TIFFTAG_STOREDFALLBACK, 0, 0, TIFF_SHORT, 0, TIFF_SETGET_UNDEFINED,  FIELD_PSEUDO, TRUE, FALSE, "StoredFallback", NULL},
 #if 0
     /* begin DNG 1.2.0.0 tags */
     {TIFFTAG_COLORIMETRICREFERENCE, 1, 1, TIFF_SHORT, 0, TIFF_SETGET_UINT16,  FIELD_CUSTOM, 1, 0, "ColorimetricReference", NULL},
@@ -630,9 +631,12 @@ int _TIFFMergeFields(TIFF *tif, const TIFFField info[], uint32_t n)
     static const char reason[] = "for fields array";
     /* TIFFField** tp; */
     uint32_t i;
+    /* the fields array outlives the directory being read, if any */
+    const int arena_active = tif->tif_arena_active;
 
     tif->tif_foundfield = NULL;
 
+    tif->tif_arena_active = 0;
     if (tif->tif_fields && tif->tif_nfields > 0)
     {
         tif->tif_fields = (TIFFField **)_TIFFCheckRealloc(
@@ -644,6 +648,7 @@ int _TIFFMergeFields(TIFF *tif, const TIFFField info[], uint32_t n)
         tif->tif_fields =
             (TIFFField **)_TIFFCheckMalloc(tif, n, sizeof(TIFFField *), reason);
     }
+    tif->tif_arena_active = arena_active;
     if (!tif->tif_fields)
     {
         tif->tif_nfields = 0;
@@ -667,6 +672,20 @@ int _TIFFMergeFields(TIFF *tif, const TIFFField info[], uint32_t n)
     /* Sort the field info by tag number */
     qsort(tif->tif_fields, tif->tif_nfields, sizeof(TIFFField *), tagCompare);
 
+    /* Fields of the codec being set up by TIFFSetCompressionScheme() */
+    if (tif->tif_incodecinit)
+    {
+        if (tif->tif_ncodecfields < TIFF_MAX_CODEC_FIELDS)
+        {
+            TIFFFieldArray *fa = &tif->tif_codecfields[tif->tif_ncodecfields];
+            fa->type = tfiatOther;
+            fa->allocated_size = 0;
+            fa->count = n;
+            fa->fields = (TIFFField *)info;
+        }
+        tif->tif_ncodecfields++;
+    }
+
     return n;
 }
 
@@ -956,11 +975,20 @@ TIFFField *_TIFFCreateAnonField(TIFF *tif, uint32_t tag,
                                 TIFFDataType field_type)
 {
     TIFFField *fld;
-    (void)tif;
+    char *field_name_buf;
+    /* the field outlives the directory being read, if any */
+    const int arena_active = tif->tif_arena_active;
 
+    tif->tif_arena_active = 0;
     fld = (TIFFField *)_TIFFmallocExt(tif, sizeof(TIFFField));
-    if (fld == NULL)
+    field_name_buf = (char *)_TIFFmallocExt(tif, 32);
+    tif->tif_arena_active = arena_active;
+    if (fld == NULL || field_name_buf == NULL)
+    {
+        _TIFFfreeExt(tif, fld);
+        _TIFFfreeExt(tif, field_name_buf);
         return NULL;
+    }
     _TIFFmemset(fld, 0, sizeof(TIFFField));
 
     fld->field_tag = tag;
@@ -1018,12 +1046,6 @@ TIFFField *_TIFFCreateAnonField(TIFF *tif, uint32_t tag,
     fld->field_bit = FIELD_CUSTOM;
     fld->field_oktochange = TRUE;
     fld->field_passcount = TRUE;
-    char *field_name_buf = (char *)_TIFFmallocExt(tif, 32);
-    if (field_name_buf == NULL)
-    {
-        _TIFFfreeExt(tif, fld);
-        return NULL;
-    }
     fld->field_subfields = NULL;
 
     /*
@@ -4243,7 +4243,7 @@ static void CalcFinalIFDdatasizeReading(TIFF *tif, uint16_t dircount)
     {
         /* Check for IFD data ends at EOF. Then IFD can always be safely
          * overwritten. */
-        offset = TIFFSeekFile(tif, 0, SEEK_END);
+        offset = _TIFFGetLogicalEOF(tif);
         if (offset == IFDendoffset)
         {
             tif->tif_dir.td_dirdatasize_read = UINT64_MAX;
@@ -4351,6 +4351,7 @@ int TIFFReadDirectory(TIFF *tif)
     /* free any old stuff and reinit */
     TIFFFreeDirectory(tif);
     TIFFDefaultDirectory(tif);
+    tif->tif_arena_active = tif->tif_arena_chunk_size > 0;
 
     /* After setup a fresh directory indicate that now active IFD is also
      * present on file, even if its entries could not be read successfully
@@ -5212,7 +5213,7 @@ int TIFFReadDirectory(TIFF *tif)
     if (!tif->tif_scanlinesize)
     {
         TIFFErrorExtR(tif, module, "Cannot handle zero scanline size");
-        return (0);
+        goto bad;
     }
 
     if (isTiled(tif))
@@ -5221,7 +5222,7 @@ int TIFFReadDirectory(TIFF *tif)
         if (!tif->tif_tilesize)
         {
             TIFFErrorExtR(tif, module, "Cannot handle zero tile size");
-            return (0);
+            goto bad;
         }
     }
     else
@@ -5229,11 +5230,13 @@ int TIFFReadDirectory(TIFF *tif)
         if (!TIFFStripSize(tif))
         {
             TIFFErrorExtR(tif, module, "Cannot handle zero strip size");
-            return (0);
+            goto bad;
         }
     }
+    tif->tif_arena_active = 0;
     return (1);
 bad:
+    tif->tif_arena_active = 0;
     if (dir)
         _TIFFfreeExt(tif, dir);
     return (0);
@@ -5364,6 +5367,7 @@ int TIFFReadCustomDirectory(TIFF *tif, toff_t diroff,
      */
     TIFFDefaultDirectory(tif);
     _TIFFSetupFields(tif, infoarray);
+    tif->tif_arena_active = tif->tif_arena_chunk_size > 0;
 
     /* Allocate arrays for offset values outside IFD entry for IFD data size
      * checking. Note: Counter are reset within TIFFFreeDirectory(). */
@@ -5375,6 +5379,7 @@ int TIFFReadCustomDirectory(TIFF *tif, toff_t diroff,
         TIFFErrorExtR(
             tif, module,
             "Failed to allocate memory for counting IFD data size at reading");
+        tif->tif_arena_active = 0;
         if (dir)
             _TIFFfreeExt(tif, dir);
         return 0;
@@ -5486,6 +5491,7 @@ int TIFFReadCustomDirectory(TIFF *tif, toff_t diroff,
 
     /* To be able to return from SubIFD or custom-IFD to main-IFD */
     tif->tif_setdirectory_force_absolute = TRUE;
+    tif->tif_arena_active = 0;
     if (dir)
         _TIFFfreeExt(tif, dir);
     return 1;
@@ -42,6 +42,9 @@ extern void TIFFCvtNativeToIEEEFloat(TIFF *tif, uint32_t n, float *fp);
 extern void TIFFCvtNativeToIEEEDouble(TIFF *tif, uint32_t n, double *dp);
 #endif
 
+/* Largest IFD data serialized in memory before being written */
+#define TIFF_DIRBUF_MAX (64 * 1024)
+
 static int TIFFWriteDirectorySec(TIFF *tif, int isimage, int imagedone,
                                  uint64_t *pdiroff);
 
@@ -226,6 +229,8 @@ static int TIFFWriteDirectoryTagData(TIFF *tif, uint32_t *ndir,
                                      TIFFDirEntry *dir, uint16_t tag,
                                      uint16_t datatype, uint32_t count,
                                      uint32_t datalength, void *data);
+static int TIFFWriteDirectoryBuffer(TIFF *tif, uint64_t off, const void *data,
+                                    uint32_t datalength);
 
 static int TIFFLinkDirectory(TIFF *);
 
@@ -296,7 +301,7 @@ int TIFFCheckpointDirectory(TIFF *tif)
     if (tif->tif_dir.td_stripoffset_p == NULL)
         (void)TIFFSetupStrips(tif);
     rc = TIFFWriteDirectorySec(tif, TRUE, FALSE, NULL);
-    (void)TIFFSetWriteOffset(tif, TIFFSeekFile(tif, 0, SEEK_END));
+    (void)TIFFSetWriteOffset(tif, _TIFFGetLogicalEOF(tif));
     return rc;
 }
 
@@ -1190,7 +1195,7 @@ static int TIFFWriteDirectorySec(TIFF *tif, int isimage, int imagedone,
             {
                 /* Append at end of file and increment to an even offset. */
                 tif->tif_diroff =
-                    (TIFFSeekFile(tif, 0, SEEK_END) + 1) & (~((toff_t)1));
+                    (_TIFFGetLogicalEOF(tif) + 1) & (~((toff_t)1));
             }
         }
         /* Return IFD offset */
@@ -1215,6 +1220,33 @@ static int TIFFWriteDirectorySec(TIFF *tif, int isimage, int imagedone,
         }
         if (tif->tif_dataoff & 1)
             tif->tif_dataoff++;
+        /* The IFD and the data following it are serialized into memory by
+         * the second pass and written to the file at once, up to
+         * TIFF_DIRBUF_MAX bytes. Larger data is written directly, as is
+         * all the data when memory limits are set in the open options.
+         */
+        tif->tif_dirbufsize = (tmsize_t)dirsize;
+        if (tif->tif_max_single_mem_alloc == 0 &&
+            tif->tif_max_cumulated_mem_alloc == 0 &&
+            tif->tif_dir.td_dirdatasize_write > (uint64_t)dirsize)
+        {
+            if (tif->tif_dir.td_dirdatasize_write > TIFF_DIRBUF_MAX)
+                tif->tif_dirbufsize = TIFF_DIRBUF_MAX;
+            else
+                tif->tif_dirbufsize =
+                    (tmsize_t)tif->tif_dir.td_dirdatasize_write;
+            if (tif->tif_dirbufsize < (tmsize_t)dirsize)
+                tif->tif_dirbufsize = (tmsize_t)dirsize;
+        }
+        tif->tif_dirbuf =
+            (uint8_t *)_TIFFcallocExt(tif, 1, tif->tif_dirbufsize);
+        if (tif->tif_dirbuf == NULL)
+        {
+            TIFFErrorExtR(tif, module, "Out of memory");
+            goto bad;
+        }
+        tif->tif_dirbufcc = (tmsize_t)dirsize;
+        tif->tif_dirbufifd = (tmsize_t)dirsize;
     } /* while() */
     if (isimage)
     {
@@ -1241,14 +1273,9 @@ static int TIFFWriteDirectorySec(TIFF *tif, int isimage, int imagedone,
                 tif->tif_subifdoff = tif->tif_diroff + 8 + na * 20 + 12;
         }
     }
-    /* Copy/swab IFD entries from "dir" into "dirmem",
-     * which is then written to file. */
-    dirmem = _TIFFmallocExt(tif, dirsize);
-    if (dirmem == NULL)
-    {
-        TIFFErrorExtR(tif, module, "Out of memory");
-        goto bad;
-    }
+    /* Copy/swab IFD entries from "dir" into "dirmem", the start of
+     * tif_dirbuf, which is then written to file with the IFD data. */
+    dirmem = tif->tif_dirbuf;
     if (!(tif->tif_flags & TIFF_BIGTIFF))
     {
         uint8_t *n;
@@ -1326,12 +1353,15 @@ static int TIFFWriteDirectorySec(TIFF *tif, int isimage, int imagedone,
                       "IO error writing directory at seek to offset");
         goto bad;
     }
-    if (!WriteOK(tif, dirmem, (tmsize_t)dirsize))
+    if (!WriteOK(tif, dirmem, tif->tif_dirbufcc))
     {
         TIFFErrorExtR(tif, module, "IO error writing directory");
         goto bad;
     }
-    _TIFFfreeExt(tif, dirmem);
+    _TIFFExtendLogicalEOF(tif, tif->tif_diroff + tif->tif_dirbufcc);
+    _TIFFfreeExt(tif, tif->tif_dirbuf);
+    tif->tif_dirbuf = NULL;
+    dirmem = NULL;
 
     /* Increment tif_curdir if IFD wasn't already written to file and no error
      * occurred during IFD writing above. */
@@ -1412,8 +1442,11 @@ static int TIFFWriteDirectorySec(TIFF *tif, int isimage, int imagedone,
 bad:
     if (dir != NULL)
         _TIFFfreeExt(tif, dir);
-    if (dirmem != NULL)
-        _TIFFfreeExt(tif, dirmem);
+    if (tif->tif_dirbuf != NULL)
+    {
+        _TIFFfreeExt(tif, tif->tif_dirbuf);
+        tif->tif_dirbuf = NULL;
+    }
     return (0);
 }
 
@@ -3093,11 +3126,6 @@ static int TIFFWriteDirectoryTagData(TIFF *tif, uint32_t *ndir,
             TIFFErrorExtR(tif, module, "Maximum TIFF file size exceeded");
             return (0);
         }
-        if (!SeekOK(tif, na))
-        {
-            TIFFErrorExtR(tif, module, "IO error writing tag data");
-            return (0);
-        }
         if (datalength >= 0x80000000UL)
         {
             TIFFErrorExtR(tif, module,
@@ -3105,11 +3133,8 @@ static int TIFFWriteDirectoryTagData(TIFF *tif, uint32_t *ndir,
                           "bytes in a tag");
             return (0);
         }
-        if (!WriteOK(tif, data, (tmsize_t)datalength))
-        {
-            TIFFErrorExtR(tif, module, "IO error writing tag data");
+        if (!TIFFWriteDirectoryBuffer(tif, na, data, datalength))
             return (0);
-        }
         tif->tif_dataoff = nb;
         if (tif->tif_dataoff & 1)
             tif->tif_dataoff++;
@@ -3132,6 +3157,48 @@ static int TIFFWriteDirectoryTagData(TIFF *tif, uint32_t *ndir,
     return (1);
 }
 
+/*
+ * Put datalength bytes of IFD data, that go at file offset off, in the
+ * directory being serialized in tif_dirbuf.  Once some data does not fit,
+ * the data buffered so far and all the data that follows are written to the
+ * file directly.
+ */
+static int TIFFWriteDirectoryBuffer(TIFF *tif, uint64_t off, const void *data,
+                                    uint32_t datalength)
+{
+    static const char module[] = "TIFFWriteDirectoryBuffer";
+    uint64_t pos = off - tif->tif_diroff;
+
+    if (pos + datalength > (uint64_t)tif->tif_dirbufsize)
+    {
+        if (tif->tif_dirbufcc > tif->tif_dirbufifd)
+        {
+            if (!SeekOK(tif, tif->tif_diroff + tif->tif_dirbufifd) ||
+                !WriteOK(tif, tif->tif_dirbuf + tif->tif_dirbufifd,
+                         tif->tif_dirbufcc - tif->tif_dirbufifd))
+            {
+                TIFFErrorExtR(tif, module, "IO error writing tag data");
+                return (0);
+            }
+            _TIFFExtendLogicalEOF(tif, tif->tif_diroff + tif->tif_dirbufcc);
+        }
+        tif->tif_dirbufsize = tif->tif_dirbufifd;
+        tif->tif_dirbufcc = tif->tif_dirbufifd;
+        if (!SeekOK(tif, off) ||
+            !WriteOK(tif, (void *)data, (tmsize_t)datalength))
+        {
+            TIFFErrorExtR(tif, module, "IO error writing tag data");
+            return (0);
+        }
+        _TIFFExtendLogicalEOF(tif, off + datalength);
+        return (1);
+    }
+    _TIFFmemcpy(tif->tif_dirbuf + pos, data, datalength);
+    if (pos + datalength > (uint64_t)tif->tif_dirbufcc)
+        tif->tif_dirbufcc = (tmsize_t)(pos + datalength);
+    return (1);
+}
+
 /*
  * Link the current directory into the directory chain for the file.
  */
@@ -3139,7 +3206,7 @@ static int TIFFLinkDirectory(TIFF *tif)
 {
     static const char module[] = "TIFFLinkDirectory";
 
-    tif->tif_diroff = (TIFFSeekFile(tif, 0, SEEK_END) + 1) & (~((toff_t)1));
+    tif->tif_diroff = (_TIFFGetLogicalEOF(tif) + 1) & (~((toff_t)1));
 
     /*
      * Handle SubIFDs
@@ -3377,6 +3444,163 @@ static int TIFFLinkDirectory(TIFF *tif)
     return (1);
 }
 
+/*
+ * Trailer ending the file when TIFFOpenOptionsSetAppendTrailer() is
+ * enabled: a magic string, then the offset of the last main directory, the
+ * number of main directories and the offset of the trailer itself, as
+ * 64 bit values in the byte order of the file.  It lets a page be appended
+ * to a file opened again without walking the whole directory chain, and is
+ * only trusted while it ends the file: anything appended by other software
+ * makes it stale.
+ */
+#define APPEND_TRAILER_SIZE 32
+static const char append_trailer_magic[8] = {'L', 'T', 'I', 'F',
+                                             'F', 'E', 'N', 'D'};
+
+/*
+ * Look for a valid trailer at the end of a file opened for appending or
+ * updating, and start the next directory search from the directory it
+ * points to.  Data appended then overwrites the trailer, which is written
+ * again at the new end of file by TIFFFlush().  Returns 1 if a trailer was
+ * found.
+ */
+int _TIFFReadAppendTrailer(TIFF *tif)
+{
+    const int big = (tif->tif_flags & TIFF_BIGTIFF) != 0;
+    uint8_t buf[APPEND_TRAILER_SIZE];
+    uint64_t v[3], size, first, nextoff, next;
+    int i;
+
+    size = TIFFGetFileSize(tif);
+    if (size < tif->tif_header_size + (uint64_t)APPEND_TRAILER_SIZE ||
+        !SeekOK(tif, size - APPEND_TRAILER_SIZE) ||
+        !ReadOK(tif, buf, APPEND_TRAILER_SIZE) ||
+        memcmp(buf, append_trailer_magic, sizeof(append_trailer_magic)) != 0)
+        return 0;
+    for (i = 0; i < 3; i++)
+    {
+        memcpy(&v[i], buf + 8 + 8 * i, 8);
+        if (tif->tif_flags & TIFF_SWAB)
+            TIFFSwabLong8(&v[i]);
+    }
+
+    /* v[0]: last directory, v[1]: number of directories, v[2]: trailer */
+    first = big ? tif->tif_header.big.tiff_diroff
+                : tif->tif_header.classic.tiff_diroff;
+    if (v[2] != size - APPEND_TRAILER_SIZE || v[0] < tif->tif_header_size ||
+        v[0] >= v[2] || v[1] == 0 || v[1] > TIFF_MAX_DIR_COUNT ||
+        first == 0 || (v[1] == 1) != (v[0] == first))
+        return 0;
+
+    /* the directory must be the last one of the chain */
+    if (!big)
+    {
+        uint16_t dircount;
+        uint32_t next32;
+
+        if (!SeekOK(tif, v[0]) || !ReadOK(tif, &dircount, 2))
+            return 0;
+        if (tif->tif_flags & TIFF_SWAB)
+            TIFFSwabShort(&dircount);
+        nextoff = v[0] + 2 + (uint64_t)dircount * 12;
+        if (nextoff + 4 > v[2] || !SeekOK(tif, nextoff) ||
+            !ReadOK(tif, &next32, 4))
+            return 0;
+        next = next32;
+    }
+    else
+    {
+        uint64_t dircount64;
+
+        if (!SeekOK(tif, v[0]) || !ReadOK(tif, &dircount64, 8))
+            return 0;
+        if (tif->tif_flags & TIFF_SWAB)
+            TIFFSwabLong8(&dircount64);
+        if (dircount64 > 0xFFFF)
+            return 0;
+        nextoff = v[0] + 8 + dircount64 * 20;
+        if (nextoff + 8 > v[2] || !SeekOK(tif, nextoff) ||
+            !ReadOK(tif, &next, 8))
+            return 0;
+    }
+    if (next != 0)
+        return 0;
+
+    if (!_TIFFCheckDirNumberAndOffset(tif, (tdir_t)(v[1] - 1), v[0]))
+        return 0;
+    tif->tif_lastdiroff = v[0];
+    tif->tif_curdircount = (tdir_t)v[1];
+    tif->tif_append_trailer_off = v[2];
+    tif->tif_logical_eof = v[2];
+    return 1;
+}
+
+/*
+ * Return the end of the data of the file: its logical end, followed by the
+ * trailer if one was written there.
+ */
+uint64_t _TIFFGetDataEnd(TIFF *tif)
+{
+    uint64_t end = _TIFFGetLogicalEOF(tif);
+
+    if (tif->tif_append_trailer_off != 0 && tif->tif_append_trailer_off == end)
+        end += APPEND_TRAILER_SIZE;
+    return end;
+}
+
+/*
+ * Write the trailer at the end of the file, if enabled and the last main
+ * directory is known.  Otherwise a trailer read when opening the file is
+ * invalidated, if it still ends the file, as the directory chain may have
+ * changed.
+ */
+int _TIFFWriteAppendTrailer(TIFF *tif)
+{
+    static const char module[] = "_TIFFWriteAppendTrailer";
+    uint8_t buf[APPEND_TRAILER_SIZE];
+    uint64_t v[3];
+    int i;
+
+    if (!tif->tif_append_trailer || tif->tif_mode == O_RDONLY)
+        return 1;
+    v[0] = tif->tif_lastdiroff;
+    v[1] = tif->tif_curdircount;
+    v[2] = _TIFFGetLogicalEOF(tif);
+    if (v[0] == 0 || tif->tif_curdircount == TIFF_NON_EXISTENT_DIR_NUMBER ||
+        tif->tif_curdircount == 0)
+    {
+        if (tif->tif_append_trailer_off != 0 &&
+            tif->tif_append_trailer_off == v[2])
+        {
+            memset(buf, 0, sizeof(append_trailer_magic));
+            if (!_TIFFWriteAt(tif, v[2], buf, sizeof(append_trailer_magic)))
+            {
+                TIFFErrorExtR(tif, module, "Cannot invalidate trailer");
+                return 0;
+            }
+        }
+        tif->tif_append_trailer_off = 0;
+        return 1;
+    }
+
+    memcpy(buf, append_trailer_magic, sizeof(append_trailer_magic));
+    for (i = 0; i < 3; i++)
+    {
+        uint64_t w = v[i];
+        if (tif->tif_flags & TIFF_SWAB)
+            TIFFSwabLong8(&w);
+        memcpy(buf + 8 + 8 * i, &w, 8);
+    }
+    /* not allocated: data appended later overwrites it */
+    if (!_TIFFWriteAt(tif, v[2], buf, APPEND_TRAILER_SIZE))
+    {
+        TIFFErrorExtR(tif, module, "Cannot write trailer");
+        return 0;
+    }
+    tif->tif_append_trailer_off = v[2];
+    return 1;
+}
+
 /************************************************************************/
 /*                          TIFFRewriteField()                          */
 /*                                                                      */
@@ -3758,14 +3982,17 @@ int _TIFFRewriteField(TIFF *tif, uint16_t tag, TIFFDataType in_datatype,
     /* -------------------------------------------------------------------- */
     if (!value_in_entry)
     {
-        entry_offset = TIFFSeekFile(tif, 0, SEEK_END);
+        entry_offset = _TIFFGetLogicalEOF(tif);
 
-        if (!WriteOK(tif, buf_to_write, count * TIFFDataWidth(datatype)))
+        if (!_TIFFWriteAt(tif, entry_offset, buf_to_write,
+                          count * TIFFDataWidth(datatype)))
         {
             _TIFFfreeExt(tif, buf_to_write);
             TIFFErrorExtR(tif, module, "Error writing directory link");
             return (0);
         }
+        _TIFFExtendLogicalEOF(tif, entry_offset +
+                                       count * TIFFDataWidth(datatype));
     }
     else
     {
@@ -44,14 +44,14 @@ int TIFFFlush(TIFF *tif)
         !(tif->tif_flags & TIFF_DIRTYDIRECT) && tif->tif_mode == O_RDWR)
     {
         if (TIFFForceStrileArrayWriting(tif))
-            return 1;
+            return _TIFFWriteAppendTrailer(tif) && _TIFFFlushWriteBuffer(tif);
     }
 
     if ((tif->tif_flags & (TIFF_DIRTYDIRECT | TIFF_DIRTYSTRIP)) &&
         !TIFFRewriteDirectory(tif))
         return (0);
 
-    return (1);
+    return _TIFFWriteAppendTrailer(tif) && _TIFFFlushWriteBuffer(tif);
 }
 
 /*
@@ -31,15 +31,33 @@
 #include <limits.h>
 #include <stdio.h>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define YCBCR_USE_SSE2
+#define MAP_USE_SSE2
+#define FLOAT_USE_SSE2
+#endif
+
 static int gtTileContig(TIFFRGBAImage *, uint32_t *, uint32_t, uint32_t);
 static int gtTileSeparate(TIFFRGBAImage *, uint32_t *, uint32_t, uint32_t);
 static int gtStripContig(TIFFRGBAImage *, uint32_t *, uint32_t, uint32_t);
 static int gtStripSeparate(TIFFRGBAImage *, uint32_t *, uint32_t, uint32_t);
+static int gtTileContigExt(TIFFRGBAImage *, uint32_t *, uint32_t, uint32_t,
+                           int);
+static int gtTileSeparateExt(TIFFRGBAImage *, uint32_t *, uint32_t, uint32_t,
+                             int);
+static int gtStripContigExt(TIFFRGBAImage *, uint32_t *, uint32_t, uint32_t,
+                            int);
+static int gtStripSeparateExt(TIFFRGBAImage *, uint32_t *, uint32_t, uint32_t,
+                              int);
 static int PickContigCase(TIFFRGBAImage *);
 static int PickSeparateCase(TIFFRGBAImage *);
+static int PickTranspose(TIFFRGBAImage *);
 
 static int BuildMapUaToAa(TIFFRGBAImage *img);
 static int BuildMapBitdepth16To8(TIFFRGBAImage *img);
+static void TIFFRGBAContextLend(TIFFRGBAImage *img, TIFFRGBAContext *ctx);
+static void TIFFRGBAContextReturn(TIFFRGBAImage *img);
 
 static const char photoTag[] = "PhotometricInterpretation";
 
@@ -49,6 +67,107 @@ static const char photoTag[] = "PhotometricInterpretation";
 #define FLIP_VERTICALLY 0x01
 #define FLIP_HORIZONTALLY 0x02
 
+/*
+ * State of TIFFRGBA_FORMAT_TRANSPOSE: the pixel at column x and row y of
+ * the image, in file order, goes to origin + x * rowstep + y * colstep in
+ * the raster.
+ */
+typedef struct _TIFFRGBATranspose
+{
+    /* put routine picked for the image, writing into buf */
+    union
+    {
+        void (*any)(TIFFRGBAImage *);
+        tileContigRoutine contig;
+        tileSeparateRoutine separate;
+    } put;
+    uint8_t *buf;     /* pixels of a strip/tile, in the output format */
+    tmsize_t bufsize; /* size of buf in bytes */
+    uint8_t *origin;
+    tmsize_t rowstep; /* bytes between rows of the raster */
+    tmsize_t colstep; /* bytes between columns of the raster */
+} TIFFRGBATranspose;
+
+/*
+ * Conversion context: the tables built by TIFFRGBAImageBeginContext() are
+ * given back to the context by TIFFRGBAImageEnd() and lent to the next
+ * image begun with it, if they were built for the same photometric
+ * parameters.  These are gathered in a key, and the colormap of palette
+ * images is compared to a copy kept by the context.  The 8-bit alpha and
+ * 16 to 8 bit tables, which are the same for all images, are always lent.
+ */
+typedef struct
+{
+    uint16_t photometric;
+    uint16_t bitspersample;
+    int cielabbits;         /* size of the CIE L*a*b* LUT, see CIELabLUTBits */
+    float luma[3];          /* YCbCrCoefficients */
+    float refblackwhite[6]; /* ReferenceBlackWhite */
+    float whitepoint[2];
+} TIFFRGBAContextKey;
+
+struct _TIFFRGBAContext
+{
+    int lent;  /* the tables are used by an image */
+    int valid; /* the tables are complete and match key */
+    TIFFRGBAContextKey key;
+    uint16_t *cmap; /* red, green and blue colormaps of a palette key */
+    TIFFRGBValue *Map;
+    uint32_t **BWmap;
+    uint32_t **PALmap;
+    TIFFYCbCrToRGB *ycbcr;
+    TIFFCIELabToRGB *cielab;
+    uint8_t *UaToAa;
+    uint8_t *Bitdepth16To8;
+};
+
+/*
+ * Size in bytes of a pixel of the raster in the output format.
+ */
+static inline size_t rgbaPixelSize(const TIFFRGBAImage *img)
+{
+    switch (img->format & TIFFRGBA_FORMAT_MASK)
+    {
+        case TIFFRGBA_FORMAT_RGB8:
+            return 3;
+        case TIFFRGBA_FORMAT_RGBA16:
+            return 4 * sizeof(uint16_t);
+        case TIFFRGBA_FORMAT_RGBAF32:
+            return 4 * sizeof(float);
+        default:
+            return sizeof(uint32_t);
+    }
+}
+
+/*
+ * Address of the pixel at offset off (in pixels) of the raster.
+ */
+static inline uint32_t *rgbaPixelAt(const TIFFRGBAImage *img,
+                                    uint32_t *raster, tmsize_t off)
+{
+    return (uint32_t *)(void *)((uint8_t *)raster +
+                                (size_t)off * rgbaPixelSize(img));
+}
+
+/*
+ * Size in bytes of a sample of the image, counted as 1 for samples of less
+ * than 8 bits.
+ */
+static inline tmsize_t rgbaSampleSize(const TIFFRGBAImage *img)
+{
+    return img->bitspersample > 8 ? img->bitspersample / 8 : 1;
+}
+
+/*
+ * Handle whose allocator the conversion tables are allocated with: none
+ * for the tables of a TIFFRGBAContext, which outlive the images, and thus
+ * the files, they are used for.
+ */
+static inline TIFF *rgbaTableOwner(const TIFFRGBAImage *img)
+{
+    return img->context != NULL ? NULL : img->tif;
+}
+
 #define EMSG_BUF_SIZE 1024
 
 /*
@@ -75,16 +194,17 @@ static const TIFFDisplay display_sRGB = {
 };
 
 /*
- * Check the image to see if TIFFReadRGBAImage can deal with it.
- * 1/0 is returned according to whether or not the image can
- * be handled.  If 0 is returned, emsg contains the reason
- * why it is being rejected.
+ * Check the image to see if TIFFReadRGBAImage can deal with it in the
+ * given output format: floating-point samples can only be read in
+ * TIFFRGBA_FORMAT_RGBAF32.
  */
-int TIFFRGBAImageOK(TIFF *tif, char emsg[EMSG_BUF_SIZE])
+static int RGBAImageOK(TIFF *tif, int format, char emsg[EMSG_BUF_SIZE])
 {
     TIFFDirectory *td = &tif->tif_dir;
     uint16_t photometric;
     int colorchannels;
+    int floatformat =
+        (format & TIFFRGBA_FORMAT_MASK) == TIFFRGBA_FORMAT_RGBAF32;
 
     if (!tif->tif_decodestatus)
     {
@@ -100,6 +220,10 @@ int TIFFRGBAImageOK(TIFF *tif, char emsg[EMSG_BUF_SIZE])
         case 8:
         case 16:
             break;
+        case 32:
+            if (floatformat && td->td_sampleformat == SAMPLEFORMAT_IEEEFP)
+                break;
+            /* fall through */
         default:
             snprintf(emsg, EMSG_BUF_SIZE,
                      "Sorry, can not handle images with %" PRIu16
@@ -107,7 +231,8 @@ int TIFFRGBAImageOK(TIFF *tif, char emsg[EMSG_BUF_SIZE])
                      td->td_bitspersample);
             return (0);
     }
-    if (td->td_sampleformat == SAMPLEFORMAT_IEEEFP)
+    if (td->td_sampleformat == SAMPLEFORMAT_IEEEFP &&
+        (!floatformat || td->td_bitspersample < 16))
     {
         snprintf(
             emsg, EMSG_BUF_SIZE,
@@ -247,11 +372,35 @@ int TIFFRGBAImageOK(TIFF *tif, char emsg[EMSG_BUF_SIZE])
                      photometric);
             return (0);
     }
+    if (td->td_sampleformat == SAMPLEFORMAT_IEEEFP &&
+        photometric != PHOTOMETRIC_MINISWHITE &&
+        photometric != PHOTOMETRIC_MINISBLACK &&
+        photometric != PHOTOMETRIC_RGB)
+    {
+        snprintf(emsg, EMSG_BUF_SIZE,
+                 "Sorry, can not handle IEEE floating-point samples with "
+                 "%s=%" PRIu16,
+                 photoTag, photometric);
+        return (0);
+    }
     return (1);
 }
 
+/*
+ * Check the image to see if TIFFReadRGBAImage can deal with it.
+ * 1/0 is returned according to whether or not the image can
+ * be handled.  If 0 is returned, emsg contains the reason
+ * why it is being rejected.
+ */
+int TIFFRGBAImageOK(TIFF *tif, char emsg[EMSG_BUF_SIZE])
+{
+    return RGBAImageOK(tif, TIFFRGBA_FORMAT_ABGR32, emsg);
+}
+
 void TIFFRGBAImageEnd(TIFFRGBAImage *img)
 {
+    if (img->context)
+        TIFFRGBAContextReturn(img);
     if (img->Map)
     {
         _TIFFfreeExt(img->tif, img->Map);
@@ -287,6 +436,18 @@ void TIFFRGBAImageEnd(TIFFRGBAImage *img)
         _TIFFfreeExt(img->tif, img->Bitdepth16To8);
         img->Bitdepth16To8 = NULL;
     }
+    if (img->formatbuf)
+    {
+        _TIFFfreeExt(img->tif, img->formatbuf);
+        img->formatbuf = NULL;
+        img->formatbufsize = 0;
+    }
+    if (img->transpose)
+    {
+        _TIFFfreeExt(img->tif, img->transpose->buf);
+        _TIFFfreeExt(img->tif, img->transpose);
+        img->transpose = NULL;
+    }
 
     if (img->redcmap)
     {
@@ -309,6 +470,40 @@ static int isCCITTCompression(TIFF *tif)
 
 int TIFFRGBAImageBegin(TIFFRGBAImage *img, TIFF *tif, int stop,
                        char emsg[EMSG_BUF_SIZE])
+{
+    return TIFFRGBAImageBeginFormat(img, tif, stop, TIFFRGBA_FORMAT_ABGR32,
+                                    emsg);
+}
+
+static int RGBAImageBegin(TIFFRGBAImage *img, TIFF *tif, int stop,
+                          int format, TIFFRGBAContext *ctx,
+                          char emsg[EMSG_BUF_SIZE]);
+
+/*
+ * Same as TIFFRGBAImageBegin(), with the raster of TIFFRGBAImageGet() in
+ * one of the TIFFRGBA_FORMAT_* pixel formats.
+ */
+int TIFFRGBAImageBeginFormat(TIFFRGBAImage *img, TIFF *tif, int stop,
+                             int format, char emsg[EMSG_BUF_SIZE])
+{
+    return RGBAImageBegin(img, tif, stop, format, NULL, emsg);
+}
+
+/*
+ * Same as TIFFRGBAImageBeginFormat(), taking the conversion tables from
+ * ctx if they were built for the same photometric parameters, and leaving
+ * them to it at TIFFRGBAImageEnd().
+ */
+int TIFFRGBAImageBeginContext(TIFFRGBAImage *img, TIFF *tif, int stop,
+                              int format, TIFFRGBAContext *ctx,
+                              char emsg[EMSG_BUF_SIZE])
+{
+    return RGBAImageBegin(img, tif, stop, format, ctx, emsg);
+}
+
+static int RGBAImageBegin(TIFFRGBAImage *img, TIFF *tif, int stop,
+                          int format, TIFFRGBAContext *ctx,
+                          char emsg[EMSG_BUF_SIZE])
 {
     uint16_t *sampleinfo;
     uint16_t extrasamples;
@@ -316,9 +511,10 @@ int TIFFRGBAImageBegin(TIFFRGBAImage *img, TIFF *tif, int stop,
     uint16_t compress;
     int colorchannels;
     uint16_t *red_orig, *green_orig, *blue_orig;
+    uint16_t sampleformat;
     int n_color;
 
-    if (!TIFFRGBAImageOK(tif, emsg))
+    if (!RGBAImageOK(tif, format, emsg))
         return 0;
 
     /* Initialize to normal values */
@@ -334,8 +530,46 @@ int TIFFRGBAImageBegin(TIFFRGBAImage *img, TIFF *tif, int stop,
     img->cielab = NULL;
     img->UaToAa = NULL;
     img->Bitdepth16To8 = NULL;
+    img->formatput.any = NULL;
+    img->formatbuf = NULL;
+    img->formatbufsize = 0;
+    img->transpose = NULL;
+    img->context = NULL;
     img->req_orientation = ORIENTATION_BOTLEFT; /* It is the default */
 
+    switch (format & TIFFRGBA_FORMAT_MASK)
+    {
+        case TIFFRGBA_FORMAT_ABGR32:
+        case TIFFRGBA_FORMAT_RGBA8:
+        case TIFFRGBA_FORMAT_BGRA8:
+        case TIFFRGBA_FORMAT_RGB8:
+        case TIFFRGBA_FORMAT_RGBA16:
+        case TIFFRGBA_FORMAT_RGBAF32:
+            if ((format & ~(TIFFRGBA_FORMAT_MASK |
+                            TIFFRGBA_FORMAT_UNASSOCIATED |
+                            TIFFRGBA_FORMAT_TRANSPOSE |
+                            TIFFRGBA_FORMAT_CIELAB_LUT |
+                            TIFFRGBA_FORMAT_CIELAB_LUT_BITS_MASK)) == 0)
+                break;
+            /* fall through */
+        default:
+            snprintf(emsg, EMSG_BUF_SIZE, "Unknown output pixel format 0x%x",
+                     (unsigned int)format);
+            return 0;
+    }
+    /* grids of 2^1+1 to 2^6+1 points, only with the table conversion */
+    if ((format & TIFFRGBA_FORMAT_CIELAB_LUT_BITS_MASK) != 0 &&
+        (!(format & TIFFRGBA_FORMAT_CIELAB_LUT) ||
+         (format & TIFFRGBA_FORMAT_CIELAB_LUT_BITS_MASK) ==
+             TIFFRGBA_FORMAT_CIELAB_LUT_BITS(7)))
+    {
+        snprintf(emsg, EMSG_BUF_SIZE,
+                 "Invalid CIE L*a*b* table grid in output pixel format 0x%x",
+                 (unsigned int)format);
+        return 0;
+    }
+    img->format = format;
+
     img->tif = tif;
     img->stoponerr = stop;
     TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &img->bitspersample);
@@ -346,6 +580,7 @@ int TIFFRGBAImageBegin(TIFFRGBAImage *img, TIFF *tif, int stop,
         case 4:
         case 8:
         case 16:
+        case 32: /* floating-point samples, see RGBAImageOK() */
             break;
         default:
             snprintf(emsg, EMSG_BUF_SIZE,
@@ -388,6 +623,37 @@ int TIFFRGBAImageBegin(TIFFRGBAImage *img, TIFF *tif, int stop,
 #endif
 
     colorchannels = img->samplesperpixel - extrasamples;
+
+    /* Range of the color samples for TIFFRGBA_FORMAT_RGBAF32: that of the
+     * SMinSampleValue and SMaxSampleValue tags, else [0, 1] for floating
+     * point samples and the non-negative values of integer ones. */
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &sampleformat);
+    img->minsamplevalue = 0.0;
+    if (sampleformat == SAMPLEFORMAT_IEEEFP)
+        img->maxsamplevalue = 1.0;
+    else if (sampleformat == SAMPLEFORMAT_INT)
+        img->maxsamplevalue =
+            (double)(((uint64_t)1 << (img->bitspersample - 1)) - 1);
+    else
+        img->maxsamplevalue =
+            (double)(((uint64_t)1 << img->bitspersample) - 1);
+    if (TIFFFieldSet(tif, FIELD_SMINSAMPLEVALUE) &&
+        TIFFFieldSet(tif, FIELD_SMAXSAMPLEVALUE) && colorchannels > 0)
+    {
+        TIFFDirectory *td = &tif->tif_dir;
+        int i;
+
+        img->minsamplevalue = td->td_sminsamplevalue[0];
+        img->maxsamplevalue = td->td_smaxsamplevalue[0];
+        for (i = 1; i < colorchannels; i++)
+        {
+            img->minsamplevalue =
+                TIFFmin(img->minsamplevalue, td->td_sminsamplevalue[i]);
+            img->maxsamplevalue =
+                TIFFmax(img->maxsamplevalue, td->td_smaxsamplevalue[i]);
+        }
+    }
+
     TIFFGetFieldDefaulted(tif, TIFFTAG_COMPRESSION, &compress);
     TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planarconfig);
     if (!TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &img->photometric))
@@ -561,6 +827,8 @@ int TIFFRGBAImageBegin(TIFFRGBAImage *img, TIFF *tif, int stop,
     TIFFGetFieldDefaulted(tif, TIFFTAG_ORIENTATION, &img->orientation);
     img->isContig =
         !(planarconfig == PLANARCONFIG_SEPARATE && img->samplesperpixel > 1);
+    if (ctx != NULL)
+        TIFFRGBAContextLend(img, ctx);
     if (img->isContig)
     {
         if (!PickContigCase(img))
@@ -577,6 +845,15 @@ int TIFFRGBAImageBegin(TIFFRGBAImage *img, TIFF *tif, int stop,
             goto fail_return;
         }
     }
+    if ((img->format & TIFFRGBA_FORMAT_TRANSPOSE) &&
+        img->orientation >= ORIENTATION_LEFTTOP &&
+        img->orientation <= ORIENTATION_LEFTBOT && !PickTranspose(img))
+    {
+        snprintf(emsg, EMSG_BUF_SIZE, "Out of memory");
+        goto fail_return;
+    }
+    if (img->context != NULL)
+        img->context->valid = 1;
     return 1;
 
 fail_return:
@@ -584,8 +861,74 @@ fail_return:
     return 0;
 }
 
-int TIFFRGBAImageGet(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
-                     uint32_t h)
+/*
+ * Get a raster transposed by TIFFRGBA_FORMAT_TRANSPOSE: the image is read
+ * in file order, as a raster of h columns and w rows (cropped to the image
+ * if smaller), and putcontigtransposed/putseparatetransposed copy each
+ * strip/tile to its place in the w x h raster.
+ */
+static int gtTransposed(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
+                        uint32_t h)
+{
+    TIFFRGBATranspose *t = img->transpose;
+    tmsize_t ps = (tmsize_t)rgbaPixelSize(img);
+    tmsize_t rowsize = (tmsize_t)w * ps;
+    int colflip, rowflip;
+    uint32_t fw, fh; /* size of the image read, in file order */
+
+    if (img->row_offset < 0 || (uint32_t)img->row_offset >= img->height ||
+        img->col_offset < 0 || (uint32_t)img->col_offset >= img->width)
+    {
+        TIFFErrorExtR(img->tif, TIFFFileName(img->tif),
+                      "Error in TIFFRGBAImageGet: offset %d,%d exceeds "
+                      "image size %" PRIu32 "x%" PRIu32,
+                      img->col_offset, img->row_offset, img->width,
+                      img->height);
+        return 0;
+    }
+    fw = TIFFmin(h, img->width - (uint32_t)img->col_offset);
+    fh = TIFFmin(w, img->height - (uint32_t)img->row_offset);
+
+    /* the rows of the file are the columns of the display, and its first
+     * row is on the right for RightTop and RightBot, its first column at
+     * the bottom for RightBot and LeftBot */
+    colflip = img->orientation == ORIENTATION_RIGHTTOP ||
+              img->orientation == ORIENTATION_RIGHTBOT;
+    rowflip = img->orientation == ORIENTATION_RIGHTBOT ||
+              img->orientation == ORIENTATION_LEFTBOT;
+    switch (img->req_orientation)
+    {
+        case ORIENTATION_TOPRIGHT:
+        case ORIENTATION_RIGHTTOP:
+            colflip = !colflip;
+            break;
+        case ORIENTATION_BOTRIGHT:
+        case ORIENTATION_RIGHTBOT:
+            colflip = !colflip;
+            rowflip = !rowflip;
+            break;
+        case ORIENTATION_BOTLEFT:
+        case ORIENTATION_LEFTBOT:
+            rowflip = !rowflip;
+            break;
+        default:
+            break;
+    }
+
+    /* as for the other orientations, the image is put at the bottom of a
+     * raster taller than it */
+    t->origin = (uint8_t *)raster + (tmsize_t)(h - fw) * rowsize;
+    t->rowstep = rowflip ? -rowsize : rowsize;
+    t->colstep = colflip ? -ps : ps;
+    if (rowflip)
+        t->origin += (tmsize_t)(fw - 1) * rowsize;
+    if (colflip)
+        t->origin += (tmsize_t)(fh - 1) * ps;
+    return (*img->get)(img, raster, fw, fh);
+}
+
+static int TIFFRGBAImageGetThreads(TIFFRGBAImage *img, uint32_t *raster,
+                                   uint32_t w, uint32_t h, int nthreads)
 {
     if (img->get == NULL)
     {
@@ -600,6 +943,8 @@ int TIFFRGBAImageGet(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
             "No \"put\" routine setupl; probably can not handle image format");
         return (0);
     }
+    if (img->transpose != NULL)
+        return gtTransposed(img, raster, w, h);
     /* Verify raster height against image height.
      * Width is checked in img->get() function individually. */
     if (0 <= img->row_offset && (uint32_t)img->row_offset < img->height)
@@ -609,7 +954,7 @@ int TIFFRGBAImageGet(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
         {
             /* Adapt parameters to read only available lines and put image
              * at the bottom of the raster. */
-            raster += (size_t)(h - hx) * w;
+            raster = rgbaPixelAt(img, raster, (tmsize_t)(h - hx) * w);
             h = hx;
         }
     }
@@ -622,24 +967,50 @@ int TIFFRGBAImageGet(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
                       img->row_offset, img->height);
         return 0;
     }
+    if (nthreads != 1)
+    {
+        if (img->get == gtTileContig)
+            return gtTileContigExt(img, raster, w, h, nthreads);
+        if (img->get == gtTileSeparate)
+            return gtTileSeparateExt(img, raster, w, h, nthreads);
+        if (img->get == gtStripContig)
+            return gtStripContigExt(img, raster, w, h, nthreads);
+        if (img->get == gtStripSeparate)
+            return gtStripSeparateExt(img, raster, w, h, nthreads);
+    }
     return (*img->get)(img, raster, w, h);
 }
 
+int TIFFRGBAImageGet(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
+                     uint32_t h)
+{
+    return TIFFRGBAImageGetThreads(img, raster, w, h, 1);
+}
+
 /*
- * Read the specified image into an ABGR-format rastertaking in account
- * specified orientation.
+ * Same as TIFFRGBAImageGet(), with the strips/tiles decoded and converted
+ * by nthreads threads (the number of processors if nthreads <= 0).
  */
-int TIFFReadRGBAImageOriented(TIFF *tif, uint32_t rwidth, uint32_t rheight,
-                              uint32_t *raster, int orientation, int stop)
+int TIFFRGBAImageGetParallel(TIFFRGBAImage *img, uint32_t *raster,
+                             uint32_t w, uint32_t h, int nthreads)
+{
+    return TIFFRGBAImageGetThreads(img, raster, w, h, nthreads);
+}
+
+static int TIFFReadRGBAImageThreads(TIFF *tif, uint32_t rwidth,
+                                    uint32_t rheight, void *raster,
+                                    int orientation, int format, int stop,
+                                    int nthreads)
 {
     char emsg[EMSG_BUF_SIZE] = "";
     TIFFRGBAImage img;
     int ok;
 
-    if (TIFFRGBAImageBegin(&img, tif, stop, emsg))
+    if (TIFFRGBAImageBeginFormat(&img, tif, stop, format, emsg))
     {
         img.req_orientation = (uint16_t)orientation;
-        ok = TIFFRGBAImageGet(&img, raster, rwidth, rheight);
+        ok = TIFFRGBAImageGetThreads(&img, (uint32_t *)raster, rwidth, rheight,
+                                     nthreads);
         TIFFRGBAImageEnd(&img);
     }
     else
@@ -650,6 +1021,40 @@ int TIFFReadRGBAImageOriented(TIFF *tif, uint32_t rwidth, uint32_t rheight,
     return (ok);
 }
 
+/*
+ * Read the specified image into an ABGR-format rastertaking in account
+ * specified orientation.
+ */
+int TIFFReadRGBAImageOriented(TIFF *tif, uint32_t rwidth, uint32_t rheight,
+                              uint32_t *raster, int orientation, int stop)
+{
+    return TIFFReadRGBAImageThreads(tif, rwidth, rheight, raster, orientation,
+                                    TIFFRGBA_FORMAT_ABGR32, stop, 1);
+}
+
+/*
+ * Same as TIFFReadRGBAImageOriented(), using nthreads threads (the number
+ * of processors if nthreads <= 0).
+ */
+int TIFFReadRGBAImageParallel(TIFF *tif, uint32_t rwidth, uint32_t rheight,
+                              uint32_t *raster, int orientation, int stop,
+                              int nthreads)
+{
+    return TIFFReadRGBAImageThreads(tif, rwidth, rheight, raster, orientation,
+                                    TIFFRGBA_FORMAT_ABGR32, stop, nthreads);
+}
+
+/*
+ * Same as TIFFReadRGBAImageOriented(), into a raster of rwidth * rheight
+ * pixels in one of the TIFFRGBA_FORMAT_* pixel formats.
+ */
+int TIFFReadRGBAImageFormat(TIFF *tif, uint32_t rwidth, uint32_t rheight,
+                            void *raster, int orientation, int format, int stop)
+{
+    return TIFFReadRGBAImageThreads(tif, rwidth, rheight, raster, orientation,
+                                    format, stop, 1);
+}
+
 /*
  * Read the specified image into an ABGR-format raster. Use bottom left
  * origin for raster by default.
@@ -663,6 +1068,9 @@ int TIFFReadRGBAImage(TIFF *tif, uint32_t rwidth, uint32_t rheight,
 
 static int setorientation(TIFFRGBAImage *img)
 {
+    /* the put routine places the pixels of transposed rasters */
+    if (img->transpose != NULL)
+        return 0;
     switch (img->orientation)
     {
         case ORIENTATION_TOPLEFT:
@@ -723,80 +1131,490 @@ static int setorientation(TIFFRGBAImage *img)
 }
 
 /*
- * Get an tile-organized image that has
- *	PlanarConfiguration contiguous if SamplesPerPixel > 1
- * or
- *	SamplesPerPixel == 1
+ * Parallel decoding, for TIFFRGBAImageGetParallel().
+ *
+ * The calling thread reads the raw data of the strips/tiles, and a pool of
+ * worker threads decodes them and puts them into the raster.  Each worker
+ * decodes with TIFFReadFromUserBuffer() on a private handle opened on the
+ * same file and directory, so that codec states are never shared, and
+ * which does no I/O once set up.  The strips/tiles are put into disjoint
+ * parts of the raster; the horizontal flip, if any, is done once they are
+ * all complete.
  */
-static int gtTileContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
-                        uint32_t h)
+#define RGBA_MAX_PLANES 4
+
+typedef struct _TIFFRGBAWorkers TIFFRGBAWorkers;
+
+typedef struct
 {
-    TIFF *tif = img->tif;
-    tileContigRoutine put = img->put.contig;
-    uint32_t col, row, y, rowstoread;
-    tmsize_t pos;
-    uint32_t tw, th;
-    unsigned char *buf = NULL;
+    TIFFRGBAWorkers *workers;
+    int inuse;  /* submitted and not collected */
+    int status; /* 0: pending, 1: done, -1: failed */
+    uint32_t strile[RGBA_MAX_PLANES]; /* strip/tile of each plane */
+    uint8_t *raw[RGBA_MAX_PLANES];    /* their raw data */
+    tmsize_t rawsize[RGBA_MAX_PLANES];
+    tmsize_t rawalloc[RGBA_MAX_PLANES];
+    tmsize_t decodesize; /* # of bytes to decode per plane */
+    tmsize_t pos;        /* offset of the first pixel in a decoded plane */
+    uint32_t *raster;    /* arguments of the put routine */
+    uint32_t x, y, w, h;
     int32_t fromskew, toskew;
-    uint32_t nrow;
-    int ret = 1, flip;
-    uint32_t this_tw, tocol;
-    int32_t this_toskew, leftmost_toskew;
-    int32_t leftmost_fromskew;
-    uint32_t leftmost_tw;
-    tmsize_t bufsize;
+} TIFFRGBAJob;
 
-    /* If the raster is smaller than the image,
-     * or if there is a col_offset, adapt the samples to be copied per row. */
-    uint32_t wmin;
+struct _TIFFRGBAWorkers
+{
+    TIFFRGBAImage *img;
+    TIFFThreadPool *pool;
+    int nplanes;        /* # of sample planes decoded per strip/tile */
+    int colorchannels;  /* color planes, for separate planes */
+    tmsize_t planesize; /* size of a decoded plane */
+    TIFF **decoders;    /* per worker */
+    uint8_t **bufs;     /* per worker, nplanes decoded planes */
+    int nworkers;
+    TIFFRGBAJob *jobs; /* circular */
+    int njobs;
+    int next;
+    uint64_t filesize;
+    int error;
+};
 
-    if (0 <= img->col_offset && (uint32_t)img->col_offset < img->width)
-    {
-        wmin = TIFFmin(w, img->width - img->col_offset);
+static int _tiffRGBADecoderCloseProc(thandle_t fd)
+{
+    (void)fd;
+    return 0;
+}
+
+/*
+ * Open a private handle reading the current directory of tif.  It shares
+ * the client data of tif, but is only used for decoding once open.
+ */
+static TIFF *TIFFRGBAOpenDecoder(TIFF *tif)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    TIFF *dec;
+
+    if (opts == NULL)
+        return NULL;
+    TIFFOpenOptionsSetErrorHandlerExtR(opts, tif->tif_errorhandler,
+                                       tif->tif_errorhandler_user_data);
+    TIFFOpenOptionsSetWarningHandlerExtR(opts, tif->tif_warnhandler,
+                                         tif->tif_warnhandler_user_data);
+    TIFFOpenOptionsSetMaxSingleMemAlloc(opts, tif->tif_max_single_mem_alloc);
+    TIFFOpenOptionsSetAllocator(opts, tif->tif_mallocproc,
+                                tif->tif_reallocproc, tif->tif_freeproc,
+                                tif->tif_alloc_user_data);
+    /* header only, not mapped, same strip chopping; the header is read at
+     * the current position of the shared client handle */
+    if (!SeekOK(tif, 0))
+    {
+        TIFFOpenOptionsFree(opts);
+        return NULL;
     }
-    else
+    dec = TIFFClientOpenExt(
+        tif->tif_name, (tif->tif_flags & TIFF_STRIPCHOP) ? "rhmC" : "rhmc",
+        tif->tif_clientdata, tif->tif_readproc, tif->tif_writeproc,
+        tif->tif_seekproc, _tiffRGBADecoderCloseProc, tif->tif_sizeproc,
+        tif->tif_mapproc, tif->tif_unmapproc, opts);
+    TIFFOpenOptionsFree(opts);
+    if (dec == NULL)
+        return NULL;
+    if (!TIFFSetSubDirectory(dec, tif->tif_diroff))
     {
-        TIFFErrorExtR(tif, TIFFFileName(tif),
-                      "Error in gtTileContig: column offset %d exceeds "
-                      "image width %" PRIu32 "",
-                      img->col_offset, img->width);
-        return 0;
+        TIFFClose(dec);
+        return NULL;
     }
-    bufsize = TIFFTileSize(tif);
+    _TIFFCopyCodecFields(dec, tif);
+    return dec;
+}
+
+static void TIFFRGBAWorkersDestroy(TIFFRGBAWorkers *workers)
+{
+    TIFF *tif = workers->img->tif;
+    int i, j;
+
+    _TIFFThreadPoolDestroy(workers->pool);
+    for (i = 0; i < workers->nworkers; i++)
+    {
+        if (workers->decoders[i] != NULL)
+            TIFFClose(workers->decoders[i]);
+        _TIFFfreeExt(tif, workers->bufs[i]);
+    }
+    for (i = 0; i < workers->njobs; i++)
+        for (j = 0; j < RGBA_MAX_PLANES; j++)
+            _TIFFfreeExt(tif, workers->jobs[i].raw[j]);
+    _TIFFfreeExt(tif, workers->decoders);
+    _TIFFfreeExt(tif, workers->bufs);
+    _TIFFfreeExt(tif, workers->jobs);
+    _TIFFfreeExt(tif, workers);
+}
+
+/*
+ * Set up the decoding of nplanes planes of planesize bytes per strip/tile
+ * by nthreads threads.  Returns NULL if the image must be read by the
+ * calling thread alone.
+ */
+static TIFFRGBAWorkers *TIFFRGBAWorkersCreate(TIFFRGBAImage *img,
+                                              int nthreads, int nplanes,
+                                              int colorchannels,
+                                              tmsize_t planesize)
+{
+    TIFF *tif = img->tif;
+    TIFFRGBAWorkers *workers;
+    tmsize_t bufsize;
+    int i;
+
+    /* The decoders read the directory from the file, and the conversion to
+     * the output format of the packed ABGR pixels and the transposition
+     * use buffers of img */
+    if (nthreads == 1 || img->formatput.any != NULL ||
+        img->transpose != NULL ||
+        tif->tif_mode != O_RDONLY || tif->tif_diroff == 0 ||
+        (tif->tif_flags & TIFF_NOREADRAW) || nplanes > RGBA_MAX_PLANES)
+        return NULL;
+    bufsize = _TIFFMultiplySSize(tif, nplanes, planesize, "TIFFRGBAImageGet");
     if (bufsize == 0)
+        return NULL;
+    workers =
+        (TIFFRGBAWorkers *)_TIFFcallocExt(tif, 1, sizeof(TIFFRGBAWorkers));
+    if (workers == NULL)
+        return NULL;
+    workers->img = img;
+    workers->nplanes = nplanes;
+    workers->colorchannels = colorchannels;
+    workers->planesize = planesize;
+    workers->filesize = TIFFGetFileSize(tif);
+    workers->pool = _TIFFThreadPoolCreate(tif, nthreads);
+    if (workers->pool == NULL)
+    {
+        _TIFFfreeExt(tif, workers);
+        return NULL;
+    }
+    workers->nworkers = _TIFFThreadPoolSize(workers->pool);
+    workers->njobs = 2 * workers->nworkers;
+    workers->decoders =
+        (TIFF **)_TIFFcallocExt(tif, workers->nworkers, sizeof(TIFF *));
+    workers->bufs =
+        (uint8_t **)_TIFFcallocExt(tif, workers->nworkers, sizeof(uint8_t *));
+    workers->jobs = (TIFFRGBAJob *)_TIFFcallocExt(tif, workers->njobs,
+                                                  sizeof(TIFFRGBAJob));
+    if (workers->decoders == NULL || workers->bufs == NULL ||
+        workers->jobs == NULL)
+    {
+        workers->nworkers = 0;
+        workers->njobs = 0;
+        TIFFRGBAWorkersDestroy(workers);
+        return NULL;
+    }
+    for (i = 0; i < workers->nworkers; i++)
     {
-        TIFFErrorExtR(tif, TIFFFileName(tif), "%s", "No space for tile buffer");
-        return (0);
+        workers->decoders[i] = TIFFRGBAOpenDecoder(tif);
+        workers->bufs[i] = (uint8_t *)_TIFFmallocExt(tif, bufsize);
+        if (workers->decoders[i] == NULL || workers->bufs[i] == NULL)
+        {
+            TIFFRGBAWorkersDestroy(workers);
+            return NULL;
+        }
     }
+    for (i = 0; i < workers->njobs; i++)
+        workers->jobs[i].workers = workers;
+    return workers;
+}
 
-    TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tw);
-    TIFFGetField(tif, TIFFTAG_TILELENGTH, &th);
+static void TIFFRGBAWorkerRun(void *arg, int worker)
+{
+    TIFFRGBAJob *job = (TIFFRGBAJob *)arg;
+    TIFFRGBAWorkers *workers = job->workers;
+    TIFFRGBAImage *img = workers->img;
+    uint8_t *buf = workers->bufs[worker];
+    int i, ok = 1;
 
-    flip = setorientation(img);
-    if (flip & FLIP_VERTICALLY)
+    for (i = 0; i < workers->nplanes; i++)
     {
-        if (((int64_t)tw + w) > INT_MAX)
-        {
-            TIFFErrorExtR(tif, TIFFFileName(tif), "%s",
-                          "unsupported tile size (too wide)");
-            return (0);
-        }
-        y = h - 1;
-        toskew = -(int32_t)(tw + w);
+        if (!TIFFReadFromUserBuffer(workers->decoders[worker], job->strile[i],
+                                    job->raw[i], job->rawsize[i],
+                                    buf + i * workers->planesize,
+                                    job->decodesize))
+            ok = 0;
     }
-    else
+    if (ok || !img->stoponerr)
     {
-        if (tw > ((int64_t)INT_MAX + w))
+        if (img->isContig)
         {
-            TIFFErrorExtR(tif, TIFFFileName(tif), "%s",
-                          "unsupported tile size (too wide)");
-            return (0);
+            (*img->put.contig)(img, job->raster, job->x, job->y, job->w,
+                               job->h, job->fromskew, job->toskew,
+                               buf + job->pos);
+        }
+        else
+        {
+            /* same layout of the planes as in gtTileSeparate() */
+            uint8_t *p0 = buf + job->pos;
+            uint8_t *p1 = p0, *p2 = p0, *pa = NULL;
+            if (workers->colorchannels > 1)
+            {
+                p1 = p0 + workers->planesize;
+                p2 = p1 + workers->planesize;
+            }
+            if (img->alpha)
+                pa = p0 + workers->colorchannels * workers->planesize;
+            (*img->put.separate)(img, job->raster, job->x, job->y, job->w,
+                                 job->h, job->fromskew, job->toskew, p0, p1,
+                                 p2, pa);
         }
-        y = 0;
-        toskew = -(int32_t)(tw - w);
     }
+    _TIFFThreadPoolDone(workers->pool, &job->status, ok ? 1 : -1);
+}
 
-    if (tw == 0 || th == 0)
+/*
+ * Wait for a job, if it was submitted, and record its status.
+ */
+static void TIFFRGBAWorkersCollect(TIFFRGBAWorkers *workers, TIFFRGBAJob *job)
+{
+    if (job->inuse)
+    {
+        if (_TIFFThreadPoolWait(workers->pool, &job->status, 1) < 0 &&
+            workers->img->stoponerr)
+            workers->error = 1;
+        job->inuse = 0;
+    }
+}
+
+/*
+ * Read the raw data of the strips/tiles of the nplanes planes (of which
+ * decodesize bytes are to be decoded) and queue their decoding and the
+ * call of the put routine with the other arguments.
+ */
+static int TIFFRGBAWorkersQueue(TIFFRGBAWorkers *workers,
+                                const uint32_t *striles, tmsize_t decodesize,
+                                tmsize_t pos, uint32_t *raster, uint32_t x,
+                                uint32_t y, uint32_t w, uint32_t h,
+                                int32_t fromskew, int32_t toskew)
+{
+    static const char module[] = "TIFFRGBAImageGet";
+    TIFFRGBAJob *job = &workers->jobs[workers->next];
+    TIFFRGBAImage *img = workers->img;
+    TIFF *tif = img->tif;
+    int i;
+
+    workers->next = (workers->next + 1) % workers->njobs;
+    TIFFRGBAWorkersCollect(workers, job);
+    if (workers->error)
+        return 0;
+    if (!isTiled(tif))
+    {
+        /* the last strip may be shorter */
+        tmsize_t stripsize =
+            _TIFFReadEncodedStripGetStripSize(tif, striles[0], NULL);
+        if (stripsize == (tmsize_t)(-1))
+            return 0;
+        if (decodesize > stripsize)
+            decodesize = stripsize;
+    }
+    for (i = 0; i < workers->nplanes; i++)
+    {
+        uint64_t bytecount = TIFFGetStrileByteCount(tif, striles[i]);
+        tmsize_t cc;
+
+        if (bytecount > workers->filesize)
+        {
+            TIFFErrorExtR(tif, module,
+                          "Invalid strip/tile byte count %" PRIu64
+                          ", strip/tile %" PRIu32,
+                          bytecount, striles[i]);
+            if (img->stoponerr)
+                return 0;
+            bytecount = 0;
+        }
+        if (job->raw[i] == NULL || (uint64_t)job->rawalloc[i] < bytecount)
+        {
+            tmsize_t alloc = bytecount > 0 ? (tmsize_t)bytecount : 1;
+            uint8_t *raw = (uint8_t *)_TIFFreallocExt(tif, job->raw[i], alloc);
+            if (raw == NULL)
+            {
+                TIFFErrorExtR(tif, module, "Out of memory");
+                return 0;
+            }
+            job->raw[i] = raw;
+            job->rawalloc[i] = alloc;
+        }
+        cc = 0;
+        if (bytecount > 0)
+        {
+            cc = isTiled(tif) ? TIFFReadRawTile(tif, striles[i], job->raw[i],
+                                                (tmsize_t)bytecount)
+                              : TIFFReadRawStrip(tif, striles[i], job->raw[i],
+                                                 (tmsize_t)bytecount);
+            if (cc < 0)
+            {
+                if (img->stoponerr)
+                    return 0;
+                cc = 0;
+            }
+        }
+        job->strile[i] = striles[i];
+        job->rawsize[i] = cc;
+    }
+    job->decodesize = decodesize;
+    job->pos = pos;
+    job->raster = raster;
+    job->x = x;
+    job->y = y;
+    job->w = w;
+    job->h = h;
+    job->fromskew = fromskew;
+    job->toskew = toskew;
+    job->status = 0;
+    job->inuse = 1;
+    if (!_TIFFThreadPoolSubmit(workers->pool, TIFFRGBAWorkerRun, job))
+    {
+        job->inuse = 0;
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Wait for all the jobs and free the workers.  Returns 0 if one failed
+ * and the image stops on errors.
+ */
+static int TIFFRGBAWorkersFinish(TIFFRGBAWorkers *workers)
+{
+    int i, ok;
+
+    for (i = 0; i < workers->njobs; i++)
+        TIFFRGBAWorkersCollect(workers, &workers->jobs[i]);
+    ok = !workers->error;
+    TIFFRGBAWorkersDestroy(workers);
+    return ok;
+}
+
+/*
+ * Get an tile-organized image that has
+ *	PlanarConfiguration contiguous if SamplesPerPixel > 1
+ * or
+ *	SamplesPerPixel == 1
+ */
+static int gtTileContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
+                        uint32_t h)
+{
+    return gtTileContigExt(img, raster, w, h, 1);
+}
+
+/*
+ * Flip the h rows of w pixels of the raster horizontally.  Use wmin to only
+ * flip horizontally data in place and not complete raster-row.
+ */
+static void flipHorizontally(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
+                             uint32_t h, uint32_t wmin)
+{
+    size_t ps = rgbaPixelSize(img);
+    uint32_t line;
+
+    for (line = 0; line < h; line++)
+    {
+        if (ps == sizeof(uint32_t))
+        {
+            uint32_t *left = rgbaPixelAt(img, raster, (tmsize_t)line * w);
+            uint32_t *right = left + wmin - 1;
+
+            while (left < right)
+            {
+                uint32_t temp = *left;
+                *left = *right;
+                *right = temp;
+                left++;
+                right--;
+            }
+        }
+        else
+        {
+            uint8_t *left =
+                (uint8_t *)rgbaPixelAt(img, raster, (tmsize_t)line * w);
+            uint8_t *right = left + (size_t)(wmin - 1) * ps;
+            uint8_t temp[4 * sizeof(float)];
+
+            while (left < right)
+            {
+                memcpy(temp, left, ps);
+                memcpy(left, right, ps);
+                memcpy(right, temp, ps);
+                left += ps;
+                right -= ps;
+            }
+        }
+    }
+}
+
+static int gtTileContigExt(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
+                           uint32_t h, int nthreads)
+{
+    TIFF *tif = img->tif;
+    TIFFRGBAWorkers *workers;
+    tileContigRoutine put = img->put.contig;
+    uint32_t col, row, y, rowstoread;
+    tmsize_t pos;
+    uint32_t tw, th;
+    unsigned char *buf = NULL;
+    int32_t fromskew, toskew;
+    uint32_t nrow;
+    int ret = 1, flip;
+    uint32_t this_tw, tocol;
+    int32_t this_toskew, leftmost_toskew;
+    int32_t leftmost_fromskew;
+    uint32_t leftmost_tw;
+    tmsize_t bufsize;
+
+    /* If the raster is smaller than the image,
+     * or if there is a col_offset, adapt the samples to be copied per row. */
+    uint32_t wmin;
+
+    if (0 <= img->col_offset && (uint32_t)img->col_offset < img->width)
+    {
+        wmin = TIFFmin(w, img->width - img->col_offset);
+    }
+    else
+    {
+        TIFFErrorExtR(tif, TIFFFileName(tif),
+                      "Error in gtTileContig: column offset %d exceeds "
+                      "image width %" PRIu32 "",
+                      img->col_offset, img->width);
+        return 0;
+    }
+    bufsize = TIFFTileSize(tif);
+    if (bufsize == 0)
+    {
+        TIFFErrorExtR(tif, TIFFFileName(tif), "%s", "No space for tile buffer");
+        return (0);
+    }
+
+    TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tw);
+    TIFFGetField(tif, TIFFTAG_TILELENGTH, &th);
+
+    flip = setorientation(img);
+    if (flip & FLIP_VERTICALLY)
+    {
+        if (((int64_t)tw + w) > INT_MAX)
+        {
+            TIFFErrorExtR(tif, TIFFFileName(tif), "%s",
+                          "unsupported tile size (too wide)");
+            return (0);
+        }
+        y = h - 1;
+        toskew = -(int32_t)(tw + w);
+    }
+    else
+    {
+        if (tw > ((int64_t)INT_MAX + w))
+        {
+            TIFFErrorExtR(tif, TIFFFileName(tif), "%s",
+                          "unsupported tile size (too wide)");
+            return (0);
+        }
+        y = 0;
+        toskew = -(int32_t)(tw - w);
+    }
+
+    if (tw == 0 || th == 0)
     {
         TIFFErrorExtR(tif, TIFFFileName(tif), "tile width or height is zero");
         return (0);
@@ -815,6 +1633,7 @@ static int gtTileContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
         return (0);
     }
     leftmost_toskew = (int32_t)skew_i64;
+    workers = TIFFRGBAWorkersCreate(img, nthreads, 1, 1, bufsize);
     for (row = 0; ret != 0 && row < h; row += nrow)
     {
         rowstoread = th - (row + img->row_offset) % th;
@@ -827,7 +1646,8 @@ static int gtTileContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
         /* wmin: only write imagewidth if raster is bigger. */
         while (tocol < wmin)
         {
-            if (_TIFFReadTileAndAllocBuffer(tif, (void **)&buf, bufsize, col,
+            if (workers == NULL &&
+                _TIFFReadTileAndAllocBuffer(tif, (void **)&buf, bufsize, col,
                                             row + img->row_offset, 0,
                                             0) == (tmsize_t)(-1) &&
                 (buf == NULL || img->stoponerr))
@@ -836,7 +1656,8 @@ static int gtTileContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
                 break;
             }
             pos = ((row + img->row_offset) % th) * TIFFTileRowSize(tif) +
-                  ((tmsize_t)fromskew * img->samplesperpixel);
+                  ((tmsize_t)fromskew * img->samplesperpixel *
+                   rgbaSampleSize(img));
             if (tocol + this_tw > wmin)
             {
                 /*
@@ -846,9 +1667,22 @@ static int gtTileContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
                 this_tw = tw - fromskew;
                 this_toskew = toskew + fromskew;
             }
-            tmsize_t roffset = (tmsize_t)y * w + tocol;
-            (*put)(img, raster + roffset, tocol, y, this_tw, nrow, fromskew,
-                   this_toskew, buf + pos);
+            uint32_t *dst = rgbaPixelAt(img, raster, (tmsize_t)y * w + tocol);
+            if (workers != NULL)
+            {
+                uint32_t tile =
+                    TIFFComputeTile(tif, col, row + img->row_offset, 0, 0);
+                if (!TIFFRGBAWorkersQueue(workers, &tile, bufsize, pos, dst,
+                                          tocol, y, this_tw, nrow, fromskew,
+                                          this_toskew))
+                {
+                    ret = 0;
+                    break;
+                }
+            }
+            else
+                (*put)(img, dst, tocol, y, this_tw, nrow, fromskew,
+                       this_toskew, buf + pos);
             tocol += this_tw;
             col += this_tw;
             /*
@@ -863,27 +1697,12 @@ static int gtTileContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
         y += ((flip & FLIP_VERTICALLY) ? -(int32_t)nrow : (int32_t)nrow);
     }
     _TIFFfreeExt(img->tif, buf);
+    if (workers != NULL && !TIFFRGBAWorkersFinish(workers))
+        ret = 0;
 
     if (flip & FLIP_HORIZONTALLY)
     {
-        uint32_t line;
-
-        for (line = 0; line < h; line++)
-        {
-            uint32_t *left = raster + (line * w);
-            /* Use wmin to only flip horizontally data in place and not complete
-             * raster-row. */
-            uint32_t *right = left + wmin - 1;
-
-            while (left < right)
-            {
-                uint32_t temp = *left;
-                *left = *right;
-                *right = temp;
-                left++;
-                right--;
-            }
-        }
+        flipHorizontally(img, raster, w, h, wmin);
     }
 
     return (ret);
@@ -897,8 +1716,15 @@ static int gtTileContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
  */
 static int gtTileSeparate(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
                           uint32_t h)
+{
+    return gtTileSeparateExt(img, raster, w, h, 1);
+}
+
+static int gtTileSeparateExt(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
+                             uint32_t h, int nthreads)
 {
     TIFF *tif = img->tif;
+    TIFFRGBAWorkers *workers;
     tileSeparateRoutine put = img->put.separate;
     uint32_t col, row, y, rowstoread;
     tmsize_t pos;
@@ -1003,6 +1829,8 @@ static int gtTileSeparate(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
         return (0);
     }
     leftmost_toskew = (int32_t)skew_i64;
+    workers = TIFFRGBAWorkersCreate(img, nthreads, colorchannels + (alpha != 0),
+                                    colorchannels, tilesize);
     for (row = 0; ret != 0 && row < h; row += nrow)
     {
         rowstoread = th - (row + img->row_offset) % th;
@@ -1015,65 +1843,68 @@ static int gtTileSeparate(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
         /* wmin: only write imagewidth if raster is bigger. */
         while (tocol < wmin)
         {
-            if (buf == NULL)
+            if (workers == NULL)
             {
-                if (_TIFFReadTileAndAllocBuffer(tif, (void **)&buf, bufsize,
-                                                col, row + img->row_offset, 0,
-                                                0) == (tmsize_t)(-1) &&
-                    (buf == NULL || img->stoponerr))
+                if (buf == NULL)
+                {
+                    if (_TIFFReadTileAndAllocBuffer(
+                            tif, (void **)&buf, bufsize, col,
+                            row + img->row_offset, 0, 0) == (tmsize_t)(-1) &&
+                        (buf == NULL || img->stoponerr))
+                    {
+                        ret = 0;
+                        break;
+                    }
+                    p0 = buf;
+                    if (colorchannels == 1)
+                    {
+                        p2 = p1 = p0;
+                        pa = (alpha ? (p0 + 3 * tilesize) : NULL);
+                    }
+                    else
+                    {
+                        p1 = p0 + tilesize;
+                        p2 = p1 + tilesize;
+                        pa = (alpha ? (p2 + tilesize) : NULL);
+                    }
+                }
+                else if (TIFFReadTile(tif, p0, col, row + img->row_offset, 0,
+                                      0) == (tmsize_t)(-1) &&
+                         img->stoponerr)
                 {
                     ret = 0;
                     break;
                 }
-                p0 = buf;
-                if (colorchannels == 1)
+                if (colorchannels > 1 &&
+                    TIFFReadTile(tif, p1, col, row + img->row_offset, 0, 1) ==
+                        (tmsize_t)(-1) &&
+                    img->stoponerr)
                 {
-                    p2 = p1 = p0;
-                    pa = (alpha ? (p0 + 3 * tilesize) : NULL);
+                    ret = 0;
+                    break;
                 }
-                else
+                if (colorchannels > 1 &&
+                    TIFFReadTile(tif, p2, col, row + img->row_offset, 0, 2) ==
+                        (tmsize_t)(-1) &&
+                    img->stoponerr)
                 {
-                    p1 = p0 + tilesize;
-                    p2 = p1 + tilesize;
-                    pa = (alpha ? (p2 + tilesize) : NULL);
+                    ret = 0;
+                    break;
+                }
+                if (alpha &&
+                    TIFFReadTile(tif, pa, col, row + img->row_offset, 0,
+                                 colorchannels) == (tmsize_t)(-1) &&
+                    img->stoponerr)
+                {
+                    ret = 0;
+                    break;
                 }
-            }
-            else if (TIFFReadTile(tif, p0, col, row + img->row_offset, 0, 0) ==
-                         (tmsize_t)(-1) &&
-                     img->stoponerr)
-            {
-                ret = 0;
-                break;
-            }
-            if (colorchannels > 1 &&
-                TIFFReadTile(tif, p1, col, row + img->row_offset, 0, 1) ==
-                    (tmsize_t)(-1) &&
-                img->stoponerr)
-            {
-                ret = 0;
-                break;
-            }
-            if (colorchannels > 1 &&
-                TIFFReadTile(tif, p2, col, row + img->row_offset, 0, 2) ==
-                    (tmsize_t)(-1) &&
-                img->stoponerr)
-            {
-                ret = 0;
-                break;
-            }
-            if (alpha &&
-                TIFFReadTile(tif, pa, col, row + img->row_offset, 0,
-                             colorchannels) == (tmsize_t)(-1) &&
-                img->stoponerr)
-            {
-                ret = 0;
-                break;
             }
 
             /* For SEPARATE the pos-offset is per sample and should not be
              * multiplied by img->samplesperpixel. */
             pos = ((row + img->row_offset) % th) * TIFFTileRowSize(tif) +
-                  (tmsize_t)fromskew;
+                  (tmsize_t)fromskew * rgbaSampleSize(img);
             if (tocol + this_tw > wmin)
             {
                 /*
@@ -1083,10 +1914,27 @@ static int gtTileSeparate(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
                 this_tw = tw - fromskew;
                 this_toskew = toskew + fromskew;
             }
-            tmsize_t roffset = (tmsize_t)y * w + tocol;
-            (*put)(img, raster + roffset, tocol, y, this_tw, nrow, fromskew,
-                   this_toskew, p0 + pos, p1 + pos, p2 + pos,
-                   (alpha ? (pa + pos) : NULL));
+            uint32_t *dst = rgbaPixelAt(img, raster, (tmsize_t)y * w + tocol);
+            if (workers != NULL)
+            {
+                uint32_t tiles[RGBA_MAX_PLANES];
+                uint16_t sample;
+                for (sample = 0; sample < colorchannels + (alpha != 0);
+                     sample++)
+                    tiles[sample] = TIFFComputeTile(
+                        tif, col, row + img->row_offset, 0, sample);
+                if (!TIFFRGBAWorkersQueue(workers, tiles, tilesize, pos, dst,
+                                          tocol, y, this_tw, nrow, fromskew,
+                                          this_toskew))
+                {
+                    ret = 0;
+                    break;
+                }
+            }
+            else
+                (*put)(img, dst, tocol, y, this_tw, nrow, fromskew,
+                       this_toskew, p0 + pos, p1 + pos, p2 + pos,
+                       (alpha ? (pa + pos) : NULL));
             tocol += this_tw;
             col += this_tw;
             /*
@@ -1100,27 +1948,12 @@ static int gtTileSeparate(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
 
         y += ((flip & FLIP_VERTICALLY) ? -(int32_t)nrow : (int32_t)nrow);
     }
+    if (workers != NULL && !TIFFRGBAWorkersFinish(workers))
+        ret = 0;
 
     if (flip & FLIP_HORIZONTALLY)
     {
-        uint32_t line;
-
-        for (line = 0; line < h; line++)
-        {
-            uint32_t *left = raster + (line * w);
-            /* Use wmin to only flip horizontally data in place and not complete
-             * raster-row. */
-            uint32_t *right = left + wmin - 1;
-
-            while (left < right)
-            {
-                uint32_t temp = *left;
-                *left = *right;
-                *right = temp;
-                left++;
-                right--;
-            }
-        }
+        flipHorizontally(img, raster, w, h, wmin);
     }
 
     _TIFFfreeExt(img->tif, buf);
@@ -1135,8 +1968,15 @@ static int gtTileSeparate(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
  */
 static int gtStripContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
                          uint32_t h)
+{
+    return gtStripContigExt(img, raster, w, h, 1);
+}
+
+static int gtStripContigExt(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
+                            uint32_t h, int nthreads)
 {
     TIFF *tif = img->tif;
+    TIFFRGBAWorkers *workers;
     tileContigRoutine put = img->put.contig;
     uint32_t row, y, nrow, nrowsub, rowstoread;
     tmsize_t pos;
@@ -1208,6 +2048,7 @@ static int gtStripContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
 
     scanline = TIFFScanlineSize(tif);
     fromskew = (w < imagewidth ? imagewidth - w : 0);
+    workers = TIFFRGBAWorkersCreate(img, nthreads, 1, 1, maxstripsize);
     for (row = 0; row < h; row += nrow)
     {
         uint32_t temp;
@@ -1221,9 +2062,11 @@ static int gtStripContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
         {
             TIFFErrorExtR(tif, TIFFFileName(tif),
                           "Integer overflow in gtStripContig");
-            return 0;
+            ret = 0;
+            break;
         }
-        if (_TIFFReadEncodedStripAndAllocBuffer(
+        if (workers == NULL &&
+            _TIFFReadEncodedStripAndAllocBuffer(
                 tif, TIFFComputeStrip(tif, row + img->row_offset, 0),
                 (void **)(&buf), maxstripsize,
                 temp * scanline) == (tmsize_t)(-1) &&
@@ -1234,12 +2077,25 @@ static int gtStripContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
         }
 
         pos = ((row + img->row_offset) % rowsperstrip) * scanline +
-              ((tmsize_t)img->col_offset * img->samplesperpixel);
-        tmsize_t roffset = (tmsize_t)y * w;
-        (*put)(img, raster + roffset, 0, y, wmin, nrow, fromskew, toskew,
-               buf + pos);
+              ((tmsize_t)img->col_offset * img->samplesperpixel *
+               rgbaSampleSize(img));
+        uint32_t *dst = rgbaPixelAt(img, raster, (tmsize_t)y * w);
+        if (workers != NULL)
+        {
+            uint32_t strip = TIFFComputeStrip(tif, row + img->row_offset, 0);
+            if (!TIFFRGBAWorkersQueue(workers, &strip, temp * scanline, pos,
+                                      dst, 0, y, wmin, nrow, fromskew, toskew))
+            {
+                ret = 0;
+                break;
+            }
+        }
+        else
+            (*put)(img, dst, 0, y, wmin, nrow, fromskew, toskew, buf + pos);
         y += ((flip & FLIP_VERTICALLY) ? -(int32_t)nrow : (int32_t)nrow);
     }
+    if (workers != NULL && !TIFFRGBAWorkersFinish(workers))
+        ret = 0;
 
     if (flip & FLIP_HORIZONTALLY)
     {
@@ -1247,29 +2103,12 @@ static int gtStripContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
          * larger than image width, data are moved horizontally to the right
          * side.
          * Use wmin to only flip data in place. */
-        uint32_t line;
+        flipHorizontally(img, raster, w, h, wmin);
+    }
 
-        for (line = 0; line < h; line++)
-        {
-            uint32_t *left = raster + (line * w);
-            /* Use wmin to only flip horizontally data in place and not complete
-             * raster-row. */
-            uint32_t *right = left + wmin - 1;
-
-            while (left < right)
-            {
-                uint32_t temp = *left;
-                *left = *right;
-                *right = temp;
-                left++;
-                right--;
-            }
-        }
-    }
-
-    _TIFFfreeExt(img->tif, buf);
-    return (ret);
-}
+    _TIFFfreeExt(img->tif, buf);
+    return (ret);
+}
 
 /*
  * Get a strip-organized image with
@@ -1279,8 +2118,15 @@ static int gtStripContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
  */
 static int gtStripSeparate(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
                            uint32_t h)
+{
+    return gtStripSeparateExt(img, raster, w, h, 1);
+}
+
+static int gtStripSeparateExt(TIFFRGBAImage *img, uint32_t *raster,
+                              uint32_t w, uint32_t h, int nthreads)
 {
     TIFF *tif = img->tif;
+    TIFFRGBAWorkers *workers;
     tileSeparateRoutine put = img->put.separate;
     unsigned char *buf = NULL;
     unsigned char *p0 = NULL, *p1 = NULL, *p2 = NULL, *pa = NULL;
@@ -1363,6 +2209,8 @@ static int gtStripSeparate(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
 
     scanline = TIFFScanlineSize(tif);
     fromskew = (w < imagewidth ? imagewidth - w : 0);
+    workers = TIFFRGBAWorkersCreate(img, nthreads, colorchannels + (alpha != 0),
+                                    colorchannels, stripsize);
     for (row = 0; row < h; row += nrow)
     {
         uint32_t temp;
@@ -1374,96 +2222,103 @@ static int gtStripSeparate(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
         {
             TIFFErrorExtR(tif, TIFFFileName(tif),
                           "Integer overflow in gtStripSeparate");
-            return 0;
+            ret = 0;
+            break;
         }
-        if (buf == NULL)
+        if (workers == NULL)
         {
-            if (_TIFFReadEncodedStripAndAllocBuffer(
-                    tif, TIFFComputeStrip(tif, offset_row, 0), (void **)&buf,
-                    bufsize, temp * scanline) == (tmsize_t)(-1) &&
-                (buf == NULL || img->stoponerr))
+            if (buf == NULL)
             {
-                ret = 0;
-                break;
+                if (_TIFFReadEncodedStripAndAllocBuffer(
+                        tif, TIFFComputeStrip(tif, offset_row, 0),
+                        (void **)&buf, bufsize,
+                        temp * scanline) == (tmsize_t)(-1) &&
+                    (buf == NULL || img->stoponerr))
+                {
+                    ret = 0;
+                    break;
+                }
+                p0 = buf;
+                if (colorchannels == 1)
+                {
+                    p2 = p1 = p0;
+                    pa = (alpha ? (p0 + 3 * stripsize) : NULL);
+                }
+                else
+                {
+                    p1 = p0 + stripsize;
+                    p2 = p1 + stripsize;
+                    pa = (alpha ? (p2 + stripsize) : NULL);
+                }
             }
-            p0 = buf;
-            if (colorchannels == 1)
+            else if (TIFFReadEncodedStrip(
+                         tif, TIFFComputeStrip(tif, offset_row, 0), p0,
+                         temp * scanline) == (tmsize_t)(-1) &&
+                     img->stoponerr)
             {
-                p2 = p1 = p0;
-                pa = (alpha ? (p0 + 3 * stripsize) : NULL);
+                ret = 0;
+                break;
             }
-            else
+            if (colorchannels > 1 &&
+                TIFFReadEncodedStrip(tif,
+                                     TIFFComputeStrip(tif, offset_row, 1),
+                                     p1, temp * scanline) == (tmsize_t)(-1) &&
+                img->stoponerr)
             {
-                p1 = p0 + stripsize;
-                p2 = p1 + stripsize;
-                pa = (alpha ? (p2 + stripsize) : NULL);
+                ret = 0;
+                break;
             }
-        }
-        else if (TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, offset_row, 0),
-                                      p0, temp * scanline) == (tmsize_t)(-1) &&
-                 img->stoponerr)
-        {
-            ret = 0;
-            break;
-        }
-        if (colorchannels > 1 &&
-            TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, offset_row, 1), p1,
-                                 temp * scanline) == (tmsize_t)(-1) &&
-            img->stoponerr)
-        {
-            ret = 0;
-            break;
-        }
-        if (colorchannels > 1 &&
-            TIFFReadEncodedStrip(tif, TIFFComputeStrip(tif, offset_row, 2), p2,
-                                 temp * scanline) == (tmsize_t)(-1) &&
-            img->stoponerr)
-        {
-            ret = 0;
-            break;
-        }
-        if (alpha)
-        {
-            if (TIFFReadEncodedStrip(
-                    tif, TIFFComputeStrip(tif, offset_row, colorchannels), pa,
-                    temp * scanline) == (tmsize_t)(-1) &&
+            if (colorchannels > 1 &&
+                TIFFReadEncodedStrip(tif,
+                                     TIFFComputeStrip(tif, offset_row, 2),
+                                     p2, temp * scanline) == (tmsize_t)(-1) &&
                 img->stoponerr)
             {
                 ret = 0;
                 break;
             }
+            if (alpha)
+            {
+                if (TIFFReadEncodedStrip(
+                        tif, TIFFComputeStrip(tif, offset_row, colorchannels),
+                        pa, temp * scanline) == (tmsize_t)(-1) &&
+                    img->stoponerr)
+                {
+                    ret = 0;
+                    break;
+                }
+            }
         }
 
         /* For SEPARATE the pos-offset is per sample and should not be
          * multiplied by img->samplesperpixel. */
         pos = ((row + img->row_offset) % rowsperstrip) * scanline +
-              (tmsize_t)img->col_offset;
-        tmsize_t roffset = (tmsize_t)y * w;
-        (*put)(img, raster + roffset, 0, y, wmin, nrow, fromskew, toskew,
-               p0 + pos, p1 + pos, p2 + pos, (alpha ? (pa + pos) : NULL));
+              (tmsize_t)img->col_offset * rgbaSampleSize(img);
+        uint32_t *dst = rgbaPixelAt(img, raster, (tmsize_t)y * w);
+        if (workers != NULL)
+        {
+            uint32_t strips[RGBA_MAX_PLANES];
+            uint16_t sample;
+            for (sample = 0; sample < colorchannels + (alpha != 0); sample++)
+                strips[sample] = TIFFComputeStrip(tif, offset_row, sample);
+            if (!TIFFRGBAWorkersQueue(workers, strips, temp * scanline, pos,
+                                      dst, 0, y, wmin, nrow, fromskew, toskew))
+            {
+                ret = 0;
+                break;
+            }
+        }
+        else
+            (*put)(img, dst, 0, y, wmin, nrow, fromskew, toskew, p0 + pos,
+                   p1 + pos, p2 + pos, (alpha ? (pa + pos) : NULL));
         y += ((flip & FLIP_VERTICALLY) ? -(int32_t)nrow : (int32_t)nrow);
     }
+    if (workers != NULL && !TIFFRGBAWorkersFinish(workers))
+        ret = 0;
 
     if (flip & FLIP_HORIZONTALLY)
     {
-        uint32_t line;
-
-        for (line = 0; line < h; line++)
-        {
-            uint32_t *left = raster + (line * w);
-            /* Use wmin to only flip horizontally data in place and not complete
-             * raster-row. */
-            uint32_t *right = left + wmin - 1;
-
-            while (left < right)
-            {
-                uint32_t temp = *left;
-                *left = *right;
-                *right = temp;
-                left++;
-                right--;
-            }
-        }
+        flipHorizontally(img, raster, w, h, wmin);
     }
 
     _TIFFfreeExt(img->tif, buf);
@@ -1595,23 +2450,98 @@ static int gtStripSeparate(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
                      uint32_t w, uint32_t h, int32_t fromskew, int32_t toskew, \
                      unsigned char *pp)
 
+/*
+ * The BWmap and PALmap tables built by makebwmap() and makecmap() hold
+ * the 8 / bitspersample pixels of each byte value one after the other,
+ * so that the pixels of byte value v are at map + v * nsamples, with map
+ * the first entry of the table.
+ */
+
+/*
+ * Expand w samples of 8 / nsamples bits packed in pp through map, one
+ * byte (a run of nsamples pixels of the table) at a time.
+ */
+static inline void putPackedMapped(uint32_t *cp, const unsigned char *pp,
+                                   uint32_t w, const uint32_t *map,
+                                   uint32_t nsamples)
+{
+    const uint32_t *bw;
+
+    for (; w >= nsamples; w -= nsamples)
+    {
+        bw = map + *pp++ * nsamples;
+#ifdef MAP_USE_SSE2
+        {
+            const __m128i *src = (const __m128i *)(const void *)bw;
+            __m128i *dst = (__m128i *)(void *)cp;
+
+            if (nsamples == 8)
+            {
+                _mm_storeu_si128(dst, _mm_loadu_si128(src));
+                _mm_storeu_si128(dst + 1, _mm_loadu_si128(src + 1));
+            }
+            else if (nsamples == 4)
+                _mm_storeu_si128(dst, _mm_loadu_si128(src));
+            else
+                _mm_storel_epi64(dst, _mm_loadl_epi64(src));
+        }
+#else
+        {
+            uint32_t i;
+            for (i = 0; i < nsamples; i++)
+                cp[i] = bw[i];
+        }
+#endif
+        cp += nsamples;
+    }
+    if (w > 0)
+    {
+        bw = map + *pp * nsamples;
+        while (w-- > 0)
+            *cp++ = *bw++;
+    }
+}
+
+/*
+ * Map w 8-bit samples, stride bytes apart in pp, through map.
+ */
+static inline void putByteMapped(uint32_t *cp, const unsigned char *pp,
+                                 uint32_t w, const uint32_t *map, int stride)
+{
+#ifdef MAP_USE_SSE2
+    for (; w >= 4; w -= 4)
+    {
+        _mm_storeu_si128((__m128i *)(void *)cp,
+                         _mm_setr_epi32((int)map[pp[0]], (int)map[pp[stride]],
+                                        (int)map[pp[2 * stride]],
+                                        (int)map[pp[3 * stride]]));
+        cp += 4;
+        pp += 4 * stride;
+    }
+#endif
+    for (; w > 0; --w)
+    {
+        *cp++ = map[*pp];
+        pp += stride;
+    }
+}
+
 /*
  * 8-bit palette => colormap/RGB
  */
 DECLAREContigPutFunc(put8bitcmaptile)
 {
-    uint32_t **PALmap = img->PALmap;
     int samplesperpixel = img->samplesperpixel;
+    const uint32_t *map = img->PALmap[0];
 
+    (void)x;
     (void)y;
     for (; h > 0; --h)
     {
-        for (x = w; x > 0; --x)
-        {
-            *cp++ = PALmap[*pp][0];
-            pp += samplesperpixel;
-        }
+        putByteMapped(cp, pp, w, map, samplesperpixel);
+        cp += w;
         cp += toskew;
+        pp += (tmsize_t)w * samplesperpixel;
         pp += fromskew;
     }
 }
@@ -1621,16 +2551,17 @@ DECLAREContigPutFunc(put8bitcmaptile)
  */
 DECLAREContigPutFunc(put4bitcmaptile)
 {
-    uint32_t **PALmap = img->PALmap;
+    const uint32_t *map = img->PALmap[0];
 
     (void)x;
     (void)y;
     fromskew /= 2;
     for (; h > 0; --h)
     {
-        uint32_t *bw;
-        UNROLL2(w, bw = PALmap[*pp++], *cp++ = *bw++);
+        putPackedMapped(cp, pp, w, map, 2);
+        cp += w;
         cp += toskew;
+        pp += (w + 1) / 2;
         pp += fromskew;
     }
 }
@@ -1640,16 +2571,17 @@ DECLAREContigPutFunc(put4bitcmaptile)
  */
 DECLAREContigPutFunc(put2bitcmaptile)
 {
-    uint32_t **PALmap = img->PALmap;
+    const uint32_t *map = img->PALmap[0];
 
     (void)x;
     (void)y;
     fromskew /= 4;
     for (; h > 0; --h)
     {
-        uint32_t *bw;
-        UNROLL4(w, bw = PALmap[*pp++], *cp++ = *bw++);
+        putPackedMapped(cp, pp, w, map, 4);
+        cp += w;
         cp += toskew;
+        pp += (w + 3) / 4;
         pp += fromskew;
     }
 }
@@ -1659,16 +2591,17 @@ DECLAREContigPutFunc(put2bitcmaptile)
  */
 DECLAREContigPutFunc(put1bitcmaptile)
 {
-    uint32_t **PALmap = img->PALmap;
+    const uint32_t *map = img->PALmap[0];
 
     (void)x;
     (void)y;
     fromskew /= 8;
     for (; h > 0; --h)
     {
-        uint32_t *bw;
-        UNROLL8(w, bw = PALmap[*pp++], *cp++ = *bw++);
+        putPackedMapped(cp, pp, w, map, 8);
+        cp += w;
         cp += toskew;
+        pp += (w + 7) / 8;
         pp += fromskew;
     }
 }
@@ -1679,17 +2612,16 @@ DECLAREContigPutFunc(put1bitcmaptile)
 DECLAREContigPutFunc(putgreytile)
 {
     int samplesperpixel = img->samplesperpixel;
-    uint32_t **BWmap = img->BWmap;
+    const uint32_t *map = img->BWmap[0];
 
+    (void)x;
     (void)y;
     for (; h > 0; --h)
     {
-        for (x = w; x > 0; --x)
-        {
-            *cp++ = BWmap[*pp][0];
-            pp += samplesperpixel;
-        }
+        putByteMapped(cp, pp, w, map, samplesperpixel);
+        cp += w;
         cp += toskew;
+        pp += (tmsize_t)w * samplesperpixel;
         pp += fromskew;
     }
 }
@@ -1711,7 +2643,7 @@ DECLAREContigPutFunc(putagreytile)
             pp += samplesperpixel;
         }
         cp += toskew;
-        pp += fromskew;
+        pp += fromskew * samplesperpixel;
     }
 }
 
@@ -1737,7 +2669,7 @@ DECLAREContigPutFunc(put16bitbwtile)
             wp += samplesperpixel;
         }
         cp += toskew;
-        pp += fromskew;
+        pp += fromskew * 2 * samplesperpixel;
     }
 }
 
@@ -1746,16 +2678,17 @@ DECLAREContigPutFunc(put16bitbwtile)
  */
 DECLAREContigPutFunc(put1bitbwtile)
 {
-    uint32_t **BWmap = img->BWmap;
+    const uint32_t *map = img->BWmap[0];
 
     (void)x;
     (void)y;
     fromskew /= 8;
     for (; h > 0; --h)
     {
-        uint32_t *bw;
-        UNROLL8(w, bw = BWmap[*pp++], *cp++ = *bw++);
+        putPackedMapped(cp, pp, w, map, 8);
+        cp += w;
         cp += toskew;
+        pp += (w + 7) / 8;
         pp += fromskew;
     }
 }
@@ -1765,16 +2698,17 @@ DECLAREContigPutFunc(put1bitbwtile)
  */
 DECLAREContigPutFunc(put2bitbwtile)
 {
-    uint32_t **BWmap = img->BWmap;
+    const uint32_t *map = img->BWmap[0];
 
     (void)x;
     (void)y;
     fromskew /= 4;
     for (; h > 0; --h)
     {
-        uint32_t *bw;
-        UNROLL4(w, bw = BWmap[*pp++], *cp++ = *bw++);
+        putPackedMapped(cp, pp, w, map, 4);
+        cp += w;
         cp += toskew;
+        pp += (w + 3) / 4;
         pp += fromskew;
     }
 }
@@ -1784,16 +2718,17 @@ DECLAREContigPutFunc(put2bitbwtile)
  */
 DECLAREContigPutFunc(put4bitbwtile)
 {
-    uint32_t **BWmap = img->BWmap;
+    const uint32_t *map = img->BWmap[0];
 
     (void)x;
     (void)y;
     fromskew /= 2;
     for (; h > 0; --h)
     {
-        uint32_t *bw;
-        UNROLL2(w, bw = BWmap[*pp++], *cp++ = *bw++);
+        putPackedMapped(cp, pp, w, map, 2);
+        cp += w;
         cp += toskew;
+        pp += (w + 1) / 2;
         pp += fromskew;
     }
 }
@@ -2039,133 +2974,1284 @@ DECLARESepPutFunc(putCMYKseparate8bittile)
     (void)y;
     for (; h > 0; --h)
     {
-        uint32_t rv, gv, bv, kv;
+        uint32_t rv, gv, bv, kv;
+        for (x = w; x > 0; --x)
+        {
+            kv = 255 - *a++;
+            rv = (kv * (255 - *r++)) / 255;
+            gv = (kv * (255 - *g++)) / 255;
+            bv = (kv * (255 - *b++)) / 255;
+            *cp++ = PACK4(rv, gv, bv, 255);
+        }
+        SKEW4(r, g, b, a, fromskew);
+        cp += toskew;
+    }
+}
+
+/*
+ * 8-bit unpacked samples => RGBA w/ unassociated alpha
+ */
+DECLARESepPutFunc(putRGBUAseparate8bittile)
+{
+    (void)img;
+    (void)y;
+    for (; h > 0; --h)
+    {
+        uint32_t rv, gv, bv, av;
+        uint8_t *m;
+        for (x = w; x > 0; --x)
+        {
+            av = *a++;
+            m = img->UaToAa + ((size_t)av << 8);
+            rv = m[*r++];
+            gv = m[*g++];
+            bv = m[*b++];
+            *cp++ = PACK4(rv, gv, bv, av);
+        }
+        SKEW4(r, g, b, a, fromskew);
+        cp += toskew;
+    }
+}
+
+/*
+ * 16-bit unpacked samples => RGB
+ */
+DECLARESepPutFunc(putRGBseparate16bittile)
+{
+    uint16_t *wr = (uint16_t *)r;
+    uint16_t *wg = (uint16_t *)g;
+    uint16_t *wb = (uint16_t *)b;
+    (void)img;
+    (void)y;
+    (void)a;
+    for (; h > 0; --h)
+    {
+        for (x = 0; x < w; x++)
+            *cp++ = PACK(img->Bitdepth16To8[*wr++], img->Bitdepth16To8[*wg++],
+                         img->Bitdepth16To8[*wb++]);
+        SKEW(wr, wg, wb, fromskew);
+        cp += toskew;
+    }
+}
+
+/*
+ * 16-bit unpacked samples => RGBA w/ associated alpha
+ */
+DECLARESepPutFunc(putRGBAAseparate16bittile)
+{
+    uint16_t *wr = (uint16_t *)r;
+    uint16_t *wg = (uint16_t *)g;
+    uint16_t *wb = (uint16_t *)b;
+    uint16_t *wa = (uint16_t *)a;
+    (void)img;
+    (void)y;
+    for (; h > 0; --h)
+    {
+        for (x = 0; x < w; x++)
+            *cp++ = PACK4(img->Bitdepth16To8[*wr++], img->Bitdepth16To8[*wg++],
+                          img->Bitdepth16To8[*wb++], img->Bitdepth16To8[*wa++]);
+        SKEW4(wr, wg, wb, wa, fromskew);
+        cp += toskew;
+    }
+}
+
+/*
+ * 16-bit unpacked samples => RGBA w/ unassociated alpha
+ */
+DECLARESepPutFunc(putRGBUAseparate16bittile)
+{
+    uint16_t *wr = (uint16_t *)r;
+    uint16_t *wg = (uint16_t *)g;
+    uint16_t *wb = (uint16_t *)b;
+    uint16_t *wa = (uint16_t *)a;
+    (void)img;
+    (void)y;
+    for (; h > 0; --h)
+    {
+        uint32_t r2, g2, b2, a2;
+        uint8_t *m;
+        for (x = w; x > 0; --x)
+        {
+            a2 = img->Bitdepth16To8[*wa++];
+            m = img->UaToAa + ((size_t)a2 << 8);
+            r2 = m[img->Bitdepth16To8[*wr++]];
+            g2 = m[img->Bitdepth16To8[*wg++]];
+            b2 = m[img->Bitdepth16To8[*wb++]];
+            *cp++ = PACK4(r2, g2, b2, a2);
+        }
+        SKEW4(wr, wg, wb, wa, fromskew);
+        cp += toskew;
+    }
+}
+
+/*
+ * Put routines writing the raster in the output pixel format of img
+ * instead of packed ABGR: cp then points to pixels of rgbaPixelSize()
+ * bytes, and toskew is in such pixels.  For each pixel, fetch sets rv,
+ * gv, bv and av (16-bit for TIFFRGBA_FORMAT_RGBA16 and
+ * TIFFRGBA_FORMAT_RGBAF32 with fetch16, which are multiplied by mul16)
+ * from the samples; skip is run at the end of each row.
+ */
+#define FORMATROWS(size, fetch, store, skip)                                   \
+    for (; h > 0; --h)                                                         \
+    {                                                                          \
+        for (x = w; x > 0; --x)                                                \
+        {                                                                      \
+            fetch;                                                             \
+            store;                                                             \
+            op += (size);                                                      \
+        }                                                                      \
+        op += (ptrdiff_t)toskew * (size);                                      \
+        skip;                                                                  \
+    }
+#define STOREABGR32 *(uint32_t *)(void *)op = PACK4(rv, gv, bv, av)
+#define STORERGBA8                                                             \
+    op[0] = (uint8_t)rv;                                                       \
+    op[1] = (uint8_t)gv;                                                       \
+    op[2] = (uint8_t)bv;                                                       \
+    op[3] = (uint8_t)av
+#define STOREBGRA8                                                             \
+    op[0] = (uint8_t)bv;                                                       \
+    op[1] = (uint8_t)gv;                                                       \
+    op[2] = (uint8_t)rv;                                                       \
+    op[3] = (uint8_t)av
+#define STORERGB8                                                              \
+    op[0] = (uint8_t)rv;                                                       \
+    op[1] = (uint8_t)gv;                                                       \
+    op[2] = (uint8_t)bv
+#define STORERGBA16(mul16)                                                     \
+    ((uint16_t *)(void *)op)[0] = (uint16_t)(rv * (mul16));                    \
+    ((uint16_t *)(void *)op)[1] = (uint16_t)(gv * (mul16));                    \
+    ((uint16_t *)(void *)op)[2] = (uint16_t)(bv * (mul16));                    \
+    ((uint16_t *)(void *)op)[3] = (uint16_t)(av * (mul16))
+#define STORERGBAF32(mul16)                                                    \
+    ((float *)(void *)op)[0] = (float)(rv * (mul16)) / 65535.0F;               \
+    ((float *)(void *)op)[1] = (float)(gv * (mul16)) / 65535.0F;               \
+    ((float *)(void *)op)[2] = (float)(bv * (mul16)) / 65535.0F;               \
+    ((float *)(void *)op)[3] = (float)(av * (mul16)) / 65535.0F
+#define FORMATPUT(fetch, fetch16, mul16, skip)                                 \
+    {                                                                          \
+        uint8_t *op = (uint8_t *)cp;                                           \
+        switch (img->format & TIFFRGBA_FORMAT_MASK)                            \
+        {                                                                      \
+            case TIFFRGBA_FORMAT_RGBA8:                                        \
+                FORMATROWS(4, fetch, STORERGBA8, skip);                        \
+                break;                                                         \
+            case TIFFRGBA_FORMAT_BGRA8:                                        \
+                FORMATROWS(4, fetch, STOREBGRA8, skip);                        \
+                break;                                                         \
+            case TIFFRGBA_FORMAT_RGB8:                                         \
+                FORMATROWS(3, fetch, STORERGB8, skip);                         \
+                break;                                                         \
+            case TIFFRGBA_FORMAT_RGBA16:                                       \
+                FORMATROWS(8, fetch16, STORERGBA16(mul16), skip);              \
+                break;                                                         \
+            case TIFFRGBA_FORMAT_RGBAF32:                                      \
+                FORMATROWS(16, fetch16, STORERGBAF32(mul16), skip);            \
+                break;                                                         \
+            default:                                                           \
+                FORMATROWS(4, fetch, STOREABGR32, skip);                       \
+                break;                                                         \
+        }                                                                      \
+    }
+
+/*
+ * 8-bit packed samples => RGB in the output format
+ */
+DECLAREContigPutFunc(putRGBcontig8bitformat)
+{
+    int samplesperpixel = img->samplesperpixel;
+    uint32_t rv, gv, bv, av = 255;
+#define FETCH                                                                  \
+    rv = pp[0];                                                                \
+    gv = pp[1];                                                                \
+    bv = pp[2];                                                                \
+    pp += samplesperpixel
+
+    (void)y;
+    fromskew *= samplesperpixel;
+    FORMATPUT(FETCH, FETCH, 257, pp += fromskew);
+#undef FETCH
+}
+
+/*
+ * 8-bit packed samples => RGBA w/ associated alpha in the output format
+ * (or w/ unassociated alpha kept as is)
+ */
+DECLAREContigPutFunc(putRGBAAcontig8bitformat)
+{
+    int samplesperpixel = img->samplesperpixel;
+    uint32_t rv, gv, bv, av;
+#define FETCH                                                                  \
+    rv = pp[0];                                                                \
+    gv = pp[1];                                                                \
+    bv = pp[2];                                                                \
+    av = pp[3];                                                                \
+    pp += samplesperpixel
+
+    (void)y;
+    fromskew *= samplesperpixel;
+    FORMATPUT(FETCH, FETCH, 257, pp += fromskew);
+#undef FETCH
+}
+
+/*
+ * 8-bit packed samples => RGBA w/ unassociated alpha in the output format
+ */
+DECLAREContigPutFunc(putRGBUAcontig8bitformat)
+{
+    int samplesperpixel = img->samplesperpixel;
+    uint32_t rv, gv, bv, av;
+    uint8_t *m;
+#define FETCH                                                                  \
+    av = pp[3];                                                                \
+    m = img->UaToAa + ((size_t)av << 8);                                       \
+    rv = m[pp[0]];                                                             \
+    gv = m[pp[1]];                                                             \
+    bv = m[pp[2]];                                                             \
+    pp += samplesperpixel
+
+    (void)y;
+    fromskew *= samplesperpixel;
+    FORMATPUT(FETCH, FETCH, 257, pp += fromskew);
+#undef FETCH
+}
+
+/*
+ * 16-bit packed samples => RGB in the output format
+ */
+DECLAREContigPutFunc(putRGBcontig16bitformat)
+{
+    int samplesperpixel = img->samplesperpixel;
+    uint16_t *wp = (uint16_t *)pp;
+    uint32_t rv, gv, bv, av;
+#define FETCH                                                                  \
+    rv = img->Bitdepth16To8[wp[0]];                                            \
+    gv = img->Bitdepth16To8[wp[1]];                                            \
+    bv = img->Bitdepth16To8[wp[2]];                                            \
+    av = 255;                                                                  \
+    wp += samplesperpixel
+#define FETCH16                                                                \
+    rv = wp[0];                                                                \
+    gv = wp[1];                                                                \
+    bv = wp[2];                                                                \
+    av = 65535;                                                                \
+    wp += samplesperpixel
+
+    (void)y;
+    fromskew *= samplesperpixel;
+    FORMATPUT(FETCH, FETCH16, 1, wp += fromskew);
+#undef FETCH
+#undef FETCH16
+}
+
+/*
+ * 16-bit packed samples => RGBA w/ associated alpha in the output format
+ * (or w/ unassociated alpha kept as is)
+ */
+DECLAREContigPutFunc(putRGBAAcontig16bitformat)
+{
+    int samplesperpixel = img->samplesperpixel;
+    uint16_t *wp = (uint16_t *)pp;
+    uint32_t rv, gv, bv, av;
+#define FETCH                                                                  \
+    rv = img->Bitdepth16To8[wp[0]];                                            \
+    gv = img->Bitdepth16To8[wp[1]];                                            \
+    bv = img->Bitdepth16To8[wp[2]];                                            \
+    av = img->Bitdepth16To8[wp[3]];                                            \
+    wp += samplesperpixel
+#define FETCH16                                                                \
+    rv = wp[0];                                                                \
+    gv = wp[1];                                                                \
+    bv = wp[2];                                                                \
+    av = wp[3];                                                                \
+    wp += samplesperpixel
+
+    (void)y;
+    fromskew *= samplesperpixel;
+    FORMATPUT(FETCH, FETCH16, 1, wp += fromskew);
+#undef FETCH
+#undef FETCH16
+}
+
+/*
+ * 16-bit packed samples => RGBA w/ unassociated alpha in the output format
+ */
+DECLAREContigPutFunc(putRGBUAcontig16bitformat)
+{
+    int samplesperpixel = img->samplesperpixel;
+    uint16_t *wp = (uint16_t *)pp;
+    uint32_t rv, gv, bv, av;
+    uint8_t *m;
+#define FETCH                                                                  \
+    av = img->Bitdepth16To8[wp[3]];                                            \
+    m = img->UaToAa + ((size_t)av << 8);                                       \
+    rv = m[img->Bitdepth16To8[wp[0]]];                                         \
+    gv = m[img->Bitdepth16To8[wp[1]]];                                         \
+    bv = m[img->Bitdepth16To8[wp[2]]];                                         \
+    wp += samplesperpixel
+#define FETCH16                                                                \
+    av = wp[3];                                                                \
+    rv = (wp[0] * av + 32767) / 65535;                                         \
+    gv = (wp[1] * av + 32767) / 65535;                                         \
+    bv = (wp[2] * av + 32767) / 65535;                                         \
+    wp += samplesperpixel
+
+    (void)y;
+    fromskew *= samplesperpixel;
+    FORMATPUT(FETCH, FETCH16, 1, wp += fromskew);
+#undef FETCH
+#undef FETCH16
+}
+
+/*
+ * 8-bit unpacked samples => RGB in the output format
+ */
+DECLARESepPutFunc(putRGBseparate8bitformat)
+{
+    uint32_t rv, gv, bv, av = 255;
+#define FETCH                                                                  \
+    rv = *r++;                                                                 \
+    gv = *g++;                                                                 \
+    bv = *b++
+
+    (void)y;
+    (void)a;
+    FORMATPUT(FETCH, FETCH, 257, SKEW(r, g, b, fromskew));
+#undef FETCH
+}
+
+/*
+ * 8-bit unpacked samples => RGBA w/ associated alpha in the output format
+ * (or w/ unassociated alpha kept as is)
+ */
+DECLARESepPutFunc(putRGBAAseparate8bitformat)
+{
+    uint32_t rv, gv, bv, av;
+#define FETCH                                                                  \
+    rv = *r++;                                                                 \
+    gv = *g++;                                                                 \
+    bv = *b++;                                                                 \
+    av = *a++
+
+    (void)y;
+    FORMATPUT(FETCH, FETCH, 257, SKEW4(r, g, b, a, fromskew));
+#undef FETCH
+}
+
+/*
+ * 8-bit unpacked samples => RGBA w/ unassociated alpha in the output format
+ */
+DECLARESepPutFunc(putRGBUAseparate8bitformat)
+{
+    uint32_t rv, gv, bv, av;
+    uint8_t *m;
+#define FETCH                                                                  \
+    av = *a++;                                                                 \
+    m = img->UaToAa + ((size_t)av << 8);                                       \
+    rv = m[*r++];                                                              \
+    gv = m[*g++];                                                              \
+    bv = m[*b++]
+
+    (void)y;
+    FORMATPUT(FETCH, FETCH, 257, SKEW4(r, g, b, a, fromskew));
+#undef FETCH
+}
+
+/*
+ * 16-bit unpacked samples => RGB in the output format
+ */
+DECLARESepPutFunc(putRGBseparate16bitformat)
+{
+    uint16_t *wr = (uint16_t *)r;
+    uint16_t *wg = (uint16_t *)g;
+    uint16_t *wb = (uint16_t *)b;
+    uint32_t rv, gv, bv, av;
+#define FETCH                                                                  \
+    rv = img->Bitdepth16To8[*wr++];                                            \
+    gv = img->Bitdepth16To8[*wg++];                                            \
+    bv = img->Bitdepth16To8[*wb++];                                            \
+    av = 255
+#define FETCH16                                                                \
+    rv = *wr++;                                                                \
+    gv = *wg++;                                                                \
+    bv = *wb++;                                                                \
+    av = 65535
+
+    (void)y;
+    (void)a;
+    FORMATPUT(FETCH, FETCH16, 1, SKEW(wr, wg, wb, fromskew));
+#undef FETCH
+#undef FETCH16
+}
+
+/*
+ * 16-bit unpacked samples => RGBA w/ associated alpha in the output format
+ * (or w/ unassociated alpha kept as is)
+ */
+DECLARESepPutFunc(putRGBAAseparate16bitformat)
+{
+    uint16_t *wr = (uint16_t *)r;
+    uint16_t *wg = (uint16_t *)g;
+    uint16_t *wb = (uint16_t *)b;
+    uint16_t *wa = (uint16_t *)a;
+    uint32_t rv, gv, bv, av;
+#define FETCH                                                                  \
+    rv = img->Bitdepth16To8[*wr++];                                            \
+    gv = img->Bitdepth16To8[*wg++];                                            \
+    bv = img->Bitdepth16To8[*wb++];                                            \
+    av = img->Bitdepth16To8[*wa++]
+#define FETCH16                                                                \
+    rv = *wr++;                                                                \
+    gv = *wg++;                                                                \
+    bv = *wb++;                                                                \
+    av = *wa++
+
+    (void)y;
+    FORMATPUT(FETCH, FETCH16, 1, SKEW4(wr, wg, wb, wa, fromskew));
+#undef FETCH
+#undef FETCH16
+}
+
+/*
+ * 16-bit unpacked samples => RGBA w/ unassociated alpha in the output format
+ */
+DECLARESepPutFunc(putRGBUAseparate16bitformat)
+{
+    uint16_t *wr = (uint16_t *)r;
+    uint16_t *wg = (uint16_t *)g;
+    uint16_t *wb = (uint16_t *)b;
+    uint16_t *wa = (uint16_t *)a;
+    uint32_t rv, gv, bv, av;
+    uint8_t *m;
+#define FETCH                                                                  \
+    av = img->Bitdepth16To8[*wa++];                                            \
+    m = img->UaToAa + ((size_t)av << 8);                                       \
+    rv = m[img->Bitdepth16To8[*wr++]];                                         \
+    gv = m[img->Bitdepth16To8[*wg++]];                                         \
+    bv = m[img->Bitdepth16To8[*wb++]]
+#define FETCH16                                                                \
+    av = *wa++;                                                                \
+    rv = (*wr++ * av + 32767) / 65535;                                         \
+    gv = (*wg++ * av + 32767) / 65535;                                         \
+    bv = (*wb++ * av + 32767) / 65535
+
+    (void)y;
+    FORMATPUT(FETCH, FETCH16, 1, SKEW4(wr, wg, wb, wa, fromskew));
+#undef FETCH
+#undef FETCH16
+}
+
+/*
+ * Make img->formatbuf hold w * h ABGR pixels.
+ */
+static int formatBuffer(TIFFRGBAImage *img, uint32_t w, uint32_t h)
+{
+    static const char module[] = "TIFFRGBAImageGet";
+    tmsize_t n = _TIFFMultiplySSize(img->tif, w, h, module);
+
+    if (n == 0)
+        return 0;
+    if (n > img->formatbufsize)
+    {
+        tmsize_t size =
+            _TIFFMultiplySSize(img->tif, n, sizeof(uint32_t), module);
+        uint32_t *buf =
+            size == 0 ? NULL
+                      : (uint32_t *)_TIFFreallocExt(img->tif, img->formatbuf,
+                                                    size);
+        if (buf == NULL)
+        {
+            TIFFErrorExtR(img->tif, module, "Out of memory");
+            return 0;
+        }
+        img->formatbuf = buf;
+        img->formatbufsize = n;
+    }
+    return 1;
+}
+
+/*
+ * Undo the premultiplication of an 8-bit sample by the alpha value a.
+ */
+static inline uint32_t unpremultiply8(uint32_t v, uint32_t a)
+{
+    if (a == 0)
+        return 0;
+    v = (v * 255 + a / 2) / a;
+    return v > 255 ? 255 : v;
+}
+
+/*
+ * Convert the ABGR pixels of img->formatbuf to the output format.
+ */
+#define FETCHABGR                                                              \
+    v = *sp++;                                                                 \
+    rv = TIFFGetR(v);                                                          \
+    gv = TIFFGetG(v);                                                          \
+    bv = TIFFGetB(v);                                                          \
+    av = TIFFGetA(v);                                                          \
+    if (unassociate && av != 255)                                              \
+    {                                                                          \
+        rv = unpremultiply8(rv, av);                                           \
+        gv = unpremultiply8(gv, av);                                           \
+        bv = unpremultiply8(bv, av);                                           \
+    }
+
+/*
+ * Any samples => output format, through the ABGR pixels of the default
+ * routine
+ */
+DECLAREContigPutFunc(putcontigformat)
+{
+    int unassociate = (img->format & TIFFRGBA_FORMAT_UNASSOCIATED) &&
+                      img->alpha == EXTRASAMPLE_ASSOCALPHA;
+    const uint32_t *sp;
+    uint32_t rv, gv, bv, av, v;
+
+    if (!formatBuffer(img, w, h))
+        return;
+    (*img->formatput.contig)(img, img->formatbuf, x, y, w, h, fromskew, 0,
+                             pp);
+    sp = img->formatbuf;
+    FORMATPUT(FETCHABGR, FETCHABGR, 257, NOP);
+}
+
+/*
+ * Any unpacked samples => output format, through the ABGR pixels of the
+ * default routine
+ */
+DECLARESepPutFunc(putseparateformat)
+{
+    int unassociate = (img->format & TIFFRGBA_FORMAT_UNASSOCIATED) &&
+                      img->alpha == EXTRASAMPLE_ASSOCALPHA;
+    const uint32_t *sp;
+    uint32_t rv, gv, bv, av, v;
+
+    if (!formatBuffer(img, w, h))
+        return;
+    (*img->formatput.separate)(img, img->formatbuf, x, y, w, h, fromskew, 0,
+                               r, g, b, a);
+    sp = img->formatbuf;
+    FORMATPUT(FETCHABGR, FETCHABGR, 257, NOP);
+}
+#undef FETCHABGR
+
+/*
+ * TIFFRGBA_FORMAT_RGBAF32 output of greyscale and RGB images: the samples
+ * are converted to float up to FLOAT_CHUNK at a time by the kernel of their
+ * type, then the color ones are mapped from [minsamplevalue, maxsamplevalue]
+ * to [0, 1], without clipping, and the alpha ones from [0, largest value of
+ * their integer type] (or as is if floating point) to [0, 1].
+ */
+#define FLOAT_CHUNK 1024
+
+typedef void (*floatKernel)(const uint8_t *, tmsize_t, float *);
+
+typedef struct
+{
+    floatKernel kernel;
+    tmsize_t samplesize; /* bytes per sample */
+    float scale;         /* color = sample * scale + offset */
+    float offset;
+    float alphascale; /* alpha = sample * alphascale */
+    int associate;    /* multiply colors by alpha if > 0, divide if < 0 */
+} TIFFRGBAFloat;
+
+static void floatFromUInt8(const uint8_t *pp, tmsize_t n, float *op)
+{
+    tmsize_t i = 0;
+#ifdef FLOAT_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadl_epi64((const __m128i *)(const void *)(pp + i));
+        v = _mm_unpacklo_epi8(v, zero);
+        _mm_storeu_ps(op + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_ps(op + i + 4,
+                      _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+    }
+#endif
+    for (; i < n; i++)
+        op[i] = (float)pp[i];
+}
+
+static void floatFromInt8(const uint8_t *pp, tmsize_t n, float *op)
+{
+    tmsize_t i = 0;
+#ifdef FLOAT_USE_SSE2
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadl_epi64((const __m128i *)(const void *)(pp + i));
+        v = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+        _mm_storeu_ps(op + i, _mm_cvtepi32_ps(_mm_srai_epi32(
+                                  _mm_unpacklo_epi16(v, v), 16)));
+        _mm_storeu_ps(op + i + 4, _mm_cvtepi32_ps(_mm_srai_epi32(
+                                      _mm_unpackhi_epi16(v, v), 16)));
+    }
+#endif
+    for (; i < n; i++)
+        op[i] = (float)(int8_t)pp[i];
+}
+
+static void floatFromUInt16(const uint8_t *pp, tmsize_t n, float *op)
+{
+    const uint16_t *wp = (const uint16_t *)(const void *)pp;
+    tmsize_t i = 0;
+#ifdef FLOAT_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(wp + i));
+        _mm_storeu_ps(op + i, _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_ps(op + i + 4,
+                      _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)));
+    }
+#endif
+    for (; i < n; i++)
+        op[i] = (float)wp[i];
+}
+
+static void floatFromInt16(const uint8_t *pp, tmsize_t n, float *op)
+{
+    const int16_t *wp = (const int16_t *)(const void *)pp;
+    tmsize_t i = 0;
+#ifdef FLOAT_USE_SSE2
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(wp + i));
+        _mm_storeu_ps(op + i, _mm_cvtepi32_ps(_mm_srai_epi32(
+                                  _mm_unpacklo_epi16(v, v), 16)));
+        _mm_storeu_ps(op + i + 4, _mm_cvtepi32_ps(_mm_srai_epi32(
+                                      _mm_unpackhi_epi16(v, v), 16)));
+    }
+#endif
+    for (; i < n; i++)
+        op[i] = (float)wp[i];
+}
+
+/*
+ * IEEE half precision samples: the exponent and mantissa bits shifted to
+ * their place in a float have their exponent rebiased, set to all ones for
+ * infinities and NaNs, and subnormal values are normalized by subtracting
+ * 2^-14 from them with the implicit bit set, without any subnormal float
+ * operand, which would be slow on some processors.
+ */
+static inline float halfToFloat(uint16_t h)
+{
+    uint32_t em = h & 0x7fffU;
+    uint32_t u = (em << 13) + ((127U - 15) << 23);
+    float f;
+
+    if (em > 0x7bffU)
+        u += (128U - 16) << 23;
+    else if (em < 0x0400U)
+    {
+        u += 1U << 23;
+        memcpy(&f, &u, sizeof(f));
+        f -= 6.103515625e-05F; /* 2^-14 */
+        memcpy(&u, &f, sizeof(u));
+    }
+    u |= (uint32_t)(h & 0x8000U) << 16;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+#ifdef FLOAT_USE_SSE2
+static inline __m128 halfToFloat4(__m128i h)
+{
+    const __m128i expmant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+    const __m128i infnan = _mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff));
+    const __m128i subnormal =
+        _mm_cmplt_epi32(expmant, _mm_set1_epi32(0x0400));
+    __m128i u = _mm_add_epi32(_mm_slli_epi32(expmant, 13),
+                              _mm_set1_epi32((127 - 15) << 23));
+    __m128 f;
+
+    u = _mm_add_epi32(
+        u, _mm_and_si128(infnan, _mm_set1_epi32((128 - 16) << 23)));
+    u = _mm_add_epi32(u, _mm_and_si128(subnormal, _mm_set1_epi32(1 << 23)));
+    f = _mm_sub_ps(_mm_castsi128_ps(u),
+                   _mm_and_ps(_mm_castsi128_ps(subnormal),
+                              _mm_set1_ps(6.103515625e-05F)));
+    return _mm_or_ps(f, _mm_castsi128_ps(_mm_slli_epi32(
+                            _mm_xor_si128(h, expmant), 16)));
+}
+#endif
+
+static void floatFromHalf(const uint8_t *pp, tmsize_t n, float *op)
+{
+    const uint16_t *wp = (const uint16_t *)(const void *)pp;
+    tmsize_t i = 0;
+#ifdef FLOAT_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(const void *)(wp + i));
+        _mm_storeu_ps(op + i, halfToFloat4(_mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_ps(op + i + 4, halfToFloat4(_mm_unpackhi_epi16(v, zero)));
+    }
+#endif
+    for (; i < n; i++)
+        op[i] = halfToFloat(wp[i]);
+}
+
+static void floatFromFloat(const uint8_t *pp, tmsize_t n, float *op)
+{
+    memcpy(op, pp, (size_t)n * sizeof(float));
+}
+
+/*
+ * Kernel converting the samples of img to float, and scale of their
+ * alpha values; NULL if there is none for their type.
+ */
+static floatKernel pickFloatKernel(TIFFRGBAImage *img, float *alphascale)
+{
+    uint16_t sampleformat = img->tif->tif_dir.td_sampleformat;
+
+    switch (img->bitspersample)
+    {
+        case 8:
+            if (sampleformat == SAMPLEFORMAT_INT)
+            {
+                *alphascale = 1.0F / 127;
+                return floatFromInt8;
+            }
+            if (sampleformat == SAMPLEFORMAT_UINT ||
+                sampleformat == SAMPLEFORMAT_VOID)
+            {
+                *alphascale = 1.0F / 255;
+                return floatFromUInt8;
+            }
+            break;
+        case 16:
+            if (sampleformat == SAMPLEFORMAT_IEEEFP)
+            {
+                *alphascale = 1.0F;
+                return floatFromHalf;
+            }
+            if (sampleformat == SAMPLEFORMAT_INT)
+            {
+                *alphascale = 1.0F / 32767;
+                return floatFromInt16;
+            }
+            if (sampleformat == SAMPLEFORMAT_UINT ||
+                sampleformat == SAMPLEFORMAT_VOID)
+            {
+                *alphascale = 1.0F / 65535;
+                return floatFromUInt16;
+            }
+            break;
+        case 32:
+            if (sampleformat == SAMPLEFORMAT_IEEEFP)
+            {
+                *alphascale = 1.0F;
+                return floatFromFloat;
+            }
+            break;
+    }
+    return NULL;
+}
+
+static void floatSetup(TIFFRGBAImage *img, TIFFRGBAFloat *f)
+{
+    double range = img->maxsamplevalue - img->minsamplevalue;
+    double scale = range != 0.0 ? 1.0 / range : 0.0;
+    double offset = -img->minsamplevalue * scale;
+    int unassociated = (img->format & TIFFRGBA_FORMAT_UNASSOCIATED) != 0;
+
+    f->kernel = pickFloatKernel(img, &f->alphascale);
+    f->samplesize = rgbaSampleSize(img);
+    if (img->photometric == PHOTOMETRIC_MINISWHITE)
+    {
+        scale = -scale;
+        offset = 1.0 - offset;
+    }
+    f->scale = (float)scale;
+    f->offset = (float)offset;
+    f->associate = 0;
+    if (img->alpha == EXTRASAMPLE_UNASSALPHA && !unassociated)
+        f->associate = 1;
+    else if (img->alpha == EXTRASAMPLE_ASSOCALPHA && unassociated)
+        f->associate = -1;
+}
+
+/*
+ * Store n pixels of the float color samples r, g and b and alpha samples a
+ * (NULL if there is none), stride floats apart, as RGBA floats.
+ */
+static void putFloatPixels(const TIFFRGBAFloat *f, const float *r,
+                           const float *g, const float *b, const float *a,
+                           size_t stride, uint32_t n, float *op)
+{
+    const float scale = f->scale, offset = f->offset;
+    uint32_t i = 0;
+
+#ifdef FLOAT_USE_SSE2
+    if (stride == 1 && f->associate >= 0)
+    {
+        /* four pixels of separate samples at a time */
+        const __m128 vscale = _mm_set1_ps(scale);
+        const __m128 voffset = _mm_set1_ps(offset);
+        const __m128 valphascale = _mm_set1_ps(f->alphascale);
+        for (; i + 4 <= n; i += 4, op += 16)
+        {
+            __m128 vr = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(r + i), vscale),
+                                   voffset);
+            __m128 vg = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(g + i), vscale),
+                                   voffset);
+            __m128 vb = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(b + i), vscale),
+                                   voffset);
+            __m128 va = _mm_set1_ps(1.0F);
+            if (a != NULL)
+                va = _mm_mul_ps(_mm_loadu_ps(a + i), valphascale);
+            if (f->associate > 0)
+            {
+                vr = _mm_mul_ps(vr, va);
+                vg = _mm_mul_ps(vg, va);
+                vb = _mm_mul_ps(vb, va);
+            }
+            _MM_TRANSPOSE4_PS(vr, vg, vb, va);
+            _mm_storeu_ps(op, vr);
+            _mm_storeu_ps(op + 4, vg);
+            _mm_storeu_ps(op + 8, vb);
+            _mm_storeu_ps(op + 12, va);
+        }
+    }
+    else if (g == r + 1 && b == r + 2 && (a == NULL || a == r + 3) &&
+             f->associate >= 0)
+    {
+        /* a pixel of contiguous RGB(A) samples at a time, reading one float
+         * past the last one of RGB samples */
+        const __m128 vscale = _mm_setr_ps(scale, scale, scale, f->alphascale);
+        const __m128 voffset = _mm_setr_ps(offset, offset, offset, 0.0F);
+        const __m128 rgbmask =
+            _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+        const __m128 alphaone = _mm_setr_ps(0.0F, 0.0F, 0.0F, 1.0F);
+        for (; i < n; i++, op += 4)
+        {
+            __m128 v = _mm_add_ps(
+                _mm_mul_ps(_mm_loadu_ps(r + i * stride), vscale), voffset);
+            if (a == NULL)
+                v = _mm_or_ps(_mm_and_ps(v, rgbmask), alphaone);
+            else if (f->associate > 0)
+                v = _mm_mul_ps(
+                    v, _mm_or_ps(_mm_and_ps(_mm_shuffle_ps(v, v, 0xff),
+                                            rgbmask),
+                                 alphaone));
+            _mm_storeu_ps(op, v);
+        }
+    }
+#endif
+    for (; i < n; i++, op += 4)
+    {
+        float av = a == NULL ? 1.0F : a[i * stride] * f->alphascale;
+        float m = 1.0F;
+        if (f->associate > 0)
+            m = av;
+        else if (f->associate < 0)
+            m = av != 0.0F ? 1.0F / av : 0.0F;
+        op[0] = (r[i * stride] * scale + offset) * m;
+        op[1] = (g[i * stride] * scale + offset) * m;
+        op[2] = (b[i * stride] * scale + offset) * m;
+        op[3] = av;
+    }
+}
+
+/*
+ * Greyscale or RGB packed samples => RGBA floats
+ */
+DECLAREContigPutFunc(putcontigfloat)
+{
+    int samplesperpixel = img->samplesperpixel;
+    int grey = img->photometric != PHOTOMETRIC_RGB;
+    int alphasample = grey ? 1 : 3;
+    int alpha = img->alpha && samplesperpixel > alphasample;
+    uint32_t chunk = FLOAT_CHUNK / samplesperpixel;
+    float *op = (float *)(void *)cp;
+    float s[FLOAT_CHUNK + 1];
+    TIFFRGBAFloat f;
+
+    (void)y;
+    floatSetup(img, &f);
+    for (; h > 0; --h)
+    {
+        for (x = 0; x < w;)
+        {
+            uint32_t n = TIFFmin(chunk, w - x);
+            tmsize_t ns = (tmsize_t)n * samplesperpixel;
+
+            (*f.kernel)(pp, ns, s);
+            s[ns] = 0.0F;
+            pp += ns * f.samplesize;
+            putFloatPixels(&f, s, grey ? s : s + 1, grey ? s : s + 2,
+                           alpha ? s + alphasample : NULL,
+                           (size_t)samplesperpixel, n, op);
+            op += (size_t)n * 4;
+            x += n;
+        }
+        pp += (tmsize_t)fromskew * samplesperpixel * f.samplesize;
+        op += (ptrdiff_t)toskew * 4;
+    }
+}
+
+/*
+ * Greyscale or RGB unpacked samples => RGBA floats
+ */
+DECLARESepPutFunc(putseparatefloat)
+{
+    int grey = g == r;
+    float s[FLOAT_CHUNK];
+    float *sr = s, *sg = s + FLOAT_CHUNK / 4, *sb = s + FLOAT_CHUNK / 2;
+    float *sa = s + 3 * (FLOAT_CHUNK / 4);
+    float *op = (float *)(void *)cp;
+    TIFFRGBAFloat f;
+
+    (void)y;
+    floatSetup(img, &f);
+    for (; h > 0; --h)
+    {
+        for (x = 0; x < w;)
+        {
+            uint32_t n = TIFFmin(FLOAT_CHUNK / 4, w - x);
+            tmsize_t nb = (tmsize_t)n * f.samplesize;
+
+            (*f.kernel)(r, n, sr);
+            r += nb;
+            if (!grey)
+            {
+                (*f.kernel)(g, n, sg);
+                (*f.kernel)(b, n, sb);
+                g += nb;
+                b += nb;
+            }
+            if (a != NULL)
+            {
+                (*f.kernel)(a, n, sa);
+                a += nb;
+            }
+            putFloatPixels(&f, sr, grey ? sr : sg, grey ? sr : sb,
+                           a != NULL ? sa : NULL, 1, n, op);
+            op += (size_t)n * 4;
+            x += n;
+        }
+        r += (tmsize_t)fromskew * f.samplesize;
+        if (!grey)
+        {
+            g += (tmsize_t)fromskew * f.samplesize;
+            b += (tmsize_t)fromskew * f.samplesize;
+        }
+        if (a != NULL)
+            a += (tmsize_t)fromskew * f.samplesize;
+        op += (ptrdiff_t)toskew * 4;
+    }
+}
+
+/*
+ * Make img->transpose->buf hold w * h pixels of the output format.
+ */
+static int transposeBuffer(TIFFRGBAImage *img, uint32_t w, uint32_t h)
+{
+    static const char module[] = "TIFFRGBAImageGet";
+    TIFFRGBATranspose *t = img->transpose;
+    tmsize_t size = _TIFFMultiplySSize(
+        img->tif, _TIFFMultiplySSize(img->tif, w, h, module),
+        (tmsize_t)rgbaPixelSize(img), module);
+
+    if (size == 0)
+        return 0;
+    if (size > t->bufsize)
+    {
+        uint8_t *buf = (uint8_t *)_TIFFreallocExt(img->tif, t->buf, size);
+        if (buf == NULL)
+        {
+            TIFFErrorExtR(img->tif, module, "Out of memory");
+            return 0;
+        }
+        t->buf = buf;
+        t->bufsize = size;
+    }
+    return 1;
+}
+
+/*
+ * Copy the w x h pixels of img->transpose->buf, at column x and row y of
+ * the image, to their place in the raster, where each of their columns is
+ * a row.  This is done by blocks of TRANSPOSE_BLOCK x TRANSPOSE_BLOCK
+ * pixels, so that both the rows read and the rows written stay in cache.
+ */
+#define TRANSPOSE_BLOCK 16
+
+#define TRANSPOSECOPY(ps)                                                      \
+    for (i = bx; i < bx + bw; i++)                                             \
+    {                                                                          \
+        const uint8_t *src = t->buf + ((tmsize_t)by * w + i) * (ps);           \
+        uint8_t *dst = t->origin + (tmsize_t)(x + i) * t->rowstep +            \
+                       (tmsize_t)(y + by) * t->colstep;                        \
+        for (j = 0; j < bh; j++)                                               \
+        {                                                                      \
+            memcpy(dst, src, (ps));                                            \
+            src += (tmsize_t)w * (ps);                                         \
+            dst += t->colstep;                                                 \
+        }                                                                      \
+    }
+
+static void transposeBlock(TIFFRGBAImage *img, uint32_t x, uint32_t y,
+                           uint32_t w, uint32_t h)
+{
+    const TIFFRGBATranspose *t = img->transpose;
+    size_t ps = rgbaPixelSize(img);
+    uint32_t bx, by, bw, bh, i, j;
+
+    for (by = 0; by < h; by += TRANSPOSE_BLOCK)
+    {
+        bh = TIFFmin(TRANSPOSE_BLOCK, h - by);
+        for (bx = 0; bx < w; bx += TRANSPOSE_BLOCK)
+        {
+            bw = TIFFmin(TRANSPOSE_BLOCK, w - bx);
+            switch (ps)
+            {
+                case 3:
+                    TRANSPOSECOPY(3);
+                    break;
+                case 8:
+                    TRANSPOSECOPY(8);
+                    break;
+                case 16:
+                    TRANSPOSECOPY(16);
+                    break;
+                default:
+                    TRANSPOSECOPY(4);
+                    break;
+            }
+        }
+    }
+}
+#undef TRANSPOSECOPY
+
+/*
+ * Any samples => transposed raster, through the output of the routine
+ * picked for the image
+ */
+DECLAREContigPutFunc(putcontigtransposed)
+{
+    (void)cp;
+    (void)toskew;
+    if (!transposeBuffer(img, w, h))
+        return;
+    (*img->transpose->put.contig)(img, (uint32_t *)(void *)img->transpose->buf,
+                                  x, y, w, h, fromskew, 0, pp);
+    transposeBlock(img, x, y, w, h);
+}
+
+/*
+ * Any unpacked samples => transposed raster, through the output of the
+ * routine picked for the image
+ */
+DECLARESepPutFunc(putseparatetransposed)
+{
+    (void)cp;
+    (void)toskew;
+    if (!transposeBuffer(img, w, h))
+        return;
+    (*img->transpose->put.separate)(
+        img, (uint32_t *)(void *)img->transpose->buf, x, y, w, h, fromskew, 0,
+        r, g, b, a);
+    transposeBlock(img, x, y, w, h);
+}
+
+/*
+ * 8-bit packed CIE L*a*b 1976 samples => RGB
+ */
+DECLAREContigPutFunc(putcontig8bitCIELab8)
+{
+    float X, Y, Z;
+    uint32_t r, g, b;
+    (void)y;
+    fromskew *= 3;
+    for (; h > 0; --h)
+    {
         for (x = w; x > 0; --x)
         {
-            kv = 255 - *a++;
-            rv = (kv * (255 - *r++)) / 255;
-            gv = (kv * (255 - *g++)) / 255;
-            bv = (kv * (255 - *b++)) / 255;
-            *cp++ = PACK4(rv, gv, bv, 255);
+            TIFFCIELabToXYZ(img->cielab, (unsigned char)pp[0],
+                            (signed char)pp[1], (signed char)pp[2], &X, &Y, &Z);
+            TIFFXYZToRGB(img->cielab, X, Y, Z, &r, &g, &b);
+            *cp++ = PACK(r, g, b);
+            pp += 3;
         }
-        SKEW4(r, g, b, a, fromskew);
         cp += toskew;
+        pp += fromskew;
     }
 }
 
 /*
- * 8-bit unpacked samples => RGBA w/ unassociated alpha
+ * 16-bit packed CIE L*a*b 1976 samples => RGB
  */
-DECLARESepPutFunc(putRGBUAseparate8bittile)
+DECLAREContigPutFunc(putcontig8bitCIELab16)
 {
-    (void)img;
+    float X, Y, Z;
+    uint32_t r, g, b;
+    uint16_t *wp = (uint16_t *)pp;
     (void)y;
+    fromskew *= 3;
     for (; h > 0; --h)
     {
-        uint32_t rv, gv, bv, av;
-        uint8_t *m;
         for (x = w; x > 0; --x)
         {
-            av = *a++;
-            m = img->UaToAa + ((size_t)av << 8);
-            rv = m[*r++];
-            gv = m[*g++];
-            bv = m[*b++];
-            *cp++ = PACK4(rv, gv, bv, av);
+            TIFFCIELab16ToXYZ(img->cielab, (uint16_t)wp[0], (int16_t)wp[1],
+                              (int16_t)wp[2], &X, &Y, &Z);
+            TIFFXYZToRGB(img->cielab, X, Y, Z, &r, &g, &b);
+            *cp++ = PACK(r, g, b);
+            wp += 3;
         }
-        SKEW4(r, g, b, a, fromskew);
         cp += toskew;
+        wp += fromskew;
     }
 }
 
 /*
- * 16-bit unpacked samples => RGB
+ * CIE L*a*b* images are converted through a table of the display luminosity
+ * of a grid of (2^bits + 1)^3 L*a*b* points, with tetrahedral interpolation
+ * between them, rather than converting each pixel with TIFFCIELabToXYZ()
+ * and TIFFXYZToRGB().  The luminosity is interpolated before it is clipped
+ * and gamma corrected, so that only the smooth L*a*b* to XYZ part of the
+ * conversion is approximated.  With TIFFRGBA_FORMAT_CIELAB_LUT, bits is
+ * given by TIFFRGBA_FORMAT_CIELAB_LUT_BITS(), between 1 and 6, or is
+ * CIELAB_LUT_FORMAT_BITS; it is CIELAB_LUT_BITS otherwise.  0 selects the
+ * exact conversion, which is the default, and is also used for images
+ * having fewer pixels than the grid has points.
  */
-DECLARESepPutFunc(putRGBseparate16bittile)
+#ifndef CIELAB_LUT_BITS
+#define CIELAB_LUT_BITS 0
+#endif
+#ifndef CIELAB_LUT_FORMAT_BITS
+#define CIELAB_LUT_FORMAT_BITS 5
+#endif
+#define CIELAB_LUT_MAX_BITS 6
+#define CIELAB_LUT_FRAC 4 /* fractional bits of the luminosity */
+
+typedef struct
 {
-    uint16_t *wr = (uint16_t *)r;
-    uint16_t *wg = (uint16_t *)g;
-    uint16_t *wb = (uint16_t *)b;
-    (void)img;
-    (void)y;
-    (void)a;
-    for (; h > 0; --h)
-    {
-        for (x = 0; x < w; x++)
-            *cp++ = PACK(img->Bitdepth16To8[*wr++], img->Bitdepth16To8[*wg++],
-                         img->Bitdepth16To8[*wb++]);
-        SKEW(wr, wg, wb, fromskew);
-        cp += toskew;
-    }
-}
+    int shift;      /* 16 - bits */
+    int size;       /* 2^bits + 1 points per axis */
+    int32_t *nodes; /* Yr2r, Yg2g and Yb2b indices of the points */
+    uint8_t *rgb;   /* R, G and B values of the indices */
+} TIFFCIELabLUT;
 
 /*
- * 16-bit unpacked samples => RGBA w/ associated alpha
+ * The table follows the TIFFCIELabToRGB structure in img->cielab.
  */
-DECLARESepPutFunc(putRGBAAseparate16bittile)
-{
-    uint16_t *wr = (uint16_t *)r;
-    uint16_t *wg = (uint16_t *)g;
-    uint16_t *wb = (uint16_t *)b;
-    uint16_t *wa = (uint16_t *)a;
-    (void)img;
-    (void)y;
-    for (; h > 0; --h)
-    {
-        for (x = 0; x < w; x++)
-            *cp++ = PACK4(img->Bitdepth16To8[*wr++], img->Bitdepth16To8[*wg++],
-                          img->Bitdepth16To8[*wb++], img->Bitdepth16To8[*wa++]);
-        SKEW4(wr, wg, wb, wa, fromskew);
-        cp += toskew;
-    }
-}
+#define CIELabLUT(img)                                                         \
+    ((TIFFCIELabLUT *)(void *)((uint8_t *)(img)->cielab +                      \
+                               TIFFroundup_32(sizeof(TIFFCIELabToRGB),         \
+                                              sizeof(long))))
 
 /*
- * 16-bit unpacked samples => RGBA w/ unassociated alpha
+ * Interpolate the RGB value of the 16-bit L*, a* + 32768 and b* + 32768
+ * values l, a and b in the tetrahedron of the grid cell holding them.
  */
-DECLARESepPutFunc(putRGBUAseparate16bittile)
+static inline uint32_t CIELabLUTLookup(const TIFFCIELabLUT *lut, uint32_t l,
+                                       uint32_t a, uint32_t b)
 {
-    uint16_t *wr = (uint16_t *)r;
-    uint16_t *wg = (uint16_t *)g;
-    uint16_t *wb = (uint16_t *)b;
-    uint16_t *wa = (uint16_t *)a;
-    (void)img;
-    (void)y;
-    for (; h > 0; --h)
+    int shift = lut->shift;
+    uint32_t mask = ((uint32_t)1 << shift) - 1;
+    int32_t sa = 3 * lut->size, sl = sa * lut->size;
+    const int32_t *c = lut->nodes + (l >> shift) * sl + (a >> shift) * sa +
+                       (b >> shift) * 3;
+    /* 8-bit position in the cell */
+    int32_t fl = (int32_t)((l & mask) >> (shift - 8));
+    int32_t fa = (int32_t)((a & mask) >> (shift - 8));
+    int32_t fb = (int32_t)((b & mask) >> (shift - 8));
+    int32_t f1, f2, f3, o1, o2;
+    uint32_t v[3];
+    int i;
+
+    /* walk from the cell origin along the axes of decreasing position */
+    if (fl >= fa)
     {
-        uint32_t r2, g2, b2, a2;
-        uint8_t *m;
-        for (x = w; x > 0; --x)
+        if (fa >= fb)
         {
-            a2 = img->Bitdepth16To8[*wa++];
-            m = img->UaToAa + ((size_t)a2 << 8);
-            r2 = m[img->Bitdepth16To8[*wr++]];
-            g2 = m[img->Bitdepth16To8[*wg++]];
-            b2 = m[img->Bitdepth16To8[*wb++]];
-            *cp++ = PACK4(r2, g2, b2, a2);
+            f1 = fl;
+            f2 = fa;
+            f3 = fb;
+            o1 = sl;
+            o2 = sl + sa;
         }
-        SKEW4(wr, wg, wb, wa, fromskew);
-        cp += toskew;
+        else if (fl >= fb)
+        {
+            f1 = fl;
+            f2 = fb;
+            f3 = fa;
+            o1 = sl;
+            o2 = sl + 3;
+        }
+        else
+        {
+            f1 = fb;
+            f2 = fl;
+            f3 = fa;
+            o1 = 3;
+            o2 = sl + 3;
+        }
+    }
+    else
+    {
+        if (fb >= fa)
+        {
+            f1 = fb;
+            f2 = fa;
+            f3 = fl;
+            o1 = 3;
+            o2 = sa + 3;
+        }
+        else if (fb >= fl)
+        {
+            f1 = fa;
+            f2 = fb;
+            f3 = fl;
+            o1 = sa;
+            o2 = sa + 3;
+        }
+        else
+        {
+            f1 = fa;
+            f2 = fl;
+            f3 = fb;
+            o1 = sa;
+            o2 = sl + sa;
+        }
+    }
+    for (i = 0; i < 3; i++)
+    {
+        int32_t c0 = c[i], c1 = c[o1 + i], c2 = c[o2 + i];
+        int32_t c3 = c[sl + sa + 3 + i];
+        int32_t t = ((256 - f1) * c0 + (f1 - f2) * c1 + (f2 - f3) * c2 +
+                     f3 * c3) >>
+                    (8 + CIELAB_LUT_FRAC);
+        /* clip as TIFFXYZToRGB() */
+        t = TIFFmax(t, 0);
+        v[i] = lut->rgb[i * (CIELABTORGB_TABLE_RANGE + 1) +
+                        TIFFmin(t, CIELABTORGB_TABLE_RANGE)];
     }
+    return PACK(v[0], v[1], v[2]);
 }
 
 /*
- * 8-bit packed CIE L*a*b 1976 samples => RGB
+ * 8-bit packed CIE L*a*b 1976 samples => RGB, through the table
  */
-DECLAREContigPutFunc(putcontig8bitCIELab8)
+DECLAREContigPutFunc(putcontig8bitCIELab8LUT)
 {
-    float X, Y, Z;
-    uint32_t r, g, b;
+    const TIFFCIELabLUT *lut = CIELabLUT(img);
     (void)y;
     fromskew *= 3;
     for (; h > 0; --h)
     {
         for (x = w; x > 0; --x)
         {
-            TIFFCIELabToXYZ(img->cielab, (unsigned char)pp[0],
-                            (signed char)pp[1], (signed char)pp[2], &X, &Y, &Z);
-            TIFFXYZToRGB(img->cielab, X, Y, Z, &r, &g, &b);
-            *cp++ = PACK(r, g, b);
+            *cp++ = CIELabLUTLookup(
+                lut, (uint32_t)pp[0] * 257,
+                (uint32_t)(((signed char)pp[1] + 128) << 8),
+                (uint32_t)(((signed char)pp[2] + 128) << 8));
             pp += 3;
         }
         cp += toskew;
@@ -2174,12 +4260,11 @@ DECLAREContigPutFunc(putcontig8bitCIELab8)
 }
 
 /*
- * 16-bit packed CIE L*a*b 1976 samples => RGB
+ * 16-bit packed CIE L*a*b 1976 samples => RGB, through the table
  */
-DECLAREContigPutFunc(putcontig8bitCIELab16)
+DECLAREContigPutFunc(putcontig8bitCIELab16LUT)
 {
-    float X, Y, Z;
-    uint32_t r, g, b;
+    const TIFFCIELabLUT *lut = CIELabLUT(img);
     uint16_t *wp = (uint16_t *)pp;
     (void)y;
     fromskew *= 3;
@@ -2187,10 +4272,8 @@ DECLAREContigPutFunc(putcontig8bitCIELab16)
     {
         for (x = w; x > 0; --x)
         {
-            TIFFCIELab16ToXYZ(img->cielab, (uint16_t)wp[0], (int16_t)wp[1],
-                              (int16_t)wp[2], &X, &Y, &Z);
-            TIFFXYZToRGB(img->cielab, X, Y, Z, &r, &g, &b);
-            *cp++ = PACK(r, g, b);
+            *cp++ = CIELabLUTLookup(lut, wp[0], (uint32_t)(wp[1] ^ 0x8000),
+                                    (uint32_t)(wp[2] ^ 0x8000));
             wp += 3;
         }
         cp += toskew;
@@ -2198,6 +4281,103 @@ DECLAREContigPutFunc(putcontig8bitCIELab16)
     }
 }
 
+/*
+ * Unclipped Yr2r, Yg2g or Yb2b index of the luminosity Yc of a channel of
+ * the display, with CIELAB_LUT_FRAC fractional bits.
+ */
+static int32_t CIELabLUTIndex(float Yc, float Y0, float step)
+{
+    float i = (Yc - Y0) / step * (float)(1 << CIELAB_LUT_FRAC);
+
+    /* far outside of the table anyway */
+    i = TIFFmax(i, -65536.0F);
+    i = TIFFmin(i, 65536.0F);
+    /* round towards minus infinity */
+    return (int32_t)(i + 65536.0F) - 65536;
+}
+
+/*
+ * Fill the table of img->cielab with the values of the 2^bits + 1 points
+ * per axis, and with the RGB values of the indices.
+ */
+static void buildCIELabLUT(TIFFRGBAImage *img, int bits)
+{
+    TIFFCIELabToRGB *cielab = img->cielab;
+    TIFFDisplay *d = &cielab->display;
+    float *matrix = &d->d_mat[0][0];
+    TIFFCIELabLUT *lut = CIELabLUT(img);
+    int32_t *node;
+    int32_t il, ia, ib;
+    int i;
+
+    lut->shift = 16 - bits;
+    lut->size = (1 << bits) + 1;
+    lut->nodes = (int32_t *)(void *)(lut + 1);
+    lut->rgb = (uint8_t *)(lut->nodes +
+                           3 * lut->size * lut->size * lut->size);
+    for (i = 0; i <= CIELABTORGB_TABLE_RANGE; i++)
+    {
+        /* as in TIFFXYZToRGB() */
+        uint8_t *rgb = lut->rgb + i;
+        float v;
+
+        v = TIFFmin(cielab->Yr2r[i], (float)d->d_Vrwr);
+        rgb[0] = (uint8_t)(v + 0.5F);
+        v = TIFFmin(cielab->Yg2g[i], (float)d->d_Vrwg);
+        rgb[CIELABTORGB_TABLE_RANGE + 1] = (uint8_t)(v + 0.5F);
+        v = TIFFmin(cielab->Yb2b[i], (float)d->d_Vrwb);
+        rgb[2 * (CIELABTORGB_TABLE_RANGE + 1)] = (uint8_t)(v + 0.5F);
+    }
+    node = lut->nodes;
+    for (il = 0; il < lut->size; il++)
+    {
+        for (ia = 0; ia < lut->size; ia++)
+        {
+            for (ib = 0; ib < lut->size; ib++)
+            {
+                float X, Y, Z;
+                TIFFCIELab16ToXYZ(cielab, (uint32_t)il << lut->shift,
+                                  (ia << lut->shift) - 32768,
+                                  (ib << lut->shift) - 32768, &X, &Y, &Z);
+                node[0] = CIELabLUTIndex(matrix[0] * X + matrix[1] * Y +
+                                             matrix[2] * Z,
+                                         d->d_Y0R, cielab->rstep);
+                node[1] = CIELabLUTIndex(matrix[3] * X + matrix[4] * Y +
+                                             matrix[5] * Z,
+                                         d->d_Y0G, cielab->gstep);
+                node[2] = CIELabLUTIndex(matrix[6] * X + matrix[7] * Y +
+                                             matrix[8] * Z,
+                                         d->d_Y0B, cielab->bstep);
+                node += 3;
+            }
+        }
+    }
+}
+
+/*
+ * Number of bits of the grid of the table, 0 for the exact conversion.
+ */
+static int CIELabLUTBits(TIFFRGBAImage *img)
+{
+    int bits = CIELAB_LUT_BITS;
+    uint64_t npoints;
+
+    if (img->format & TIFFRGBA_FORMAT_CIELAB_LUT)
+    {
+        bits = (img->format & TIFFRGBA_FORMAT_CIELAB_LUT_BITS_MASK) >> 12;
+        if (bits == 0)
+            bits = CIELAB_LUT_FORMAT_BITS;
+    }
+    if (bits <= 0 || bits > CIELAB_LUT_MAX_BITS)
+        return 0;
+    /* not worth it for images with fewer pixels than points */
+    npoints = (uint64_t)((1 << bits) + 1) * ((1 << bits) + 1) *
+              ((1 << bits) + 1);
+    if ((uint64_t)img->width * img->height < npoints)
+        return 0;
+    return bits;
+}
+
 /*
  * YCbCr -> RGB conversion and packing routines.
  */
@@ -2209,6 +4389,67 @@ DECLAREContigPutFunc(putcontig8bitCIELab16)
         dst = PACK(r, g, b);                                                   \
     }
 
+#ifdef YCBCR_USE_SSE2
+/*
+ * Vectorized conversion of 8 pixels of a row, for the packed layouts
+ * below: blocks of bsize bytes, each one holding the luma samples of hs
+ * pixels per row followed by a Cb, Cr pair at offset coff.
+ *
+ * The values of the tables of TIFFYCbCrToRGBInit() are bounded (luma and
+ * scaled chroma are clamped to +/-4096, the coefficients to 0..2), so that
+ * the sums computed by TIFFYCbCrtoRGB() fit in 16 bit lanes, and the
+ * unsigned saturating pack does the final clamping to 0..255: the result
+ * is the same as the one of the scalar conversion.  The chroma terms are
+ * computed once per block and shared by all its pixels.
+ */
+static inline void YCbCrChroma8SSE2(const TIFFYCbCrToRGB *ycbcr,
+                                    const unsigned char *pp, int hs,
+                                    int bsize, int coff, __m128i *cr,
+                                    __m128i *cg, __m128i *cb)
+{
+    int16_t r[8], g[8], b[8];
+    int i;
+
+    for (i = 0; i < 8 / hs; i++, pp += bsize)
+    {
+        int Cb = pp[coff];
+        int Cr = pp[coff + 1];
+        r[i] = (int16_t)ycbcr->Cr_r_tab[Cr];
+        /* same rounding shift as TIFFYCbCrtoRGB() */
+        g[i] = (int16_t)((ycbcr->Cb_g_tab[Cb] + ycbcr->Cr_g_tab[Cr]) >> 16);
+        b[i] = (int16_t)ycbcr->Cb_b_tab[Cb];
+    }
+#define YCBCR_UPSAMPLE8(v)                                                     \
+    _mm_set_epi16(v[7 / hs], v[6 / hs], v[5 / hs], v[4 / hs], v[3 / hs],       \
+                  v[2 / hs], v[1 / hs], v[0])
+    *cr = YCBCR_UPSAMPLE8(r);
+    *cg = YCBCR_UPSAMPLE8(g);
+    *cb = YCBCR_UPSAMPLE8(b);
+#undef YCBCR_UPSAMPLE8
+}
+
+static inline void YCbCrPut8SSE2(const TIFFYCbCrToRGB *ycbcr, uint32_t *cp,
+                                 const unsigned char *pp, int hs, int bsize,
+                                 int yoff, __m128i cr, __m128i cg, __m128i cb)
+{
+    __m128i y, rg, ba;
+
+#define YCBCR_LUMA(k)                                                          \
+    (int16_t)ycbcr->Y_tab[pp[((k) / hs) * bsize + yoff + (k) % hs]]
+    y = _mm_set_epi16(YCBCR_LUMA(7), YCBCR_LUMA(6), YCBCR_LUMA(5),
+                      YCBCR_LUMA(4), YCBCR_LUMA(3), YCBCR_LUMA(2),
+                      YCBCR_LUMA(1), YCBCR_LUMA(0));
+#undef YCBCR_LUMA
+    /* r in the low half, g in the high half */
+    rg = _mm_packus_epi16(_mm_add_epi16(y, cr), _mm_add_epi16(y, cg));
+    ba = _mm_packus_epi16(_mm_add_epi16(y, cb), _mm_set1_epi16(0xff));
+    rg = _mm_unpacklo_epi8(rg, _mm_srli_si128(rg, 8));
+    ba = _mm_unpacklo_epi8(ba, _mm_srli_si128(ba, 8));
+    _mm_storeu_si128((__m128i *)cp, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i *)(cp + 4), _mm_unpackhi_epi16(rg, ba));
+}
+#endif
+
 /*
  * 8-bit packed YCbCr samples w/ 4,4 subsampling => RGB
  */
@@ -2221,12 +4462,28 @@ DECLAREContigPutFunc(putcontig8bitYCbCr44tile)
 
     (void)y;
     /* adjust fromskew */
-    fromskew = (fromskew / 4) * (4 * 2 + 2);
+    fromskew = (fromskew / 4) * (4 * 4 + 2);
     if ((h & 3) == 0 && (w & 3) == 0)
     {
         for (; h >= 4; h -= 4)
         {
             x = w >> 2;
+#ifdef YCBCR_USE_SSE2
+            for (; x > 2; x -= 2)
+            {
+                __m128i cr, cg, cb;
+                YCbCrChroma8SSE2(img->ycbcr, pp, 4, 18, 16, &cr, &cg, &cb);
+                YCbCrPut8SSE2(img->ycbcr, cp, pp, 4, 18, 0, cr, cg, cb);
+                YCbCrPut8SSE2(img->ycbcr, cp1, pp, 4, 18, 4, cr, cg, cb);
+                YCbCrPut8SSE2(img->ycbcr, cp2, pp, 4, 18, 8, cr, cg, cb);
+                YCbCrPut8SSE2(img->ycbcr, cp3, pp, 4, 18, 12, cr, cg, cb);
+                cp += 8;
+                cp1 += 8;
+                cp2 += 8;
+                cp3 += 8;
+                pp += 36;
+            }
+#endif
             do
             {
                 int32_t Cb = pp[16];
@@ -2270,6 +4527,25 @@ DECLAREContigPutFunc(putcontig8bitYCbCr44tile)
             {
                 int32_t Cb = pp[16];
                 int32_t Cr = pp[17];
+#ifdef YCBCR_USE_SSE2
+                if (x >= 8 && h >= 4)
+                {
+                    __m128i cr, cg, cb;
+                    YCbCrChroma8SSE2(img->ycbcr, pp, 4, 18, 16, &cr, &cg,
+                                     &cb);
+                    YCbCrPut8SSE2(img->ycbcr, cp, pp, 4, 18, 0, cr, cg, cb);
+                    YCbCrPut8SSE2(img->ycbcr, cp1, pp, 4, 18, 4, cr, cg, cb);
+                    YCbCrPut8SSE2(img->ycbcr, cp2, pp, 4, 18, 8, cr, cg, cb);
+                    YCbCrPut8SSE2(img->ycbcr, cp3, pp, 4, 18, 12, cr, cg, cb);
+                    cp += 8;
+                    cp1 += 8;
+                    cp2 += 8;
+                    cp3 += 8;
+                    x -= 8;
+                    pp += 36;
+                    continue;
+                }
+#endif
                 switch (x)
                 {
                     default:
@@ -2366,6 +4642,18 @@ DECLAREContigPutFunc(putcontig8bitYCbCr42tile)
         for (; h >= 2; h -= 2)
         {
             x = w >> 2;
+#ifdef YCBCR_USE_SSE2
+            for (; x > 2; x -= 2)
+            {
+                __m128i cr, cg, cb;
+                YCbCrChroma8SSE2(img->ycbcr, pp, 4, 10, 8, &cr, &cg, &cb);
+                YCbCrPut8SSE2(img->ycbcr, cp, pp, 4, 10, 0, cr, cg, cb);
+                YCbCrPut8SSE2(img->ycbcr, cp1, pp, 4, 10, 4, cr, cg, cb);
+                cp += 8;
+                cp1 += 8;
+                pp += 20;
+            }
+#endif
             do
             {
                 int32_t Cb = pp[8];
@@ -2397,6 +4685,21 @@ DECLAREContigPutFunc(putcontig8bitYCbCr42tile)
             {
                 int32_t Cb = pp[8];
                 int32_t Cr = pp[9];
+#ifdef YCBCR_USE_SSE2
+                if (x >= 8 && h >= 2)
+                {
+                    __m128i cr, cg, cb;
+                    YCbCrChroma8SSE2(img->ycbcr, pp, 4, 10, 8, &cr, &cg,
+                                     &cb);
+                    YCbCrPut8SSE2(img->ycbcr, cp, pp, 4, 10, 0, cr, cg, cb);
+                    YCbCrPut8SSE2(img->ycbcr, cp1, pp, 4, 10, 4, cr, cg, cb);
+                    cp += 8;
+                    cp1 += 8;
+                    x -= 8;
+                    pp += 20;
+                    continue;
+                }
+#endif
                 switch (x)
                 {
                     default:
@@ -2466,6 +4769,16 @@ DECLAREContigPutFunc(putcontig8bitYCbCr41tile)
     do
     {
         x = w >> 2;
+#ifdef YCBCR_USE_SSE2
+        for (; x >= 2; x -= 2)
+        {
+            __m128i cr, cg, cb;
+            YCbCrChroma8SSE2(img->ycbcr, pp, 4, 6, 4, &cr, &cg, &cb);
+            YCbCrPut8SSE2(img->ycbcr, cp, pp, 4, 6, 0, cr, cg, cb);
+            cp += 8;
+            pp += 12;
+        }
+#endif
         while (x > 0)
         {
             int32_t Cb = pp[4];
@@ -2520,6 +4833,18 @@ DECLAREContigPutFunc(putcontig8bitYCbCr22tile)
     while (h >= 2)
     {
         x = w;
+#ifdef YCBCR_USE_SSE2
+        for (; x >= 8; x -= 8)
+        {
+            __m128i cr, cg, cb;
+            YCbCrChroma8SSE2(img->ycbcr, pp, 2, 6, 4, &cr, &cg, &cb);
+            YCbCrPut8SSE2(img->ycbcr, cp, pp, 2, 6, 0, cr, cg, cb);
+            YCbCrPut8SSE2(img->ycbcr, cp2, pp, 2, 6, 2, cr, cg, cb);
+            cp += 8;
+            cp2 += 8;
+            pp += 24;
+        }
+#endif
         while (x >= 2)
         {
             uint32_t Cb = pp[4];
@@ -2551,6 +4876,16 @@ DECLAREContigPutFunc(putcontig8bitYCbCr22tile)
     if (h == 1)
     {
         x = w;
+#ifdef YCBCR_USE_SSE2
+        for (; x >= 8; x -= 8)
+        {
+            __m128i cr, cg, cb;
+            YCbCrChroma8SSE2(img->ycbcr, pp, 2, 6, 4, &cr, &cg, &cb);
+            YCbCrPut8SSE2(img->ycbcr, cp, pp, 2, 6, 0, cr, cg, cb);
+            cp += 8;
+            pp += 24;
+        }
+#endif
         while (x >= 2)
         {
             uint32_t Cb = pp[4];
@@ -2581,6 +4916,16 @@ DECLAREContigPutFunc(putcontig8bitYCbCr21tile)
     do
     {
         x = w >> 1;
+#ifdef YCBCR_USE_SSE2
+        for (; x >= 4; x -= 4)
+        {
+            __m128i cr, cg, cb;
+            YCbCrChroma8SSE2(img->ycbcr, pp, 2, 4, 2, &cr, &cg, &cb);
+            YCbCrPut8SSE2(img->ycbcr, cp, pp, 2, 4, 0, cr, cg, cb);
+            cp += 8;
+            pp += 16;
+        }
+#endif
         while (x > 0)
         {
             int32_t Cb = pp[2];
@@ -2623,6 +4968,18 @@ DECLAREContigPutFunc(putcontig8bitYCbCr12tile)
     while (h >= 2)
     {
         x = w;
+#ifdef YCBCR_USE_SSE2
+        for (; x > 8; x -= 8)
+        {
+            __m128i cr, cg, cb;
+            YCbCrChroma8SSE2(img->ycbcr, pp, 1, 4, 2, &cr, &cg, &cb);
+            YCbCrPut8SSE2(img->ycbcr, cp, pp, 1, 4, 0, cr, cg, cb);
+            YCbCrPut8SSE2(img->ycbcr, cp2, pp, 1, 4, 1, cr, cg, cb);
+            cp += 8;
+            cp2 += 8;
+            pp += 32;
+        }
+#endif
         do
         {
             uint32_t Cb = pp[2];
@@ -2641,6 +4998,16 @@ DECLAREContigPutFunc(putcontig8bitYCbCr12tile)
     if (h == 1)
     {
         x = w;
+#ifdef YCBCR_USE_SSE2
+        for (; x > 8; x -= 8)
+        {
+            __m128i cr, cg, cb;
+            YCbCrChroma8SSE2(img->ycbcr, pp, 1, 4, 2, &cr, &cg, &cb);
+            YCbCrPut8SSE2(img->ycbcr, cp, pp, 1, 4, 0, cr, cg, cb);
+            cp += 8;
+            pp += 32;
+        }
+#endif
         do
         {
             uint32_t Cb = pp[2];
@@ -2662,6 +5029,16 @@ DECLAREContigPutFunc(putcontig8bitYCbCr11tile)
     do
     {
         x = w; /* was x = w>>1; patched 2000/09/25 warmerda@home.com */
+#ifdef YCBCR_USE_SSE2
+        for (; x > 8; x -= 8)
+        {
+            __m128i cr, cg, cb;
+            YCbCrChroma8SSE2(img->ycbcr, pp, 1, 3, 1, &cr, &cg, &cb);
+            YCbCrPut8SSE2(img->ycbcr, cp, pp, 1, 3, 0, cr, cg, cb);
+            cp += 8;
+            pp += 24;
+        }
+#endif
         do
         {
             int32_t Cb = pp[1];
@@ -2711,20 +5088,6 @@ static int initYCbCrConversion(TIFFRGBAImage *img)
 
     float *luma, *refBlackWhite;
 
-    if (img->ycbcr == NULL)
-    {
-        img->ycbcr = (TIFFYCbCrToRGB *)_TIFFmallocExt(
-            img->tif, TIFFroundup_32(sizeof(TIFFYCbCrToRGB), sizeof(long)) +
-                          4 * 256 * sizeof(TIFFRGBValue) +
-                          2 * 256 * sizeof(int) + 3 * 256 * sizeof(int32_t));
-        if (img->ycbcr == NULL)
-        {
-            TIFFErrorExtR(img->tif, module,
-                          "No space for YCbCr->RGB conversion state");
-            return (0);
-        }
-    }
-
     TIFFGetFieldDefaulted(img->tif, TIFFTAG_YCBCRCOEFFICIENTS, &luma);
     TIFFGetFieldDefaulted(img->tif, TIFFTAG_REFERENCEBLACKWHITE,
                           &refBlackWhite);
@@ -2751,6 +5114,20 @@ static int initYCbCrConversion(TIFFRGBAImage *img)
         return (0);
     }
 
+    /* already set up for the same parameters, see TIFFRGBAContextLend() */
+    if (img->ycbcr != NULL)
+        return (1);
+    img->ycbcr = (TIFFYCbCrToRGB *)_TIFFmallocExt(
+        rgbaTableOwner(img),
+        TIFFroundup_32(sizeof(TIFFYCbCrToRGB), sizeof(long)) +
+            4 * 256 * sizeof(TIFFRGBValue) + 2 * 256 * sizeof(int) +
+            3 * 256 * sizeof(int32_t));
+    if (img->ycbcr == NULL)
+    {
+        TIFFErrorExtR(img->tif, module,
+                      "No space for YCbCr->RGB conversion state");
+        return (0);
+    }
     if (TIFFYCbCrToRGBInit(img->ycbcr, luma, refBlackWhite) < 0)
         return (0);
     return (1);
@@ -2762,6 +5139,8 @@ static tileContigRoutine initCIELabConversion(TIFFRGBAImage *img)
 
     float *whitePoint;
     float refWhite[3];
+    int bits = CIELabLUTBits(img);
+    tmsize_t size = sizeof(TIFFCIELabToRGB);
 
     TIFFGetFieldDefaulted(img->tif, TIFFTAG_WHITEPOINT, &whitePoint);
     if (whitePoint[1] == 0.0f)
@@ -2770,30 +5149,52 @@ static tileContigRoutine initCIELabConversion(TIFFRGBAImage *img)
         return NULL;
     }
 
-    if (!img->cielab)
+    if (bits > 0)
+    {
+        tmsize_t npoints = ((tmsize_t)1 << bits) + 1;
+        size = TIFFroundup_32(sizeof(TIFFCIELabToRGB), sizeof(long)) +
+               sizeof(TIFFCIELabLUT) +
+               npoints * npoints * npoints * 3 * sizeof(int32_t) +
+               3 * (CIELABTORGB_TABLE_RANGE + 1);
+    }
+    /* already set up for the same white point and table size, see
+     * TIFFRGBAContextLend() */
+    if (img->cielab == NULL)
     {
-        img->cielab = (TIFFCIELabToRGB *)_TIFFmallocExt(
-            img->tif, sizeof(TIFFCIELabToRGB));
+        img->cielab =
+            (TIFFCIELabToRGB *)_TIFFmallocExt(rgbaTableOwner(img), size);
         if (!img->cielab)
         {
             TIFFErrorExtR(img->tif, module,
                           "No space for CIE L*a*b*->RGB conversion state.");
             return NULL;
         }
+
+        refWhite[1] = 100.0F;
+        refWhite[0] = whitePoint[0] / whitePoint[1] * refWhite[1];
+        refWhite[2] = (1.0F - whitePoint[0] - whitePoint[1]) / whitePoint[1] *
+                      refWhite[1];
+        if (TIFFCIELabToRGBInit(img->cielab, &display_sRGB, refWhite) < 0)
+        {
+            TIFFErrorExtR(
+                img->tif, module,
+                "Failed to initialize CIE L*a*b*->RGB conversion state.");
+            _TIFFfreeExt(rgbaTableOwner(img), img->cielab);
+            img->cielab = NULL;
+            return NULL;
+        }
+        if (bits > 0)
+            buildCIELabLUT(img, bits);
     }
 
-    refWhite[1] = 100.0F;
-    refWhite[0] = whitePoint[0] / whitePoint[1] * refWhite[1];
-    refWhite[2] =
-        (1.0F - whitePoint[0] - whitePoint[1]) / whitePoint[1] * refWhite[1];
-    if (TIFFCIELabToRGBInit(img->cielab, &display_sRGB, refWhite) < 0)
+    if (bits > 0)
     {
-        TIFFErrorExtR(img->tif, module,
-                      "Failed to initialize CIE L*a*b*->RGB conversion state.");
-        _TIFFfreeExt(img->tif, img->cielab);
+        if (img->bitspersample == 8)
+            return putcontig8bitCIELab8LUT;
+        else if (img->bitspersample == 16)
+            return putcontig8bitCIELab16LUT;
         return NULL;
     }
-
     if (img->bitspersample == 8)
         return putcontig8bitCIELab8;
     else if (img->bitspersample == 16)
@@ -2820,7 +5221,7 @@ static int makebwmap(TIFFRGBAImage *img)
         nsamples = 1;
 
     img->BWmap = (uint32_t **)_TIFFmallocExt(
-        img->tif,
+        rgbaTableOwner(img),
         256 * sizeof(uint32_t *) + (256 * nsamples * sizeof(uint32_t)));
     if (img->BWmap == NULL)
     {
@@ -2876,6 +5277,13 @@ static int makebwmap(TIFFRGBAImage *img)
 static int setupMap(TIFFRGBAImage *img)
 {
     int32_t x, range;
+    int bw = img->bitspersample <= 16 &&
+             (img->photometric == PHOTOMETRIC_MINISBLACK ||
+              img->photometric == PHOTOMETRIC_MINISWHITE);
+
+    /* already set up for the same parameters, see TIFFRGBAContextLend() */
+    if (bw ? img->BWmap != NULL : img->Map != NULL)
+        return (1);
 
     range = (int32_t)((1L << img->bitspersample) - 1);
 
@@ -2884,7 +5292,7 @@ static int setupMap(TIFFRGBAImage *img)
         range = (int32_t)255;
 
     img->Map = (TIFFRGBValue *)_TIFFmallocExt(
-        img->tif, (range + 1) * sizeof(TIFFRGBValue));
+        rgbaTableOwner(img), (range + 1) * sizeof(TIFFRGBValue));
     if (img->Map == NULL)
     {
         TIFFErrorExtR(img->tif, TIFFFileName(img->tif),
@@ -2901,9 +5309,7 @@ static int setupMap(TIFFRGBAImage *img)
         for (x = 0; x <= range; x++)
             img->Map[x] = (TIFFRGBValue)((x * 255) / range);
     }
-    if (img->bitspersample <= 16 &&
-        (img->photometric == PHOTOMETRIC_MINISBLACK ||
-         img->photometric == PHOTOMETRIC_MINISWHITE))
+    if (bw)
     {
         /*
          * Use photometric mapping table to construct
@@ -2912,7 +5318,7 @@ static int setupMap(TIFFRGBAImage *img)
         if (!makebwmap(img))
             return (0);
         /* no longer need Map, free it */
-        _TIFFfreeExt(img->tif, img->Map);
+        _TIFFfreeExt(rgbaTableOwner(img), img->Map);
         img->Map = NULL;
     }
     return (1);
@@ -2965,8 +5371,11 @@ static int makecmap(TIFFRGBAImage *img)
     uint32_t *p;
     int i;
 
+    /* already set up for the same colormap, see TIFFRGBAContextLend() */
+    if (img->PALmap != NULL)
+        return (1);
     img->PALmap = (uint32_t **)_TIFFmallocExt(
-        img->tif,
+        rgbaTableOwner(img),
         256 * sizeof(uint32_t *) + (256 * nsamples * sizeof(uint32_t)));
     if (img->PALmap == NULL)
     {
@@ -3050,16 +5459,123 @@ static int buildMap(TIFFRGBAImage *img)
                 return (0);
             break;
     }
-    return (1);
+    return (1);
+}
+
+/*
+ * Select the appropriate conversion routine for packed data.
+ */
+/*
+ * Select the routine writing the output format directly in place of the
+ * packed ABGR routine picked for the image, if there is one.
+ */
+static tileContigRoutine PickContigFormat(TIFFRGBAImage *img)
+{
+    tileContigRoutine put = img->put.contig;
+    int unassociated = (img->format & TIFFRGBA_FORMAT_UNASSOCIATED) != 0;
+
+    if (put == putRGBcontig8bittile)
+        return putRGBcontig8bitformat;
+    if (put == putRGBAAcontig8bittile && !unassociated)
+        return putRGBAAcontig8bitformat;
+    if (put == putRGBUAcontig8bittile)
+        return unassociated ? putRGBAAcontig8bitformat
+                            : putRGBUAcontig8bitformat;
+    if (put == putRGBcontig16bittile)
+        return putRGBcontig16bitformat;
+    if (put == putRGBAAcontig16bittile && !unassociated)
+        return putRGBAAcontig16bitformat;
+    if (put == putRGBUAcontig16bittile)
+        return unassociated ? putRGBAAcontig16bitformat
+                            : putRGBUAcontig16bitformat;
+    return NULL;
+}
+
+static tileSeparateRoutine PickSeparateFormat(TIFFRGBAImage *img)
+{
+    tileSeparateRoutine put = img->put.separate;
+    int unassociated = (img->format & TIFFRGBA_FORMAT_UNASSOCIATED) != 0;
+
+    if (put == putRGBseparate8bittile)
+        return putRGBseparate8bitformat;
+    if (put == putRGBAAseparate8bittile && !unassociated)
+        return putRGBAAseparate8bitformat;
+    if (put == putRGBUAseparate8bittile)
+        return unassociated ? putRGBAAseparate8bitformat
+                            : putRGBUAseparate8bitformat;
+    if (put == putRGBseparate16bittile)
+        return putRGBseparate16bitformat;
+    if (put == putRGBAAseparate16bittile && !unassociated)
+        return putRGBAAseparate16bitformat;
+    if (put == putRGBUAseparate16bittile)
+        return unassociated ? putRGBAAseparate16bitformat
+                            : putRGBUAseparate16bitformat;
+    return NULL;
+}
+
+/*
+ * Wrap the put routine picked for an image with an Orientation of 5 to 8
+ * read with TIFFRGBA_FORMAT_TRANSPOSE.
+ */
+static int PickTranspose(TIFFRGBAImage *img)
+{
+    TIFFRGBATranspose *t = (TIFFRGBATranspose *)_TIFFcallocExt(
+        img->tif, 1, sizeof(TIFFRGBATranspose));
+
+    if (t == NULL)
+        return 0;
+    img->transpose = t;
+    if (img->isContig)
+    {
+        t->put.contig = img->put.contig;
+        img->put.contig = putcontigtransposed;
+    }
+    else
+    {
+        t->put.separate = img->put.separate;
+        img->put.separate = putseparatetransposed;
+    }
+    return 1;
 }
 
 /*
- * Select the appropriate conversion routine for packed data.
+ * Select the routine writing TIFFRGBA_FORMAT_RGBAF32 from the samples of
+ * greyscale and RGB images of 8, 16 or 32 bits.  Returns 0 if the image is
+ * not such an image, and the routine is then picked from the packed ABGR
+ * one as for the other formats.
  */
+static int PickFloatCase(TIFFRGBAImage *img)
+{
+    float alphascale;
+
+    if ((img->format & TIFFRGBA_FORMAT_MASK) != TIFFRGBA_FORMAT_RGBAF32 ||
+        pickFloatKernel(img, &alphascale) == NULL)
+        return 0;
+    switch (img->photometric)
+    {
+        case PHOTOMETRIC_MINISWHITE:
+        case PHOTOMETRIC_MINISBLACK:
+            break;
+        case PHOTOMETRIC_RGB:
+            if (img->samplesperpixel < 3)
+                return 0;
+            break;
+        default:
+            return 0;
+    }
+    if (!img->isContig)
+        img->put.separate = putseparatefloat;
+    else if (img->samplesperpixel <= FLOAT_CHUNK)
+        img->put.contig = putcontigfloat;
+    return 1;
+}
+
 static int PickContigCase(TIFFRGBAImage *img)
 {
     img->get = TIFFIsTiled(img->tif) ? gtTileContig : gtStripContig;
     img->put.contig = NULL;
+    if (PickFloatCase(img))
+        return ((img->get != NULL) && (img->put.contig != NULL));
     switch (img->photometric)
     {
         case PHOTOMETRIC_RGB:
@@ -3224,6 +5740,21 @@ static int PickContigCase(TIFFRGBAImage *img)
                 break;
             }
     }
+    if (img->put.contig != NULL &&
+        (img->format & ~(TIFFRGBA_FORMAT_TRANSPOSE |
+                         TIFFRGBA_FORMAT_CIELAB_LUT |
+                         TIFFRGBA_FORMAT_CIELAB_LUT_BITS_MASK)) !=
+            TIFFRGBA_FORMAT_ABGR32)
+    {
+        tileContigRoutine put = PickContigFormat(img);
+        if (put == NULL)
+        {
+            /* convert the output of the packed ABGR routine */
+            img->formatput.contig = img->put.contig;
+            put = putcontigformat;
+        }
+        img->put.contig = put;
+    }
     return ((img->get != NULL) && (img->put.contig != NULL));
 }
 
@@ -3237,6 +5768,8 @@ static int PickSeparateCase(TIFFRGBAImage *img)
 {
     img->get = TIFFIsTiled(img->tif) ? gtTileSeparate : gtStripSeparate;
     img->put.separate = NULL;
+    if (PickFloatCase(img))
+        return ((img->get != NULL) && (img->put.separate != NULL));
     switch (img->photometric)
     {
         case PHOTOMETRIC_MINISWHITE:
@@ -3303,6 +5836,21 @@ static int PickSeparateCase(TIFFRGBAImage *img)
             }
             break;
     }
+    if (img->put.separate != NULL &&
+        (img->format & ~(TIFFRGBA_FORMAT_TRANSPOSE |
+                         TIFFRGBA_FORMAT_CIELAB_LUT |
+                         TIFFRGBA_FORMAT_CIELAB_LUT_BITS_MASK)) !=
+            TIFFRGBA_FORMAT_ABGR32)
+    {
+        tileSeparateRoutine put = PickSeparateFormat(img);
+        if (put == NULL)
+        {
+            /* convert the output of the packed ABGR routine */
+            img->formatput.separate = img->put.separate;
+            put = putseparateformat;
+        }
+        img->put.separate = put;
+    }
     return ((img->get != NULL) && (img->put.separate != NULL));
 }
 
@@ -3311,8 +5859,9 @@ static int BuildMapUaToAa(TIFFRGBAImage *img)
     static const char module[] = "BuildMapUaToAa";
     uint8_t *m;
     uint16_t na, nv;
-    assert(img->UaToAa == NULL);
-    img->UaToAa = (uint8_t *)_TIFFmallocExt(img->tif, 65536);
+    if (img->UaToAa != NULL) /* from a TIFFRGBAContext */
+        return (1);
+    img->UaToAa = (uint8_t *)_TIFFmallocExt(rgbaTableOwner(img), 65536);
     if (img->UaToAa == NULL)
     {
         TIFFErrorExtR(img->tif, module, "Out of memory");
@@ -3332,8 +5881,10 @@ static int BuildMapBitdepth16To8(TIFFRGBAImage *img)
     static const char module[] = "BuildMapBitdepth16To8";
     uint8_t *m;
     uint32_t n;
-    assert(img->Bitdepth16To8 == NULL);
-    img->Bitdepth16To8 = (uint8_t *)_TIFFmallocExt(img->tif, 65536);
+    if (img->Bitdepth16To8 != NULL) /* from a TIFFRGBAContext */
+        return (1);
+    img->Bitdepth16To8 =
+        (uint8_t *)_TIFFmallocExt(rgbaTableOwner(img), 65536);
     if (img->Bitdepth16To8 == NULL)
     {
         TIFFErrorExtR(img->tif, module, "Out of memory");
@@ -3345,6 +5896,177 @@ static int BuildMapBitdepth16To8(TIFFRGBAImage *img)
     return (1);
 }
 
+static void TIFFRGBAContextKeyOf(TIFFRGBAImage *img, TIFFRGBAContextKey *key)
+{
+    TIFF *tif = img->tif;
+    float *v;
+
+    /* padding included, for memcmp() */
+    memset(key, 0, sizeof(*key));
+    key->photometric = img->photometric;
+    key->bitspersample = img->bitspersample;
+    switch (img->photometric)
+    {
+        case PHOTOMETRIC_YCBCR:
+            TIFFGetFieldDefaulted(tif, TIFFTAG_YCBCRCOEFFICIENTS, &v);
+            memcpy(key->luma, v, sizeof(key->luma));
+            TIFFGetFieldDefaulted(tif, TIFFTAG_REFERENCEBLACKWHITE, &v);
+            memcpy(key->refblackwhite, v, sizeof(key->refblackwhite));
+            break;
+        case PHOTOMETRIC_CIELAB:
+            TIFFGetFieldDefaulted(tif, TIFFTAG_WHITEPOINT, &v);
+            memcpy(key->whitepoint, v, sizeof(key->whitepoint));
+            key->cielabbits = CIELabLUTBits(img);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Return whether the colormap of img, if it is a palette image, is the one
+ * kept by ctx, whose key is the one of img.
+ */
+static int TIFFRGBAContextSameColormap(TIFFRGBAImage *img,
+                                       const TIFFRGBAContext *ctx)
+{
+    size_t n = (size_t)1 << img->bitspersample;
+
+    if (img->photometric != PHOTOMETRIC_PALETTE || img->redcmap == NULL)
+        return 1;
+    return ctx->cmap != NULL &&
+           memcmp(ctx->cmap, img->redcmap, n * sizeof(uint16_t)) == 0 &&
+           memcmp(ctx->cmap + n, img->greencmap, n * sizeof(uint16_t)) == 0 &&
+           memcmp(ctx->cmap + 2 * n, img->bluecmap, n * sizeof(uint16_t)) == 0;
+}
+
+/*
+ * Keep a copy of the colormap of img in ctx.  Without it, the tables are
+ * not reused.
+ */
+static void TIFFRGBAContextKeepColormap(TIFFRGBAImage *img,
+                                        TIFFRGBAContext *ctx)
+{
+    size_t n = (size_t)1 << img->bitspersample;
+
+    if (img->photometric != PHOTOMETRIC_PALETTE || img->redcmap == NULL)
+        return;
+    ctx->cmap = (uint16_t *)_TIFFmallocExt(
+        NULL, (tmsize_t)(3 * n * sizeof(uint16_t)));
+    if (ctx->cmap == NULL)
+        return;
+    _TIFFmemcpy(ctx->cmap, img->redcmap, (tmsize_t)(n * sizeof(uint16_t)));
+    _TIFFmemcpy(ctx->cmap + n, img->greencmap,
+                (tmsize_t)(n * sizeof(uint16_t)));
+    _TIFFmemcpy(ctx->cmap + 2 * n, img->bluecmap,
+                (tmsize_t)(n * sizeof(uint16_t)));
+}
+
+/* Free the tables that depend on the key */
+static void TIFFRGBAContextFreeTables(TIFFRGBAContext *ctx)
+{
+    _TIFFfreeExt(NULL, ctx->cmap);
+    _TIFFfreeExt(NULL, ctx->Map);
+    _TIFFfreeExt(NULL, ctx->BWmap);
+    _TIFFfreeExt(NULL, ctx->PALmap);
+    _TIFFfreeExt(NULL, ctx->ycbcr);
+    _TIFFfreeExt(NULL, ctx->cielab);
+    ctx->Map = NULL;
+    ctx->BWmap = NULL;
+    ctx->PALmap = NULL;
+    ctx->ycbcr = NULL;
+    ctx->cielab = NULL;
+    ctx->cmap = NULL;
+    ctx->valid = 0;
+}
+
+/*
+ * Lend the tables of ctx to img if they were built for the parameters of
+ * img, and otherwise drop them, img building and then giving back its own.
+ * A context lent to another image is not used.
+ */
+static void TIFFRGBAContextLend(TIFFRGBAImage *img, TIFFRGBAContext *ctx)
+{
+    TIFFRGBAContextKey key;
+
+    if (ctx->lent)
+        return;
+    TIFFRGBAContextKeyOf(img, &key);
+    if (!ctx->valid || memcmp(&key, &ctx->key, sizeof(key)) != 0 ||
+        !TIFFRGBAContextSameColormap(img, ctx))
+    {
+        TIFFRGBAContextFreeTables(ctx);
+        ctx->key = key;
+        TIFFRGBAContextKeepColormap(img, ctx);
+    }
+    img->Map = ctx->Map;
+    img->BWmap = ctx->BWmap;
+    img->PALmap = ctx->PALmap;
+    img->ycbcr = ctx->ycbcr;
+    img->cielab = ctx->cielab;
+    img->UaToAa = ctx->UaToAa;
+    img->Bitdepth16To8 = ctx->Bitdepth16To8;
+    ctx->Map = NULL;
+    ctx->BWmap = NULL;
+    ctx->PALmap = NULL;
+    ctx->ycbcr = NULL;
+    ctx->cielab = NULL;
+    ctx->UaToAa = NULL;
+    ctx->Bitdepth16To8 = NULL;
+    /* set again once the image is successfully begun */
+    ctx->valid = 0;
+    ctx->lent = 1;
+    img->context = ctx;
+}
+
+/* Give the tables of img back to its context, at TIFFRGBAImageEnd() */
+static void TIFFRGBAContextReturn(TIFFRGBAImage *img)
+{
+    TIFFRGBAContext *ctx = img->context;
+
+    ctx->Map = img->Map;
+    ctx->BWmap = img->BWmap;
+    ctx->PALmap = img->PALmap;
+    ctx->ycbcr = img->ycbcr;
+    ctx->cielab = img->cielab;
+    ctx->UaToAa = img->UaToAa;
+    ctx->Bitdepth16To8 = img->Bitdepth16To8;
+    img->Map = NULL;
+    img->BWmap = NULL;
+    img->PALmap = NULL;
+    img->ycbcr = NULL;
+    img->cielab = NULL;
+    img->UaToAa = NULL;
+    img->Bitdepth16To8 = NULL;
+    /* the tables of an image that failed to begin may be incomplete */
+    if (!ctx->valid)
+        TIFFRGBAContextFreeTables(ctx);
+    ctx->lent = 0;
+    img->context = NULL;
+}
+
+/*
+ * Allocate a context keeping the conversion tables of the images begun
+ * with TIFFRGBAImageBeginContext() from one image to the next.  It may be
+ * used for images of different files, but by one image at a time.
+ */
+TIFFRGBAContext *TIFFRGBAContextAlloc(void)
+{
+    return (TIFFRGBAContext *)_TIFFcallocExt(NULL, 1,
+                                             sizeof(TIFFRGBAContext));
+}
+
+void TIFFRGBAContextFree(TIFFRGBAContext *ctx)
+{
+    if (ctx != NULL)
+    {
+        TIFFRGBAContextFreeTables(ctx);
+        _TIFFfreeExt(NULL, ctx->UaToAa);
+        _TIFFfreeExt(NULL, ctx->Bitdepth16To8);
+        _TIFFfreeExt(NULL, ctx);
+    }
+}
+
 /*
  * Read a whole strip off data from the file, and convert to RGBA form.
  * If this is the last strip, then it will only contain the portion of
@@ -3547,3 +6269,553 @@ int TIFFReadRGBATileExt(TIFF *tif, uint32_t col, uint32_t row, uint32_t *raster,
 
     return (ok);
 }
+
+/*
+ * Read a window of an image, decimated by an integer factor.
+ *
+ * The window is read in bands of whole strips or tiles with the
+ * TIFFRGBAImage machinery, in the order of the rows in the file, and each
+ * row is folded into the output raster as it comes.  The output pixel of
+ * a factor x factor block is, with TIFFRGBA_REGION_BOX, the rounded
+ * average of its pixels and otherwise the pixel at its center, so that
+ * with the nearest filter the strips/tiles holding none of the sampled
+ * rows are not read at all, and the other ones are only decoded up to
+ * the last sampled row.
+ */
+typedef struct
+{
+    uint32_t *raster; /* ow x oh output raster */
+    uint32_t ow, oh;
+    int flip; /* flips from file order to the requested orientation */
+    uint32_t factor;
+    uint32_t row, width, height; /* window, in file order */
+    uint64_t *sums;              /* per output column, for the box filter */
+} TIFFRGBARegion;
+
+/* Size of the block starting at start, in a window ending at end */
+static uint32_t TIFFRGBARegionBlock(TIFFRGBARegion *rg, uint32_t start,
+                                    uint32_t end)
+{
+    return end - start < rg->factor ? end - start : rg->factor;
+}
+
+/* Returns the last row of [r0, r1) sampled by the nearest filter, or r0 - 1
+ * if there is none */
+static uint32_t TIFFRGBARegionLastSampled(TIFFRGBARegion *rg, uint32_t r0,
+                                          uint32_t r1)
+{
+    uint32_t end = rg->row + rg->height;
+    uint32_t j = (r0 - rg->row) / rg->factor;
+    uint32_t last = r0 - 1;
+
+    for (; j < rg->oh; j++)
+    {
+        uint32_t start = rg->row + j * rg->factor;
+        uint32_t sample;
+        if (start >= r1)
+            break;
+        sample = start + TIFFRGBARegionBlock(rg, start, end) / 2;
+        if (sample >= r0 && sample < r1)
+            last = sample;
+    }
+    return last;
+}
+
+static void TIFFRGBARegionPutRow(TIFFRGBARegion *rg, uint32_t r,
+                                 const uint32_t *src)
+{
+    uint32_t j = (r - rg->row) / rg->factor;
+    uint32_t start = rg->row + j * rg->factor;
+    uint32_t bh = TIFFRGBARegionBlock(rg, start, rg->row + rg->height);
+    uint32_t oj = (rg->flip & FLIP_VERTICALLY) ? rg->oh - 1 - j : j;
+    uint32_t *dst = rg->raster + (size_t)oj * rg->ow;
+    uint32_t i, k;
+
+    if (rg->sums == NULL)
+    {
+        if (r != start + bh / 2)
+            return;
+        for (i = 0; i < rg->ow; i++)
+        {
+            uint32_t c = i * rg->factor;
+            uint32_t bw = TIFFRGBARegionBlock(rg, c, rg->width);
+            dst[(rg->flip & FLIP_HORIZONTALLY) ? rg->ow - 1 - i : i] =
+                src[c + bw / 2];
+        }
+        return;
+    }
+
+    for (i = 0; i < rg->ow; i++)
+    {
+        uint32_t c = i * rg->factor;
+        uint32_t bw = TIFFRGBARegionBlock(rg, c, rg->width);
+        uint64_t *s = rg->sums + 4 * (size_t)i;
+        for (k = c; k < c + bw; k++)
+        {
+            s[0] += TIFFGetR(src[k]);
+            s[1] += TIFFGetG(src[k]);
+            s[2] += TIFFGetB(src[k]);
+            s[3] += TIFFGetA(src[k]);
+        }
+        if (r == start + bh - 1)
+        {
+            uint64_t n = (uint64_t)bh * bw;
+            dst[(rg->flip & FLIP_HORIZONTALLY) ? rg->ow - 1 - i : i] =
+                (uint32_t)((s[0] + n / 2) / n) |
+                ((uint32_t)((s[1] + n / 2) / n) << 8) |
+                ((uint32_t)((s[2] + n / 2) / n) << 16) |
+                ((uint32_t)((s[3] + n / 2) / n) << 24);
+            s[0] = s[1] = s[2] = s[3] = 0;
+        }
+    }
+}
+
+static int TIFFReadRGBARegionDirectory(TIFF *tif, uint32_t col, uint32_t row,
+                                       uint32_t width, uint32_t height,
+                                       uint32_t factor, int flags,
+                                       uint32_t *raster, int orientation,
+                                       int stop)
+{
+    static const char module[] = "TIFFReadRGBARegion";
+    char emsg[EMSG_BUF_SIZE] = "";
+    TIFFRGBAImage img;
+    TIFFRGBARegion rg;
+    uint32_t blockrows, bandrows, r0;
+    uint32_t *band = NULL;
+    int ok = 1;
+
+    if (!TIFFRGBAImageBegin(&img, tif, stop, emsg))
+    {
+        TIFFErrorExtR(tif, TIFFFileName(tif), "%s", emsg);
+        return 0;
+    }
+    if (width == 0 || height == 0 || factor == 0 || col >= img.width ||
+        width > img.width - col || row >= img.height ||
+        height > img.height - row || img.height > INT_MAX ||
+        img.width > INT_MAX)
+    {
+        TIFFErrorExtR(tif, module, "Invalid region");
+        TIFFRGBAImageEnd(&img);
+        return 0;
+    }
+
+    rg.raster = raster;
+    rg.ow = (width - 1) / factor + 1;
+    rg.oh = (height - 1) / factor + 1;
+    img.req_orientation = (uint16_t)orientation;
+    rg.flip = setorientation(&img);
+    rg.factor = factor;
+    rg.row = row;
+    rg.width = width;
+    rg.height = height;
+    rg.sums = NULL;
+    /* the bands are read in file order, and flipped by TIFFRGBARegionPutRow */
+    img.req_orientation = img.orientation;
+
+    if (TIFFIsTiled(tif))
+        TIFFGetFieldDefaulted(tif, TIFFTAG_TILELENGTH, &blockrows);
+    else
+        TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &blockrows);
+    if (blockrows == 0)
+        blockrows = img.height;
+    bandrows = blockrows < height ? blockrows : height;
+
+    band = (uint32_t *)_TIFFcallocExt(
+        tif, _TIFFMultiplySSize(tif, width, bandrows, module),
+        sizeof(uint32_t));
+    if ((flags & TIFFRGBA_REGION_BOX) && band != NULL)
+        rg.sums = (uint64_t *)_TIFFcallocExt(tif, 4 * (tmsize_t)rg.ow,
+                                             sizeof(uint64_t));
+    if (band == NULL || ((flags & TIFFRGBA_REGION_BOX) && rg.sums == NULL))
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        _TIFFfreeExt(tif, band);
+        TIFFRGBAImageEnd(&img);
+        return 0;
+    }
+
+    for (r0 = row; r0 < row + height;)
+    {
+        /* end of the strip or tile row holding r0 */
+        uint64_t next = ((uint64_t)r0 / blockrows + 1) * blockrows;
+        uint32_t r1 = next < (uint64_t)row + height ? (uint32_t)next
+                                                     : row + height;
+        uint32_t nrows = r1 - r0;
+        uint32_t k;
+
+        if (rg.sums == NULL)
+        {
+            uint32_t last = TIFFRGBARegionLastSampled(&rg, r0, r1);
+            if (last == r0 - 1)
+            {
+                r0 = r1;
+                continue;
+            }
+            nrows = last + 1 - r0;
+        }
+        img.row_offset = (int)r0;
+        img.col_offset = (int)col;
+        if (!TIFFRGBAImageGet(&img, band, width, nrows))
+        {
+            ok = 0;
+            if (stop)
+                break;
+        }
+        for (k = 0; k < nrows; k++)
+            TIFFRGBARegionPutRow(&rg, r0 + k, band + (size_t)k * width);
+        r0 = r1;
+    }
+
+    _TIFFfreeExt(tif, rg.sums);
+    _TIFFfreeExt(tif, band);
+    TIFFRGBAImageEnd(&img);
+    return ok;
+}
+
+/*
+ * Returns the scale of the current directory with respect to a width x
+ * height image if it is a reduced-resolution version of it that can be
+ * used to decimate it by factor, and 1 otherwise.
+ */
+static uint32_t TIFFRGBAOverviewScale(TIFF *tif, uint32_t width,
+                                      uint32_t height, uint32_t factor)
+{
+    char emsg[EMSG_BUF_SIZE];
+    uint32_t subfiletype, ovwidth, ovheight, scale;
+
+    if (!TIFFGetFieldDefaulted(tif, TIFFTAG_SUBFILETYPE, &subfiletype) ||
+        !(subfiletype & FILETYPE_REDUCEDIMAGE) ||
+        !TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &ovwidth) ||
+        !TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &ovheight) || ovwidth == 0 ||
+        ovheight == 0 || ovwidth >= width)
+        return 1;
+    scale = (uint32_t)(((uint64_t)width + ovwidth / 2) / ovwidth);
+    if (scale < 2 || scale > factor || factor % scale != 0)
+        return 1;
+    /* either rounding of the size is found in the wild */
+    if ((width / scale != ovwidth &&
+         ((uint64_t)width + scale - 1) / scale != ovwidth) ||
+        (height / scale != ovheight &&
+         ((uint64_t)height + scale - 1) / scale != ovheight))
+        return 1;
+    if (!TIFFRGBAImageOK(tif, emsg))
+        return 1;
+    return scale;
+}
+
+/*
+ * Look for the reduced-resolution image with the largest scale usable to
+ * decimate the current one by factor, among its SubIFDs and the
+ * directories following it.  Returns the scale, or 1 if there is none.
+ * The current directory is changed.
+ */
+static uint32_t TIFFRGBAFindOverview(TIFF *tif, uint32_t factor,
+                                     uint64_t *ovoff)
+{
+    uint64_t diroff = TIFFCurrentDirOffset(tif);
+    uint32_t width, height, scale, best = 1;
+    uint16_t nsubifd = 0;
+    uint64_t *subifd = NULL, *p;
+    uint16_t i;
+
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+    if (TIFFGetField(tif, TIFFTAG_SUBIFD, &nsubifd, &p) && nsubifd > 0)
+    {
+        subifd = (uint64_t *)_TIFFmallocExt(
+            tif, (tmsize_t)nsubifd * (tmsize_t)sizeof(uint64_t));
+        if (subifd == NULL)
+            nsubifd = 0;
+        else
+            _TIFFmemcpy(subifd, p, (tmsize_t)nsubifd * sizeof(uint64_t));
+    }
+    for (i = 0; i < nsubifd; i++)
+    {
+        if (!TIFFSetSubDirectory(tif, subifd[i]))
+            continue;
+        scale = TIFFRGBAOverviewScale(tif, width, height, factor);
+        if (scale > best)
+        {
+            best = scale;
+            *ovoff = subifd[i];
+        }
+    }
+    _TIFFfreeExt(tif, subifd);
+
+    /* overviews stored after the image, as in cloud optimized GeoTIFF */
+    if (TIFFSetSubDirectory(tif, diroff))
+    {
+        while (TIFFReadDirectory(tif))
+        {
+            uint32_t subfiletype;
+            if (!TIFFGetFieldDefaulted(tif, TIFFTAG_SUBFILETYPE,
+                                       &subfiletype) ||
+                !(subfiletype & FILETYPE_REDUCEDIMAGE))
+                break;
+            scale = TIFFRGBAOverviewScale(tif, width, height, factor);
+            if (scale > best)
+            {
+                best = scale;
+                *ovoff = TIFFCurrentDirOffset(tif);
+            }
+        }
+    }
+    return best;
+}
+
+/*
+ * Read the width x height window at (col, row) of the image, decimated by
+ * factor, into a ceil(width / factor) x ceil(height / factor) ABGR-format
+ * raster with the given orientation.  The window is in the coordinates of
+ * the row_offset and col_offset fields of TIFFRGBAImage, i.e. in the order
+ * of the data in the file.
+ */
+int TIFFReadRGBARegion(TIFF *tif, uint32_t col, uint32_t row, uint32_t width,
+                       uint32_t height, uint32_t factor, int flags,
+                       uint32_t *raster, int orientation, int stop)
+{
+    uint64_t diroff = TIFFCurrentDirOffset(tif);
+    uint64_t ovoff = 0;
+    uint32_t scale = 1;
+    int ok;
+
+    if ((flags & TIFFRGBA_REGION_OVERVIEWS) && factor > 1 && diroff != 0 &&
+        tif->tif_mode == O_RDONLY)
+    {
+        scale = TIFFRGBAFindOverview(tif, factor, &ovoff);
+        if (scale > 1 && TIFFSetSubDirectory(tif, ovoff))
+        {
+            uint32_t ovwidth, ovheight;
+            /* same output size, rounding the window outwards */
+            uint32_t ovfactor = factor / scale;
+            uint32_t ovcol = col / scale, ovrow = row / scale;
+            uint32_t w = (uint32_t)(((uint64_t)width + scale - 1) / scale);
+            uint32_t h = (uint32_t)(((uint64_t)height + scale - 1) / scale);
+
+            TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &ovwidth);
+            TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &ovheight);
+            if (w <= ovwidth && h <= ovheight &&
+                (w - 1) / ovfactor == (width - 1) / factor &&
+                (h - 1) / ovfactor == (height - 1) / factor)
+            {
+                if (ovcol > ovwidth - w)
+                    ovcol = ovwidth - w;
+                if (ovrow > ovheight - h)
+                    ovrow = ovheight - h;
+                ok = TIFFReadRGBARegionDirectory(tif, ovcol, ovrow, w, h,
+                                                 ovfactor, flags, raster,
+                                                 orientation, stop);
+                if (!TIFFSetSubDirectory(tif, diroff))
+                    ok = 0;
+                return ok;
+            }
+        }
+        if (!TIFFSetSubDirectory(tif, diroff))
+            return 0;
+    }
+    return TIFFReadRGBARegionDirectory(tif, col, row, width, height, factor,
+                                       flags, raster, orientation, stop);
+}
+
+/*
+ * Band iterator.
+ *
+ * The image is returned in bands of consecutive raster rows, each band
+ * being read with TIFFRGBAImageGet() from the strips or rows of tiles
+ * holding it.  A strip or row of tiles that is entirely in a band is put
+ * straight into the caller's raster, and the one that straddles the end
+ * of a band is converted into a cache, from which the rows of the next
+ * band are copied, so that no strip or tile is decoded twice and the
+ * memory used is that of one strip or row of tiles, whatever the band
+ * height.
+ */
+struct _TIFFRGBABandIterator
+{
+    TIFFRGBAImage img;
+    uint32_t bandheight;
+    uint32_t blockrows; /* rows of a strip or of a row of tiles */
+    int flip;           /* raster rows in the reverse order of the file */
+    int nthreads;
+    uint32_t row;      /* first raster row of the next band */
+    tmsize_t rowsize;  /* size in bytes of a raster row */
+    uint8_t *cache;    /* raster rows of the cached strip or row of tiles */
+    uint32_t cacherow; /* first file row in the cache */
+    uint32_t cacherows;
+};
+
+/*
+ * Read the nrows rows of the image from file row row into the raster, in
+ * the requested orientation.
+ */
+static int TIFFRGBABandIteratorGet(TIFFRGBABandIterator *it, uint8_t *raster,
+                                   uint32_t row, uint32_t nrows)
+{
+    it->img.row_offset = (int)row;
+    it->img.col_offset = 0;
+    return TIFFRGBAImageGetThreads(&it->img, (uint32_t *)(void *)raster,
+                                   it->img.width, nrows, it->nthreads);
+}
+
+/*
+ * Start reading the image of the current directory of tif in bands of
+ * bandheight rows of a raster with the given orientation and
+ * TIFFRGBA_FORMAT_* pixel format, decoded by nthreads threads (the number
+ * of processors if nthreads <= 0).
+ */
+TIFFRGBABandIterator *TIFFRGBABandIteratorBegin(TIFF *tif, uint32_t bandheight,
+                                                int orientation, int format,
+                                                int stop, int nthreads)
+{
+    static const char module[] = "TIFFRGBABandIteratorBegin";
+    char emsg[EMSG_BUF_SIZE] = "";
+    TIFFRGBABandIterator *it;
+
+    if (bandheight == 0)
+    {
+        TIFFErrorExtR(tif, module, "Invalid band height");
+        return NULL;
+    }
+    if (format & TIFFRGBA_FORMAT_TRANSPOSE)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Transposed rasters can not be read in bands");
+        return NULL;
+    }
+    it = (TIFFRGBABandIterator *)_TIFFcallocExt(tif, 1, sizeof(*it));
+    if (it == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return NULL;
+    }
+    if (!TIFFRGBAImageBeginFormat(&it->img, tif, stop, format, emsg))
+    {
+        TIFFErrorExtR(tif, TIFFFileName(tif), "%s", emsg);
+        _TIFFfreeExt(tif, it);
+        return NULL;
+    }
+    it->img.req_orientation = (uint16_t)orientation;
+    it->rowsize = _TIFFMultiplySSize(tif, it->img.width,
+                                     (tmsize_t)rgbaPixelSize(&it->img),
+                                     module);
+    if (it->rowsize == 0 || it->img.height > INT_MAX)
+    {
+        TIFFErrorExtR(tif, module, "Image too large");
+        TIFFRGBABandIteratorEnd(it);
+        return NULL;
+    }
+    if (TIFFIsTiled(tif))
+        TIFFGetFieldDefaulted(tif, TIFFTAG_TILELENGTH, &it->blockrows);
+    else
+        TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &it->blockrows);
+    if (it->blockrows == 0 || it->blockrows > it->img.height)
+        it->blockrows = it->img.height;
+    it->bandheight = bandheight;
+    it->flip = (setorientation(&it->img) & FLIP_VERTICALLY) != 0;
+    it->nthreads = nthreads;
+    return it;
+}
+
+/*
+ * Read the next band into raster, an array of ImageWidth x bandheight
+ * pixels, and set *nrows to its number of rows, less than bandheight for
+ * the last band.  Returns 1 if a band was read, 0 once the whole image has
+ * been, and -1 on error.
+ */
+int TIFFRGBABandIteratorNext(TIFFRGBABandIterator *it, void *raster,
+                             uint32_t *nrows)
+{
+    static const char module[] = "TIFFRGBABandIteratorNext";
+    TIFF *tif = it->img.tif;
+    uint32_t height = it->img.height;
+    uint32_t n, k, end, r, first;
+    int ok = 1;
+
+    *nrows = 0;
+    if (it->row >= height)
+        return 0;
+    n = TIFFmin(it->bandheight, height - it->row);
+    /* file rows of the band */
+    first = it->flip ? height - it->row - n : it->row;
+    end = first + n;
+
+    /* strips or rows of tiles in the order of the raster rows, so that the
+     * one shared with the previous band, if any, comes first */
+    for (k = 0; k < n;)
+    {
+        uint32_t row = it->flip ? end - 1 - k : first + k;
+        uint32_t blockrow = row - row % it->blockrows;
+        uint32_t blockend = TIFFmin(blockrow + it->blockrows, height);
+        uint32_t r0 = TIFFmax(blockrow, first), r1 = TIFFmin(blockend, end);
+
+        k += r1 - r0;
+        if (r0 == blockrow && r1 == blockend &&
+            !(it->cacherows != 0 && it->cacherow == blockrow))
+        {
+            /* whole strip or row of tiles, in place */
+            uint32_t dst = it->flip ? height - blockend - it->row
+                                    : blockrow - it->row;
+            if (!TIFFRGBABandIteratorGet(
+                    it, (uint8_t *)raster + (tmsize_t)dst * it->rowsize,
+                    blockrow, blockend - blockrow))
+            {
+                ok = 0;
+                if (it->img.stoponerr)
+                    break;
+            }
+            continue;
+        }
+
+        if (it->cacherows == 0 || it->cacherow != blockrow)
+        {
+            if (it->cache == NULL)
+            {
+                it->cache = (uint8_t *)_TIFFmallocExt(
+                    tif, _TIFFMultiplySSize(tif, it->rowsize, it->blockrows,
+                                            module));
+                if (it->cache == NULL)
+                {
+                    TIFFErrorExtR(tif, module, "Out of memory");
+                    ok = 0;
+                    break;
+                }
+            }
+            it->cacherow = blockrow;
+            it->cacherows = blockend - blockrow;
+            if (!TIFFRGBABandIteratorGet(it, it->cache, blockrow,
+                                         it->cacherows))
+            {
+                ok = 0;
+                if (it->img.stoponerr)
+                {
+                    it->cacherows = 0;
+                    break;
+                }
+            }
+        }
+        for (r = r0; r < r1; r++)
+        {
+            uint32_t src = it->flip ? blockend - 1 - r : r - blockrow;
+            uint32_t dst = it->flip ? height - 1 - r - it->row : r - it->row;
+            _TIFFmemcpy((uint8_t *)raster + (tmsize_t)dst * it->rowsize,
+                        it->cache + (tmsize_t)src * it->rowsize,
+                        it->rowsize);
+        }
+    }
+
+    if (!ok && it->img.stoponerr)
+        return -1;
+    it->row += n;
+    *nrows = n;
+    return ok ? 1 : -1;
+}
+
+void TIFFRGBABandIteratorEnd(TIFFRGBABandIterator *it)
+{
+    if (it != NULL)
+    {
+        TIFF *tif = it->img.tif;
+        _TIFFfreeExt(tif, it->cache);
+        TIFFRGBAImageEnd(&it->img);
+        _TIFFfreeExt(tif, it);
+    }
+}
@@ -158,6 +158,7 @@ typedef struct
     tmsize_t enc_outcount;   /* encoded (output) bytes */
     uint8_t *enc_rawlimit;   /* bound on tif_rawdata buffer */
     hash_t *enc_hashtab;     /* kept separate for small machines */
+    int enc_stored;          /* strip written as literals only */
 } LZWCodecState;
 
 #define LZWState(tif) ((LZWBaseState *)(tif)->tif_data)
@@ -1064,6 +1065,7 @@ static int LZWPreEncode(TIFF *tif, uint16_t s)
     sp->enc_ratio = 0;
     sp->enc_incount = 0;
     sp->enc_outcount = 0;
+    sp->enc_stored = 0;
     /*
      * The 4 here insures there is space for 2 max-sized
      * codes in LZWEncode and LZWPostDecode.
@@ -1152,6 +1154,7 @@ static int LZWEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
 
     if (ent == (hcode_t)-1 && cc > 0)
     {
+        sp->enc_stored = _TIFFStoredFallback(tif, bp, cc);
         /*
          * NB: This is safe because it can only happen
          *     at the start of a strip where we know there
@@ -1162,6 +1165,33 @@ static int LZWEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
         cc--;
         incount++;
     }
+    if (sp->enc_stored)
+    {
+        /*
+         * LZW has no stored mode, but emitting every byte as a
+         * literal code, with a Clear code before the code width
+         * would grow, costs almost nothing and only expands the
+         * data by 1/8, which is less than LZW on random data.
+         */
+        while (cc > 0)
+        {
+            if (op > limit)
+            {
+                tif->tif_rawcc = (tmsize_t)(op - tif->tif_rawdata);
+                if (!TIFFFlushData1(tif))
+                    return 0;
+                op = tif->tif_rawdata;
+            }
+            PutNextCode(op, ent);
+            ent = *bp++;
+            cc--;
+            if (++free_ent == maxcode)
+            {
+                PutNextCode(op, CODE_CLEAR);
+                free_ent = CODE_FIRST;
+            }
+        }
+    }
     while (cc > 0)
     {
         c = *bp++;
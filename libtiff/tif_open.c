@@ -118,6 +118,89 @@ void TIFFOpenOptionsSetWarnAboutUnknownTags(TIFFOpenOptions *opts,
     opts->warn_about_unknown_tags = warn_about_unknown_tags;
 }
 
+/** Size in bytes of a buffer gathering the writes to consecutive file
+ * offsets into larger ones, for files opened for writing.
+ * If write_buffer_size is set to 0, which is the default, writes are passed
+ * to the I/O procedures as they come.
+ */
+void TIFFOpenOptionsSetWriteBufferSize(TIFFOpenOptions *opts,
+                                       tmsize_t write_buffer_size)
+{
+    opts->write_buffer_size = write_buffer_size;
+}
+
+/** Whether files opened for writing, appending or updating end with a small
+ * trailer giving the offset of the last directory, so that a page can be
+ * appended when the file is opened again without walking all the
+ * directories. The default is 0 (no trailer).
+ */
+void TIFFOpenOptionsSetAppendTrailer(TIFFOpenOptions *opts, int append_trailer)
+{
+    opts->append_trailer = append_trailer;
+}
+
+/** Functions used for all the memory allocations done for a TIFF handle,
+ * including the TIFF structure itself, instead of _TIFFmalloc(),
+ * _TIFFrealloc() and _TIFFfree().  The three functions must be given, and
+ * are called with alloc_user_data as their first argument.  Passing a NULL
+ * function restores the default functions.
+ */
+void TIFFOpenOptionsSetAllocator(TIFFOpenOptions *opts,
+                                 TIFFMallocProc mallocproc,
+                                 TIFFReallocProc reallocproc,
+                                 TIFFFreeProc freeproc, void *alloc_user_data)
+{
+    if (mallocproc == NULL || reallocproc == NULL || freeproc == NULL)
+    {
+        mallocproc = NULL;
+        reallocproc = NULL;
+        freeproc = NULL;
+    }
+    opts->mallocproc = mallocproc;
+    opts->reallocproc = reallocproc;
+    opts->freeproc = freeproc;
+    opts->alloc_user_data = alloc_user_data;
+}
+
+/** Size in bytes of the chunks of an arena holding the memory allocated
+ * while a directory is read.  The memory is then released in one step when
+ * the directory is freed, i.e. when another directory is read or when the
+ * file is closed, instead of by many individual frees.
+ * If chunk_size is set to 0, which is the default, there is no arena.
+ */
+void TIFFOpenOptionsSetDirectoryArena(TIFFOpenOptions *opts,
+                                      tmsize_t chunk_size)
+{
+    opts->arena_chunk_size = chunk_size > 0 ? chunk_size : 0;
+}
+
+/** Whether strip and tile data written to a file opened with TIFFOpenExt()
+ * bypasses the operating system cache (O_DIRECT), where supported.
+ * The default is 0 (buffered I/O).
+ */
+void TIFFOpenOptionsSetDirectIO(TIFFOpenOptions *opts, int direct_io)
+{
+    opts->direct_io = direct_io;
+}
+
+/** Maximum size in bytes of the buffer receiving the data encoded by
+ * TIFFWriteScanline(), which otherwise holds a whole strip.  The codecs
+ * encoding rows as they arrive write the buffer out whenever it is full, so
+ * memory use no longer depends on RowsPerStrip.  Values below 4096 are
+ * raised to 4096.
+ * If buffer_size is set to 0, which is the default, the buffer is sized
+ * for a whole strip.
+ */
+void TIFFOpenOptionsSetStreamingWrite(TIFFOpenOptions *opts,
+                                      tmsize_t buffer_size)
+{
+    if (buffer_size <= 0)
+        buffer_size = 0;
+    else if (buffer_size < 4096)
+        buffer_size = 4096;
+    opts->streaming_write_size = buffer_size;
+}
+
 void TIFFOpenOptionsSetErrorHandlerExtR(TIFFOpenOptions *opts,
                                         TIFFErrorHandlerExtR handler,
                                         void *errorhandler_user_data)
@@ -157,6 +240,203 @@ static void _TIFFEmitErrorAboveMaxCumulatedMemAlloc(TIFF *tif,
                   (uint64_t)tif->tif_max_cumulated_mem_alloc);
 }
 
+/* Allocation functions of a handle, as set by TIFFOpenOptionsSetAllocator() */
+static void *_TIFFHeapMalloc(TIFF *tif, tmsize_t s)
+{
+    if (tif != NULL && tif->tif_mallocproc != NULL)
+        return tif->tif_mallocproc(tif->tif_alloc_user_data, s);
+    return _TIFFmalloc(s);
+}
+
+static void *_TIFFHeapCalloc(TIFF *tif, tmsize_t nmemb, tmsize_t siz)
+{
+    if (tif != NULL && tif->tif_mallocproc != NULL)
+    {
+        void *p = tif->tif_mallocproc(tif->tif_alloc_user_data, nmemb * siz);
+        if (p != NULL)
+            memset(p, 0, (size_t)(nmemb * siz));
+        return p;
+    }
+    return _TIFFcalloc(nmemb, siz);
+}
+
+static void *_TIFFHeapRealloc(TIFF *tif, void *p, tmsize_t s)
+{
+    if (tif != NULL && tif->tif_mallocproc != NULL)
+        return tif->tif_reallocproc(tif->tif_alloc_user_data, p, s);
+    return _TIFFrealloc(p, s);
+}
+
+static void _TIFFHeapFree(TIFF *tif, void *p)
+{
+    if (tif != NULL && tif->tif_mallocproc != NULL)
+        tif->tif_freeproc(tif->tif_alloc_user_data, p);
+    else
+        _TIFFfree(p);
+}
+
+/*
+ * Directory arena (TIFFOpenOptionsSetDirectoryArena()).
+ *
+ * While a directory is read, tif_arena_active is set and the memory is
+ * allocated from chunks by bumping a pointer.  Each allocation is preceded
+ * by its capacity, so that it can be reallocated, and freeing it does
+ * nothing: all the chunks are recycled at once by _TIFFArenaReset(), called
+ * when the directory is freed.  Memory that must outlive the directory,
+ * such as the field definitions, is allocated with the arena suspended.
+ * Reallocating an arena block while the arena is not active moves it to
+ * the heap.
+ */
+#define ARENA_ALIGNMENT 16
+#define ARENA_ALLOC_HEADER ARENA_ALIGNMENT
+#define ARENA_CHUNK_HEADER                                                     \
+    ((tmsize_t)TIFFroundup_64(sizeof(TIFFArenaChunk), ARENA_ALIGNMENT))
+#define ARENA_DATA(chunk) ((uint8_t *)(chunk) + ARENA_CHUNK_HEADER)
+
+static void *_TIFFArenaMalloc(TIFF *tif, tmsize_t s)
+{
+    TIFFArenaChunk *chunk = tif->tif_arena;
+    tmsize_t asize;
+    uint8_t *p;
+
+    if (s <= 0 || s > TIFF_TMSIZE_T_MAX / 2 - ARENA_CHUNK_HEADER)
+        return NULL;
+    if (tif->tif_max_single_mem_alloc > 0 && s > tif->tif_max_single_mem_alloc)
+    {
+        _TIFFEmitErrorAboveMaxSingleMemAlloc(tif, "_TIFFmallocExt", s);
+        return NULL;
+    }
+    asize = ARENA_ALLOC_HEADER +
+            ((s + ARENA_ALIGNMENT - 1) & ~(tmsize_t)(ARENA_ALIGNMENT - 1));
+    if (chunk == NULL || asize > chunk->size - chunk->used)
+    {
+        tmsize_t size = tif->tif_arena_chunk_size;
+        if (asize > size)
+            size = asize;
+        tif->tif_arena_active = 0;
+        chunk =
+            (TIFFArenaChunk *)_TIFFmallocExt(tif, ARENA_CHUNK_HEADER + size);
+        tif->tif_arena_active = 1;
+        if (chunk == NULL)
+            return NULL;
+        chunk->size = size;
+        chunk->used = 0;
+        if (size > tif->tif_arena_chunk_size && tif->tif_arena != NULL)
+        {
+            /* Dedicated to a large block: keep using the current chunk */
+            chunk->next = tif->tif_arena->next;
+            tif->tif_arena->next = chunk;
+        }
+        else
+        {
+            chunk->next = tif->tif_arena;
+            tif->tif_arena = chunk;
+        }
+    }
+    p = ARENA_DATA(chunk) + chunk->used;
+    chunk->used += asize;
+    asize -= ARENA_ALLOC_HEADER;
+    memcpy(p, &asize, sizeof(asize));
+    return p + ARENA_ALLOC_HEADER;
+}
+
+/* Return the chunk holding p, or NULL if p was not allocated from the arena */
+static TIFFArenaChunk *_TIFFArenaFind(TIFF *tif, const void *p)
+{
+    TIFFArenaChunk *chunk;
+
+    for (chunk = tif->tif_arena; chunk != NULL; chunk = chunk->next)
+    {
+        uintptr_t data = (uintptr_t)ARENA_DATA(chunk);
+        if ((uintptr_t)p > data && (uintptr_t)p < data + (uintptr_t)chunk->used)
+            return chunk;
+    }
+    return NULL;
+}
+
+static void *_TIFFArenaRealloc(TIFF *tif, TIFFArenaChunk *chunk, void *p,
+                               tmsize_t s)
+{
+    tmsize_t capacity;
+    void *newp;
+
+    memcpy(&capacity, (uint8_t *)p - ARENA_ALLOC_HEADER, sizeof(capacity));
+    if (tif->tif_arena_active)
+    {
+        if (s <= capacity)
+            return p;
+        if ((uint8_t *)p + capacity == ARENA_DATA(chunk) + chunk->used &&
+            s - capacity <= chunk->size - chunk->used - ARENA_ALIGNMENT)
+        {
+            /* Last block of the chunk: grow it in place */
+            tmsize_t grow = (s - capacity + ARENA_ALIGNMENT - 1) &
+                            ~(tmsize_t)(ARENA_ALIGNMENT - 1);
+            chunk->used += grow;
+            capacity += grow;
+            memcpy((uint8_t *)p - ARENA_ALLOC_HEADER, &capacity,
+                   sizeof(capacity));
+            return p;
+        }
+        /* Grow geometrically, as arrays are often extended one by one */
+        newp = _TIFFArenaMalloc(
+            tif, capacity < TIFF_TMSIZE_T_MAX / 4 && s < 2 * capacity
+                     ? 2 * capacity
+                     : s);
+    }
+    else
+    {
+        newp = _TIFFmallocExt(tif, s);
+    }
+    if (newp != NULL)
+        memcpy(newp, p, (size_t)(s < capacity ? s : capacity));
+    return newp;
+}
+
+/** Recycle the arena once the directory using it has been freed. */
+void _TIFFArenaReset(TIFF *tif)
+{
+    TIFFArenaChunk *chunk = tif->tif_arena;
+    TIFFArenaChunk *keep = NULL;
+
+    tif->tif_arena = NULL;
+    while (chunk != NULL)
+    {
+        TIFFArenaChunk *next = chunk->next;
+        if (keep == NULL && chunk->size == tif->tif_arena_chunk_size)
+        {
+            keep = chunk;
+            keep->next = NULL;
+            keep->used = 0;
+        }
+        else
+        {
+            _TIFFfreeExt(tif, chunk);
+        }
+        chunk = next;
+    }
+    tif->tif_arena = keep;
+}
+
+void _TIFFArenaDestroy(TIFF *tif)
+{
+    _TIFFArenaReset(tif);
+    if (tif->tif_arena != NULL)
+    {
+        TIFFArenaChunk *chunk = tif->tif_arena;
+        tif->tif_arena = NULL;
+        _TIFFfreeExt(tif, chunk);
+    }
+}
+
+/** Free the TIFF structure, with the allocator it was allocated with. */
+void _TIFFFreeHandle(TIFF *tif)
+{
+    if (tif->tif_mallocproc != NULL)
+        tif->tif_freeproc(tif->tif_alloc_user_data, tif);
+    else
+        _TIFFfreeExt(NULL, tif);
+}
+
 /* When allocating memory, we write at the beginning of the buffer it size.
  * This allows us to keep track of the total memory allocated when we
  * malloc/calloc/realloc and free. In theory we need just SIZEOF_SIZE_T bytes
@@ -172,6 +452,8 @@ static void _TIFFEmitErrorAboveMaxCumulatedMemAlloc(TIFF *tif,
 /** malloc() version that takes into account memory-specific open options */
 void *_TIFFmallocExt(TIFF *tif, tmsize_t s)
 {
+    if (tif != NULL && tif->tif_arena_active)
+        return _TIFFArenaMalloc(tif, s);
     if (tif != NULL && tif->tif_max_single_mem_alloc > 0 &&
         s > tif->tif_max_single_mem_alloc)
     {
@@ -187,14 +469,14 @@ void *_TIFFmallocExt(TIFF *tif, tmsize_t s)
             _TIFFEmitErrorAboveMaxCumulatedMemAlloc(tif, "_TIFFmallocExt", s);
             return NULL;
         }
-        void *ptr = _TIFFmalloc(LEADING_AREA_TO_STORE_ALLOC_SIZE + s);
+        void *ptr = _TIFFHeapMalloc(tif, LEADING_AREA_TO_STORE_ALLOC_SIZE + s);
         if (!ptr)
             return NULL;
         tif->tif_cur_cumulated_mem_alloc += s;
         memcpy(ptr, &s, sizeof(s));
         return (char *)ptr + LEADING_AREA_TO_STORE_ALLOC_SIZE;
     }
-    return _TIFFmalloc(s);
+    return _TIFFHeapMalloc(tif, s);
 }
 
 /** calloc() version that takes into account memory-specific open options */
@@ -202,6 +484,13 @@ void *_TIFFcallocExt(TIFF *tif, tmsize_t nmemb, tmsize_t siz)
 {
     if (nmemb <= 0 || siz <= 0 || nmemb > TIFF_TMSIZE_T_MAX / siz)
         return NULL;
+    if (tif != NULL && tif->tif_arena_active)
+    {
+        void *p = _TIFFArenaMalloc(tif, nmemb * siz);
+        if (p != NULL)
+            memset(p, 0, (size_t)(nmemb * siz));
+        return p;
+    }
     if (tif != NULL && tif->tif_max_single_mem_alloc > 0)
     {
         if (nmemb * siz > tif->tif_max_single_mem_alloc)
@@ -221,19 +510,28 @@ void *_TIFFcallocExt(TIFF *tif, tmsize_t nmemb, tmsize_t siz)
             _TIFFEmitErrorAboveMaxCumulatedMemAlloc(tif, "_TIFFcallocExt", s);
             return NULL;
         }
-        void *ptr = _TIFFcalloc(LEADING_AREA_TO_STORE_ALLOC_SIZE + s, 1);
+        void *ptr =
+            _TIFFHeapCalloc(tif, LEADING_AREA_TO_STORE_ALLOC_SIZE + s, 1);
         if (!ptr)
             return NULL;
         tif->tif_cur_cumulated_mem_alloc += s;
         memcpy(ptr, &s, sizeof(s));
         return (char *)ptr + LEADING_AREA_TO_STORE_ALLOC_SIZE;
     }
-    return _TIFFcalloc(nmemb, siz);
+    return _TIFFHeapCalloc(tif, nmemb, siz);
 }
 
 /** realloc() version that takes into account memory-specific open options */
 void *_TIFFreallocExt(TIFF *tif, void *p, tmsize_t s)
 {
+    if (tif != NULL && tif->tif_arena != NULL && p != NULL)
+    {
+        TIFFArenaChunk *chunk = _TIFFArenaFind(tif, p);
+        if (chunk != NULL)
+            return _TIFFArenaRealloc(tif, chunk, p, s);
+    }
+    if (tif != NULL && tif->tif_arena_active && p == NULL)
+        return _TIFFArenaMalloc(tif, s);
     if (tif != NULL && tif->tif_max_single_mem_alloc > 0 &&
         s > tif->tif_max_single_mem_alloc)
     {
@@ -260,7 +558,7 @@ void *_TIFFreallocExt(TIFF *tif, void *p, tmsize_t s)
             return NULL;
         }
         void *newPtr =
-            _TIFFrealloc(oldPtr, LEADING_AREA_TO_STORE_ALLOC_SIZE + s);
+            _TIFFHeapRealloc(tif, oldPtr, LEADING_AREA_TO_STORE_ALLOC_SIZE + s);
         if (newPtr == NULL)
             return NULL;
         tif->tif_cur_cumulated_mem_alloc -= oldSize;
@@ -268,12 +566,15 @@ void *_TIFFreallocExt(TIFF *tif, void *p, tmsize_t s)
         memcpy(newPtr, &s, sizeof(s));
         return (char *)newPtr + LEADING_AREA_TO_STORE_ALLOC_SIZE;
     }
-    return _TIFFrealloc(p, s);
+    return _TIFFHeapRealloc(tif, p, s);
 }
 
 /** free() version that takes into account memory-specific open options */
 void _TIFFfreeExt(TIFF *tif, void *p)
 {
+    if (p != NULL && tif != NULL && tif->tif_arena != NULL &&
+        _TIFFArenaFind(tif, p) != NULL)
+        return; /* released by _TIFFArenaReset() */
     if (p != NULL && tif != NULL && tif->tif_max_cumulated_mem_alloc > 0)
     {
         void *oldPtr = (char *)p - LEADING_AREA_TO_STORE_ALLOC_SIZE;
@@ -283,7 +584,7 @@ void _TIFFfreeExt(TIFF *tif, void *p)
         tif->tif_cur_cumulated_mem_alloc -= oldSize;
         p = oldPtr;
     }
-    _TIFFfree(p);
+    _TIFFHeapFree(tif, p);
 }
 
 TIFF *TIFFClientOpen(const char *name, const char *mode, thandle_t clientdata,
@@ -364,7 +665,10 @@ TIFF *TIFFClientOpenExt(const char *name, const char *mode,
                         (uint64_t)opts->max_cumulated_mem_alloc);
         goto bad2;
     }
-    tif = (TIFF *)_TIFFmallocExt(NULL, size_to_alloc);
+    if (opts && opts->mallocproc)
+        tif = (TIFF *)opts->mallocproc(opts->alloc_user_data, size_to_alloc);
+    else
+        tif = (TIFF *)_TIFFmallocExt(NULL, size_to_alloc);
     if (tif == NULL)
     {
         _TIFFErrorEarly(opts, clientdata, module,
@@ -397,17 +701,40 @@ TIFF *TIFFClientOpenExt(const char *name, const char *mode,
         tif->tif_max_single_mem_alloc = opts->max_single_mem_alloc;
         tif->tif_max_cumulated_mem_alloc = opts->max_cumulated_mem_alloc;
         tif->tif_warn_about_unknown_tags = opts->warn_about_unknown_tags;
+        tif->tif_append_trailer = opts->append_trailer && m != O_RDONLY;
+        if (opts->mallocproc)
+        {
+            tif->tif_mallocproc = opts->mallocproc;
+            tif->tif_reallocproc = opts->reallocproc;
+            tif->tif_freeproc = opts->freeproc;
+            tif->tif_alloc_user_data = opts->alloc_user_data;
+        }
+        tif->tif_arena_chunk_size = opts->arena_chunk_size;
+        tif->tif_streaming_write_size = opts->streaming_write_size;
     }
 
     if (!readproc || !writeproc || !seekproc || !closeproc || !sizeproc)
     {
         TIFFErrorExtR(tif, module,
                       "One of the client procedures is NULL pointer.");
-        _TIFFfreeExt(NULL, tif);
+        _TIFFFreeHandle(tif);
         goto bad2;
     }
 
     _TIFFSetDefaultCompressionState(tif); /* setup default state */
+
+    if (opts && opts->write_buffer_size > 0 && m != O_RDONLY)
+    {
+        tif->tif_wbuf =
+            (uint8_t *)_TIFFmallocExt(tif, opts->write_buffer_size);
+        if (tif->tif_wbuf == NULL)
+        {
+            TIFFErrorExtR(tif, module, "%s: Out of memory (write buffer)",
+                          name);
+            goto bad;
+        }
+        tif->tif_wbufsize = opts->write_buffer_size;
+    }
     /*
      * Default is to return data MSB2LSB and enable the
      * use of memory-mapped files and strip chopping when
@@ -769,6 +1096,8 @@ TIFF *TIFFClientOpenExt(const char *name, const char *mode,
              */
             if (TIFFReadDirectory(tif))
             {
+                if (tif->tif_append_trailer)
+                    (void)_TIFFReadAppendTrailer(tif);
                 return (tif);
             }
             break;
@@ -780,6 +1109,8 @@ TIFF *TIFFClientOpenExt(const char *name, const char *mode,
              */
             if (!TIFFDefaultDirectory(tif))
                 goto bad;
+            if (tif->tif_append_trailer)
+                (void)_TIFFReadAppendTrailer(tif);
             return (tif);
     }
 bad:
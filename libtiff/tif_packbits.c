@@ -31,8 +31,81 @@
  */
 #include <stdio.h>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 #ifndef PACKBITS_READ_ONLY
 
+/*
+ * Return the index of the lowest bit set in the 16-bit mask m (m != 0).
+ */
+static int PackBitsFirstSet(int m)
+{
+    int i = 0;
+    while (!(m & 1))
+    {
+        m >>= 1;
+        i++;
+    }
+    return i;
+}
+
+/*
+ * Return the number of leading bytes of bp[0..cc) equal to b.
+ */
+static tmsize_t PackBitsRunLength(const uint8_t *bp, tmsize_t cc, int b)
+{
+    tmsize_t n = 0;
+#if defined(__x86_64__) || defined(_M_X64)
+    const __m128i vb = _mm_set1_epi8((char)b);
+    /* Short runs are common, do not pay the vector setup for them */
+    for (; n < 8 && n < cc; n++)
+    {
+        if (bp[n] != b)
+            return n;
+    }
+    for (; n + 16 <= cc; n += 16)
+    {
+        int m = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bp + n)), vb));
+        if (m != 0xffff)
+            return n + PackBitsFirstSet(~m & 0xffff);
+    }
+#endif
+    for (; n < cc && bp[n] == b; n++)
+        ;
+    return n;
+}
+
+/*
+ * Return the number of leading bytes of bp[0..cc) that differ from the
+ * byte following them, that is that would each be encoded as a one byte
+ * run, and hence belong to a literal.
+ */
+static tmsize_t PackBitsLiteralLength(const uint8_t *bp, tmsize_t cc)
+{
+    tmsize_t n = 0;
+#if defined(__x86_64__) || defined(_M_X64)
+    for (; n < 4 && n + 1 < cc; n++)
+    {
+        if (bp[n] == bp[n + 1])
+            return n;
+    }
+    for (; n + 17 <= cc; n += 16)
+    {
+        int m = _mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(bp + n)),
+                           _mm_loadu_si128((const __m128i *)(bp + n + 1))));
+        if (m != 0)
+            return n + PackBitsFirstSet(m);
+    }
+#endif
+    for (; n + 1 < cc && bp[n] != bp[n + 1]; n++)
+        ;
+    return n + 1 == cc ? cc : n;
+}
+
 static int PackBitsPreEncode(TIFF *tif, uint16_t s)
 {
     (void)s;
@@ -89,8 +162,13 @@ static int PackBitsEncode(TIFF *tif, uint8_t *buf, tmsize_t cc, uint16_t s)
         b = *bp++;
         cc--;
         n = 1;
-        for (; cc > 0 && b == *bp; cc--, bp++)
-            n++;
+        if (cc > 0 && b == *bp)
+        {
+            tmsize_t run = PackBitsRunLength(bp, cc, b);
+            n += (long)run;
+            bp += run;
+            cc -= run;
+        }
     again:
         if (op + 2 >= ep)
         { /* insure space for new data */
@@ -201,6 +279,30 @@ static int PackBitsEncode(TIFF *tif, uint8_t *buf, tmsize_t cc, uint16_t s)
                     state = RUN;
                 goto again;
         }
+        if (state == LITERAL)
+        {
+            /*
+             * Append the following bytes that would each be encoded as
+             * one byte runs to the current literal at once. This is
+             * limited so that neither the literal length nor the output
+             * space check of the byte at a time path would be hit.
+             */
+            tmsize_t lit = PackBitsLiteralLength(bp, cc);
+            if (lit > 127 - *lastliteral)
+                lit = 127 - *lastliteral;
+            if (lit > ep - op - 3)
+                lit = ep - op - 3;
+            if (lit > 0)
+            {
+                _TIFFmemcpy(op, bp, lit);
+                op += lit;
+                bp += lit;
+                cc -= lit;
+                *lastliteral = (uint8_t)(*lastliteral + lit);
+                if (*lastliteral == 127)
+                    state = BASE;
+            }
+        }
     }
     tif->tif_rawcc += (tmsize_t)(op - tif->tif_rawcp);
     tif->tif_rawcp = op;
@@ -273,8 +375,8 @@ static int PackBitsDecode(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
             occ -= n;
             b = *bp++;
             cc--;
-            while (n-- > 0)
-                *op++ = (uint8_t)b;
+            memset(op, b, (size_t)n);
+            op += n;
         }
         else
         { /* copy next n+1 bytes literally */
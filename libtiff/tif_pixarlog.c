@@ -94,6 +94,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PIXARLOG_USE_SSE2
+#endif
+
 /* Tables for converting to/from 11 bit coded values */
 
 #define TSIZE 2048   /* decode table size (11-bit tokens) */
@@ -320,6 +325,91 @@ static void horizontalAccumulate16(uint16_t *wp, int n, int stride,
     }
 }
 
+#ifdef PIXARLOG_USE_SSE2
+/*
+ * Vectorized version of horizontalAccumulate11() for 3 or 4 samples per
+ * pixel. Undoing the differencing is a running sum per channel, computed
+ * here with log-step prefix sums over blocks of 8 pixels. Sums are done
+ * modulo 2^16, which is fine as only the low 11 bits are kept.
+ *
+ * The other horizontalAccumulateXX() functions are dominated by their
+ * lookups into 2048 entry tables, for which SSE2 has no gather, and are
+ * left scalar.
+ */
+static void horizontalAccumulate11SSE2(const uint16_t *wp, int n, int stride,
+                                       uint16_t *op)
+{
+    const __m128i mask = _mm_set1_epi16(CODE_MASK);
+    uint16_t carry[4];
+    int i = 0, k;
+
+    if (stride == 4)
+    {
+        /* Two pixels per register */
+        __m128i c = _mm_setzero_si128();
+        for (; i + 8 <= n; i += 8)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i *)(wp + i));
+            x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+            x = _mm_add_epi16(x, c);
+            _mm_storeu_si128((__m128i *)(op + i), _mm_and_si128(x, mask));
+            c = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 2, 3, 2));
+        }
+        _mm_storel_epi64((__m128i *)carry, c);
+    }
+    else
+    {
+        /*
+         * Eight pixels spread over three registers a, b, c. The shifts by
+         * 1, 2 and 4 pixels (3, 6 and 12 lanes) of this 24 lane vector are
+         * assembled from byte shifts of neighbouring registers. Registers
+         * are updated from the highest one down, so that each update only
+         * reads lower registers that have not been modified yet.
+         */
+        __m128i x = _mm_setzero_si128();
+        for (; i + 24 <= n; i += 24)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(wp + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(wp + i + 8));
+            __m128i c = _mm_loadu_si128((const __m128i *)(wp + i + 16));
+            /* running sum of the previous block */
+            a = _mm_add_epi16(a, x);
+            /* 1 pixel */
+            c = _mm_add_epi16(
+                c, _mm_or_si128(_mm_slli_si128(c, 6), _mm_srli_si128(b, 10)));
+            b = _mm_add_epi16(
+                b, _mm_or_si128(_mm_slli_si128(b, 6), _mm_srli_si128(a, 10)));
+            a = _mm_add_epi16(a, _mm_slli_si128(a, 6));
+            /* 2 pixels */
+            c = _mm_add_epi16(
+                c, _mm_or_si128(_mm_slli_si128(c, 12), _mm_srli_si128(b, 4)));
+            b = _mm_add_epi16(
+                b, _mm_or_si128(_mm_slli_si128(b, 12), _mm_srli_si128(a, 4)));
+            a = _mm_add_epi16(a, _mm_slli_si128(a, 12));
+            /* 4 pixels */
+            c = _mm_add_epi16(
+                c, _mm_or_si128(_mm_slli_si128(b, 8), _mm_srli_si128(a, 8)));
+            b = _mm_add_epi16(b, _mm_slli_si128(a, 8));
+            _mm_storeu_si128((__m128i *)(op + i), _mm_and_si128(a, mask));
+            _mm_storeu_si128((__m128i *)(op + i + 8), _mm_and_si128(b, mask));
+            _mm_storeu_si128((__m128i *)(op + i + 16), _mm_and_si128(c, mask));
+            /* last pixel of the block */
+            x = _mm_srli_si128(c, 10);
+        }
+        _mm_storel_epi64((__m128i *)carry, x);
+    }
+
+    for (; i < n; i += stride)
+    {
+        for (k = 0; k < stride; k++)
+        {
+            carry[k] = (uint16_t)(carry[k] + wp[i + k]);
+            op[i + k] = (uint16_t)(carry[k] & CODE_MASK);
+        }
+    }
+}
+#endif
+
 /*
  * Returns the log encoded 11-bit values with the horizontal
  * differencing undone.
@@ -329,6 +419,14 @@ static void horizontalAccumulate11(uint16_t *wp, int n, int stride,
 {
     unsigned int cr, cg, cb, ca, mask;
 
+#ifdef PIXARLOG_USE_SSE2
+    if (n >= stride && (stride == 3 || stride == 4))
+    {
+        horizontalAccumulate11SSE2(wp, n, stride, op);
+        return;
+    }
+#endif
+
     if (n >= stride)
     {
         mask = CODE_MASK;
@@ -1063,6 +1161,43 @@ static int PixarLogPreEncode(TIFF *tif, uint16_t s)
     return (deflateReset(&sp->stream) == Z_OK);
 }
 
+#ifdef PIXARLOG_USE_SSE2
+/*
+ * Horizontal differencing of rows with 3 or 4 samples per pixel, 8 samples
+ * at a time. CONV(i) must give the 11-bit code of sample i of ip. The codes
+ * of the previous block are kept in a register, from which the codes one
+ * pixel back are assembled with byte shifts, so each input sample is only
+ * converted once.
+ */
+#define HORIZONTAL_DIFFERENCE_SSE2(CONV)                                       \
+    if (n >= stride && (stride == 3 || stride == 4))                           \
+    {                                                                          \
+        const __m128i vmask = _mm_set1_epi16(CODE_MASK);                       \
+        __m128i prev = _mm_setzero_si128();                                    \
+        int i = 0;                                                             \
+        for (; i + 8 <= n; i += 8)                                             \
+        {                                                                      \
+            __m128i cur = _mm_setr_epi16(                                      \
+                (short)CONV(i), (short)CONV(i + 1), (short)CONV(i + 2),        \
+                (short)CONV(i + 3), (short)CONV(i + 4), (short)CONV(i + 5),    \
+                (short)CONV(i + 6), (short)CONV(i + 7));                       \
+            __m128i back =                                                     \
+                stride == 4 ? _mm_or_si128(_mm_slli_si128(cur, 8),             \
+                                           _mm_srli_si128(prev, 8))            \
+                            : _mm_or_si128(_mm_slli_si128(cur, 6),             \
+                                           _mm_srli_si128(prev, 10));          \
+            _mm_storeu_si128((__m128i *)(wp + i),                              \
+                             _mm_and_si128(_mm_sub_epi16(cur, back), vmask));  \
+            prev = cur;                                                        \
+        }                                                                      \
+        for (; i < n; i++)                                                     \
+            wp[i] = (uint16_t)(i < stride ? CONV(i)                            \
+                                          : (CONV(i) - CONV(i - stride)) &     \
+                                                CODE_MASK);                    \
+        return;                                                                \
+    }
+#endif
+
 static void horizontalDifferenceF(float *ip, int n, int stride, uint16_t *wp,
                                   uint16_t *FromLT2)
 {
@@ -1076,6 +1211,11 @@ static void horizontalDifferenceF(float *ip, int n, int stride, uint16_t *wp,
                          : LogK1 * log(v * LogK2) + 0.5)
 
     mask = CODE_MASK;
+#ifdef PIXARLOG_USE_SSE2
+#define CONV(k) ((int)(uint16_t)CLAMP(ip[k]))
+    HORIZONTAL_DIFFERENCE_SSE2(CONV)
+#undef CONV
+#endif
     if (n >= stride)
     {
         if (stride == 3)
@@ -1153,6 +1293,11 @@ static void horizontalDifference16(unsigned short *ip, int n, int stride,
 #define CLAMP(v) From14[(v) >> 2]
 
     mask = CODE_MASK;
+#ifdef PIXARLOG_USE_SSE2
+#define CONV(k) CLAMP(ip[k])
+    HORIZONTAL_DIFFERENCE_SSE2(CONV)
+#undef CONV
+#endif
     if (n >= stride)
     {
         if (stride == 3)
@@ -1228,6 +1373,11 @@ static void horizontalDifference8(unsigned char *ip, int n, int stride,
 #define CLAMP(v) (From8[(v)])
 
     mask = CODE_MASK;
+#ifdef PIXARLOG_USE_SSE2
+#define CONV(k) CLAMP(ip[k])
+    HORIZONTAL_DIFFERENCE_SSE2(CONV)
+#undef CONV
+#endif
     if (n >= stride)
     {
         if (stride == 3)
@@ -341,6 +341,14 @@ static int PredictorSetupEncode(TIFF *tif)
         case 0:;                                                               \
     }
 
+/* Byte swapping of single values, for the swab variants of the routines */
+#define SWAB16(x) ((uint16_t)(((x) << 8) | ((x) >> 8)))
+#define SWAB32(x)                                                              \
+    ((uint32_t)(((x) << 24) | (((x) << 8) & 0xff0000U) |                       \
+                (((x) >> 8) & 0xff00U) | ((x) >> 24)))
+#define SWAB64(x)                                                              \
+    ((uint64_t)SWAB32((uint32_t)(x)) << 32 | SWAB32((uint32_t)((x) >> 32)))
+
 /* Remarks related to C standard compliance in all below functions : */
 /* - to avoid any undefined behavior, we only operate on unsigned types */
 /*   since the behavior of "overflows" is defined (wrap over) */
@@ -423,13 +431,39 @@ static int horAcc8(TIFF *tif, uint8_t *cp0, tmsize_t cc)
     return 1;
 }
 
+/*
+ * Byte swap and accumulate in a single pass over the data, instead of
+ * swapping the whole buffer with TIFFSwabArrayOfShort() and then going
+ * over it again in horAcc16().
+ */
+TIFF_NOSANITIZE_UNSIGNED_INT_OVERFLOW
 static int swabHorAcc16(TIFF *tif, uint8_t *cp0, tmsize_t cc)
 {
+    tmsize_t stride = PredictorState(tif)->stride;
     uint16_t *wp = (uint16_t *)cp0;
     tmsize_t wc = cc / 2;
+    tmsize_t i;
+
+    if ((cc % (2 * stride)) != 0)
+    {
+        TIFFErrorExtR(tif, "swabHorAcc16", "%s", "cc%(2*stride))!=0");
+        return 0;
+    }
 
-    TIFFSwabArrayOfShort(wp, wc);
-    return horAcc16(tif, cp0, cc);
+    for (i = 0; i < stride && i < wc; i++)
+        wp[i] = SWAB16(wp[i]);
+    if (stride == 1)
+    {
+        uint16_t acc = wc > 0 ? wp[0] : 0;
+        for (; i < wc; i++)
+            wp[i] = acc = (uint16_t)(acc + SWAB16(wp[i]));
+    }
+    else
+    {
+        for (; i < wc; i++)
+            wp[i] = (uint16_t)(wp[i - stride] + SWAB16(wp[i]));
+    }
+    return 1;
 }
 
 TIFF_NOSANITIZE_UNSIGNED_INT_OVERFLOW
@@ -460,13 +494,39 @@ static int horAcc16(TIFF *tif, uint8_t *cp0, tmsize_t cc)
     return 1;
 }
 
+/*
+ * Byte swap and accumulate in a single pass over the data, instead of
+ * swapping the whole buffer with TIFFSwabArrayOfLong() and then going
+ * over it again in horAcc32().
+ */
+TIFF_NOSANITIZE_UNSIGNED_INT_OVERFLOW
 static int swabHorAcc32(TIFF *tif, uint8_t *cp0, tmsize_t cc)
 {
+    tmsize_t stride = PredictorState(tif)->stride;
     uint32_t *wp = (uint32_t *)cp0;
     tmsize_t wc = cc / 4;
+    tmsize_t i;
 
-    TIFFSwabArrayOfLong(wp, wc);
-    return horAcc32(tif, cp0, cc);
+    if ((cc % (4 * stride)) != 0)
+    {
+        TIFFErrorExtR(tif, "swabHorAcc32", "%s", "cc%(4*stride))!=0");
+        return 0;
+    }
+
+    for (i = 0; i < stride && i < wc; i++)
+        wp[i] = SWAB32(wp[i]);
+    if (stride == 1)
+    {
+        uint32_t acc = wc > 0 ? wp[0] : 0;
+        for (; i < wc; i++)
+            wp[i] = acc = (uint32_t)(acc + SWAB32(wp[i]));
+    }
+    else
+    {
+        for (; i < wc; i++)
+            wp[i] = (uint32_t)(wp[i - stride] + SWAB32(wp[i]));
+    }
+    return 1;
 }
 
 TIFF_NOSANITIZE_UNSIGNED_INT_OVERFLOW
@@ -494,13 +554,39 @@ static int horAcc32(TIFF *tif, uint8_t *cp0, tmsize_t cc)
     return 1;
 }
 
+/*
+ * Byte swap and accumulate in a single pass over the data, instead of
+ * swapping the whole buffer with TIFFSwabArrayOfLong8() and then going
+ * over it again in horAcc64().
+ */
+TIFF_NOSANITIZE_UNSIGNED_INT_OVERFLOW
 static int swabHorAcc64(TIFF *tif, uint8_t *cp0, tmsize_t cc)
 {
+    tmsize_t stride = PredictorState(tif)->stride;
     uint64_t *wp = (uint64_t *)cp0;
     tmsize_t wc = cc / 8;
+    tmsize_t i;
 
-    TIFFSwabArrayOfLong8(wp, wc);
-    return horAcc64(tif, cp0, cc);
+    if ((cc % (8 * stride)) != 0)
+    {
+        TIFFErrorExtR(tif, "swabHorAcc64", "%s", "cc%(8*stride))!=0");
+        return 0;
+    }
+
+    for (i = 0; i < stride && i < wc; i++)
+        wp[i] = SWAB64(wp[i]);
+    if (stride == 1)
+    {
+        uint64_t acc = wc > 0 ? wp[0] : 0;
+        for (; i < wc; i++)
+            wp[i] = acc = (uint64_t)(acc + SWAB64(wp[i]));
+    }
+    else
+    {
+        for (; i < wc; i++)
+            wp[i] = (uint64_t)(wp[i - stride] + SWAB64(wp[i]));
+    }
+    return 1;
 }
 
 TIFF_NOSANITIZE_UNSIGNED_INT_OVERFLOW
@@ -811,15 +897,28 @@ static int horDiff16(TIFF *tif, uint8_t *cp0, tmsize_t cc)
     return 1;
 }
 
+/*
+ * Difference and byte swap in a single pass over the data, going backwards
+ * so that the previous sample is always read before being modified.
+ */
+TIFF_NOSANITIZE_UNSIGNED_INT_OVERFLOW
 static int swabHorDiff16(TIFF *tif, uint8_t *cp0, tmsize_t cc)
 {
+    tmsize_t stride = PredictorState(tif)->stride;
     uint16_t *wp = (uint16_t *)cp0;
     tmsize_t wc = cc / 2;
+    tmsize_t i;
 
-    if (!horDiff16(tif, cp0, cc))
+    if ((cc % (2 * stride)) != 0)
+    {
+        TIFFErrorExtR(tif, "swabHorDiff16", "%s", "(cc%(2*stride))!=0");
         return 0;
+    }
 
-    TIFFSwabArrayOfShort(wp, wc);
+    for (i = wc - 1; i >= stride; i--)
+        wp[i] = SWAB16((uint16_t)(wp[i] - wp[i - stride]));
+    for (; i >= 0; i--)
+        wp[i] = SWAB16(wp[i]);
     return 1;
 }
 
@@ -850,15 +949,28 @@ static int horDiff32(TIFF *tif, uint8_t *cp0, tmsize_t cc)
     return 1;
 }
 
+/*
+ * Difference and byte swap in a single pass over the data, going backwards
+ * so that the previous sample is always read before being modified.
+ */
+TIFF_NOSANITIZE_UNSIGNED_INT_OVERFLOW
 static int swabHorDiff32(TIFF *tif, uint8_t *cp0, tmsize_t cc)
 {
+    tmsize_t stride = PredictorState(tif)->stride;
     uint32_t *wp = (uint32_t *)cp0;
     tmsize_t wc = cc / 4;
+    tmsize_t i;
 
-    if (!horDiff32(tif, cp0, cc))
+    if ((cc % (4 * stride)) != 0)
+    {
+        TIFFErrorExtR(tif, "swabHorDiff32", "%s", "(cc%(4*stride))!=0");
         return 0;
+    }
 
-    TIFFSwabArrayOfLong(wp, wc);
+    for (i = wc - 1; i >= stride; i--)
+        wp[i] = SWAB32((uint32_t)(wp[i] - wp[i - stride]));
+    for (; i >= 0; i--)
+        wp[i] = SWAB32(wp[i]);
     return 1;
 }
 
@@ -889,15 +1001,28 @@ static int horDiff64(TIFF *tif, uint8_t *cp0, tmsize_t cc)
     return 1;
 }
 
+/*
+ * Difference and byte swap in a single pass over the data, going backwards
+ * so that the previous sample is always read before being modified.
+ */
+TIFF_NOSANITIZE_UNSIGNED_INT_OVERFLOW
 static int swabHorDiff64(TIFF *tif, uint8_t *cp0, tmsize_t cc)
 {
+    tmsize_t stride = PredictorState(tif)->stride;
     uint64_t *wp = (uint64_t *)cp0;
     tmsize_t wc = cc / 8;
+    tmsize_t i;
 
-    if (!horDiff64(tif, cp0, cc))
+    if ((cc % (8 * stride)) != 0)
+    {
+        TIFFErrorExtR(tif, "swabHorDiff64", "%s", "(cc%(8*stride))!=0");
         return 0;
+    }
 
-    TIFFSwabArrayOfLong8(wp, wc);
+    for (i = wc - 1; i >= stride; i--)
+        wp[i] = SWAB64((uint64_t)(wp[i] - wp[i - stride]));
+    for (; i >= 0; i--)
+        wp[i] = SWAB64(wp[i]);
     return 1;
 }
 
@@ -494,8 +494,8 @@ int TIFFReadScanline(TIFF *tif, void *buf, uint32_t row, uint16_t sample)
  * rows in the strip (check for truncated last strip on any
  * of the separations).
  */
-static tmsize_t TIFFReadEncodedStripGetStripSize(TIFF *tif, uint32_t strip,
-                                                 uint16_t *pplane)
+tmsize_t _TIFFReadEncodedStripGetStripSize(TIFF *tif, uint32_t strip,
+                                           uint16_t *pplane)
 {
     static const char module[] = "TIFFReadEncodedStrip";
     TIFFDirectory *td = &tif->tif_dir;
@@ -548,7 +548,7 @@ tmsize_t TIFFReadEncodedStrip(TIFF *tif, uint32_t strip, void *buf,
     tmsize_t stripsize;
     uint16_t plane;
 
-    stripsize = TIFFReadEncodedStripGetStripSize(tif, strip, &plane);
+    stripsize = _TIFFReadEncodedStripGetStripSize(tif, strip, &plane);
     if (stripsize == ((tmsize_t)(-1)))
         return ((tmsize_t)(-1));
 
@@ -603,7 +603,7 @@ tmsize_t _TIFFReadEncodedStripAndAllocBuffer(TIFF *tif, uint32_t strip,
         return TIFFReadEncodedStrip(tif, strip, *buf, size_to_read);
     }
 
-    this_stripsize = TIFFReadEncodedStripGetStripSize(tif, strip, &plane);
+    this_stripsize = _TIFFReadEncodedStripGetStripSize(tif, strip, &plane);
     if (this_stripsize == ((tmsize_t)(-1)))
         return ((tmsize_t)(-1));
 
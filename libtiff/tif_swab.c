@@ -29,6 +29,41 @@
  */
 #include "tiffiop.h"
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+
+/*
+ * SSE2 is always available on x86_64, and its 16-bit shifts and word
+ * shuffles are enough to reverse the byte order of 16, 32 and 64-bit
+ * values, 16 bytes at a time.
+ */
+static __m128i TIFFSwab16SSE2(__m128i x)
+{
+    return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+static __m128i TIFFSwab32SSE2(__m128i x)
+{
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+    return TIFFSwab16SSE2(x);
+}
+
+static __m128i TIFFSwab64SSE2(__m128i x)
+{
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+    return TIFFSwab16SSE2(x);
+}
+
+#define TIFF_SWAB_SSE2(p, n, count, func)                                      \
+    for (; (n) >= (count); (n) -= (count), (p) += (count))                     \
+    {                                                                          \
+        __m128i x = _mm_loadu_si128((const __m128i *)(void *)(p));             \
+        _mm_storeu_si128((__m128i *)(void *)(p), func(x));                     \
+    }
+#endif
+
 #if defined(DISABLE_CHECK_TIFFSWABMACROS) || !defined(TIFFSwabShort)
 void TIFFSwabShort(uint16_t *wp)
 {
@@ -83,6 +118,9 @@ void TIFFSwabArrayOfShort(uint16_t *wp, tmsize_t n)
     unsigned char *cp;
     unsigned char t;
     assert(sizeof(uint16_t) == 2);
+#if defined(__x86_64__) || defined(_M_X64)
+    TIFF_SWAB_SSE2(wp, n, 8, TIFFSwab16SSE2)
+#endif
     /* XXX unroll loop some */
     while (n-- > 0)
     {
@@ -119,6 +157,9 @@ void TIFFSwabArrayOfLong(uint32_t *lp, tmsize_t n)
     unsigned char *cp;
     unsigned char t;
     assert(sizeof(uint32_t) == 4);
+#if defined(__x86_64__) || defined(_M_X64)
+    TIFF_SWAB_SSE2(lp, n, 4, TIFFSwab32SSE2)
+#endif
     /* XXX unroll loop some */
     while (n-- > 0)
     {
@@ -140,6 +181,9 @@ void TIFFSwabArrayOfLong8(uint64_t *lp, tmsize_t n)
     unsigned char *cp;
     unsigned char t;
     assert(sizeof(uint64_t) == 8);
+#if defined(__x86_64__) || defined(_M_X64)
+    TIFF_SWAB_SSE2(lp, n, 2, TIFFSwab64SSE2)
+#endif
     /* XXX unroll loop some */
     while (n-- > 0)
     {
@@ -182,6 +226,9 @@ void TIFFSwabArrayOfFloat(float *fp, tmsize_t n)
     unsigned char *cp;
     unsigned char t;
     assert(sizeof(float) == 4);
+#if defined(__x86_64__) || defined(_M_X64)
+    TIFF_SWAB_SSE2(fp, n, 4, TIFFSwab32SSE2)
+#endif
     /* XXX unroll loop some */
     while (n-- > 0)
     {
@@ -224,6 +271,9 @@ void TIFFSwabArrayOfDouble(double *dp, tmsize_t n)
     unsigned char *cp;
     unsigned char t;
     assert(sizeof(double) == 8);
+#if defined(__x86_64__) || defined(_M_X64)
+    TIFF_SWAB_SSE2(dp, n, 2, TIFFSwab64SSE2)
+#endif
     /* XXX unroll loop some */
     while (n-- > 0)
     {
@@ -309,6 +359,26 @@ const unsigned char *TIFFGetBitRevTable(int reversed)
 
 void TIFFReverseBits(uint8_t *cp, tmsize_t n)
 {
+#if defined(__x86_64__) || defined(_M_X64)
+    /*
+     * Swap adjacent bits, then bit pairs, then nibbles. The 16-bit shifts
+     * move some bits across byte boundaries, but the masks discard them.
+     */
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+    for (; n >= 16; n -= 16, cp += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)cp);
+        x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 1), m1),
+                         _mm_slli_epi16(_mm_and_si128(x, m1), 1));
+        x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 2), m2),
+                         _mm_slli_epi16(_mm_and_si128(x, m2), 2));
+        x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 4), m4),
+                         _mm_slli_epi16(_mm_and_si128(x, m4), 4));
+        _mm_storeu_si128((__m128i *)cp, x);
+    }
+#endif
     for (; n > 8; n -= 8)
     {
         cp[0] = TIFFBitRevTable[cp[0]];
@@ -0,0 +1,353 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * TIFF Library.
+ *
+ * Minimal pool of worker threads used internally to spread independent
+ * strip/tile work over several cores.  Tasks are run in submission order
+ * by the first idle worker; completion is reported through an integer
+ * flag set with _TIFFThreadPoolDone() and waited upon with
+ * _TIFFThreadPoolWait().  Without thread support (neither Win32 nor
+ * POSIX threads), the pool has no thread and tasks run synchronously
+ * within _TIFFThreadPoolSubmit().
+ */
+#include "tiffiop.h"
+
+#if defined(_WIN32)
+#define TIFF_WIN32_THREADS
+#include <process.h>
+#include <windows.h>
+#elif defined(HAVE_PTHREAD)
+#define TIFF_POSIX_THREADS
+#include <pthread.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+typedef struct
+{
+    TIFFThreadTask func;
+    void *arg;
+} TIFFThreadPoolTask;
+
+typedef struct
+{
+    TIFFThreadPool *pool;
+    int index;
+} TIFFThreadPoolWorker;
+
+struct _TIFFThreadPool
+{
+    int nthreads;
+    int stop;
+    TIFFThreadPoolTask *tasks; /* circular queue */
+    int taskalloc;
+    int taskfirst;
+    int taskcount;
+    TIFFThreadPoolWorker *workers;
+#if defined(TIFF_WIN32_THREADS)
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE wakeup; /* a task was queued, or the pool stops */
+    CONDITION_VARIABLE done;   /* a task completed */
+    HANDLE *threads;
+#elif defined(TIFF_POSIX_THREADS)
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_cond_t done;
+    pthread_t *threads;
+#endif
+};
+
+#if defined(TIFF_WIN32_THREADS)
+#define POOL_LOCK(pool) EnterCriticalSection(&(pool)->lock)
+#define POOL_UNLOCK(pool) LeaveCriticalSection(&(pool)->lock)
+#define POOL_WAIT(pool, cond)                                                  \
+    SleepConditionVariableCS(&(pool)->cond, &(pool)->lock, INFINITE)
+#define POOL_SIGNAL(pool, cond) WakeConditionVariable(&(pool)->cond)
+#define POOL_BROADCAST(pool, cond) WakeAllConditionVariable(&(pool)->cond)
+#elif defined(TIFF_POSIX_THREADS)
+#define POOL_LOCK(pool) pthread_mutex_lock(&(pool)->lock)
+#define POOL_UNLOCK(pool) pthread_mutex_unlock(&(pool)->lock)
+#define POOL_WAIT(pool, cond) pthread_cond_wait(&(pool)->cond, &(pool)->lock)
+#define POOL_SIGNAL(pool, cond) pthread_cond_signal(&(pool)->cond)
+#define POOL_BROADCAST(pool, cond) pthread_cond_broadcast(&(pool)->cond)
+#endif
+
+/*
+ * Return the number of processors available, or 1 if unknown.
+ */
+int _TIFFGetCPUCount(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)(n < 1024 ? n : 1024) : 1;
+#else
+    return 1;
+#endif
+}
+
+#if defined(TIFF_WIN32_THREADS) || defined(TIFF_POSIX_THREADS)
+static void _TIFFThreadPoolRun(TIFFThreadPoolWorker *worker)
+{
+    TIFFThreadPool *pool = worker->pool;
+
+    POOL_LOCK(pool);
+    for (;;)
+    {
+        TIFFThreadPoolTask task;
+        while (pool->taskcount == 0 && !pool->stop)
+            POOL_WAIT(pool, wakeup);
+        if (pool->taskcount == 0)
+            break;
+        task = pool->tasks[pool->taskfirst];
+        pool->taskfirst = (pool->taskfirst + 1) % pool->taskalloc;
+        pool->taskcount--;
+        POOL_UNLOCK(pool);
+        task.func(task.arg, worker->index);
+        POOL_LOCK(pool);
+    }
+    POOL_UNLOCK(pool);
+}
+
+#if defined(TIFF_WIN32_THREADS)
+static unsigned __stdcall _TIFFThreadPoolMain(void *arg)
+{
+    _TIFFThreadPoolRun((TIFFThreadPoolWorker *)arg);
+    return 0;
+}
+#else
+static void *_TIFFThreadPoolMain(void *arg)
+{
+    _TIFFThreadPoolRun((TIFFThreadPoolWorker *)arg);
+    return NULL;
+}
+#endif
+#endif
+
+/*
+ * Create a pool of nthreads workers (the number of processors if
+ * nthreads <= 0).  The pool has no thread at all if the library was
+ * built without thread support.
+ */
+TIFFThreadPool *_TIFFThreadPoolCreate(TIFF *tif, int nthreads)
+{
+    static const char module[] = "_TIFFThreadPoolCreate";
+    TIFFThreadPool *pool;
+
+    pool = (TIFFThreadPool *)_TIFFcallocExt(NULL, 1, sizeof(TIFFThreadPool));
+    if (pool == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return NULL;
+    }
+#if defined(TIFF_WIN32_THREADS) || defined(TIFF_POSIX_THREADS)
+    if (nthreads <= 0)
+        nthreads = _TIFFGetCPUCount();
+    pool->taskalloc = 2 * nthreads;
+    pool->tasks = (TIFFThreadPoolTask *)_TIFFcallocExt(
+        NULL, pool->taskalloc, sizeof(TIFFThreadPoolTask));
+    pool->workers = (TIFFThreadPoolWorker *)_TIFFcallocExt(
+        NULL, nthreads, sizeof(TIFFThreadPoolWorker));
+#if defined(TIFF_WIN32_THREADS)
+    pool->threads = (HANDLE *)_TIFFcallocExt(NULL, nthreads, sizeof(HANDLE));
+#else
+    pool->threads =
+        (pthread_t *)_TIFFcallocExt(NULL, nthreads, sizeof(pthread_t));
+#endif
+    if (pool->tasks == NULL || pool->workers == NULL || pool->threads == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        _TIFFfreeExt(NULL, pool->tasks);
+        _TIFFfreeExt(NULL, pool->workers);
+        _TIFFfreeExt(NULL, pool->threads);
+        _TIFFfreeExt(NULL, pool);
+        return NULL;
+    }
+#if defined(TIFF_WIN32_THREADS)
+    InitializeCriticalSection(&pool->lock);
+    InitializeConditionVariable(&pool->wakeup);
+    InitializeConditionVariable(&pool->done);
+#else
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wakeup, NULL);
+    pthread_cond_init(&pool->done, NULL);
+#endif
+    for (pool->nthreads = 0; pool->nthreads < nthreads; pool->nthreads++)
+    {
+        TIFFThreadPoolWorker *worker = &pool->workers[pool->nthreads];
+        worker->pool = pool;
+        worker->index = pool->nthreads;
+#if defined(TIFF_WIN32_THREADS)
+        pool->threads[pool->nthreads] = (HANDLE)_beginthreadex(
+            NULL, 0, _TIFFThreadPoolMain, worker, 0, NULL);
+        if (pool->threads[pool->nthreads] == 0)
+            break;
+#else
+        if (pthread_create(&pool->threads[pool->nthreads], NULL,
+                           _TIFFThreadPoolMain, worker) != 0)
+            break;
+#endif
+    }
+    if (pool->nthreads == 0)
+    {
+        TIFFErrorExtR(tif, module, "Cannot create worker threads");
+        _TIFFThreadPoolDestroy(pool);
+        return NULL;
+    }
+#else
+    (void)nthreads;
+#endif
+    return pool;
+}
+
+/*
+ * Return the number of distinct worker indices passed to tasks: the
+ * number of threads, or 1 for a pool without thread.
+ */
+int _TIFFThreadPoolSize(TIFFThreadPool *pool)
+{
+    return pool->nthreads > 0 ? pool->nthreads : 1;
+}
+
+/*
+ * Queue a task.  It will be called as func(arg, worker) by one of the
+ * workers, with worker in [0, _TIFFThreadPoolSize()[ identifying it, so
+ * that tasks can use per-worker state without locking.
+ */
+int _TIFFThreadPoolSubmit(TIFFThreadPool *pool, TIFFThreadTask func, void *arg)
+{
+#if defined(TIFF_WIN32_THREADS) || defined(TIFF_POSIX_THREADS)
+    POOL_LOCK(pool);
+    if (pool->taskcount == pool->taskalloc)
+    {
+        int newalloc = 2 * pool->taskalloc;
+        TIFFThreadPoolTask *tasks = (TIFFThreadPoolTask *)_TIFFcallocExt(
+            NULL, newalloc, sizeof(TIFFThreadPoolTask));
+        int i;
+        if (tasks == NULL)
+        {
+            POOL_UNLOCK(pool);
+            return 0;
+        }
+        for (i = 0; i < pool->taskcount; i++)
+            tasks[i] = pool->tasks[(pool->taskfirst + i) % pool->taskalloc];
+        _TIFFfreeExt(NULL, pool->tasks);
+        pool->tasks = tasks;
+        pool->taskalloc = newalloc;
+        pool->taskfirst = 0;
+    }
+    pool->tasks[(pool->taskfirst + pool->taskcount) % pool->taskalloc].func =
+        func;
+    pool->tasks[(pool->taskfirst + pool->taskcount) % pool->taskalloc].arg =
+        arg;
+    pool->taskcount++;
+    POOL_SIGNAL(pool, wakeup);
+    POOL_UNLOCK(pool);
+#else
+    func(arg, 0);
+#endif
+    return 1;
+}
+
+/*
+ * Called by a task to publish its completion status in *flag, which must
+ * be non-zero.
+ */
+void _TIFFThreadPoolDone(TIFFThreadPool *pool, int *flag, int value)
+{
+#if defined(TIFF_WIN32_THREADS) || defined(TIFF_POSIX_THREADS)
+    POOL_LOCK(pool);
+    *flag = value;
+    POOL_BROADCAST(pool, done);
+    POOL_UNLOCK(pool);
+#else
+    (void)pool;
+    *flag = value;
+#endif
+}
+
+/*
+ * Return the value of a flag set by _TIFFThreadPoolDone(), waiting until
+ * it is set if block is non-zero.  0 means the task has not completed.
+ */
+int _TIFFThreadPoolWait(TIFFThreadPool *pool, int *flag, int block)
+{
+    int value;
+#if defined(TIFF_WIN32_THREADS) || defined(TIFF_POSIX_THREADS)
+    POOL_LOCK(pool);
+    while (*flag == 0 && block)
+        POOL_WAIT(pool, done);
+    value = *flag;
+    POOL_UNLOCK(pool);
+#else
+    (void)pool;
+    (void)block;
+    value = *flag;
+#endif
+    return value;
+}
+
+/*
+ * Run the tasks still queued, then terminate the workers and free the
+ * pool.
+ */
+void _TIFFThreadPoolDestroy(TIFFThreadPool *pool)
+{
+    if (pool == NULL)
+        return;
+#if defined(TIFF_WIN32_THREADS) || defined(TIFF_POSIX_THREADS)
+    if (pool->threads != NULL)
+    {
+        int i;
+        POOL_LOCK(pool);
+        pool->stop = 1;
+        POOL_BROADCAST(pool, wakeup);
+        POOL_UNLOCK(pool);
+        for (i = 0; i < pool->nthreads; i++)
+        {
+#if defined(TIFF_WIN32_THREADS)
+            WaitForSingleObject(pool->threads[i], INFINITE);
+            CloseHandle(pool->threads[i]);
+#else
+            pthread_join(pool->threads[i], NULL);
+#endif
+        }
+#if defined(TIFF_WIN32_THREADS)
+        DeleteCriticalSection(&pool->lock);
+#else
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->wakeup);
+        pthread_cond_destroy(&pool->done);
+#endif
+    }
+    _TIFFfreeExt(NULL, pool->tasks);
+    _TIFFfreeExt(NULL, pool->workers);
+    _TIFFfreeExt(NULL, pool->threads);
+#endif
+    _TIFFfreeExt(NULL, pool);
+}
@@ -31,6 +31,11 @@
 #undef TIFF_DO_NOT_USE_NON_EXT_ALLOC_FUNCTIONS
 #endif
 
+/* for O_DIRECT */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "tif_config.h"
 
 #ifdef HAVE_SYS_TYPES_H
@@ -128,6 +133,39 @@ static tmsize_t _tiffWriteProc(thandle_t fd, void *buf, tmsize_t size)
     /* return ((tmsize_t) write(fdh.fd, buf, bytes_total)); */
 }
 
+#ifdef HAVE_PWRITE
+static tmsize_t _tiffPWriteProc(thandle_t fd, void *buf, tmsize_t size,
+                                uint64_t off)
+{
+    fd_as_handle_union_t fdh;
+    const size_t bytes_total = (size_t)size;
+    size_t bytes_written;
+    tmsize_t count = -1;
+    _TIFF_off_t off_io = (_TIFF_off_t)off;
+    if ((tmsize_t)bytes_total != size || (uint64_t)off_io != off)
+    {
+        errno = EINVAL;
+        return (tmsize_t)-1;
+    }
+    fdh.h = fd;
+    for (bytes_written = 0; bytes_written < bytes_total; bytes_written += count)
+    {
+        const char *buf_offset = (char *)buf + bytes_written;
+        size_t io_size = bytes_total - bytes_written;
+        if (io_size > TIFF_IO_MAX)
+            io_size = TIFF_IO_MAX;
+        count = pwrite(fdh.fd, buf_offset, (TIFFIOSize_t)io_size,
+                       off_io + (_TIFF_off_t)bytes_written);
+        if (count <= 0)
+            break;
+    }
+    if (count < 0)
+        return (tmsize_t)-1;
+    /* coverity[return_overflow:SUPPRESS] */
+    return (tmsize_t)bytes_written;
+}
+#endif
+
 static uint64_t _tiffSeekProc(thandle_t fd, uint64_t off, int whence)
 {
     fd_as_handle_union_t fdh;
@@ -203,6 +241,52 @@ static void _tiffUnmapProc(thandle_t fd, void *base, toff_t size)
 }
 #endif /* !HAVE_MMAP */
 
+#if defined(O_DIRECT) && defined(HAVE_PWRITE)
+/* Alignment of the file offsets, sizes and buffers of direct I/O. This is
+ * the page size on most systems, and a multiple of the logical block size
+ * of the usual devices. */
+#define DIRECT_IO_ALIGNMENT 4096
+
+static int _tiffDirectCloseProc(thandle_t fd, uint64_t size)
+{
+    fd_as_handle_union_t fdh;
+    _TIFF_stat_s sb;
+    int ret = 0;
+
+    fdh.h = fd;
+    if (size > 0 && _TIFF_fstat_f(fdh.fd, &sb) == 0 &&
+        (uint64_t)sb.st_size > size)
+        ret = ftruncate(fdh.fd, (_TIFF_off_t)size);
+    if (close(fdh.fd) != 0)
+        ret = -1;
+    return ret;
+}
+
+/*
+ * Open name a second time with O_DIRECT, for the strip/tile data written
+ * by TIFFAppendToStrip(). If the file system does not support it, the
+ * regular handle is used.
+ */
+static void _tiffSetupDirectIO(TIFF *tif, const char *name)
+{
+    fd_as_handle_union_t fdh;
+
+    fdh.fd = open(name, O_WRONLY | O_DIRECT);
+    if (fdh.fd < 0)
+    {
+        TIFFWarningExtR(tif, "TIFFOpen",
+                        "%s: Direct I/O not available (%s), using buffered "
+                        "I/O",
+                        name, strerror(errno));
+        return;
+    }
+    tif->tif_directwriteproc = _tiffPWriteProc;
+    tif->tif_directcloseproc = _tiffDirectCloseProc;
+    tif->tif_directhandle = fdh.h;
+    tif->tif_directalign = DIRECT_IO_ALIGNMENT;
+}
+#endif
+
 /*
  * Open a TIFF file descriptor for read/writing.
  */
@@ -222,7 +306,12 @@ TIFF *TIFFFdOpenExt(int fd, const char *name, const char *mode,
                             _tiffSeekProc, _tiffCloseProc, _tiffSizeProc,
                             _tiffMapProc, _tiffUnmapProc, opts);
     if (tif)
+    {
         tif->tif_fd = fd;
+#ifdef HAVE_PWRITE
+        tif->tif_pwriteproc = _tiffPWriteProc;
+#endif
+    }
     return (tif);
 }
 
@@ -267,6 +356,10 @@ TIFF *TIFFOpenExt(const char *name, const char *mode, TIFFOpenOptions *opts)
     tif = TIFFFdOpenExt((int)fd, name, mode, opts);
     if (!tif)
         close(fd);
+#if defined(O_DIRECT) && defined(HAVE_PWRITE)
+    else if (opts && opts->direct_io && tif->tif_mode != O_RDONLY)
+        _tiffSetupDirectIO(tif, name);
+#endif
     return tif;
 }
 
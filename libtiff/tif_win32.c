@@ -120,6 +120,40 @@ static tmsize_t _tiffWriteProc(thandle_t fd, void *buf, tmsize_t size)
     return (p);
 }
 
+static tmsize_t _tiffPWriteProc(thandle_t fd, void *buf, tmsize_t size,
+                                uint64_t off)
+{
+    /* Same as _tiffWriteProc(), but each chunk is written at an explicit
+     * offset given through an OVERLAPPED structure. */
+    uint8_t *ma;
+    uint64_t mb;
+    DWORD n;
+    DWORD o;
+    tmsize_t p;
+    OVERLAPPED ov;
+    ma = (uint8_t *)buf;
+    mb = size;
+    p = 0;
+    while (mb > 0)
+    {
+        n = 0x80000000UL;
+        if ((uint64_t)n > mb)
+            n = (DWORD)mb;
+        memset(&ov, 0, sizeof(ov));
+        ov.Offset = (DWORD)off;
+        ov.OffsetHigh = (DWORD)(off >> 32);
+        if (!WriteFile(fd, (LPVOID)ma, n, &o, &ov))
+            return (0);
+        ma += o;
+        mb -= o;
+        p += o;
+        off += o;
+        if (o != n)
+            break;
+    }
+    return (p);
+}
+
 static uint64_t _tiffSeekProc(thandle_t fd, uint64_t off, int whence)
 {
     LARGE_INTEGER offli;
@@ -234,7 +268,10 @@ TIFF *TIFFFdOpenExt(int ifd, const char *name, const char *mode,
         fSuppressMap ? _tiffDummyMapProc : _tiffMapProc,
         fSuppressMap ? _tiffDummyUnmapProc : _tiffUnmapProc, opts);
     if (tif)
+    {
         tif->tif_fd = ifd;
+        tif->tif_pwriteproc = _tiffPWriteProc;
+    }
     return (tif);
 }
 
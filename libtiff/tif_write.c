@@ -44,6 +44,31 @@ static int TIFFGrowStrips(TIFF *tif, uint32_t delta, const char *module);
 static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
                              tmsize_t cc);
 
+/*
+ * Handle delayed allocation of the data buffer of TIFFWriteScanline().
+ * The codecs encode each row as it arrives and write the buffer out
+ * whenever it is full, so in streaming mode (TIFFOpenOptionsSetStreamingWrite)
+ * it does not need to hold a whole strip, and memory use stays bounded
+ * however tall the strips are.
+ */
+static int TIFFScanlineBufferCheck(TIFF *tif)
+{
+    uint64_t size;
+
+    if ((tif->tif_flags & TIFF_BUFFERSETUP) && tif->tif_rawdata)
+        return 1;
+    if (tif->tif_streaming_write_size == 0)
+        return TIFFWriteBufferSetup(tif, NULL, (tmsize_t)-1);
+    /* Same as the default size, but capped */
+    size = TIFFStripSize64(tif);
+    size += size / 10;
+    if (size < 8 * 1024)
+        size = 8 * 1024;
+    if (size > (uint64_t)tif->tif_streaming_write_size)
+        size = (uint64_t)tif->tif_streaming_write_size;
+    return TIFFWriteBufferSetup(tif, NULL, (tmsize_t)size);
+}
+
 int TIFFWriteScanline(TIFF *tif, void *buf, uint32_t row, uint16_t sample)
 {
     static const char module[] = "TIFFWriteScanline";
@@ -58,7 +83,7 @@ int TIFFWriteScanline(TIFF *tif, void *buf, uint32_t row, uint16_t sample)
      * permits it to be sized more intelligently (using
      * directory information).
      */
-    if (!BUFFERCHECK(tif))
+    if (!TIFFScanlineBufferCheck(tif))
         return (-1);
     tif->tif_flags |= TIFF_BUF4WRITE; /* not strictly sure this is right*/
 
@@ -547,6 +572,113 @@ tmsize_t TIFFWriteRawTile(TIFF *tif, uint32_t tile, void *data, tmsize_t cc)
                                                               : (tmsize_t)(-1));
 }
 
+/*
+ * Write a strip or tile encoded elsewhere (see tif_asyncwrite.c), as
+ * TIFFWriteEncodedStrip() and TIFFWriteEncodedTile() write the output of
+ * the codec.
+ */
+int _TIFFWriteEncodedStrile(TIFF *tif, uint32_t strile, uint8_t *data,
+                            tmsize_t cc)
+{
+    if (isTiled(tif))
+        tif->tif_curtile = strile;
+    else
+        tif->tif_curstrip = strile;
+
+    /* this informs TIFFAppendToStrip() we have changed or reset strip */
+    tif->tif_curoff = 0;
+
+    return (cc <= 0 || TIFFAppendToStrip(tif, strile, data, cc));
+}
+
+/*
+ * Reserve size bytes at the end of the file for a strip or tile, and record
+ * them as its offset and byte count.  The data is written afterwards with
+ * TIFFWriteReservedStrile(), in any order.
+ */
+uint64_t TIFFReserveStrile(TIFF *tif, uint32_t strile, uint64_t size)
+{
+    static const char module[] = "TIFFReserveStrile";
+    TIFFDirectory *td = &tif->tif_dir;
+    uint64_t off;
+    uint64_t end;
+
+    if (isTiled(tif) ? !WRITECHECKTILES(tif, module)
+                     : !WRITECHECKSTRIPS(tif, module))
+        return 0;
+    if (strile >= td->td_nstrips)
+    {
+        TIFFErrorExtR(tif, module, "Strip/tile %u out of range, max %u",
+                      strile, td->td_nstrips);
+        return 0;
+    }
+    if (size == 0)
+    {
+        TIFFErrorExtR(tif, module, "Cannot reserve an empty strip/tile");
+        return 0;
+    }
+
+    off = _TIFFGetLogicalEOF(tif);
+    end = off + size;
+    if (end < off ||
+        (!(tif->tif_flags & TIFF_BIGTIFF) && end != (uint32_t)end))
+    {
+        TIFFErrorExtR(tif, module, "Maximum TIFF file size exceeded");
+        return 0;
+    }
+
+    /* A strip/tile that TIFFAppendToStrip() is still growing at the end */
+    /* of the file must now be moved before it grows again. */
+    if (tif->tif_curoff == off && tif->tif_lastvalidoff == 0)
+        tif->tif_lastvalidoff = off;
+
+    tif->tif_logical_eof = end;
+    td->td_stripoffset_p[strile] = off;
+    td->td_stripbytecount_p[strile] = size;
+    tif->tif_flags |= TIFF_DIRTYSTRIP;
+    return off;
+}
+
+/*
+ * Write the data of a strip or tile into the space reserved for it by
+ * TIFFReserveStrile().  Only the handle's I/O is used, so with an I/O
+ * layer that does positional writes several threads may call this at
+ * once for different striles.
+ */
+tmsize_t TIFFWriteReservedStrile(TIFF *tif, uint32_t strile, const void *data,
+                                 tmsize_t cc)
+{
+    static const char module[] = "TIFFWriteReservedStrile";
+    TIFFDirectory *td = &tif->tif_dir;
+
+    if (td->td_stripoffset_p == NULL || strile >= td->td_nstrips ||
+        td->td_stripoffset_p[strile] == 0)
+    {
+        TIFFErrorExtR(tif, module, "No space reserved for strip/tile %u",
+                      strile);
+        return ((tmsize_t)-1);
+    }
+    if (cc < 0 || (uint64_t)cc != td->td_stripbytecount_p[strile])
+    {
+        TIFFErrorExtR(tif, module,
+                      "%" TIFF_SSIZE_FORMAT
+                      " bytes given for strip/tile %u, %" PRIu64 " reserved",
+                      cc, strile, td->td_stripbytecount_p[strile]);
+        return ((tmsize_t)-1);
+    }
+    /* Bypass the write-combining buffer, so as not to share its state */
+    if (tif->tif_pwriteproc != NULL
+            ? (*tif->tif_pwriteproc)(tif->tif_clientdata, (void *)data, cc,
+                                     td->td_stripoffset_p[strile]) != cc
+            : !_TIFFWriteAt(tif, td->td_stripoffset_p[strile], data, cc))
+    {
+        TIFFErrorExtR(tif, module, "Write error at offset %" PRIu64,
+                      td->td_stripoffset_p[strile]);
+        return ((tmsize_t)-1);
+    }
+    return cc;
+}
+
 #define isUnspecified(tif, f)                                                  \
     (TIFFFieldSet(tif, f) && (tif)->tif_dir.td_imagelength == 0)
 
@@ -654,6 +786,8 @@ int TIFFWriteCheck(TIFF *tif, int tiles, const char *module)
     if (tif->tif_scanlinesize == 0)
         return (0);
     tif->tif_flags |= TIFF_BEENWRITING;
+    tif->tif_fallback_striles = 0;
+    tif->tif_fallback_stored = 0;
 
     if (tif->tif_dir.td_stripoffset_entry.tdir_tag != 0 &&
         tif->tif_dir.td_stripoffset_entry.tdir_count == 0 &&
@@ -758,6 +892,240 @@ static int TIFFGrowStrips(TIFF *tif, uint32_t delta, const char *module)
     return (1);
 }
 
+/*
+ * Write-combining buffer, enabled with TIFFOpenOptionsSetWriteBufferSize().
+ * Writes at consecutive offsets are gathered in tif_wbuf and reach the file
+ * in blocks of the buffer size.  Seeks only move tif_wbufpos; the pending
+ * bytes are written out before a write elsewhere in the file, a read, and
+ * by TIFFFlush() and TIFFClose().
+ */
+int _TIFFFlushWriteBuffer(TIFF *tif)
+{
+    static const char module[] = "_TIFFFlushWriteBuffer";
+    tmsize_t cc = tif->tif_wbufcc;
+    int ok;
+
+    if (cc == 0)
+        return 1;
+    tif->tif_wbufcc = 0;
+    if (tif->tif_pwriteproc != NULL)
+        ok = (*tif->tif_pwriteproc)(tif->tif_clientdata, tif->tif_wbuf, cc,
+                                    tif->tif_wbufoff) == cc;
+    else
+        ok = (*tif->tif_seekproc)(tif->tif_clientdata, tif->tif_wbufoff,
+                                  SEEK_SET) == tif->tif_wbufoff &&
+             (*tif->tif_writeproc)(tif->tif_clientdata, tif->tif_wbuf, cc) ==
+                 cc;
+    if (!ok)
+        TIFFErrorExtR(tif, module,
+                      "Write error of %" TIFF_SSIZE_FORMAT
+                      " bytes at offset %" PRIu64,
+                      cc, tif->tif_wbufoff);
+    return ok;
+}
+
+tmsize_t _TIFFBufferedWrite(TIFF *tif, void *buf, tmsize_t size)
+{
+    tmsize_t n;
+
+    if (size <= 0)
+        return size;
+    if (tif->tif_wbufcc > 0 &&
+        (tif->tif_wbufpos != tif->tif_wbufoff + (uint64_t)tif->tif_wbufcc ||
+         size > tif->tif_wbufsize - tif->tif_wbufcc))
+    {
+        if (!_TIFFFlushWriteBuffer(tif))
+            return (tmsize_t)-1;
+    }
+    if (size < tif->tif_wbufsize)
+    {
+        if (tif->tif_wbufcc == 0)
+            tif->tif_wbufoff = tif->tif_wbufpos;
+        _TIFFmemcpy(tif->tif_wbuf + tif->tif_wbufcc, buf, size);
+        tif->tif_wbufcc += size;
+        tif->tif_wbufpos += (uint64_t)size;
+        return size;
+    }
+
+    /* Not worth copying */
+    if (tif->tif_pwriteproc != NULL)
+        n = (*tif->tif_pwriteproc)(tif->tif_clientdata, buf, size,
+                                   tif->tif_wbufpos);
+    else if ((*tif->tif_seekproc)(tif->tif_clientdata, tif->tif_wbufpos,
+                                  SEEK_SET) == tif->tif_wbufpos)
+        n = (*tif->tif_writeproc)(tif->tif_clientdata, buf, size);
+    else
+        n = (tmsize_t)-1;
+    if (n > 0)
+        tif->tif_wbufpos += (uint64_t)n;
+    return n;
+}
+
+tmsize_t _TIFFBufferedRead(TIFF *tif, void *buf, tmsize_t size)
+{
+    tmsize_t n;
+
+    if (!_TIFFFlushWriteBuffer(tif) ||
+        (*tif->tif_seekproc)(tif->tif_clientdata, tif->tif_wbufpos,
+                             SEEK_SET) != tif->tif_wbufpos)
+        return (tmsize_t)-1;
+    n = (*tif->tif_readproc)(tif->tif_clientdata, buf, size);
+    if (n > 0)
+        tif->tif_wbufpos += (uint64_t)n;
+    return n;
+}
+
+uint64_t _TIFFBufferedSeek(TIFF *tif, uint64_t off, int whence)
+{
+    switch (whence)
+    {
+        case SEEK_SET:
+            tif->tif_wbufpos = off;
+            break;
+        case SEEK_CUR:
+            tif->tif_wbufpos += off;
+            break;
+        default:
+            if (!_TIFFFlushWriteBuffer(tif))
+                return (uint64_t)-1;
+            off = (*tif->tif_seekproc)(tif->tif_clientdata, off, whence);
+            if (off == (uint64_t)-1)
+                return off;
+            tif->tif_wbufpos = off;
+            break;
+    }
+    return tif->tif_wbufpos;
+}
+
+uint64_t _TIFFBufferedSize(TIFF *tif)
+{
+    uint64_t size = (*tif->tif_sizeproc)(tif->tif_clientdata);
+    uint64_t end = tif->tif_wbufoff + (uint64_t)tif->tif_wbufcc;
+    return (tif->tif_wbufcc > 0 && end > size) ? end : size;
+}
+
+/*
+ * Return the offset at which data appended to the file goes.  The end of
+ * file is queried once and then tracked here, as strips/tiles and
+ * directories are allocated from it, so that appending does not depend on
+ * the position of the file handle.
+ */
+uint64_t _TIFFGetLogicalEOF(TIFF *tif)
+{
+    if (tif->tif_logical_eof == 0)
+        tif->tif_logical_eof = TIFFSeekFile(tif, 0, SEEK_END);
+    return tif->tif_logical_eof;
+}
+
+/*
+ * Record that the file space up to end is in use.
+ */
+void _TIFFExtendLogicalEOF(TIFF *tif, uint64_t end)
+{
+    if (end > _TIFFGetLogicalEOF(tif))
+        tif->tif_logical_eof = end;
+}
+
+/*
+ * Write size bytes at offset off.  With a positional write method, and no
+ * write-combining buffer, the file position is left alone and several
+ * threads may write disjoint ranges at once; otherwise this is a seek
+ * followed by a write.
+ */
+int _TIFFWriteAt(TIFF *tif, uint64_t off, const void *buf, tmsize_t size)
+{
+    if (tif->tif_pwriteproc != NULL && tif->tif_wbuf == NULL)
+        return (*tif->tif_pwriteproc)(tif->tif_clientdata, (void *)buf, size,
+                                      off) == size;
+    return SeekOK(tif, off) && WriteOK(tif, (void *)buf, size);
+}
+
+/*
+ * Direct I/O, enabled with TIFFOpenOptionsSetDirectIO().  A strip/tile
+ * appended at the end of the file starts at an offset aligned on
+ * tif_directalign, and its data goes through the aligned staging buffer
+ * tif_directbuf to the handle opened for direct I/O, in whole aligned
+ * blocks.  The last block is padded with zeros and kept in the buffer, so
+ * that data appended to the same strip/tile completes it.  Everything else,
+ * notably the header and the directories, goes through the regular handle,
+ * and the padding after the last block is removed when the file is closed.
+ */
+#define DIRECT_IO_BUFFER_SIZE (1024 * 1024)
+
+static int TIFFDirectWrite(TIFF *tif, uint64_t off, const uint8_t *data,
+                           tmsize_t cc)
+{
+    static const char module[] = "TIFFDirectWrite";
+    const tmsize_t align = tif->tif_directalign;
+    uint8_t *buf = tif->tif_directbuf;
+
+    if (buf == NULL)
+    {
+        uintptr_t misalign;
+
+        tif->tif_directbufbase =
+            _TIFFmallocExt(tif, DIRECT_IO_BUFFER_SIZE + align);
+        if (tif->tif_directbufbase == NULL)
+        {
+            TIFFErrorExtR(tif, module, "No space for direct I/O buffer");
+            return 0;
+        }
+        misalign = (uintptr_t)tif->tif_directbufbase % (uintptr_t)align;
+        buf = (uint8_t *)tif->tif_directbufbase +
+              (misalign ? align - (tmsize_t)misalign : 0);
+        tif->tif_directbuf = buf;
+    }
+    assert(off == tif->tif_directoff + (uint64_t)tif->tif_directcc);
+    (void)off;
+
+    while (cc > 0)
+    {
+        tmsize_t n = DIRECT_IO_BUFFER_SIZE - tif->tif_directcc;
+        tmsize_t size, full;
+
+        if (n > cc)
+            n = cc;
+        _TIFFmemcpy(buf + tif->tif_directcc, data, n);
+        tif->tif_directcc += n;
+        data += n;
+        cc -= n;
+        if (cc > 0 && tif->tif_directcc < DIRECT_IO_BUFFER_SIZE)
+            continue;
+
+        size = (tmsize_t)TIFFroundup_64(tif->tif_directcc, align);
+        _TIFFmemset(buf + tif->tif_directcc, 0, size - tif->tif_directcc);
+        if ((*tif->tif_directwriteproc)(tif->tif_directhandle, buf, size,
+                                        tif->tif_directoff) != size)
+        {
+            /* Not supported for this file after all: write it as usual */
+            TIFFWarningExtR(tif, module,
+                            "Direct I/O write failed at offset %" PRIu64
+                            ", using buffered I/O",
+                            tif->tif_directoff);
+            tif->tif_directwriteproc = NULL;
+            return _TIFFWriteAt(tif, tif->tif_directoff, buf,
+                                tif->tif_directcc) &&
+                   (cc == 0 ||
+                    _TIFFWriteAt(tif,
+                                 tif->tif_directoff +
+                                     (uint64_t)tif->tif_directcc,
+                                 data, cc));
+        }
+        if (tif->tif_directoff + (uint64_t)size > tif->tif_directend)
+            tif->tif_directend = tif->tif_directoff + (uint64_t)size;
+
+        /* Keep the last partial block */
+        full = tif->tif_directcc - tif->tif_directcc % align;
+        if (full > 0)
+        {
+            memmove(buf, buf + full, (size_t)(tif->tif_directcc - full));
+            tif->tif_directoff += (uint64_t)full;
+            tif->tif_directcc -= full;
+        }
+    }
+    return 1;
+}
+
 /*
  * Append the data to the specified strip.
  */
@@ -767,6 +1135,7 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
     static const char module[] = "TIFFAppendToStrip";
     TIFFDirectory *td = &tif->tif_dir;
     uint64_t m;
+    uint64_t writeoff;
     int64_t old_byte_count = -1;
 
     if (tif->tif_curoff == 0)
@@ -787,23 +1156,24 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
              * more data to append to this strip before we are done
              * depending on how we are getting called.
              */
-            if (!SeekOK(tif, td->td_stripoffset_p[strip]))
-            {
-                TIFFErrorExtR(tif, module, "Seek error at scanline %lu",
-                              (unsigned long)tif->tif_row);
-                return (0);
-            }
-
             tif->tif_lastvalidoff =
                 td->td_stripoffset_p[strip] + td->td_stripbytecount_p[strip];
+            tif->tif_directoff = 0;
+            tif->tif_directcc = 0;
         }
         else
         {
             /*
-             * Seek to end of file, and set that as our location to
-             * write this strip.
+             * Place the strip at the end of the file.
              */
-            td->td_stripoffset_p[strip] = TIFFSeekFile(tif, 0, SEEK_END);
+            td->td_stripoffset_p[strip] = _TIFFGetLogicalEOF(tif);
+            if (tif->tif_directwriteproc != NULL)
+            {
+                td->td_stripoffset_p[strip] = TIFFroundup_64(
+                    td->td_stripoffset_p[strip], tif->tif_directalign);
+                tif->tif_directoff = td->td_stripoffset_p[strip];
+                tif->tif_directcc = 0;
+            }
             tif->tif_flags |= TIFF_DIRTYSTRIP;
         }
 
@@ -816,7 +1186,8 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
         td->td_stripbytecount_p[strip] = 0;
     }
 
-    m = tif->tif_curoff + cc;
+    writeoff = tif->tif_curoff;
+    m = writeoff + cc;
     if (!(tif->tif_flags & TIFF_BIGTIFF))
         m = (uint32_t)m;
     if ((m < tif->tif_curoff) || (m < (uint64_t)cc))
@@ -848,7 +1219,7 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
             tempSize = 1024 * 1024;
 
         offsetRead = td->td_stripoffset_p[strip];
-        offsetWrite = TIFFSeekFile(tif, 0, SEEK_END);
+        offsetWrite = _TIFFGetLogicalEOF(tif);
 
         m = offsetWrite + toCopy + cc;
         if (!(tif->tif_flags & TIFF_BIGTIFF) && m != (uint32_t)m)
@@ -884,13 +1255,7 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
                 _TIFFfreeExt(tif, temp);
                 return (0);
             }
-            if (!SeekOK(tif, offsetWrite))
-            {
-                TIFFErrorExtR(tif, module, "Seek error");
-                _TIFFfreeExt(tif, temp);
-                return (0);
-            }
-            if (!WriteOK(tif, temp, tempSize))
+            if (!_TIFFWriteAt(tif, offsetWrite, temp, tempSize))
             {
                 TIFFErrorExtR(tif, module, "Cannot write");
                 _TIFFfreeExt(tif, temp);
@@ -904,16 +1269,29 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
         _TIFFfreeExt(tif, temp);
 
         /* Append the data of this call */
-        offsetWrite += cc;
-        m = offsetWrite;
+        writeoff = offsetWrite;
+        m = offsetWrite + cc;
+        tif->tif_directoff = 0;
+        tif->tif_directcc = 0;
     }
 
-    if (!WriteOK(tif, data, cc))
+    if (tif->tif_directwriteproc != NULL && tif->tif_directoff != 0 &&
+        writeoff == tif->tif_directoff + (uint64_t)tif->tif_directcc)
+    {
+        if (!TIFFDirectWrite(tif, writeoff, data, cc))
+        {
+            TIFFErrorExtR(tif, module, "Write error at scanline %lu",
+                          (unsigned long)tif->tif_row);
+            return (0);
+        }
+    }
+    else if (!_TIFFWriteAt(tif, writeoff, data, cc))
     {
         TIFFErrorExtR(tif, module, "Write error at scanline %lu",
                       (unsigned long)tif->tif_row);
         return (0);
     }
+    _TIFFExtendLogicalEOF(tif, m);
     tif->tif_curoff = m;
     td->td_stripbytecount_p[strip] += cc;
 
@@ -72,6 +72,9 @@ typedef struct
     int zipquality; /* compression level */
     int state;      /* state flags */
     int subcodec;   /* DEFLATE_SUBCODEC_ZLIB or DEFLATE_SUBCODEC_LIBDEFLATE */
+    int stored;     /* -1 until the first ZIPEncode() of a strip/tile, then */
+                    /* whether it is written with stored blocks */
+    uLong adler;    /* Adler-32 checksum of the stored data */
 #if LIBDEFLATE_SUPPORT
     int libdeflate_state; /* -1 = until first time ZIPEncode() / ZIPDecode() is
                              called, 0 = use zlib, 1 = use libdeflate */
@@ -360,6 +363,7 @@ static int ZIPPreEncode(TIFF *tif, uint16_t s)
 #if LIBDEFLATE_SUPPORT
     sp->libdeflate_state = -1;
 #endif
+    sp->stored = -1;
     sp->stream.next_out = tif->tif_rawdata;
     assert(sizeof(sp->stream.avail_out) == 4); /* if this assert gets raised,
          we need to simplify this code to reflect a ZLib that is likely updated
@@ -371,6 +375,63 @@ static int ZIPPreEncode(TIFF *tif, uint16_t s)
     return (deflateReset(&sp->stream) == Z_OK);
 }
 
+/*
+ * Append data to the output buffer, flushing it when full.
+ */
+static int ZIPPutStored(TIFF *tif, const uint8_t *bp, tmsize_t cc)
+{
+    ZIPState *sp = ZIPEncoderState(tif);
+
+    while (cc > 0)
+    {
+        uInt n = sp->stream.avail_out;
+        if ((tmsize_t)n > cc)
+            n = (uInt)cc;
+        memcpy(sp->stream.next_out, bp, n);
+        sp->stream.next_out += n;
+        sp->stream.avail_out -= n;
+        bp += n;
+        cc -= n;
+        if (sp->stream.avail_out == 0)
+        {
+            tif->tif_rawcc = tif->tif_rawdatasize;
+            if (!TIFFFlushData1(tif))
+                return 0;
+            sp->stream.next_out = tif->tif_rawdata;
+            sp->stream.avail_out =
+                TIFF_CLAMP_UINT64_TO_INT32_MAX(tif->tif_rawdatasize);
+        }
+    }
+    return 1;
+}
+
+/*
+ * Write data as non-final stored deflate blocks, which only costs a copy
+ * and the update of the checksum. The zlib header was written by ZIPEncode()
+ * and the final block and checksum are added by ZIPPostEncode().
+ */
+static int ZIPEncodeStored(TIFF *tif, uint8_t *bp, tmsize_t cc)
+{
+    ZIPState *sp = ZIPEncoderState(tif);
+
+    while (cc > 0)
+    {
+        uint16_t len = cc > 0xffff ? 0xffff : (uint16_t)cc;
+        uint8_t header[5];
+        header[0] = 0; /* BFINAL = 0, BTYPE = 00, padding */
+        header[1] = (uint8_t)(len & 0xff);
+        header[2] = (uint8_t)(len >> 8);
+        header[3] = (uint8_t)(~len & 0xff);
+        header[4] = (uint8_t)((~len >> 8) & 0xff);
+        if (!ZIPPutStored(tif, header, 5) || !ZIPPutStored(tif, bp, len))
+            return 0;
+        sp->adler = adler32(sp->adler, bp, len);
+        bp += len;
+        cc -= len;
+    }
+    return 1;
+}
+
 /*
  * Encode a chunk of pixels.
  */
@@ -384,6 +445,21 @@ static int ZIPEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
 
     (void)s;
 
+    if (sp->stored < 0)
+    {
+        sp->stored = _TIFFStoredFallback(tif, bp, cc);
+        if (sp->stored)
+        {
+            /* zlib header: deflate with 32K window, fastest level */
+            static const uint8_t header[2] = {0x78, 0x01};
+            sp->adler = adler32(0L, Z_NULL, 0);
+            if (!ZIPPutStored(tif, header, 2))
+                return 0;
+        }
+    }
+    if (sp->stored)
+        return ZIPEncodeStored(tif, bp, cc);
+
 #if LIBDEFLATE_SUPPORT
     if (sp->libdeflate_state == 1)
         return 0;
@@ -516,6 +592,25 @@ static int ZIPPostEncode(TIFF *tif)
     ZIPState *sp = ZIPEncoderState(tif);
     int state;
 
+    if (sp->stored > 0)
+    {
+        /* final empty stored block, and the checksum, big-endian */
+        uint8_t trailer[9] = {1, 0, 0, 0xff, 0xff};
+        trailer[5] = (uint8_t)((sp->adler >> 24) & 0xff);
+        trailer[6] = (uint8_t)((sp->adler >> 16) & 0xff);
+        trailer[7] = (uint8_t)((sp->adler >> 8) & 0xff);
+        trailer[8] = (uint8_t)(sp->adler & 0xff);
+        if (!ZIPPutStored(tif, trailer, sizeof(trailer)))
+            return 0;
+        if ((tmsize_t)sp->stream.avail_out != tif->tif_rawdatasize)
+        {
+            tif->tif_rawcc = tif->tif_rawdatasize - sp->stream.avail_out;
+            if (!TIFFFlushData1(tif))
+                return 0;
+        }
+        return 1;
+    }
+
 #if LIBDEFLATE_SUPPORT
     if (sp->libdeflate_state == 1)
         return 1;
@@ -46,7 +46,9 @@ typedef struct
     ZSTD_CStream *cstream;
     int compression_level; /* compression level */
     ZSTD_outBuffer out_buffer;
-    int state; /* state flags */
+    int stored; /* -1 until the first ZSTDEncode() of a strip/tile, then */
+                /* whether it is written as raw blocks */
+    int state;  /* state flags */
 #define LSTATE_INIT_DECODE 0x01
 #define LSTATE_INIT_ENCODE 0x02
 
@@ -221,10 +223,62 @@ static int ZSTDPreEncode(TIFF *tif, uint16_t s)
     sp->out_buffer.dst = tif->tif_rawdata;
     sp->out_buffer.size = (size_t)tif->tif_rawdatasize;
     sp->out_buffer.pos = 0;
+    sp->stored = -1;
 
     return 1;
 }
 
+/*
+ * Append data to the output buffer, flushing it when full.
+ */
+static int ZSTDPutStored(TIFF *tif, const uint8_t *bp, size_t cc)
+{
+    ZSTDState *sp = ZSTDEncoderState(tif);
+
+    while (cc > 0)
+    {
+        size_t n = sp->out_buffer.size - sp->out_buffer.pos;
+        if (n > cc)
+            n = cc;
+        memcpy((uint8_t *)sp->out_buffer.dst + sp->out_buffer.pos, bp, n);
+        sp->out_buffer.pos += n;
+        bp += n;
+        cc -= n;
+        if (sp->out_buffer.pos == sp->out_buffer.size)
+        {
+            tif->tif_rawcc = tif->tif_rawdatasize;
+            if (!TIFFFlushData1(tif))
+                return 0;
+            sp->out_buffer.dst = tif->tif_rawcp;
+            sp->out_buffer.pos = 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Write data as non-last raw blocks, of at most 128 KiB, the window size
+ * declared in the frame header written by ZSTDEncode(). ZSTDPostEncode()
+ * ends the frame with an empty last block.
+ */
+static int ZSTDEncodeStored(TIFF *tif, uint8_t *bp, tmsize_t cc)
+{
+    while (cc > 0)
+    {
+        uint32_t len = cc > 0x20000 ? 0x20000 : (uint32_t)cc;
+        uint8_t header[3];
+        /* Last_Block = 0, Block_Type = 0 (Raw_Block), Block_Size */
+        header[0] = (uint8_t)((len << 3) & 0xff);
+        header[1] = (uint8_t)((len >> 5) & 0xff);
+        header[2] = (uint8_t)((len >> 13) & 0xff);
+        if (!ZSTDPutStored(tif, header, 3) || !ZSTDPutStored(tif, bp, len))
+            return 0;
+        bp += len;
+        cc -= len;
+    }
+    return 1;
+}
+
 /*
  * Encode a chunk of pixels.
  */
@@ -240,6 +294,21 @@ static int ZSTDEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
 
     (void)s;
 
+    if (sp->stored < 0)
+    {
+        sp->stored = _TIFFStoredFallback(tif, bp, cc);
+        if (sp->stored)
+        {
+            /* magic number, no checksum nor content size, 128 KiB window */
+            static const uint8_t header[6] = {0x28, 0xB5, 0x2F,
+                                              0xFD, 0x00, 0x38};
+            if (!ZSTDPutStored(tif, header, 6))
+                return 0;
+        }
+    }
+    if (sp->stored)
+        return ZSTDEncodeStored(tif, bp, cc);
+
     in_buffer.src = bp;
     in_buffer.size = (size_t)cc;
     in_buffer.pos = 0;
@@ -276,6 +345,23 @@ static int ZSTDPostEncode(TIFF *tif)
     ZSTDState *sp = ZSTDEncoderState(tif);
     size_t zstd_ret;
 
+    if (sp->stored > 0)
+    {
+        /* Last_Block = 1, Raw_Block, Block_Size = 0 */
+        static const uint8_t last[3] = {0x01, 0x00, 0x00};
+        if (!ZSTDPutStored(tif, last, 3))
+            return 0;
+        if (sp->out_buffer.pos > 0)
+        {
+            tif->tif_rawcc = sp->out_buffer.pos;
+            if (!TIFFFlushData1(tif))
+                return 0;
+            sp->out_buffer.dst = tif->tif_rawcp;
+            sp->out_buffer.pos = 0;
+        }
+        return 1;
+    }
+
     do
     {
         zstd_ret = ZSTD_endStream(sp->cstream, &sp->out_buffer);
@@ -766,6 +766,10 @@ typedef enum
 #define TIFFTAG_DEFLATE_SUBCODEC 65570 /* ZIP codec: to get/set the sub-codec to use. Will default to libdeflate when available */
 #define DEFLATE_SUBCODEC_ZLIB 0
 #define DEFLATE_SUBCODEC_LIBDEFLATE 1
+#define TIFFTAG_STOREDFALLBACK 65572 /* Deflate/ZSTD/LZW: store data that */
+                                     /* would not compress */
+#define STOREDFALLBACK_NONE 0        /* always compress (default) */
+#define STOREDFALLBACK_AUTO 1        /* store incompressible strips/tiles */
 
 /*
  * EXIF tags
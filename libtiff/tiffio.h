@@ -192,6 +192,8 @@ typedef struct
  * RGBA-style image support.
  */
 typedef struct _TIFFRGBAImage TIFFRGBAImage;
+/* conversion tables kept across images, see TIFFRGBAImageBeginContext */
+typedef struct _TIFFRGBAContext TIFFRGBAContext;
 /*
  * The image reading and conversion routines invoke
  * ``put routines'' to copy/image/whatever tiles of
@@ -248,8 +250,59 @@ struct _TIFFRGBAImage
 
     int row_offset;
     int col_offset;
+
+    int format; /* output pixel format (TIFFRGBA_FORMAT_*) */
+    /* put routine converted to the output format by the default one */
+    union
+    {
+        void (*any)(TIFFRGBAImage *);
+        tileContigRoutine contig;
+        tileSeparateRoutine separate;
+    } formatput;
+    uint32_t *formatbuf;    /* ABGR pixels for formatput */
+    tmsize_t formatbufsize; /* size of formatbuf in pixels */
+    /* state of the TIFFRGBA_FORMAT_TRANSPOSE conversion, if done */
+    struct _TIFFRGBATranspose *transpose;
+    /* range of the color samples mapped to [0, 1] by TIFFRGBA_FORMAT_RGBAF32 */
+    double minsamplevalue;
+    double maxsamplevalue;
+    /* context the conversion tables are borrowed from, if any */
+    TIFFRGBAContext *context;
 };
 
+/*
+ * Output pixel formats for TIFFRGBAImageBeginFormat and
+ * TIFFReadRGBAImageFormat.
+ */
+#define TIFFRGBA_FORMAT_ABGR32 0  /* packed uint32_t, as TIFFReadRGBAImage */
+#define TIFFRGBA_FORMAT_RGBA8 1   /* R, G, B, A bytes */
+#define TIFFRGBA_FORMAT_BGRA8 2   /* B, G, R, A bytes */
+#define TIFFRGBA_FORMAT_RGB8 3    /* R, G, B bytes */
+#define TIFFRGBA_FORMAT_RGBA16 4  /* R, G, B, A uint16_t in host byte order */
+#define TIFFRGBA_FORMAT_RGBAF32 5 /* R, G, B, A float, normalized to [0, 1] */
+#define TIFFRGBA_FORMAT_MASK 0xff
+/* unassociated (not premultiplied) alpha in the output */
+#define TIFFRGBA_FORMAT_UNASSOCIATED 0x100
+/* images with an Orientation of 5 to 8 read into a transposed raster */
+#define TIFFRGBA_FORMAT_TRANSPOSE 0x200
+/* CIE L*a*b* images converted through an interpolated table */
+#define TIFFRGBA_FORMAT_CIELAB_LUT 0x400
+/* with it, a grid of 2^n+1 points per axis, n from 1 to 6, 0 for the default */
+#define TIFFRGBA_FORMAT_CIELAB_LUT_BITS(n) (((n)&0x7) << 12)
+#define TIFFRGBA_FORMAT_CIELAB_LUT_BITS_MASK 0x7000
+
+/*
+ * Flags for TIFFReadRGBARegion.
+ */
+#define TIFFRGBA_REGION_NEAREST 0x0   /* center pixel of each block */
+#define TIFFRGBA_REGION_BOX 0x1       /* average of each block */
+#define TIFFRGBA_REGION_OVERVIEWS 0x2 /* use reduced-resolution images */
+
+/*
+ * Reader of an image in bands of raster rows, see TIFFRGBABandIteratorBegin.
+ */
+typedef struct _TIFFRGBABandIterator TIFFRGBABandIterator;
+
 /*
  * Macros for extracting components from the
  * packed ABGR form returned by TIFFReadRGBAImage.
@@ -310,6 +363,10 @@ extern "C"
     typedef int (*TIFFMapFileProc)(thandle_t, void **base, toff_t *size);
     typedef void (*TIFFUnmapFileProc)(thandle_t, void *base, toff_t size);
     typedef void (*TIFFExtendProc)(TIFF *);
+    typedef void *(*TIFFMallocProc)(void *user_data, tmsize_t size);
+    typedef void *(*TIFFReallocProc)(void *user_data, void *ptr,
+                                     tmsize_t size);
+    typedef void (*TIFFFreeProc)(void *user_data, void *ptr);
 
     extern const char *TIFFGetVersion(void);
 
@@ -318,6 +375,8 @@ extern "C"
     extern void TIFFUnRegisterCODEC(TIFFCodec *);
     extern int TIFFIsCODECConfigured(uint16_t);
     extern TIFFCodec *TIFFGetConfiguredCODECs(void);
+    extern void TIFFGetStoredFallbackCounts(TIFF *tif, uint32_t *striles,
+                                            uint32_t *stored);
 
     /*
      * Auxiliary functions.
@@ -453,6 +512,20 @@ extern "C"
     extern int TIFFSetField(TIFF *, uint32_t, ...);
     extern int TIFFVSetField(TIFF *, uint32_t, va_list);
     extern int TIFFUnsetField(TIFF *, uint32_t);
+
+    /*
+     * Value of a field set by TIFFSetFields(): count values of the C type
+     * corresponding to type (e.g. uint16_t for TIFF_SHORT, char for
+     * TIFF_ASCII), in native byte order.
+     */
+    typedef struct
+    {
+        uint32_t tag;
+        TIFFDataType type;
+        uint32_t count;
+        const void *value;
+    } TIFFFieldValue;
+    extern int TIFFSetFields(TIFF *, const TIFFFieldValue *, uint32_t);
     extern int TIFFWriteDirectory(TIFF *);
     extern int TIFFWriteCustomDirectory(TIFF *, uint64_t *);
     extern int TIFFCheckpointDirectory(TIFF *);
@@ -489,9 +562,34 @@ extern int TIFFReadRGBAImageOriented(TIFF *, uint32_t, uint32_t, uint32_t *,
                                    int stop_on_error);
     extern int TIFFRGBAImageOK(TIFF *, char[1024]);
     extern int TIFFRGBAImageBegin(TIFFRGBAImage *, TIFF *, int, char[1024]);
+    extern int TIFFRGBAImageBeginFormat(TIFFRGBAImage *, TIFF *, int stop,
+                                        int format, char[1024]);
+    extern int TIFFRGBAImageBeginContext(TIFFRGBAImage *, TIFF *, int stop,
+                                         int format, TIFFRGBAContext *,
+                                         char[1024]);
+    extern TIFFRGBAContext *TIFFRGBAContextAlloc(void);
+    extern void TIFFRGBAContextFree(TIFFRGBAContext *);
     extern int TIFFRGBAImageGet(TIFFRGBAImage *, uint32_t *, uint32_t,
                                 uint32_t);
+    extern int TIFFRGBAImageGetParallel(TIFFRGBAImage *, uint32_t *, uint32_t,
+                                        uint32_t, int nthreads);
+    extern int TIFFReadRGBAImageParallel(TIFF *, uint32_t, uint32_t,
+                                         uint32_t *, int orientation, int stop,
+                                         int nthreads);
+    extern int TIFFReadRGBARegion(TIFF *, uint32_t col, uint32_t row,
+                                  uint32_t width, uint32_t height,
+                                  uint32_t factor, int flags, uint32_t *raster,
+                                  int orientation, int stop_on_error);
+    extern int TIFFReadRGBAImageFormat(TIFF *, uint32_t, uint32_t,
+                                       void *raster, int orientation,
+                                       int format, int stop);
     extern void TIFFRGBAImageEnd(TIFFRGBAImage *);
+    extern TIFFRGBABandIterator *
+    TIFFRGBABandIteratorBegin(TIFF *, uint32_t bandheight, int orientation,
+                              int format, int stop, int nthreads);
+    extern int TIFFRGBABandIteratorNext(TIFFRGBABandIterator *, void *raster,
+                                        uint32_t *nrows);
+    extern void TIFFRGBABandIteratorEnd(TIFFRGBABandIterator *);
 
     extern const char *TIFFFileName(TIFF *);
     extern const char *TIFFSetFileName(TIFF *, const char *);
@@ -525,6 +623,21 @@ extern int TIFFReadRGBAImageOriented(TIFF *, uint32_t, uint32_t, uint32_t *,
     extern void
     TIFFOpenOptionsSetWarnAboutUnknownTags(TIFFOpenOptions *opts,
                                            int warn_about_unknown_tags);
+    extern void TIFFOpenOptionsSetAppendTrailer(TIFFOpenOptions *opts,
+                                                int append_trailer);
+    extern void TIFFOpenOptionsSetWriteBufferSize(TIFFOpenOptions *opts,
+                                                  tmsize_t write_buffer_size);
+    extern void TIFFOpenOptionsSetAllocator(TIFFOpenOptions *opts,
+                                            TIFFMallocProc mallocproc,
+                                            TIFFReallocProc reallocproc,
+                                            TIFFFreeProc freeproc,
+                                            void *alloc_user_data);
+    extern void TIFFOpenOptionsSetDirectoryArena(TIFFOpenOptions *opts,
+                                                 tmsize_t chunk_size);
+    extern void TIFFOpenOptionsSetDirectIO(TIFFOpenOptions *opts,
+                                           int direct_io);
+    extern void TIFFOpenOptionsSetStreamingWrite(TIFFOpenOptions *opts,
+                                                 tmsize_t buffer_size);
     extern void
     TIFFOpenOptionsSetErrorHandlerExtR(TIFFOpenOptions *opts,
                                        TIFFErrorHandlerExtR handler,
@@ -584,6 +697,41 @@ extern int TIFFReadRGBAImageOriented(TIFF *, uint32_t, uint32_t, uint32_t *,
                                          tmsize_t cc);
     extern tmsize_t TIFFWriteRawTile(TIFF *tif, uint32_t tile, void *data,
                                      tmsize_t cc);
+    extern uint64_t TIFFReserveStrile(TIFF *tif, uint32_t strile,
+                                      uint64_t size);
+    extern tmsize_t TIFFWriteReservedStrile(TIFF *tif, uint32_t strile,
+                                            const void *data, tmsize_t cc);
+
+    /*
+     * Asynchronous compression of strips/tiles on worker threads,
+     * written to the file in submission order.
+     */
+    typedef struct _TIFFAsyncWriter TIFFAsyncWriter;
+    extern TIFFAsyncWriter *TIFFAsyncWriterOpen(TIFF *tif, int nthreads);
+    extern int64_t TIFFAsyncWriteEncodedStrip(TIFFAsyncWriter *w,
+                                              uint32_t strip, const void *data,
+                                              tmsize_t cc);
+    extern int64_t TIFFAsyncWriteEncodedTile(TIFFAsyncWriter *w, uint32_t tile,
+                                             const void *data, tmsize_t cc);
+    extern int64_t TIFFAsyncWriterCompleted(TIFFAsyncWriter *w);
+    extern int TIFFAsyncWriterWait(TIFFAsyncWriter *w, int64_t seq);
+    extern int TIFFAsyncWriterClose(TIFFAsyncWriter *w);
+
+    /*
+     * Single-pass writing of a pyramid with all the directories and
+     * strip/tile arrays ahead of the image data (cloud optimized layout).
+     */
+    typedef struct _TIFFCOGWriter TIFFCOGWriter;
+    extern TIFFCOGWriter *TIFFCOGWriterOpen(TIFF *tif);
+    extern int TIFFCOGWriterAddLevel(TIFFCOGWriter *w);
+    extern int TIFFCOGWriterSetLevel(TIFFCOGWriter *w, int level);
+    extern int TIFFCOGWriterClose(TIFFCOGWriter *w);
+
+    /*
+     * Copy of all the directories and image data of a file to a new file,
+     * without the space left unused by rewrites.
+     */
+    extern int TIFFCompact(TIFF *in, TIFF *out, uint64_t *reclaimed);
     extern int TIFFDataWidth(
         TIFFDataType); /* table of tag datatype widths within TIFF file. */
     extern void TIFFSetWriteOffset(TIFF *tif, toff_t off);
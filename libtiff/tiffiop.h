@@ -63,6 +63,9 @@
 
 #define TIFF_NON_EXISTENT_DIR_NUMBER UINT_MAX
 
+/* Max. number of field arrays merged by a codec init that are recorded */
+#define TIFF_MAX_CODEC_FIELDS 4
+
 #define streq(a, b) (strcmp(a, b) == 0)
 #define strneq(a, b, n) (strncmp(a, b, n) == 0)
 
@@ -94,6 +97,11 @@ typedef int (*TIFFSeekMethod)(TIFF *, uint32_t);
 typedef void (*TIFFPostMethod)(TIFF *tif, uint8_t *buf, tmsize_t size);
 typedef uint32_t (*TIFFStripMethod)(TIFF *, uint32_t);
 typedef void (*TIFFTileMethod)(TIFF *, uint32_t *, uint32_t *);
+typedef tmsize_t (*TIFFPWriteProc)(thandle_t, void *, tmsize_t, uint64_t);
+typedef int (*TIFFDirectCloseProc)(thandle_t, uint64_t);
+
+typedef struct _TIFFThreadPool TIFFThreadPool;
+typedef void (*TIFFThreadTask)(void *arg, int worker);
 
 struct TIFFOffsetAndDirNumber
 {
@@ -102,6 +110,14 @@ struct TIFFOffsetAndDirNumber
 };
 typedef struct TIFFOffsetAndDirNumber TIFFOffsetAndDirNumber;
 
+/* Chunk of the directory arena: the allocations follow the header. */
+typedef struct TIFFArenaChunk
+{
+    struct TIFFArenaChunk *next;
+    tmsize_t size; /* # of bytes available after the header */
+    tmsize_t used; /* # of bytes allocated */
+} TIFFArenaChunk;
+
 typedef union
 {
     TIFFHeaderCommon common;
@@ -154,10 +170,15 @@ struct tiff
     0x8000000U /* set when lazy/ondemand loading of strip/tile                 \
                   offset/bytecount values has been requested on opening ('O'   \
                   flag) */
+#define TIFF_STOREDFALLBACK                                                    \
+    0x10000000U /* store incompressible strips/tiles (TIFFTAG_STOREDFALLBACK) \
+                 */
 
     uint64_t tif_diroff;     /* file offset of current directory */
     uint64_t tif_nextdiroff; /* file offset of following directory */
     uint64_t tif_lastdiroff; /* file offset of last directory written so far */
+    int tif_append_trailer;  /* maintain a trailer locating the last IFD */
+    uint64_t tif_append_trailer_off; /* offset of the trailer read, or 0 */
     TIFFHashSet *tif_map_dir_offset_to_number;
     TIFFHashSet *tif_map_dir_number_to_offset;
     int tif_setdirectory_force_absolute; /* switch between relative and absolute
@@ -194,6 +215,10 @@ struct tiff
     uint64_t tif_lastvalidoff; /* last valid offset allowed for rewrite in
                                   place. Used only by TIFFAppendToStrip() */
     uint64_t tif_dataoff;      /* current offset for writing dir (IFD) */
+    uint8_t *tif_dirbuf;       /* IFD being serialized, then its data */
+    tmsize_t tif_dirbufsize;   /* size of tif_dirbuf available for data */
+    tmsize_t tif_dirbufcc;     /* # of bytes used in tif_dirbuf */
+    tmsize_t tif_dirbufifd;    /* # of bytes of tif_dirbuf for the IFD */
     /* SubIFD support */
     uint16_t tif_nsubifd;   /* remaining subifds to write */
     uint64_t tif_subifdoff; /* offset for patching SubIFD link */
@@ -243,6 +268,26 @@ struct tiff
     TIFFSeekProc tif_seekproc;       /* lseek method */
     TIFFCloseProc tif_closeproc;     /* close method */
     TIFFSizeProc tif_sizeproc;       /* filesize method */
+    TIFFPWriteProc tif_pwriteproc;   /* positional write method, or NULL */
+    uint64_t tif_logical_eof; /* end of allocated file space, 0 if unknown */
+    /* write-combining buffer (TIFFOpenOptionsSetWriteBufferSize) */
+    uint8_t *tif_wbuf;     /* pending output, NULL if not buffered */
+    tmsize_t tif_wbufsize; /* size of tif_wbuf */
+    tmsize_t tif_wbufcc;   /* # of bytes pending in tif_wbuf */
+    uint64_t tif_wbufoff;  /* file offset of the pending bytes */
+    uint64_t tif_wbufpos;  /* file position seen through TIFFSeekFile() */
+    /* direct I/O (TIFFOpenOptionsSetDirectIO), set up by the I/O layer */
+    TIFFPWriteProc tif_directwriteproc;      /* aligned writes, or NULL */
+    TIFFDirectCloseProc tif_directcloseproc; /* close, truncating if size */
+    thandle_t tif_directhandle; /* handle opened for direct I/O */
+    tmsize_t tif_directalign;   /* alignment of offsets, sizes and buffers */
+    void *tif_directbufbase;    /* staging buffer, as allocated */
+    uint8_t *tif_directbuf;     /* staging buffer, aligned */
+    uint64_t tif_directoff;     /* file offset of tif_directbuf */
+    tmsize_t tif_directcc;      /* # of bytes of data in tif_directbuf */
+    uint64_t tif_directend;     /* end of the blocks written directly */
+    /* max. size of the TIFFWriteScanline() buffer, 0 for a whole strip */
+    tmsize_t tif_streaming_write_size;
     /* post-decoding support */
     TIFFPostMethod tif_postdecode; /* post decoding routine */
     /* tag support */
@@ -250,6 +295,12 @@ struct tiff
     size_t tif_nfields;              /* # entries in registered tag table */
     const TIFFField *tif_foundfield; /* cached pointer to already found tag */
     TIFFTagMethods tif_tagmethods;   /* tag get/set/print routines */
+    /* codec support recorded by TIFFSetCompressionScheme() */
+    TIFFFieldArray tif_codecfields[TIFF_MAX_CODEC_FIELDS]; /* merged by init */
+    int tif_ncodecfields;  /* # of arrays merged, may exceed the max. */
+    int tif_incodecinit;   /* codec init running, record merged fields */
+    TIFFVSetMethod tif_codecvsetparent; /* tag set routine before init */
+    TIFFVSetMethod tif_codecvsetfield;  /* set by a builtin codec, or NULL */
     TIFFClientInfoLink *tif_clientinfo; /* extra client information. */
     /* Backward compatibility stuff. We need these two fields for
      * setting up an old tag extension scheme. */
@@ -263,7 +314,19 @@ struct tiff
     tmsize_t tif_max_single_mem_alloc;    /* in bytes. 0 for unlimited */
     tmsize_t tif_max_cumulated_mem_alloc; /* in bytes. 0 for unlimited */
     tmsize_t tif_cur_cumulated_mem_alloc; /* in bytes */
+    /* memory allocator (TIFFOpenOptionsSetAllocator) */
+    TIFFMallocProc tif_mallocproc; /* NULL for _TIFFmalloc() and friends */
+    TIFFReallocProc tif_reallocproc;
+    TIFFFreeProc tif_freeproc;
+    void *tif_alloc_user_data;
+    /* directory arena (TIFFOpenOptionsSetDirectoryArena) */
+    TIFFArenaChunk *tif_arena;        /* chunks, the current one first */
+    tmsize_t tif_arena_chunk_size;    /* 0 if there is no arena */
+    int tif_arena_active;             /* allocations go to the arena */
     int tif_warn_about_unknown_tags;
+    /* TIFFTAG_STOREDFALLBACK statistics for the directory being written */
+    uint32_t tif_fallback_striles; /* strips/tiles checked */
+    uint32_t tif_fallback_stored;  /* strips/tiles stored */
 };
 
 struct TIFFOpenOptions
@@ -275,6 +338,15 @@ struct TIFFOpenOptions
     tmsize_t max_single_mem_alloc;     /* in bytes. 0 for unlimited */
     tmsize_t max_cumulated_mem_alloc;  /* in bytes. 0 for unlimited */
     int warn_about_unknown_tags;
+    tmsize_t write_buffer_size; /* in bytes. 0 for unbuffered writes */
+    int append_trailer;
+    TIFFMallocProc mallocproc;   /* NULL for _TIFFmalloc() and friends */
+    TIFFReallocProc reallocproc; /* NULL for _TIFFrealloc() */
+    TIFFFreeProc freeproc;       /* NULL for _TIFFfree() */
+    void *alloc_user_data;       /* may be NULL */
+    tmsize_t arena_chunk_size;   /* in bytes. 0 for no directory arena */
+    int direct_io;
+    tmsize_t streaming_write_size; /* in bytes. 0 for whole strip buffers */
 };
 
 #define isPseudoTag(t) (t > 0xffff) /* is tag value normal or pseudo */
@@ -284,13 +356,21 @@ struct TIFFOpenOptions
 #define isFillOrder(tif, o) (((tif)->tif_flags & (o)) != 0)
 #define isUpSampled(tif) (((tif)->tif_flags & TIFF_UPSAMPLED) != 0)
 #define TIFFReadFile(tif, buf, size)                                           \
-    ((*(tif)->tif_readproc)((tif)->tif_clientdata, (buf), (size)))
+    ((tif)->tif_wbuf                                                           \
+         ? _TIFFBufferedRead((tif), (buf), (size))                             \
+         : (*(tif)->tif_readproc)((tif)->tif_clientdata, (buf), (size)))
 #define TIFFWriteFile(tif, buf, size)                                          \
-    ((*(tif)->tif_writeproc)((tif)->tif_clientdata, (buf), (size)))
+    ((tif)->tif_wbuf                                                           \
+         ? _TIFFBufferedWrite((tif), (buf), (size))                            \
+         : (*(tif)->tif_writeproc)((tif)->tif_clientdata, (buf), (size)))
 #define TIFFSeekFile(tif, off, whence)                                         \
-    ((*(tif)->tif_seekproc)((tif)->tif_clientdata, (off), (whence)))
+    ((tif)->tif_wbuf                                                           \
+         ? _TIFFBufferedSeek((tif), (off), (whence))                           \
+         : (*(tif)->tif_seekproc)((tif)->tif_clientdata, (off), (whence)))
 #define TIFFCloseFile(tif) ((*(tif)->tif_closeproc)((tif)->tif_clientdata))
-#define TIFFGetFileSize(tif) ((*(tif)->tif_sizeproc)((tif)->tif_clientdata))
+#define TIFFGetFileSize(tif)                                                   \
+    ((tif)->tif_wbuf ? _TIFFBufferedSize(tif)                                  \
+                     : (*(tif)->tif_sizeproc)((tif)->tif_clientdata))
 #define TIFFMapFileContents(tif, paddr, psize)                                 \
     ((*(tif)->tif_mapproc)((tif)->tif_clientdata, (paddr), (psize)))
 #define TIFFUnmapFileContents(tif, addr, size)                                 \
@@ -422,6 +502,21 @@ extern "C"
     extern void _TIFFNoPostDecode(TIFF *tif, uint8_t *buf, tmsize_t cc);
     extern int _TIFFNoPreCode(TIFF *tif, uint16_t s);
     extern int _TIFFNoSeek(TIFF *tif, uint32_t off);
+    extern int _TIFFStoredFallback(TIFF *tif, const uint8_t *bp, tmsize_t cc);
+    extern int _TIFFWriteEncodedStrile(TIFF *tif, uint32_t strile,
+                                       uint8_t *data, tmsize_t cc);
+    extern int _TIFFFlushWriteBuffer(TIFF *tif);
+    extern uint64_t _TIFFGetDataEnd(TIFF *tif);
+    extern int _TIFFReadAppendTrailer(TIFF *tif);
+    extern int _TIFFWriteAppendTrailer(TIFF *tif);
+    extern tmsize_t _TIFFBufferedRead(TIFF *tif, void *buf, tmsize_t size);
+    extern tmsize_t _TIFFBufferedWrite(TIFF *tif, void *buf, tmsize_t size);
+    extern uint64_t _TIFFBufferedSeek(TIFF *tif, uint64_t off, int whence);
+    extern uint64_t _TIFFBufferedSize(TIFF *tif);
+    extern uint64_t _TIFFGetLogicalEOF(TIFF *tif);
+    extern void _TIFFExtendLogicalEOF(TIFF *tif, uint64_t end);
+    extern int _TIFFWriteAt(TIFF *tif, uint64_t off, const void *buf,
+                            tmsize_t size);
     extern void _TIFFSwab16BitData(TIFF *tif, uint8_t *buf, tmsize_t cc);
     extern void _TIFFSwab24BitData(TIFF *tif, uint8_t *buf, tmsize_t cc);
     extern void _TIFFSwab32BitData(TIFF *tif, uint8_t *buf, tmsize_t cc);
@@ -475,6 +570,9 @@ extern "C"
     extern uint32_t _TIFFClampDoubleToUInt32(double);
 
     extern void _TIFFCleanupIFDOffsetAndNumberMaps(TIFF *tif);
+    extern void _TIFFArenaReset(TIFF *tif);
+    extern void _TIFFArenaDestroy(TIFF *tif);
+    extern void _TIFFFreeHandle(TIFF *tif);
 
     extern tmsize_t _TIFFReadEncodedStripAndAllocBuffer(TIFF *tif,
                                                         uint32_t strip,
@@ -490,6 +588,20 @@ extern "C"
                                                 uint32_t x, uint32_t y,
                                                 uint32_t z, uint16_t s);
     extern int _TIFFSeekOK(TIFF *tif, toff_t off);
+    extern tmsize_t _TIFFReadEncodedStripGetStripSize(TIFF *tif,
+                                                      uint32_t strip,
+                                                      uint16_t *pplane);
+    extern void _TIFFCopyCodecFields(TIFF *enc, TIFF *tif);
+
+    extern int _TIFFGetCPUCount(void);
+    extern TIFFThreadPool *_TIFFThreadPoolCreate(TIFF *tif, int nthreads);
+    extern int _TIFFThreadPoolSize(TIFFThreadPool *pool);
+    extern int _TIFFThreadPoolSubmit(TIFFThreadPool *pool, TIFFThreadTask func,
+                                     void *arg);
+    extern void _TIFFThreadPoolDone(TIFFThreadPool *pool, int *flag,
+                                    int value);
+    extern int _TIFFThreadPoolWait(TIFFThreadPool *pool, int *flag, int block);
+    extern void _TIFFThreadPoolDestroy(TIFFThreadPool *pool);
 
     extern int TIFFInitDumpMode(TIFF *, int);
 #ifdef PACKBITS_SUPPORT
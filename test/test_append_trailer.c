@@ -0,0 +1,352 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFOpenOptionsSetAppendTrailer(): appending a page to a file that
+ * ends with a trailer does not read the directory chain, and a trailer made
+ * stale by other changes to the file is not trusted.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define NPAGES 300
+#define SIZE 4
+
+/* In-memory file counting the reads */
+typedef struct
+{
+    uint8_t *data;
+    toff_t size;
+    toff_t alloc;
+    toff_t pos;
+    int nreads;
+} MemFile;
+
+static tmsize_t mem_read(thandle_t h, void *buf, tmsize_t size)
+{
+    MemFile *m = (MemFile *)h;
+    m->nreads++;
+    if (m->pos >= m->size)
+        return 0;
+    if ((toff_t)size > m->size - m->pos)
+        size = (tmsize_t)(m->size - m->pos);
+    memcpy(buf, m->data + m->pos, (size_t)size);
+    m->pos += (toff_t)size;
+    return size;
+}
+
+static tmsize_t mem_write(thandle_t h, void *buf, tmsize_t size)
+{
+    MemFile *m = (MemFile *)h;
+    toff_t end = m->pos + (toff_t)size;
+    if (end > m->alloc)
+    {
+        toff_t alloc = m->alloc ? m->alloc : 65536;
+        uint8_t *data;
+        while (alloc < end)
+            alloc *= 2;
+        data = (uint8_t *)realloc(m->data, (size_t)alloc);
+        if (!data)
+            return -1;
+        m->data = data;
+        m->alloc = alloc;
+    }
+    if (m->pos > m->size)
+        memset(m->data + m->size, 0, (size_t)(m->pos - m->size));
+    memcpy(m->data + m->pos, buf, (size_t)size);
+    m->pos = end;
+    if (end > m->size)
+        m->size = end;
+    return size;
+}
+
+static toff_t mem_seek(thandle_t h, toff_t off, int whence)
+{
+    MemFile *m = (MemFile *)h;
+    switch (whence)
+    {
+        case SEEK_SET:
+            m->pos = off;
+            break;
+        case SEEK_CUR:
+            m->pos += off;
+            break;
+        case SEEK_END:
+            m->pos = m->size + off;
+            break;
+    }
+    return m->pos;
+}
+
+static int mem_close(thandle_t h)
+{
+    (void)h;
+    return 0;
+}
+
+static toff_t mem_size(thandle_t h) { return ((MemFile *)h)->size; }
+
+static int mem_map(thandle_t h, void **base, toff_t *size)
+{
+    (void)h;
+    (void)base;
+    (void)size;
+    return 0;
+}
+
+static void mem_unmap(thandle_t h, void *base, toff_t size)
+{
+    (void)h;
+    (void)base;
+    (void)size;
+}
+
+static TIFF *mem_open(MemFile *m, const char *mode, int trailer)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    TIFF *tif;
+
+    TIFFOpenOptionsSetAppendTrailer(opts, trailer);
+    m->pos = 0;
+    m->nreads = 0;
+    if (mode[0] == 'w')
+        m->size = 0;
+    tif = TIFFClientOpenExt("test_append_trailer", mode, (thandle_t)m,
+                            mem_read, mem_write, mem_seek, mem_close, mem_size,
+                            mem_map, mem_unmap, opts);
+    TIFFOpenOptionsFree(opts);
+    return tif;
+}
+
+static int write_page(TIFF *tif, int page)
+{
+    uint8_t buf[SIZE * SIZE];
+
+    memset(buf, page & 0xff, sizeof(buf));
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, SIZE);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, SIZE);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, SIZE);
+    TIFFSetField(tif, TIFFTAG_PAGENUMBER, page, 0);
+    if (TIFFWriteEncodedStrip(tif, 0, buf, sizeof(buf)) < 0 ||
+        !TIFFWriteDirectory(tif))
+    {
+        fprintf(stderr, "Cannot write page %d\n", page);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Append a page in a new session and return the number of reads done, or
+ * -1 on error.
+ */
+static int append_page(MemFile *m, int page, int trailer)
+{
+    TIFF *tif = mem_open(m, "a", trailer);
+    int nreads;
+
+    if (!tif)
+        return -1;
+    if (write_page(tif, page))
+    {
+        TIFFClose(tif);
+        return -1;
+    }
+    TIFFClose(tif);
+    nreads = m->nreads;
+    return nreads;
+}
+
+static int has_trailer(const MemFile *m)
+{
+    return m->size >= 32 && memcmp(m->data + m->size - 32, "LTIFFEND", 8) == 0;
+}
+
+static int check_pages(MemFile *m, int npages)
+{
+    TIFF *tif = mem_open(m, "r", 0);
+    uint8_t buf[SIZE * SIZE];
+    int page;
+
+    if (!tif)
+        return 1;
+    if (TIFFNumberOfDirectories(tif) != (tdir_t)npages)
+    {
+        fprintf(stderr, "Expected %d pages, got %u\n", npages,
+                (unsigned)TIFFNumberOfDirectories(tif));
+        goto bad;
+    }
+    for (page = 0; page < npages; page++)
+    {
+        uint16_t pagenumber = 0, total = 0;
+
+        if (!TIFFSetDirectory(tif, (tdir_t)page) ||
+            !TIFFGetField(tif, TIFFTAG_PAGENUMBER, &pagenumber, &total) ||
+            pagenumber != page ||
+            TIFFReadEncodedStrip(tif, 0, buf, sizeof(buf)) != sizeof(buf) ||
+            buf[0] != (page & 0xff))
+        {
+            fprintf(stderr, "Bad page %d\n", page);
+            goto bad;
+        }
+    }
+    TIFFClose(tif);
+    return 0;
+bad:
+    TIFFClose(tif);
+    return 1;
+}
+
+static int test(const char *mode)
+{
+    MemFile m;
+    TIFF *tif;
+    int page, n, npages = NPAGES;
+
+    memset(&m, 0, sizeof(m));
+    tif = mem_open(&m, mode, 1);
+    if (!tif)
+        return 1;
+    for (page = 0; page < npages; page++)
+        if (write_page(tif, page))
+            return 1;
+    TIFFClose(tif);
+    if (!has_trailer(&m))
+    {
+        fprintf(stderr, "No trailer written (%s)\n", mode);
+        return 1;
+    }
+
+    /* the trailer avoids walking the directories */
+    n = append_page(&m, npages++, 1);
+    if (n < 0 || n > 10 || !has_trailer(&m))
+    {
+        fprintf(stderr, "Append with trailer did %d reads (%s)\n", n, mode);
+        return 1;
+    }
+    n = append_page(&m, npages++, 0);
+    if (n < NPAGES)
+    {
+        fprintf(stderr, "Append without trailer did %d reads (%s)\n", n,
+                mode);
+        return 1;
+    }
+
+    /* the trailer is stale after an append without it */
+    if (has_trailer(&m))
+    {
+        fprintf(stderr, "Trailer still ends the file (%s)\n", mode);
+        return 1;
+    }
+    n = append_page(&m, npages++, 1);
+    if (n < NPAGES || !has_trailer(&m))
+    {
+        fprintf(stderr, "Stale trailer used (%s)\n", mode);
+        return 1;
+    }
+    n = append_page(&m, npages++, 1);
+    if (n < 0 || n > 10)
+    {
+        fprintf(stderr, "Append with trailer did %d reads (%s)\n", n, mode);
+        return 1;
+    }
+    if (check_pages(&m, npages))
+        return 1;
+
+    /* a session that writes nothing keeps the trailer */
+    tif = mem_open(&m, "a", 1);
+    if (!tif)
+        return 1;
+    TIFFClose(tif);
+    if (!has_trailer(&m))
+    {
+        fprintf(stderr, "Trailer lost by an empty session (%s)\n", mode);
+        return 1;
+    }
+
+    /* so does rewriting the last directory, which moves it */
+    tif = mem_open(&m, "r+", 1);
+    if (!tif || !TIFFSetDirectory(tif, (tdir_t)(npages - 1)) ||
+        !TIFFSetField(tif, TIFFTAG_PAGENUMBER, npages - 1, npages) ||
+        !TIFFRewriteDirectory(tif))
+    {
+        fprintf(stderr, "Cannot rewrite the last page (%s)\n", mode);
+        return 1;
+    }
+    TIFFClose(tif);
+    if (!has_trailer(&m))
+    {
+        fprintf(stderr, "Trailer lost by a rewrite (%s)\n", mode);
+        return 1;
+    }
+    n = append_page(&m, npages, 1);
+    if (n < 0 || n > 10)
+    {
+        fprintf(stderr, "Append after a rewrite did %d reads (%s)\n", n,
+                mode);
+        return 1;
+    }
+    npages++;
+
+    /* removing the last page invalidates the trailer */
+    tif = mem_open(&m, "r+", 1);
+    if (!tif || !TIFFUnlinkDirectory(tif, (tdir_t)npages))
+    {
+        fprintf(stderr, "Cannot unlink last page (%s)\n", mode);
+        return 1;
+    }
+    TIFFClose(tif);
+    npages--;
+    if (has_trailer(&m))
+    {
+        fprintf(stderr, "Trailer not invalidated (%s)\n", mode);
+        return 1;
+    }
+    if (append_page(&m, npages++, 1) < 0 || check_pages(&m, npages))
+        return 1;
+
+    free(m.data);
+    return 0;
+}
+
+int main(void)
+{
+    if (test("w") || test("w8"))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,399 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFAsyncWriter: files written with strips/tiles compressed on
+ * worker threads must be identical to those written with
+ * TIFFWriteEncodedStrip()/TIFFWriteEncodedTile() in the same order,
+ * whatever the number of threads.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 600
+#define HEIGHT 400
+#define TILESIZE 128
+#define ROWSPERSTRIP 48
+
+typedef struct
+{
+    uint16_t compression;
+    uint16_t predictor;
+    uint16_t bitspersample;
+    uint16_t samplesperpixel;
+    int tiled;
+    int bigendian;
+} Config;
+
+static const char *filenames[] = {"test_async_write_0.tif",
+                                  "test_async_write_1.tif",
+                                  "test_async_write_2.tif"};
+
+static uint8_t *image;
+
+static void fill_image(tmsize_t size)
+{
+    tmsize_t i;
+    uint32_t seed = 1;
+    for (i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245U + 12345U;
+        /* smooth with some noise, so that codecs have work to do */
+        image[i] = (uint8_t)((i / 3) % 251 + ((seed >> 16) & 7));
+    }
+}
+
+/*
+ * Write the image with nthreads threads, or with the synchronous API if
+ * nthreads < 0.  Strips/tiles are submitted in reverse order if reverse.
+ */
+static int write_file(const char *filename, const Config *cfg, int nthreads,
+                      int reverse)
+{
+    TIFF *tif;
+    TIFFAsyncWriter *w = NULL;
+    tmsize_t size;
+    uint8_t *buf;
+    uint32_t n, i;
+    int ok = 0;
+
+    tif = TIFFOpen(filename, cfg->bigendian ? "wb" : "wl");
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        return 0;
+    }
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, cfg->bitspersample);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, cfg->samplesperpixel);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, cfg->samplesperpixel == 3
+                                               ? PHOTOMETRIC_RGB
+                                               : PHOTOMETRIC_MINISBLACK);
+    if (cfg->tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, cfg->compression);
+    if (cfg->predictor != PREDICTOR_NONE)
+        TIFFSetField(tif, TIFFTAG_PREDICTOR, cfg->predictor);
+    if (cfg->compression == COMPRESSION_JPEG)
+        TIFFSetField(tif, TIFFTAG_JPEGQUALITY, 90);
+    if (cfg->compression == COMPRESSION_ADOBE_DEFLATE)
+        TIFFSetField(tif, TIFFTAG_ZIPQUALITY, 9);
+
+    size = cfg->tiled ? TIFFTileSize(tif) : TIFFStripSize(tif);
+    n = cfg->tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif);
+    buf = (uint8_t *)malloc((size_t)size);
+    if (nthreads >= 0)
+    {
+        w = TIFFAsyncWriterOpen(tif, nthreads);
+        if (!w)
+        {
+            fprintf(stderr, "TIFFAsyncWriterOpen() failed\n");
+            goto end;
+        }
+    }
+    for (i = 0; i < n; i++)
+    {
+        uint32_t strile = reverse ? n - 1 - i : i;
+        /* the data of each strile is a slice of the image */
+        memcpy(buf, image + (size_t)strile * 4096, (size_t)size);
+        if (w)
+        {
+            if (cfg->tiled ? TIFFAsyncWriteEncodedTile(w, strile, buf, size) !=
+                                 (int64_t)i
+                           : TIFFAsyncWriteEncodedStrip(w, strile, buf, size) !=
+                                 (int64_t)i)
+            {
+                fprintf(stderr, "Cannot submit strile %u\n", strile);
+                goto end;
+            }
+            memset(buf, 0, (size_t)size); /* the writer has its own copy */
+        }
+        else if ((cfg->tiled ? TIFFWriteEncodedTile(tif, strile, buf, size)
+                             : TIFFWriteEncodedStrip(tif, strile, buf, size)) !=
+                 size)
+        {
+            fprintf(stderr, "Cannot write strile %u\n", strile);
+            goto end;
+        }
+    }
+    if (w)
+    {
+        if (!TIFFAsyncWriterWait(w, -1) ||
+            TIFFAsyncWriterCompleted(w) != (int64_t)n)
+        {
+            fprintf(stderr, "TIFFAsyncWriterWait() failed\n");
+            goto end;
+        }
+        ok = TIFFAsyncWriterClose(w);
+        w = NULL;
+        if (!ok)
+        {
+            fprintf(stderr, "TIFFAsyncWriterClose() failed\n");
+            goto end;
+        }
+    }
+    ok = 1;
+end:
+    if (w)
+        TIFFAsyncWriterClose(w);
+    free(buf);
+    TIFFClose(tif);
+    return ok;
+}
+
+static int same_files(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    int ca = 0, cb = 0;
+    long count = 0;
+
+    if (fa && fb)
+    {
+        do
+        {
+            ca = getc(fa);
+            cb = getc(fb);
+            count++;
+        } while (ca == cb && ca != EOF);
+    }
+    if (fa)
+        fclose(fa);
+    if (fb)
+        fclose(fb);
+    if (ca != cb || count < 1000)
+    {
+        fprintf(stderr, "%s and %s differ at byte %ld\n", a, b, count - 1);
+        return 0;
+    }
+    return 1;
+}
+
+static int check_read(const Config *cfg)
+{
+    TIFF *tif = TIFFOpen(filenames[0], "r");
+    tmsize_t size;
+    uint8_t *buf;
+    uint32_t n, i;
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    size = cfg->tiled ? TIFFTileSize(tif) : TIFFStripSize(tif);
+    n = cfg->tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif);
+    buf = (uint8_t *)malloc((size_t)size);
+    for (i = 0; i < n && ok; i++)
+    {
+        tmsize_t expected = size;
+        if (!cfg->tiled && i == n - 1)
+            expected = TIFFVStripSize(tif, HEIGHT - i * ROWSPERSTRIP);
+        if ((cfg->tiled ? TIFFReadEncodedTile(tif, i, buf, size)
+                        : TIFFReadEncodedStrip(tif, i, buf, size)) !=
+                expected ||
+            memcmp(buf, image + (size_t)i * 4096, (size_t)expected) != 0)
+        {
+            fprintf(stderr, "Strile %u does not read back\n", i);
+            ok = 0;
+        }
+    }
+    free(buf);
+    TIFFClose(tif);
+    return ok;
+}
+
+/*
+ * Peak resident memory of the process in kilobytes, or 0 if unknown.
+ */
+static long max_rss_kb(void)
+{
+#if defined(__linux__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return (long)(usage.ru_maxrss / 1024);
+#else
+    return (long)usage.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Write many uncompressed strips with one worker.  Each of them is encoded
+ * at the start of the memory file of the worker, which must not grow with
+ * the strips encoded before: it would otherwise reach the size of the
+ * whole image.
+ */
+#define MANY_STRIPS 2000
+#define MANY_STRIP_SIZE 16384
+
+static int test_many_strips(void)
+{
+    TIFF *tif = TIFFOpen(filenames[0], "w");
+    TIFFAsyncWriter *w = NULL;
+    long rss = max_rss_kb();
+    uint32_t i;
+    int ok = 0;
+
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot create %s\n", filenames[0]);
+        return 0;
+    }
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, MANY_STRIP_SIZE);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, MANY_STRIPS);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
+    w = TIFFAsyncWriterOpen(tif, 1);
+    if (!w)
+    {
+        fprintf(stderr, "TIFFAsyncWriterOpen() failed\n");
+        goto end;
+    }
+    for (i = 0; i < MANY_STRIPS; i++)
+    {
+        if (TIFFAsyncWriteEncodedStrip(w, i, image + (i % 64) * 4096,
+                                       MANY_STRIP_SIZE) != (int64_t)i)
+        {
+            fprintf(stderr, "Cannot submit strip %u\n", i);
+            goto end;
+        }
+    }
+    ok = TIFFAsyncWriterClose(w);
+    w = NULL;
+    if (!ok)
+    {
+        fprintf(stderr, "TIFFAsyncWriterClose() failed\n");
+        goto end;
+    }
+    /* the image is 32 MB, the memory file should stay at one strip */
+    if (rss > 0 && max_rss_kb() - rss > 8 * 1024)
+    {
+        fprintf(stderr, "Memory grew by %ld kB writing %u strips\n",
+                max_rss_kb() - rss, MANY_STRIPS);
+        ok = 0;
+    }
+end:
+    if (w)
+        TIFFAsyncWriterClose(w);
+    TIFFClose(tif);
+    return ok;
+}
+
+static int test(const Config *cfg)
+{
+    int reverse;
+
+    for (reverse = 0; reverse <= 1; reverse++)
+    {
+        if (!write_file(filenames[0], cfg, -1, reverse) ||
+            !write_file(filenames[1], cfg, 1, reverse) ||
+            !write_file(filenames[2], cfg, 4, reverse) ||
+            !same_files(filenames[0], filenames[1]) ||
+            !same_files(filenames[0], filenames[2]))
+        {
+            fprintf(stderr,
+                    "Failed for compression %u, predictor %u, %s, "
+                    "reverse %d\n",
+                    cfg->compression, cfg->predictor,
+                    cfg->tiled ? "tiles" : "strips", reverse);
+            return 0;
+        }
+    }
+    /* lossy codecs do not read back exactly */
+    if (cfg->compression != COMPRESSION_JPEG &&
+        cfg->compression != COMPRESSION_WEBP && !check_read(cfg))
+    {
+        fprintf(stderr, "Read back failed for compression %u\n",
+                cfg->compression);
+        return 0;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    static const Config configs[] = {
+        {COMPRESSION_NONE, PREDICTOR_NONE, 8, 3, 1, 0},
+        {COMPRESSION_NONE, PREDICTOR_NONE, 16, 1, 0, 1},
+        {COMPRESSION_LZW, PREDICTOR_HORIZONTAL, 8, 3, 1, 0},
+        {COMPRESSION_LZW, PREDICTOR_HORIZONTAL, 16, 1, 0, 1},
+        {COMPRESSION_PACKBITS, PREDICTOR_NONE, 8, 1, 0, 0},
+        {COMPRESSION_ADOBE_DEFLATE, PREDICTOR_HORIZONTAL, 16, 1, 1, 1},
+        {COMPRESSION_ADOBE_DEFLATE, PREDICTOR_NONE, 8, 3, 0, 0},
+        {COMPRESSION_JPEG, PREDICTOR_NONE, 8, 3, 1, 0},
+        {COMPRESSION_ZSTD, PREDICTOR_HORIZONTAL, 8, 3, 1, 0},
+        {COMPRESSION_LZMA, PREDICTOR_NONE, 8, 1, 0, 0},
+        {COMPRESSION_WEBP, PREDICTOR_NONE, 8, 3, 1, 0}};
+    size_t i, k;
+
+    image = (uint8_t *)malloc((size_t)WIDTH * HEIGHT * 6 + 4096 * 64);
+    if (!image)
+        return 1;
+    fill_image((tmsize_t)WIDTH * HEIGHT * 6 + 4096 * 64);
+    /* first, while the peak memory of the process is low */
+    if (!test_many_strips())
+    {
+        free(image);
+        return 1;
+    }
+    for (i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+    {
+        if (!TIFFIsCODECConfigured(configs[i].compression))
+            continue;
+        if (!test(&configs[i]))
+        {
+            free(image);
+            return 1;
+        }
+    }
+    free(image);
+    for (k = 0; k < sizeof(filenames) / sizeof(filenames[0]); k++)
+        unlink(filenames[k]);
+    return 0;
+}
@@ -0,0 +1,257 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test the table driven CIE L*a*b* to RGB conversion of TIFFRGBAImage: for
+ * 8 and 16-bit images covering the whole a*, b* plane at several L*
+ * values, the raster read through the tables of each grid size must stay
+ * close to the raster of the exact conversion, used by default, while
+ * TIFFRGBA_FORMAT_CIELAB_LUT alone selects the default grid.  Grids with
+ * more points than the image has pixels are not used, and invalid grid
+ * sizes are rejected.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 128
+/* the a*, b* plane is repeated, for more pixels than the default grid has
+ * points */
+#define PLANE_HEIGHT 128
+#define HEIGHT (3 * PLANE_HEIGHT)
+#define NLEVELS 5
+
+static const char filename[] = "test_cielab_lut.tif";
+
+static const uint8_t levels[NLEVELS] = {0, 30, 100, 180, 255};
+
+/*
+ * Write NLEVELS directories, each with a* along the columns and b* along
+ * the rows at one L* value.
+ */
+static int write_image(uint16_t bitspersample)
+{
+    TIFF *tif = TIFFOpen(filename, "w");
+    uint8_t *buf;
+    uint32_t x, y;
+    int i;
+
+    if (tif == NULL)
+        return 0;
+    buf = (uint8_t *)malloc((size_t)WIDTH * 3 * 2);
+    if (buf == NULL)
+    {
+        TIFFClose(tif);
+        return 0;
+    }
+    for (i = 0; i < NLEVELS; i++)
+    {
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bitspersample);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
+        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_CIELAB);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 16);
+        for (y = 0; y < HEIGHT; y++)
+        {
+            for (x = 0; x < WIDTH; x++)
+            {
+                int a = (int)(x * 256 / WIDTH) - 128;
+                int b = (int)(y % PLANE_HEIGHT * 256 / PLANE_HEIGHT) - 128;
+                if (bitspersample == 8)
+                {
+                    buf[3 * x] = levels[i];
+                    buf[3 * x + 1] = (uint8_t)(int8_t)a;
+                    buf[3 * x + 2] = (uint8_t)(int8_t)b;
+                }
+                else
+                {
+                    uint16_t *wp = (uint16_t *)buf + 3 * x;
+                    wp[0] = (uint16_t)(levels[i] * 257);
+                    wp[1] = (uint16_t)(int16_t)(a * 256 + (int)x % 256);
+                    wp[2] = (uint16_t)(int16_t)(b * 256 +
+                                                (int)(y % PLANE_HEIGHT));
+                }
+            }
+            if (TIFFWriteScanline(tif, buf, y, 0) < 0)
+            {
+                free(buf);
+                TIFFClose(tif);
+                return 0;
+            }
+        }
+        if (!TIFFWriteDirectory(tif))
+        {
+            free(buf);
+            TIFFClose(tif);
+            return 0;
+        }
+    }
+    free(buf);
+    TIFFClose(tif);
+    return 1;
+}
+
+static int read_image(int format, tdir_t dir, uint32_t *raster)
+{
+    TIFF *tif;
+    int ok;
+
+    tif = TIFFOpen(filename, "r");
+    if (tif == NULL)
+        return 0;
+    ok = TIFFSetDirectory(tif, dir) &&
+         TIFFReadRGBAImageFormat(tif, WIDTH, HEIGHT, raster,
+                                 ORIENTATION_TOPLEFT, format, 1);
+    TIFFClose(tif);
+    return ok;
+}
+
+/*
+ * Outside of the cells crossed by the gamut boundary, the error is at most
+ * 1; inside, it may reach a step of the gamma table near black, where the
+ * table of the exact conversion is steepest.  The bounds are those of this
+ * image, which is mostly out of gamut.
+ */
+typedef struct
+{
+    int bits;
+    unsigned maxerr;
+    unsigned over1; /* samples off by more than 1, out of 3 per pixel */
+} Grid;
+
+static const Grid grids[] = {
+    {4, 32, WIDTH * HEIGHT * 3 / 16},
+    {5, 16, WIDTH * HEIGHT * 3 / 128},
+};
+
+#define LUT_FORMAT(bits)                                                     \
+    (TIFFRGBA_FORMAT_ABGR32 | TIFFRGBA_FORMAT_CIELAB_LUT |                   \
+     TIFFRGBA_FORMAT_CIELAB_LUT_BITS(bits))
+
+static int test_image(uint16_t bitspersample)
+{
+    uint32_t *exact = (uint32_t *)malloc((size_t)WIDTH * HEIGHT * 4);
+    uint32_t *raster = (uint32_t *)malloc((size_t)WIDTH * HEIGHT * 4);
+    uint32_t *grid5 = (uint32_t *)malloc((size_t)WIDTH * HEIGHT * 4);
+    int ok = 0;
+    size_t g, i;
+    tdir_t dir;
+
+    if (exact == NULL || raster == NULL || grid5 == NULL ||
+        !write_image(bitspersample))
+        goto done;
+    for (dir = 0; dir < NLEVELS; dir++)
+    {
+        if (!read_image(TIFFRGBA_FORMAT_ABGR32, dir, exact))
+        {
+            fprintf(stderr, "Exact read of directory %u failed.\n",
+                    (unsigned)dir);
+            goto done;
+        }
+        /* the grid of 2^6+1 points per axis has more points than pixels */
+        if (!read_image(LUT_FORMAT(6), dir, raster) ||
+            memcmp(raster, exact, (size_t)WIDTH * HEIGHT * 4) != 0)
+        {
+            fprintf(stderr,
+                    "%u-bit image, L* %u: 6-bit grid used for a small "
+                    "image.\n",
+                    bitspersample, levels[dir]);
+            goto done;
+        }
+        /* the flag selects the default grid, of 2^5+1 points per axis */
+        if (!read_image(LUT_FORMAT(5), dir, grid5) ||
+            !read_image(TIFFRGBA_FORMAT_CIELAB_LUT, dir, raster) ||
+            memcmp(raster, grid5, (size_t)WIDTH * HEIGHT * 4) != 0)
+        {
+            fprintf(stderr,
+                    "%u-bit image, L* %u: TIFFRGBA_FORMAT_CIELAB_LUT does "
+                    "not use the default grid.\n",
+                    bitspersample, levels[dir]);
+            goto done;
+        }
+        for (g = 0; g < sizeof(grids) / sizeof(grids[0]); g++)
+        {
+            unsigned maxerr = 0, over1 = 0;
+
+            if (!read_image(LUT_FORMAT(grids[g].bits), dir, raster))
+            {
+                fprintf(stderr, "Read of directory %u with %d bits failed.\n",
+                        (unsigned)dir, grids[g].bits);
+                goto done;
+            }
+            for (i = 0; i < (size_t)WIDTH * HEIGHT * 4; i++)
+            {
+                int e = ((const uint8_t *)exact)[i];
+                int v = ((const uint8_t *)raster)[i];
+                unsigned err = (unsigned)abs(e - v);
+                if (err > maxerr)
+                    maxerr = err;
+                if (err > 1)
+                    over1++;
+            }
+            if (maxerr > grids[g].maxerr || over1 > grids[g].over1)
+            {
+                fprintf(stderr,
+                        "%u-bit image, L* %u, %d bits: max error %u, "
+                        "%u samples off by more than 1.\n",
+                        bitspersample, levels[dir], grids[g].bits, maxerr,
+                        over1);
+                goto done;
+            }
+        }
+    }
+    /* no 7-bit grid, and no grid size without the table conversion */
+    if (read_image(LUT_FORMAT(7), 0, raster) ||
+        read_image(TIFFRGBA_FORMAT_CIELAB_LUT_BITS(4), 0, raster))
+    {
+        fprintf(stderr, "%u-bit image: invalid grid size accepted.\n",
+                bitspersample);
+        goto done;
+    }
+    ok = 1;
+done:
+    free(exact);
+    free(raster);
+    free(grid5);
+    return ok;
+}
+
+int main(void)
+{
+    if (!test_image(8) || !test_image(16))
+        return 1;
+    unlink(filename);
+    return 0;
+}
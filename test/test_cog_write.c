@@ -0,0 +1,369 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFCOGWriter: a pyramid written in a single pass has all its
+ * directories first, then the smallest level's tiles and the full
+ * resolution tiles last, with nothing moved to the end of the file.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define NLEVELS 3
+#define WIDTH 100
+#define HEIGHT 70
+#define TILESIZE 16
+
+static const char filename[] = "test_cog_write.tif";
+
+static int nerrors;
+
+static int quiet_error_handler(TIFF *tif, void *user_data, const char *module,
+                               const char *fmt, va_list ap)
+{
+    (void)tif;
+    (void)user_data;
+    (void)module;
+    (void)fmt;
+    (void)ap;
+    nerrors++;
+    return 1;
+}
+
+static uint8_t pixel(uint32_t x, uint32_t y, int level)
+{
+    return (uint8_t)(x + y + level * 20);
+}
+
+static uint32_t level_width(int level)
+{
+    return (WIDTH + (1 << level) - 1) >> level;
+}
+
+static uint32_t level_height(int level)
+{
+    return (HEIGHT + (1 << level) - 1) >> level;
+}
+
+static int write_file(const char *mode, int subifds, uint16_t compression,
+                      tmsize_t bufsize)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    uint8_t buf[TILESIZE * TILESIZE];
+    TIFFCOGWriter *w;
+    TIFF *tif;
+    int level;
+
+    TIFFOpenOptionsSetWriteBufferSize(opts, bufsize);
+    TIFFOpenOptionsSetErrorHandlerExtR(opts, quiet_error_handler, NULL);
+    tif = TIFFOpenExt(filename, mode, opts);
+    TIFFOpenOptionsFree(opts);
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        return 1;
+    }
+    w = TIFFCOGWriterOpen(tif);
+    if (!w)
+    {
+        fprintf(stderr, "TIFFCOGWriterOpen() failed\n");
+        TIFFClose(tif);
+        return 1;
+    }
+    for (level = 0; level < NLEVELS; level++)
+    {
+        if (level > 0)
+            TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+        else if (subifds)
+        {
+            uint64_t offsets[NLEVELS - 1] = {0};
+            TIFFSetField(tif, TIFFTAG_SUBIFD, NLEVELS - 1, offsets);
+        }
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, level_width(level));
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, level_height(level));
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+        if (compression == COMPRESSION_ADOBE_DEFLATE)
+        {
+            TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+            TIFFSetField(tif, TIFFTAG_ZIPQUALITY, 9);
+        }
+        else if (compression == COMPRESSION_JPEG)
+            TIFFSetField(tif, TIFFTAG_JPEGQUALITY, 95);
+        if (TIFFCOGWriterAddLevel(w) != level)
+        {
+            fprintf(stderr, "TIFFCOGWriterAddLevel(%d) failed\n", level);
+            goto bad;
+        }
+    }
+
+    /* smallest level first */
+    for (level = NLEVELS - 1; level >= 0; level--)
+    {
+        uint32_t x, y, i, j;
+
+        if (!TIFFCOGWriterSetLevel(w, level))
+        {
+            fprintf(stderr, "TIFFCOGWriterSetLevel(%d) failed\n", level);
+            goto bad;
+        }
+        for (y = 0; y < level_height(level); y += TILESIZE)
+            for (x = 0; x < level_width(level); x += TILESIZE)
+            {
+                for (j = 0; j < TILESIZE; j++)
+                    for (i = 0; i < TILESIZE; i++)
+                        buf[j * TILESIZE + i] = pixel(x + i, y + j, level);
+                if (TIFFWriteTile(tif, buf, x, y, 0, 0) < 0)
+                {
+                    fprintf(stderr, "Cannot write tile of level %d\n",
+                            level);
+                    goto bad;
+                }
+            }
+    }
+
+    /* the levels cannot be changed any more */
+    nerrors = 0;
+    if (TIFFCOGWriterAddLevel(w) != -1 || nerrors == 0)
+    {
+        fprintf(stderr, "TIFFCOGWriterAddLevel() should have failed\n");
+        goto bad;
+    }
+    if (!TIFFCOGWriterClose(w))
+    {
+        fprintf(stderr, "TIFFCOGWriterClose() failed\n");
+        TIFFClose(tif);
+        return 1;
+    }
+    TIFFClose(tif);
+    return 0;
+bad:
+    TIFFCOGWriterClose(w);
+    TIFFClose(tif);
+    return 1;
+}
+
+static int check_file(int subifds, uint16_t compression)
+{
+    uint64_t diroff[NLEVELS];
+    uint64_t first[NLEVELS], last[NLEVELS];
+    uint64_t subifd[NLEVELS - 1];
+    uint8_t buf[TILESIZE * TILESIZE];
+    uint64_t filesize;
+    TIFF *tif;
+    FILE *f;
+    int level;
+    int maxdiff = compression == COMPRESSION_JPEG ? 8 : 0;
+
+    tif = TIFFOpen(filename, "r");
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return 1;
+    }
+    if (TIFFNumberOfDirectories(tif) != (subifds ? 1 : NLEVELS))
+    {
+        fprintf(stderr, "Unexpected number of directories\n");
+        goto bad;
+    }
+    if (subifds)
+    {
+        uint16_t n = 0;
+        uint64_t *offsets = NULL;
+        if (!TIFFGetField(tif, TIFFTAG_SUBIFD, &n, &offsets) ||
+            n != NLEVELS - 1)
+        {
+            fprintf(stderr, "Missing SubIFDs\n");
+            goto bad;
+        }
+        memcpy(subifd, offsets, sizeof(subifd));
+    }
+    for (level = 0; level < NLEVELS; level++)
+    {
+        uint32_t x, y, i, j;
+        uint32_t tile;
+        int ok = level == 0     ? TIFFSetDirectory(tif, 0)
+                 : subifds ? TIFFSetSubDirectory(tif, subifd[level - 1])
+                           : TIFFSetDirectory(tif, (tdir_t)level);
+        if (!ok || TIFFCurrentDirOffset(tif) == 0)
+        {
+            fprintf(stderr, "Cannot read level %d\n", level);
+            goto bad;
+        }
+        diroff[level] = TIFFCurrentDirOffset(tif);
+        first[level] = UINT64_MAX;
+        last[level] = 0;
+        for (tile = 0; tile < TIFFNumberOfTiles(tif); tile++)
+        {
+            const uint64_t off = TIFFGetStrileOffset(tif, tile);
+            const uint64_t end = off + TIFFGetStrileByteCount(tif, tile);
+            if (off == 0 || end == off)
+            {
+                fprintf(stderr, "Tile %u of level %d not written\n", tile,
+                        level);
+                goto bad;
+            }
+            if (off < first[level])
+                first[level] = off;
+            if (end > last[level])
+                last[level] = end;
+        }
+        for (y = 0; y < level_height(level); y += TILESIZE)
+            for (x = 0; x < level_width(level); x += TILESIZE)
+            {
+                if (TIFFReadTile(tif, buf, x, y, 0, 0) < 0)
+                {
+                    fprintf(stderr, "Cannot read tile of level %d\n", level);
+                    goto bad;
+                }
+                for (j = 0; j < TILESIZE; j++)
+                    for (i = 0; i < TILESIZE; i++)
+                    {
+                        const int diff = buf[j * TILESIZE + i] -
+                                         pixel(x + i, y + j, level);
+                        if (x + i < level_width(level) &&
+                            y + j < level_height(level) &&
+                            (diff > maxdiff || diff < -maxdiff))
+                        {
+                            fprintf(stderr,
+                                    "Wrong pixel %u,%u of level %d: %d\n",
+                                    x + i, y + j, level,
+                                    buf[j * TILESIZE + i]);
+                            goto bad;
+                        }
+                    }
+            }
+    }
+    TIFFClose(tif);
+
+    f = fopen(filename, "rb");
+    if (!f || fseek(f, 0, SEEK_END) != 0)
+    {
+        fprintf(stderr, "Cannot get size of %s\n", filename);
+        if (f)
+            fclose(f);
+        return 1;
+    }
+    filesize = (uint64_t)ftell(f);
+    fclose(f);
+
+    for (level = 0; level < NLEVELS; level++)
+    {
+        if (diroff[level] >= first[NLEVELS - 1])
+        {
+            fprintf(stderr, "Directory of level %d after the tile data\n",
+                    level);
+            return 1;
+        }
+        if (level > 0 && first[level - 1] < last[level])
+        {
+            fprintf(stderr, "Level %d not written before level %d\n", level,
+                    level - 1);
+            return 1;
+        }
+    }
+    if (filesize != last[0])
+    {
+        fprintf(stderr,
+                "File does not end with the full resolution tiles "
+                "(%" PRIu64 " != %" PRIu64 ")\n",
+                filesize, last[0]);
+        return 1;
+    }
+    return 0;
+bad:
+    TIFFClose(tif);
+    return 1;
+}
+
+static int test(const char *mode, int subifds, uint16_t compression,
+                tmsize_t bufsize)
+{
+    if (write_file(mode, subifds, compression, bufsize) ||
+        check_file(subifds, compression))
+    {
+        fprintf(stderr,
+                "Failed with mode=%s subifds=%d compression=%u "
+                "bufsize=%d\n",
+                mode, subifds, compression, (int)bufsize);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    TIFF *tif;
+    TIFFCOGWriter *w;
+
+    if (test("w", 0, COMPRESSION_ADOBE_DEFLATE, 0) ||
+        test("w8", 0, COMPRESSION_ADOBE_DEFLATE, 0) ||
+        test("w", 1, COMPRESSION_ADOBE_DEFLATE, 0) ||
+        test("w8", 1, COMPRESSION_NONE, 0) ||
+        test("w", 0, COMPRESSION_ADOBE_DEFLATE, 4096)
+#ifdef JPEG_SUPPORT
+        || test("w", 0, COMPRESSION_JPEG, 0)
+#endif
+    )
+        return 1;
+
+    /* a writer cannot be started once a directory has been written */
+    tif = TIFFOpen(filename, "w");
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        return 1;
+    }
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, 1);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, 1);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFWriteDirectory(tif);
+    TIFFSetErrorHandler(NULL);
+    w = TIFFCOGWriterOpen(tif);
+    TIFFClose(tif);
+    if (w != NULL)
+    {
+        fprintf(stderr, "TIFFCOGWriterOpen() should have failed\n");
+        return 1;
+    }
+
+    unlink(filename);
+    return 0;
+}
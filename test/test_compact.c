@@ -0,0 +1,347 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFCompact(): a file whose directory and strips were rewritten is
+ * copied without the space they left unused, with the same pixels and
+ * fields, its SubIFD and each directory followed by its strips.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 64
+#define HEIGHT 40
+#define ROWSPERSTRIP 8
+#define SUBWIDTH 32
+#define SUBHEIGHT 20
+
+static const char srcname[] = "test_compact_src.tif";
+static const char dstname[] = "test_compact_dst.tif";
+static const char description[] = "rewritten with a longer description";
+
+#ifdef ZIP_SUPPORT
+#define COMPRESSION COMPRESSION_ADOBE_DEFLATE
+#else
+#define COMPRESSION COMPRESSION_LZW
+#endif
+
+static uint8_t pixel(uint32_t x, uint32_t y)
+{
+    return (uint8_t)((x * 7 + y * 13) ^ (x * y));
+}
+
+static void set_fields(TIFF *tif, uint32_t width, uint32_t height,
+                       uint16_t compression)
+{
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+}
+
+static int write_image(TIFF *tif, uint32_t width, uint32_t height, int zero)
+{
+    uint8_t buf[WIDTH * ROWSPERSTRIP];
+    uint32_t strip, x, y;
+
+    for (strip = 0; strip * ROWSPERSTRIP < height; strip++)
+    {
+        for (y = 0; y < ROWSPERSTRIP; y++)
+            for (x = 0; x < width; x++)
+                buf[y * width + x] =
+                    zero ? 0 : pixel(x, strip * ROWSPERSTRIP + y);
+        if (TIFFWriteEncodedStrip(tif, strip, buf,
+                                  (tmsize_t)width * ROWSPERSTRIP) < 0)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Write a first image with a SubIFD and a second image, then rewrite the
+ * strips of the first image and its directory, which both move to the end
+ * of the file.
+ */
+static int make_source(const char *mode)
+{
+    TIFF *tif;
+    uint64_t subifd = 0;
+
+    tif = TIFFOpen(srcname, mode);
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot create %s\n", srcname);
+        return 1;
+    }
+    set_fields(tif, WIDTH, HEIGHT, COMPRESSION);
+    TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, "first");
+    TIFFSetField(tif, TIFFTAG_SUBIFD, 1, &subifd);
+    if (write_image(tif, WIDTH, HEIGHT, 1) || !TIFFWriteDirectory(tif))
+        goto bad;
+    set_fields(tif, SUBWIDTH, SUBHEIGHT, COMPRESSION_NONE);
+    TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+    if (write_image(tif, SUBWIDTH, SUBHEIGHT, 0) || !TIFFWriteDirectory(tif))
+        goto bad;
+    set_fields(tif, WIDTH, HEIGHT, COMPRESSION_NONE);
+    if (write_image(tif, WIDTH, HEIGHT, 0) || !TIFFWriteDirectory(tif))
+        goto bad;
+    TIFFClose(tif);
+
+    tif = TIFFOpen(srcname, "r+");
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s for update\n", srcname);
+        return 1;
+    }
+    if (write_image(tif, WIDTH, HEIGHT, 0))
+        goto bad;
+    TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, description);
+    if (!TIFFRewriteDirectory(tif))
+        goto bad;
+    TIFFClose(tif);
+    return 0;
+bad:
+    fprintf(stderr, "Cannot write %s\n", srcname);
+    TIFFClose(tif);
+    return 1;
+}
+
+static int check_image(TIFF *tif, uint32_t width, uint32_t height)
+{
+    uint8_t buf[WIDTH];
+    uint32_t w = 0, h = 0, x, y;
+    uint64_t diroff = TIFFCurrentDirOffset(tif);
+    uint64_t *offsets = NULL, *bytecounts = NULL;
+    uint32_t strip, nstrips = TIFFNumberOfStrips(tif);
+
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h);
+    if (w != width || h != height)
+    {
+        fprintf(stderr, "Bad size %ux%u\n", w, h);
+        return 1;
+    }
+    for (y = 0; y < height; y++)
+    {
+        if (TIFFReadScanline(tif, buf, y, 0) < 0)
+        {
+            fprintf(stderr, "Cannot read line %u\n", y);
+            return 1;
+        }
+        for (x = 0; x < width; x++)
+        {
+            if (buf[x] != pixel(x, y))
+            {
+                fprintf(stderr, "Bad pixel at %u,%u\n", x, y);
+                return 1;
+            }
+        }
+    }
+
+    /* the strips follow the directory, in order and without gaps */
+    TIFFGetField(tif, TIFFTAG_STRIPOFFSETS, &offsets);
+    TIFFGetField(tif, TIFFTAG_STRIPBYTECOUNTS, &bytecounts);
+    for (strip = 0; strip < nstrips; strip++)
+    {
+        if (offsets[strip] <= diroff ||
+            (strip > 0 &&
+             offsets[strip] != offsets[strip - 1] + bytecounts[strip - 1]))
+        {
+            fprintf(stderr, "Strip %u not contiguous\n", strip);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int check_copy(void)
+{
+    TIFF *tif;
+    char *desc = NULL;
+    uint16_t nsubifd = 0;
+    uint64_t *subifds = NULL;
+    uint32_t subfiletype = 0;
+
+    tif = TIFFOpen(dstname, "r");
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s\n", dstname);
+        return 1;
+    }
+    if (TIFFNumberOfDirectories(tif) != 2)
+    {
+        fprintf(stderr, "Bad number of directories\n");
+        goto bad;
+    }
+    if (!TIFFGetField(tif, TIFFTAG_IMAGEDESCRIPTION, &desc) ||
+        strcmp(desc, description) != 0)
+    {
+        fprintf(stderr, "Bad ImageDescription\n");
+        goto bad;
+    }
+    if (check_image(tif, WIDTH, HEIGHT))
+        goto bad;
+    if (!TIFFGetField(tif, TIFFTAG_SUBIFD, &nsubifd, &subifds) ||
+        nsubifd != 1)
+    {
+        fprintf(stderr, "SubIFD missing\n");
+        goto bad;
+    }
+    if (!TIFFSetSubDirectory(tif, subifds[0]) ||
+        !TIFFGetField(tif, TIFFTAG_SUBFILETYPE, &subfiletype) ||
+        subfiletype != FILETYPE_REDUCEDIMAGE ||
+        check_image(tif, SUBWIDTH, SUBHEIGHT))
+    {
+        fprintf(stderr, "Bad SubIFD\n");
+        goto bad;
+    }
+    if (!TIFFSetDirectory(tif, 1) || check_image(tif, WIDTH, HEIGHT))
+    {
+        fprintf(stderr, "Bad second directory\n");
+        goto bad;
+    }
+    TIFFClose(tif);
+    return 0;
+bad:
+    TIFFClose(tif);
+    return 1;
+}
+
+static uint64_t file_size(const char *name)
+{
+    long size;
+    FILE *f = fopen(name, "rb");
+
+    if (!f)
+        return 0;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fclose(f);
+    return size > 0 ? (uint64_t)size : 0;
+}
+
+static int test(const char *srcmode, const char *dstmode)
+{
+    TIFF *in, *out;
+    uint64_t reclaimed = 0, srcsize, dstsize;
+    int ok;
+
+    if (make_source(srcmode))
+        return 1;
+    in = TIFFOpen(srcname, "r");
+    out = TIFFOpen(dstname, dstmode);
+    if (!in || !out)
+    {
+        fprintf(stderr, "Cannot open files\n");
+        return 1;
+    }
+    ok = TIFFCompact(in, out, &reclaimed);
+    TIFFClose(in);
+    TIFFClose(out);
+    if (!ok)
+    {
+        fprintf(stderr, "TIFFCompact() failed with mode %s\n", srcmode);
+        return 1;
+    }
+    srcsize = file_size(srcname);
+    dstsize = file_size(dstname);
+    if (reclaimed == 0 || dstsize + reclaimed != srcsize)
+    {
+        fprintf(stderr,
+                "Bad reclaimed size %" PRIu64 " (%" PRIu64 " -> %" PRIu64
+                ") with mode %s\n",
+                reclaimed, srcsize, dstsize, srcmode);
+        return 1;
+    }
+    if (check_copy())
+    {
+        fprintf(stderr, "Failed with mode %s\n", srcmode);
+        return 1;
+    }
+    return 0;
+}
+
+/* TIFFCompact() is expected to fail */
+static int test_error(const char *dstmode, int nonempty)
+{
+    TIFF *in, *out;
+    int ok;
+
+    in = TIFFOpen(srcname, "r");
+    out = TIFFOpen(dstname, dstmode);
+    if (!in || !out)
+    {
+        fprintf(stderr, "Cannot open files\n");
+        return 1;
+    }
+    if (nonempty)
+    {
+        set_fields(out, 1, 1, COMPRESSION_NONE);
+        TIFFWriteDirectory(out);
+    }
+    ok = TIFFCompact(in, out, NULL);
+    TIFFClose(in);
+    TIFFClose(out);
+    if (ok)
+    {
+        fprintf(stderr, "TIFFCompact() should have failed with mode %s\n",
+                dstmode);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    if (test("wl", "wl") || test("wb", "wb") || test("wl8", "wl8") ||
+        test("wb8", "wb8"))
+        return 1;
+
+    /*
+     * The source is now big-endian BigTIFF: the copy must have its byte
+     * order and format, and be empty.
+     */
+    TIFFSetErrorHandler(NULL);
+    if (test_error("wl8", 0) || test_error("wb", 0) || test_error("wb8", 1))
+        return 1;
+
+    unlink(srcname);
+    unlink(dstname);
+    return 0;
+}
@@ -0,0 +1,314 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFOpenOptionsSetDirectIO(): pages written with whole strips,
+ * with scanlines flushed in several pieces per strip and with tiles are
+ * read back identical, with the append trailer still ending the file and
+ * a page appended later.  Where the file system supports direct I/O, the
+ * strips/tiles must start at aligned offsets.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 1000
+#define HEIGHT 60
+#define ROWSPERSTRIP 7
+#define TILESIZE 64
+#define ALIGNMENT 4096
+
+static const char filename[] = "test_direct_io.tif";
+
+static uint8_t pixel(int page, uint32_t x, uint32_t y)
+{
+    return (uint8_t)((x * 7 + y * 13 + (uint32_t)page * 29) ^ (x >> 3));
+}
+
+static void set_fields(TIFF *tif, int page)
+{
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    if (page == 2)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+    {
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+    }
+    if (page == 1)
+        TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+}
+
+/* page 0: whole strips, 1: scanlines, 2: tiles, 3: whole strips again */
+static int write_page(TIFF *tif, int page)
+{
+    uint8_t *buf = (uint8_t *)malloc((size_t)WIDTH * TILESIZE);
+    uint32_t x, y;
+    int ret = 1;
+
+    if (!buf)
+        return 1;
+    set_fields(tif, page);
+    if (page == 2)
+    {
+        uint32_t tx, ty;
+        for (ty = 0; ty < HEIGHT; ty += TILESIZE)
+        {
+            for (tx = 0; tx < WIDTH; tx += TILESIZE)
+            {
+                for (y = 0; y < TILESIZE; y++)
+                    for (x = 0; x < TILESIZE; x++)
+                        buf[y * TILESIZE + x] = pixel(page, tx + x, ty + y);
+                if (TIFFWriteTile(tif, buf, tx, ty, 0, 0) < 0)
+                    goto end;
+            }
+        }
+    }
+    else if (page == 1)
+    {
+        /* A small buffer, so that each strip is appended in pieces */
+        if (!TIFFWriteBufferSetup(tif, NULL, 1500))
+            goto end;
+        for (y = 0; y < HEIGHT; y++)
+        {
+            for (x = 0; x < WIDTH; x++)
+                buf[x] = pixel(page, x, y);
+            if (TIFFWriteScanline(tif, buf, y, 0) < 0)
+                goto end;
+        }
+    }
+    else
+    {
+        for (y = 0; y < HEIGHT; y += ROWSPERSTRIP)
+        {
+            uint32_t rows = HEIGHT - y < ROWSPERSTRIP ? HEIGHT - y
+                                                      : ROWSPERSTRIP;
+            uint32_t i;
+            for (i = 0; i < rows; i++)
+                for (x = 0; x < WIDTH; x++)
+                    buf[i * WIDTH + x] = pixel(page, x, y + i);
+            if (TIFFWriteEncodedStrip(tif, y / ROWSPERSTRIP, buf,
+                                      (tmsize_t)rows * WIDTH) < 0)
+                goto end;
+        }
+    }
+    ret = !TIFFWriteDirectory(tif);
+end:
+    if (ret)
+        fprintf(stderr, "Cannot write page %d\n", page);
+    free(buf);
+    return ret;
+}
+
+static TIFF *open_direct(const char *mode)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    TIFF *tif;
+
+    TIFFOpenOptionsSetDirectIO(opts, 1);
+    TIFFOpenOptionsSetAppendTrailer(opts, 1);
+    tif = TIFFOpenExt(filename, mode, opts);
+    TIFFOpenOptionsFree(opts);
+    if (!tif)
+        fprintf(stderr, "Cannot open %s in \"%s\" mode\n", filename, mode);
+    return tif;
+}
+
+/* Returns the number of unaligned strips/tiles, or -1 on error */
+static int check_page(TIFF *tif, int page)
+{
+    uint8_t *buf = (uint8_t *)malloc((size_t)WIDTH * TILESIZE);
+    uint32_t x, y, i;
+    int unaligned = 0;
+
+    if (!buf)
+        return -1;
+    if (TIFFIsTiled(tif))
+    {
+        uint32_t tx, ty;
+        for (ty = 0; ty < HEIGHT; ty += TILESIZE)
+        {
+            for (tx = 0; tx < WIDTH; tx += TILESIZE)
+            {
+                if (TIFFReadTile(tif, buf, tx, ty, 0, 0) < 0)
+                {
+                    fprintf(stderr, "Page %d: cannot read tile (%u,%u)\n",
+                            page, tx, ty);
+                    free(buf);
+                    return -1;
+                }
+                for (y = 0; y < TILESIZE && ty + y < HEIGHT; y++)
+                {
+                    for (x = 0; x < TILESIZE && tx + x < WIDTH; x++)
+                    {
+                        if (buf[y * TILESIZE + x] !=
+                            pixel(page, tx + x, ty + y))
+                        {
+                            fprintf(stderr,
+                                    "Page %d: wrong pixel at (%u,%u)\n", page,
+                                    tx + x, ty + y);
+                            free(buf);
+                            return -1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    else
+    {
+        for (y = 0; y < HEIGHT; y++)
+        {
+            if (TIFFReadScanline(tif, buf, y, 0) < 0)
+            {
+                fprintf(stderr, "Page %d: cannot read row %u\n", page, y);
+                free(buf);
+                return -1;
+            }
+            for (x = 0; x < WIDTH; x++)
+            {
+                if (buf[x] != pixel(page, x, y))
+                {
+                    fprintf(stderr, "Page %d: wrong pixel at (%u,%u)\n", page,
+                            x, y);
+                    free(buf);
+                    return -1;
+                }
+            }
+        }
+    }
+    free(buf);
+    for (i = 0; i < TIFFNumberOfStrips(tif); i++)
+    {
+        if (TIFFGetStrileOffset(tif, i) % ALIGNMENT != 0)
+            unaligned++;
+    }
+    return unaligned;
+}
+
+static int check_file(int npages)
+{
+    TIFF *tif = TIFFOpen(filename, "r");
+    char magic[8];
+    FILE *f;
+    int page, unaligned = 0;
+    int ret = 0;
+
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot reopen %s\n", filename);
+        return 1;
+    }
+    for (page = 0; page < npages; page++)
+    {
+        int n;
+        if (page > 0 && !TIFFReadDirectory(tif))
+        {
+            fprintf(stderr, "Cannot read page %d\n", page);
+            TIFFClose(tif);
+            return 1;
+        }
+        n = check_page(tif, page);
+        if (n < 0)
+            ret++;
+        else
+            unaligned += n;
+    }
+    if (TIFFReadDirectory(tif))
+    {
+        fprintf(stderr, "More than %d pages\n", npages);
+        ret++;
+    }
+    TIFFClose(tif);
+
+    /* The padding of the last strip must not hide the trailer */
+    f = fopen(filename, "rb");
+    if (!f || fseek(f, -32, SEEK_END) != 0 || fread(magic, 1, 8, f) != 8 ||
+        memcmp(magic, "LTIFFEND", 8) != 0)
+    {
+        fprintf(stderr, "The file does not end with the append trailer\n");
+        ret++;
+    }
+    if (f)
+        fclose(f);
+
+    if (unaligned > 0)
+        fprintf(stderr, "%d unaligned strips/tiles: direct I/O is not "
+                        "available here\n",
+                unaligned);
+    return ret;
+}
+
+static int test(const char *mode)
+{
+    TIFF *tif = open_direct(mode);
+    int page, ret = 0;
+
+    if (!tif)
+        return 1;
+    for (page = 0; page < 3 && ret == 0; page++)
+        ret += write_page(tif, page);
+    TIFFClose(tif);
+    if (ret == 0)
+        ret += check_file(3);
+
+    /* Append a page to the file, after the trailer */
+    if (ret == 0)
+    {
+        tif = open_direct("a");
+        if (!tif)
+            return 1;
+        ret += write_page(tif, 3);
+        TIFFClose(tif);
+        if (ret == 0)
+            ret += check_file(4);
+    }
+    if (ret)
+        fprintf(stderr, "Failed in \"%s\" mode\n", mode);
+    return ret;
+}
+
+int main(void)
+{
+    int ret = test("w");
+    ret += test("w8");
+    if (ret == 0)
+        unlink(filename);
+    return ret;
+}
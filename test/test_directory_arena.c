@@ -0,0 +1,386 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFOpenOptionsSetAllocator() and TIFFOpenOptionsSetDirectoryArena():
+ * the directories of a multi-page file, with custom, unknown and EXIF
+ * fields, are read through a counting allocator with and without a
+ * directory arena, and must give the same values with every allocation
+ * released at close.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 16
+#define HEIGHT 8
+#define NPAGES 12
+#define UNKNOWN_TAG 65000
+
+static const char filename[] = "test_directory_arena.tif";
+
+typedef struct
+{
+    long calls; /* malloc() and realloc() calls */
+    long live;  /* blocks not freed yet */
+    int errors;
+} AllocCounts;
+
+static void *count_malloc(void *user_data, tmsize_t size)
+{
+    AllocCounts *counts = (AllocCounts *)user_data;
+    void *p = malloc((size_t)size);
+    counts->calls++;
+    if (p != NULL)
+        counts->live++;
+    return p;
+}
+
+static void *count_realloc(void *user_data, void *ptr, tmsize_t size)
+{
+    AllocCounts *counts = (AllocCounts *)user_data;
+    void *p = realloc(ptr, (size_t)size);
+    counts->calls++;
+    if (ptr == NULL && p != NULL)
+        counts->live++;
+    return p;
+}
+
+static void count_free(void *user_data, void *ptr)
+{
+    AllocCounts *counts = (AllocCounts *)user_data;
+    if (ptr != NULL)
+        counts->live--;
+    free(ptr);
+}
+
+static int count_errors(TIFF *tif, void *user_data, const char *module,
+                        const char *fmt, va_list ap)
+{
+    AllocCounts *counts = (AllocCounts *)user_data;
+    (void)tif;
+    fprintf(stderr, "%s: ", module);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    counts->errors++;
+    return 1;
+}
+
+static const TIFFFieldInfo unknownFieldInfo[] = {
+    {UNKNOWN_TAG, TIFF_VARIABLE, TIFF_VARIABLE, TIFF_LONG, FIELD_CUSTOM, 1, 1,
+     "UnknownLongs"},
+};
+
+static TIFFExtendProc parent_extender = NULL;
+
+static void extender(TIFF *tif)
+{
+    TIFFMergeFieldInfo(tif, unknownFieldInfo, 1);
+    if (parent_extender)
+        (*parent_extender)(tif);
+}
+
+static uint8_t pixel(int page, uint32_t x, uint32_t y)
+{
+    return (uint8_t)(page * 31 + x * 3 + y * 7);
+}
+
+static int write_file(void)
+{
+    uint8_t buf[WIDTH * HEIGHT];
+    uint32_t longs[64];
+    uint64_t exifdiroff = 0;
+    char text[64];
+    TIFF *tif;
+    int page;
+    uint32_t i;
+
+    parent_extender = TIFFSetTagExtender(extender);
+    tif = TIFFOpen(filename, "w");
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        TIFFSetTagExtender(parent_extender);
+        return 1;
+    }
+    if (TIFFCreateEXIFDirectory(tif) != 0 ||
+        !TIFFSetField(tif, EXIFTAG_FNUMBER, 2.8) ||
+        !TIFFSetField(tif, EXIFTAG_DATETIMEORIGINAL, "2024:01:02 03:04:05") ||
+        !TIFFWriteCustomDirectory(tif, &exifdiroff) ||
+        TIFFCreateDirectory(tif) != 0)
+    {
+        fprintf(stderr, "Cannot write the EXIF directory\n");
+        goto failure;
+    }
+    for (page = 0; page < NPAGES; page++)
+    {
+        uint32_t x, y;
+
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 2);
+        TIFFSetField(tif, TIFFTAG_PAGENUMBER, page, NPAGES);
+        snprintf(text, sizeof(text), "page %d", page);
+        TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, text);
+        TIFFSetField(tif, TIFFTAG_PAGENAME, text);
+        TIFFSetField(tif, TIFFTAG_DOCUMENTNAME, "test_directory_arena");
+        TIFFSetField(tif, TIFFTAG_SOFTWARE, "libtiff");
+        TIFFSetField(tif, TIFFTAG_ARTIST, "artist");
+        for (i = 0; i < 64; i++)
+            longs[i] = (uint32_t)(page * 1000) + i;
+        TIFFSetField(tif, UNKNOWN_TAG, (uint32_t)(page + 1), longs);
+        if (page == 0)
+            TIFFSetField(tif, TIFFTAG_EXIFIFD, exifdiroff);
+        for (y = 0; y < HEIGHT; y++)
+            for (x = 0; x < WIDTH; x++)
+                buf[y * WIDTH + x] = pixel(page, x, y);
+        for (y = 0; y < HEIGHT; y += 2)
+        {
+            if (TIFFWriteEncodedStrip(tif, y / 2, buf + y * WIDTH,
+                                      2 * WIDTH) != 2 * WIDTH)
+            {
+                fprintf(stderr, "Cannot write strip %u of page %d\n", y / 2,
+                        page);
+                goto failure;
+            }
+        }
+        if (!TIFFWriteDirectory(tif))
+        {
+            fprintf(stderr, "Cannot write page %d\n", page);
+            goto failure;
+        }
+    }
+    TIFFClose(tif);
+    TIFFSetTagExtender(parent_extender);
+    return 0;
+
+failure:
+    TIFFClose(tif);
+    TIFFSetTagExtender(parent_extender);
+    return 1;
+}
+
+static int check_string(TIFF *tif, int page, uint32_t tag,
+                        const char *expected)
+{
+    const char *value = NULL;
+
+    if (!TIFFGetField(tif, tag, &value) || strcmp(value, expected) != 0)
+    {
+        fprintf(stderr, "Page %d: tag %u is \"%s\" instead of \"%s\"\n", page,
+                tag, value ? value : "(unset)", expected);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_page(TIFF *tif, int page)
+{
+    uint8_t buf[WIDTH * HEIGHT];
+    char text[64];
+    uint16_t pagenum = 0, npages = 0;
+    uint32_t count = 0;
+    uint32_t *longs = NULL;
+    uint32_t i, x, y;
+    int ret = 0;
+
+    if (!TIFFSetDirectory(tif, (tdir_t)page))
+    {
+        fprintf(stderr, "Cannot read page %d\n", page);
+        return 1;
+    }
+    snprintf(text, sizeof(text), "page %d", page);
+    ret += check_string(tif, page, TIFFTAG_IMAGEDESCRIPTION, text);
+    ret += check_string(tif, page, TIFFTAG_PAGENAME, text);
+    ret += check_string(tif, page, TIFFTAG_DOCUMENTNAME,
+                        "test_directory_arena");
+    ret += check_string(tif, page, TIFFTAG_SOFTWARE, "libtiff");
+    ret += check_string(tif, page, TIFFTAG_ARTIST, "artist");
+    if (!TIFFGetField(tif, TIFFTAG_PAGENUMBER, &pagenum, &npages) ||
+        pagenum != page || npages != NPAGES)
+    {
+        fprintf(stderr, "Page %d: wrong PageNumber\n", page);
+        ret++;
+    }
+    /* Read as an anonymous field, as the extender is not set anymore */
+    if (!TIFFGetField(tif, UNKNOWN_TAG, &count, &longs) ||
+        count != (uint32_t)(page + 1))
+    {
+        fprintf(stderr, "Page %d: wrong count for tag %u\n", page,
+                UNKNOWN_TAG);
+        return ret + 1;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (longs[i] != (uint32_t)(page * 1000) + i)
+        {
+            fprintf(stderr, "Page %d: wrong value %u for tag %u\n", page, i,
+                    UNKNOWN_TAG);
+            return ret + 1;
+        }
+    }
+    for (y = 0; y < HEIGHT; y += 2)
+    {
+        if (TIFFReadEncodedStrip(tif, y / 2, buf + y * WIDTH, 2 * WIDTH) !=
+            2 * WIDTH)
+        {
+            fprintf(stderr, "Page %d: cannot read strip %u\n", page, y / 2);
+            return ret + 1;
+        }
+    }
+    for (y = 0; y < HEIGHT; y++)
+    {
+        for (x = 0; x < WIDTH; x++)
+        {
+            if (buf[y * WIDTH + x] != pixel(page, x, y))
+            {
+                fprintf(stderr, "Page %d: wrong pixel at (%u,%u)\n", page, x,
+                        y);
+                return ret + 1;
+            }
+        }
+    }
+    return ret;
+}
+
+static int check_exif(TIFF *tif)
+{
+    uint64_t exifdiroff = 0;
+    float fnumber = 0;
+    int ret = 0;
+
+    if (!TIFFSetDirectory(tif, 0) ||
+        !TIFFGetField(tif, TIFFTAG_EXIFIFD, &exifdiroff) ||
+        !TIFFReadEXIFDirectory(tif, exifdiroff))
+    {
+        fprintf(stderr, "Cannot read the EXIF directory\n");
+        return 1;
+    }
+    if (!TIFFGetField(tif, EXIFTAG_FNUMBER, &fnumber) || fnumber != 2.8f)
+    {
+        fprintf(stderr, "Wrong FNumber\n");
+        ret++;
+    }
+    ret += check_string(tif, 0, EXIFTAG_DATETIMEORIGINAL,
+                        "2024:01:02 03:04:05");
+    return ret;
+}
+
+/* Change fields allocated while reading the directory, then leave it */
+static int check_changes(TIFF *tif)
+{
+    int ret = 0;
+
+    if (!TIFFSetDirectory(tif, 1) || !TIFFSetField(tif, TIFFTAG_ARTIST, "new") ||
+        !TIFFSetField(tif, TIFFTAG_HOSTCOMPUTER, "host") ||
+        !TIFFUnsetField(tif, TIFFTAG_PAGENAME))
+    {
+        fprintf(stderr, "Cannot change page 1\n");
+        return 1;
+    }
+    ret += check_string(tif, 1, TIFFTAG_ARTIST, "new");
+    ret += check_string(tif, 1, TIFFTAG_HOSTCOMPUTER, "host");
+    ret += check_string(tif, 1, TIFFTAG_SOFTWARE, "libtiff");
+    ret += check_string(tif, 1, TIFFTAG_IMAGEDESCRIPTION, "page 1");
+    ret += check_page(tif, 2);
+    return ret;
+}
+
+static int read_file(tmsize_t arena_chunk_size, tmsize_t max_cumulated,
+                     AllocCounts *counts)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    TIFF *tif;
+    int page;
+    int ret = 0;
+
+    memset(counts, 0, sizeof(*counts));
+    TIFFOpenOptionsSetAllocator(opts, count_malloc, count_realloc, count_free,
+                                counts);
+    TIFFOpenOptionsSetDirectoryArena(opts, arena_chunk_size);
+    TIFFOpenOptionsSetMaxCumulatedMemAlloc(opts, max_cumulated);
+    TIFFOpenOptionsSetErrorHandlerExtR(opts, count_errors, counts);
+    tif = TIFFOpenExt(filename, "r", opts);
+    TIFFOpenOptionsFree(opts);
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return 1;
+    }
+    for (page = 0; page < NPAGES; page++)
+        ret += check_page(tif, page);
+    /* Read them backwards, going through the IFD offset cache */
+    for (page = NPAGES - 1; page >= 0; page--)
+        ret += check_page(tif, page);
+    ret += check_exif(tif);
+    ret += check_changes(tif);
+    TIFFClose(tif);
+    if (counts->live != 0)
+    {
+        fprintf(stderr, "%ld block(s) not freed (arena chunk size %" PRId64
+                        ")\n",
+                counts->live, (int64_t)arena_chunk_size);
+        ret++;
+    }
+    if (counts->errors != 0)
+        ret++;
+    return ret;
+}
+
+int main(void)
+{
+    AllocCounts plain, arena, small;
+    int ret;
+
+    if (write_file())
+        return 1;
+    ret = read_file(0, 0, &plain);
+    ret += read_file(64 * 1024, 0, &arena);
+    /* Small chunks: blocks larger than a chunk and many chunks */
+    ret += read_file(256, 0, &small);
+    ret += read_file(256, 1024 * 1024, &small);
+    if (ret == 0 && arena.calls * 2 > plain.calls)
+    {
+        fprintf(stderr,
+                "%ld allocations with the arena, %ld without: expected at "
+                "least half less\n",
+                arena.calls, plain.calls);
+        ret++;
+    }
+    if (ret == 0)
+        unlink(filename);
+    return ret;
+}
@@ -0,0 +1,150 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * TIFF Library
+ *
+ * Test the PackBits codec: exact encoding of the example of the TIFF 6.0
+ * specification, and round trips of rows mixing literals and runs of
+ * lengths around the vector block sizes and the 128 byte limits.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+static const char filename[] = "test_packbits.tif";
+
+static int write_strip(const uint8_t *buf, uint32_t width, uint32_t height)
+{
+    TIFF *tif = TIFFOpen(filename, "w");
+    tmsize_t size = (tmsize_t)width * height;
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        return 0;
+    }
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, height);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_PACKBITS);
+    if (TIFFWriteEncodedStrip(tif, 0, (void *)buf, size) != size)
+    {
+        fprintf(stderr, "TIFFWriteEncodedStrip() failed\n");
+        TIFFClose(tif);
+        return 0;
+    }
+    TIFFClose(tif);
+    return 1;
+}
+
+static int test_spec_example(void)
+{
+    static const uint8_t unpacked[] = {
+        0xAA, 0xAA, 0xAA, 0x80, 0x00, 0x2A, 0xAA, 0xAA, 0xAA, 0xAA, 0x80, 0x00,
+        0x2A, 0x22, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA};
+    static const uint8_t packed[] = {0xFE, 0xAA, 0x02, 0x80, 0x00,
+                                     0x2A, 0xFD, 0xAA, 0x03, 0x80,
+                                     0x00, 0x2A, 0x22, 0xF7, 0xAA};
+    uint8_t raw[sizeof(packed) + 16];
+    tmsize_t size;
+    TIFF *tif;
+
+    if (!write_strip(unpacked, sizeof(unpacked), 1))
+        return 0;
+    tif = TIFFOpen(filename, "r");
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return 0;
+    }
+    size = TIFFReadRawStrip(tif, 0, raw, sizeof(raw));
+    TIFFClose(tif);
+    if (size != (tmsize_t)sizeof(packed) || memcmp(raw, packed, sizeof(packed)))
+    {
+        fprintf(stderr, "Unexpected encoding of the specification example\n");
+        return 0;
+    }
+    return 1;
+}
+
+static int test_round_trip(void)
+{
+    /* lengths of the runs, repeated over the rows */
+    static const int lengths[] = {1,  2,  3,  1,  15, 16,  17,  1,   1,   31,
+                                  32, 33, 2,  1,  1,  127, 128, 129, 130, 1,
+                                  2,  1,  2,  255, 256, 257, 1,  1,   1,   500};
+    const uint32_t width = 1000, height = 20;
+    size_t size = (size_t)width * height, i = 0;
+    uint8_t *buf = (uint8_t *)malloc(size);
+    uint8_t *out = (uint8_t *)malloc(size);
+    int k = 0, value = 0, ok = 0;
+    TIFF *tif;
+
+    while (i < size)
+    {
+        int n = lengths[k++ % (sizeof(lengths) / sizeof(lengths[0]))];
+        /* sequences of one byte runs are literals */
+        for (; n > 0 && i < size; n--)
+            buf[i++] = (uint8_t)value;
+        value = (value * 7 + 13) & 0xff;
+    }
+    if (!write_strip(buf, width, height))
+        goto end;
+    tif = TIFFOpen(filename, "r");
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        goto end;
+    }
+    if (TIFFReadEncodedStrip(tif, 0, out, (tmsize_t)size) != (tmsize_t)size)
+        fprintf(stderr, "TIFFReadEncodedStrip() failed\n");
+    else if (memcmp(buf, out, size) != 0)
+        fprintf(stderr, "Round trip mismatch\n");
+    else
+        ok = 1;
+    TIFFClose(tif);
+end:
+    free(buf);
+    free(out);
+    return ok;
+}
+
+int main(void)
+{
+    if (!test_spec_example())
+        return 1;
+    if (!test_round_trip())
+        return 1;
+    unlink(filename);
+    return 0;
+}
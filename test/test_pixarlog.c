@@ -0,0 +1,523 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * TIFF Library
+ *
+ * Test the horizontal differencing / accumulation of the PixarLog codec
+ * with 3 and 4 samples per pixel, for which vectorized code paths exist.
+ *
+ * The test keeps scalar reference copies of the conversion tables and of
+ * horizontalDifferenceF/16/8() and horizontalAccumulate11(). Files are
+ * written without compression (PIXARLOGQUALITY 0, so zlib only emits
+ * stored blocks), which gives access to the differenced codes produced by
+ * the codec, and read back as 11-bit codes to get the accumulated ones.
+ * Both are compared to the reference outputs. Row widths are chosen so that
+ * vector bodies, scalar tails and multi-chunk rows are all exercised.
+ */
+
+#include "tif_config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define HEIGHT 3
+#define NCODES 2048
+
+/* Same as in tif_pixarlog.c */
+#define TSIZE 2048
+#define TSIZEP1 2049
+#define ONE 1250
+#define RATIO 1.004
+#define CODE_MASK 0x7ff
+
+static const char filename[] = "test_pixarlog.tif";
+
+static float Fltsize;
+static float LogK1, LogK2;
+static uint16_t *FromLT2;
+static uint16_t From14[16384];
+static uint16_t From8[256];
+
+/* The encoding tables of PixarLogMakeTables() */
+static int make_tables(void)
+{
+    float ToLinearF[TSIZEP1];
+    int nlin, lt2size;
+    int i, j;
+    double b, c, linstep, v;
+
+    c = log(RATIO);
+    nlin = (int)(1. / c);
+    c = 1. / nlin;
+    b = exp(-c * ONE);
+    linstep = b * c * exp(1.);
+
+    LogK1 = (float)(1. / c);
+    LogK2 = (float)(1. / b);
+    lt2size = (int)(2. / linstep) + 1;
+    FromLT2 = (uint16_t *)_TIFFmalloc(lt2size * sizeof(uint16_t));
+    if (!FromLT2)
+        return 0;
+
+    j = 0;
+    for (i = 0; i < nlin; i++)
+    {
+        v = i * linstep;
+        ToLinearF[j++] = (float)v;
+    }
+    for (i = nlin; i < TSIZE; i++)
+        ToLinearF[j++] = (float)(b * exp(c * i));
+    ToLinearF[2048] = ToLinearF[2047];
+
+    j = 0;
+    for (i = 0; i < lt2size; i++)
+    {
+        if ((i * linstep) * (i * linstep) > ToLinearF[j] * ToLinearF[j + 1])
+            j++;
+        FromLT2[i] = (uint16_t)j;
+    }
+    j = 0;
+    for (i = 0; i < 16384; i++)
+    {
+        while ((i / 16383.) * (i / 16383.) > ToLinearF[j] * ToLinearF[j + 1])
+            j++;
+        From14[i] = (uint16_t)j;
+    }
+    j = 0;
+    for (i = 0; i < 256; i++)
+    {
+        while ((i / 255.) * (i / 255.) > ToLinearF[j] * ToLinearF[j + 1])
+            j++;
+        From8[i] = (uint16_t)j;
+    }
+    Fltsize = (float)(lt2size / 2);
+    return 1;
+}
+
+/* Scalar reference versions of the functions of tif_pixarlog.c */
+
+static void ref_horizontalDifferenceF(const float *ip, int n, int stride,
+                                      uint16_t *wp)
+{
+    float fltsize = Fltsize;
+    int i;
+
+#define CLAMP(v)                                                               \
+    ((v < (float)0.)     ? 0                                                   \
+     : (v < (float)2.)   ? FromLT2[(int)(v * fltsize)]                         \
+     : (v > (float)24.2) ? 2047                                                \
+                         : LogK1 * log(v * LogK2) + 0.5)
+
+    for (i = 0; i < stride; i++)
+        wp[i] = (uint16_t)CLAMP(ip[i]);
+    for (; i < n; i++)
+        wp[i] = (uint16_t)(((int32_t)CLAMP(ip[i]) -
+                            (int32_t)CLAMP(ip[i - stride])) &
+                           CODE_MASK);
+#undef CLAMP
+}
+
+static void ref_horizontalDifference16(const uint16_t *ip, int n, int stride,
+                                       uint16_t *wp)
+{
+    int i;
+
+    for (i = 0; i < stride; i++)
+        wp[i] = From14[ip[i] >> 2];
+    for (; i < n; i++)
+        wp[i] = (uint16_t)((From14[ip[i] >> 2] - From14[ip[i - stride] >> 2]) &
+                           CODE_MASK);
+}
+
+static void ref_horizontalDifference8(const uint8_t *ip, int n, int stride,
+                                      uint16_t *wp)
+{
+    int i;
+
+    for (i = 0; i < stride; i++)
+        wp[i] = From8[ip[i]];
+    for (; i < n; i++)
+        wp[i] = (uint16_t)((From8[ip[i]] - From8[ip[i - stride]]) & CODE_MASK);
+}
+
+static void ref_horizontalAccumulate11(const uint16_t *wp, int n, int stride,
+                                       uint16_t *op)
+{
+    unsigned int sum[4];
+    int i;
+
+    for (i = 0; i < stride; i++)
+    {
+        sum[i] = wp[i];
+        op[i] = (uint16_t)(sum[i] & CODE_MASK);
+    }
+    for (; i < n; i++)
+    {
+        sum[i % stride] += wp[i];
+        op[i] = (uint16_t)(sum[i % stride] & CODE_MASK);
+    }
+}
+
+static uint32_t seed = 1;
+
+static uint32_t next_random(void)
+{
+    seed = seed * 1103515245U + 12345U;
+    return (seed >> 16) & 0x7fff;
+}
+
+static void fill_input(void *buf, size_t nsamples, int datafmt)
+{
+    size_t i;
+    for (i = 0; i < nsamples; i++)
+    {
+        switch (datafmt)
+        {
+            case PIXARLOGDATAFMT_8BIT:
+                ((uint8_t *)buf)[i] = (uint8_t)next_random();
+                break;
+            case PIXARLOGDATAFMT_16BIT:
+                ((uint16_t *)buf)[i] =
+                    (uint16_t)(next_random() ^ (next_random() << 1));
+                break;
+            default:
+                /* covers the < 0, < 2, log and > 24.2 ranges of the encoder */
+                ((float *)buf)[i] =
+                    (float)(next_random() % 2048) * 0.0125f - 0.5f;
+                break;
+        }
+    }
+}
+
+static int write_file(uint32_t width, uint16_t spp, int datafmt,
+                      const void *buf)
+{
+    TIFF *tif = TIFFOpen(filename, "w");
+    uint16_t bps = datafmt == PIXARLOGDATAFMT_8BIT    ? 8
+                   : datafmt == PIXARLOGDATAFMT_16BIT ? 16
+                                                      : 32;
+    tmsize_t size = (tmsize_t)width * HEIGHT * spp * (bps / 8);
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        return 0;
+    }
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bps);
+    TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, datafmt == PIXARLOGDATAFMT_FLOAT
+                                                ? SAMPLEFORMAT_IEEEFP
+                                                : SAMPLEFORMAT_UINT);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, spp);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    if (spp == 4)
+    {
+        uint16_t extra = EXTRASAMPLE_UNASSALPHA;
+        TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &extra);
+    }
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_PIXARLOG);
+    TIFFSetField(tif, TIFFTAG_PIXARLOGDATAFMT, datafmt);
+    /* no compression, so that the differenced codes can be read back */
+    TIFFSetField(tif, TIFFTAG_PIXARLOGQUALITY, 0);
+    if (TIFFWriteEncodedStrip(tif, 0, (void *)buf, size) != size)
+    {
+        fprintf(stderr, "TIFFWriteEncodedStrip() failed\n");
+        TIFFClose(tif);
+        return 0;
+    }
+    TIFFClose(tif);
+    return 1;
+}
+
+static void *read_file(int datafmt, tmsize_t *size)
+{
+    TIFF *tif = TIFFOpen(filename, "r");
+    void *buf;
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return NULL;
+    }
+    TIFFSetField(tif, TIFFTAG_PIXARLOGDATAFMT, datafmt);
+    *size = TIFFStripSize(tif);
+    buf = _TIFFmalloc(*size);
+    if (!buf || TIFFReadEncodedStrip(tif, 0, buf, *size) != *size)
+    {
+        fprintf(stderr, "TIFFReadEncodedStrip() failed\n");
+        _TIFFfree(buf);
+        buf = NULL;
+    }
+    TIFFClose(tif);
+    return buf;
+}
+
+/*
+ * Read the differenced codes written by the encoder, from a zlib stream
+ * only made of stored blocks.
+ */
+static uint16_t *read_differences(size_t nsamples)
+{
+    TIFF *tif = TIFFOpen(filename, "r");
+    uint8_t *raw = NULL;
+    uint16_t *wp = NULL;
+    tmsize_t rawsize, pos = 2, len, n = 0;
+    int last = 0;
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return NULL;
+    }
+    rawsize = (tmsize_t)TIFFGetStrileByteCount(tif, 0);
+    raw = (uint8_t *)_TIFFmalloc(rawsize);
+    wp = (uint16_t *)_TIFFmalloc((tmsize_t)(nsamples * sizeof(uint16_t)));
+    if (!raw || !wp || TIFFReadRawStrip(tif, 0, raw, rawsize) != rawsize ||
+        rawsize < 2 || (raw[0] & 0x0f) != 8 || (raw[1] & 0x20) != 0)
+    {
+        fprintf(stderr, "Cannot read the zlib stream\n");
+        goto bad;
+    }
+    while (!last)
+    {
+        if (pos + 5 > rawsize || ((raw[pos] >> 1) & 3) != 0)
+        {
+            fprintf(stderr, "Not a stored deflate block at %u\n",
+                    (unsigned)pos);
+            goto bad;
+        }
+        last = raw[pos] & 1;
+        len = raw[pos + 1] | (raw[pos + 2] << 8);
+        pos += 5;
+        if (len > rawsize - pos ||
+            (size_t)(n + len) > nsamples * sizeof(uint16_t))
+        {
+            fprintf(stderr, "Invalid stored deflate block\n");
+            goto bad;
+        }
+        memcpy((uint8_t *)wp + n, raw + pos, len);
+        pos += len;
+        n += len;
+    }
+    if ((size_t)n != nsamples * sizeof(uint16_t))
+    {
+        fprintf(stderr, "Got %u bytes of differences instead of %u\n",
+                (unsigned)n, (unsigned)(nsamples * sizeof(uint16_t)));
+        goto bad;
+    }
+    _TIFFfree(raw);
+    TIFFClose(tif);
+    return wp;
+bad:
+    _TIFFfree(raw);
+    _TIFFfree(wp);
+    TIFFClose(tif);
+    return NULL;
+}
+
+/* Compare the codes of the codec to the reference ones, row by row */
+static int check_rows(const char *what, const uint16_t *codes,
+                      const uint16_t *ref, uint32_t width, uint16_t spp)
+{
+    size_t rowsize = (size_t)width * spp;
+    uint32_t row;
+    for (row = 0; row < HEIGHT; row++)
+    {
+        if (memcmp(codes + row * rowsize, ref + row * rowsize,
+                   rowsize * sizeof(uint16_t)) != 0)
+        {
+            fprintf(stderr, "%s differ from the reference in row %u\n", what,
+                    row);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Check that every decoded sample is a function of its 11-bit code */
+static int check_decoded(const uint16_t *codes, size_t nsamples, uint16_t spp,
+                         int datafmt)
+{
+    static const char *const names[] = {"8BIT",  "8BITABGR", "11BITLOG",
+                                        "12BITPICIO", "16BIT", "FLOAT"};
+    uint32_t table[NCODES];
+    unsigned char seen[NCODES];
+    tmsize_t size;
+    size_t i;
+    void *buf = read_file(datafmt, &size);
+    if (!buf)
+        return 0;
+    memset(seen, 0, sizeof(seen));
+    for (i = 0; i < nsamples; i++)
+    {
+        uint32_t v;
+        size_t pixel = i / spp, sample = i % spp;
+        switch (datafmt)
+        {
+            case PIXARLOGDATAFMT_8BIT:
+                v = ((uint8_t *)buf)[i];
+                break;
+            case PIXARLOGDATAFMT_8BITABGR:
+                v = ((uint8_t *)buf)[pixel * 4 + (3 - sample)];
+                break;
+            case PIXARLOGDATAFMT_12BITPICIO:
+                v = (uint16_t)((int16_t *)buf)[i];
+                break;
+            case PIXARLOGDATAFMT_16BIT:
+                v = ((uint16_t *)buf)[i];
+                break;
+            default:
+                memcpy(&v, (float *)buf + i, sizeof(v));
+                break;
+        }
+        if (!seen[codes[i]])
+        {
+            seen[codes[i]] = 1;
+            table[codes[i]] = v;
+        }
+        else if (table[codes[i]] != v)
+        {
+            fprintf(stderr,
+                    "PIXARLOGDATAFMT_%s: mismatch at sample %u for code %u\n",
+                    names[datafmt], (unsigned)i, codes[i]);
+            _TIFFfree(buf);
+            return 0;
+        }
+    }
+    _TIFFfree(buf);
+    return 1;
+}
+
+static int test(uint32_t width, uint16_t spp, int input_datafmt)
+{
+    static const int output_datafmts[] = {
+        PIXARLOGDATAFMT_8BIT, PIXARLOGDATAFMT_8BITABGR,
+        PIXARLOGDATAFMT_12BITPICIO, PIXARLOGDATAFMT_16BIT,
+        PIXARLOGDATAFMT_FLOAT};
+    size_t nsamples = (size_t)width * HEIGHT * spp;
+    int n = (int)(width * spp);
+    size_t i;
+    uint32_t row;
+    tmsize_t size;
+    int ok = 0;
+    void *input = _TIFFmalloc((tmsize_t)(nsamples * sizeof(float)));
+    uint16_t *ref_diff =
+        (uint16_t *)_TIFFmalloc((tmsize_t)(nsamples * sizeof(uint16_t)));
+    uint16_t *ref_codes =
+        (uint16_t *)_TIFFmalloc((tmsize_t)(nsamples * sizeof(uint16_t)));
+    uint16_t *diff = NULL;
+    uint16_t *codes = NULL;
+
+    if (!input || !ref_diff || !ref_codes)
+        goto end;
+    fill_input(input, nsamples, input_datafmt);
+    for (row = 0; row < HEIGHT; row++)
+    {
+        size_t offset = (size_t)row * n;
+        switch (input_datafmt)
+        {
+            case PIXARLOGDATAFMT_8BIT:
+                ref_horizontalDifference8((const uint8_t *)input + offset, n,
+                                          spp, ref_diff + offset);
+                break;
+            case PIXARLOGDATAFMT_16BIT:
+                ref_horizontalDifference16((const uint16_t *)input + offset, n,
+                                           spp, ref_diff + offset);
+                break;
+            default:
+                ref_horizontalDifferenceF((const float *)input + offset, n,
+                                          spp, ref_diff + offset);
+                break;
+        }
+        ref_horizontalAccumulate11(ref_diff + offset, n, spp,
+                                   ref_codes + offset);
+    }
+
+    if (!write_file(width, spp, input_datafmt, input))
+        goto end;
+    diff = read_differences(nsamples);
+    if (!diff || !check_rows("Differences", diff, ref_diff, width, spp))
+        goto end;
+    codes = (uint16_t *)read_file(PIXARLOGDATAFMT_11BITLOG, &size);
+    if (!codes || (size_t)size != nsamples * sizeof(uint16_t))
+        goto end;
+    if (!check_rows("Accumulated codes", codes, ref_codes, width, spp))
+        goto end;
+    for (i = 0; i < sizeof(output_datafmts) / sizeof(output_datafmts[0]); i++)
+    {
+        /* 8BITABGR expands RGB to 4 bytes per pixel, more than the strip
+         * size libtiff computes, so only check it with alpha */
+        if (output_datafmts[i] == PIXARLOGDATAFMT_8BITABGR && spp != 4)
+            continue;
+        if (!check_decoded(codes, nsamples, spp, output_datafmts[i]))
+            goto end;
+    }
+    ok = 1;
+end:
+    if (!ok)
+        fprintf(stderr, "Failed for width=%u, spp=%u, input datafmt=%d\n",
+                width, spp, input_datafmt);
+    _TIFFfree(codes);
+    _TIFFfree(diff);
+    _TIFFfree(ref_codes);
+    _TIFFfree(ref_diff);
+    _TIFFfree(input);
+    return ok;
+}
+
+int main(void)
+{
+    static const uint32_t widths[] = {1, 2, 7, 8, 9, 17, 31, 300};
+    static const int input_datafmts[] = {
+        PIXARLOGDATAFMT_8BIT, PIXARLOGDATAFMT_16BIT, PIXARLOGDATAFMT_FLOAT};
+    size_t i, j;
+    uint16_t spp;
+
+    if (!TIFFIsCODECConfigured(COMPRESSION_PIXARLOG))
+        return 0;
+    if (!make_tables())
+        return 1;
+
+    for (spp = 3; spp <= 4; spp++)
+    {
+        for (i = 0; i < sizeof(widths) / sizeof(widths[0]); i++)
+        {
+            for (j = 0; j < sizeof(input_datafmts) / sizeof(input_datafmts[0]);
+                 j++)
+            {
+                if (!test(widths[i], spp, input_datafmts[j]))
+                    return 1;
+            }
+        }
+    }
+    _TIFFfree(FromLT2);
+    unlink(filename);
+    return 0;
+}
@@ -0,0 +1,394 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFReserveStrile() and TIFFWriteReservedStrile(): strips/tiles
+ * placed in advance and written in any order, mixed with the regular
+ * writing routines.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 64
+#define HEIGHT 64
+#define ROWSPERSTRIP 8
+#define NSTRIPS (HEIGHT / ROWSPERSTRIP)
+#define TILESIZE 16
+
+static const char filename[] = "test_reserve_strile.tif";
+
+static int nerrors;
+
+static int quiet_error_handler(TIFF *tif, void *user_data, const char *module,
+                               const char *fmt, va_list ap)
+{
+    (void)tif;
+    (void)user_data;
+    (void)module;
+    (void)fmt;
+    (void)ap;
+    nerrors++;
+    return 1;
+}
+
+static uint8_t pixel(uint32_t x, uint32_t y, int dir)
+{
+    return (uint8_t)(x * 3 + y * 7 + dir * 31);
+}
+
+static void fill(uint8_t *buf, uint32_t x0, uint32_t y0, uint32_t w,
+                 uint32_t h, int dir)
+{
+    uint32_t x, y;
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            buf[y * w + x] = pixel(x0 + x, y0 + y, dir);
+}
+
+static TIFF *open_for_writing(int bigtiff)
+{
+    TIFF *tif;
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    if (!opts)
+        return NULL;
+    TIFFOpenOptionsSetErrorHandlerExtR(opts, quiet_error_handler, NULL);
+    tif = TIFFOpenExt(filename, bigtiff ? "w8" : "w", opts);
+    TIFFOpenOptionsFree(opts);
+    if (!tif)
+        fprintf(stderr, "Cannot create %s\n", filename);
+    return tif;
+}
+
+static void set_fields(TIFF *tif, int tiled)
+{
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+    if (tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+}
+
+/* Check that directory dir holds the image generated by fill(). */
+static int check_directory(TIFF *tif, int dir)
+{
+    uint8_t buf[WIDTH];
+    uint32_t x, y;
+
+    if (!TIFFSetDirectory(tif, (tdir_t)dir))
+    {
+        fprintf(stderr, "Cannot read directory %d\n", dir);
+        return 1;
+    }
+    if (TIFFIsTiled(tif))
+    {
+        uint8_t tile[TILESIZE * TILESIZE];
+        uint32_t tx, ty;
+        for (ty = 0; ty < HEIGHT; ty += TILESIZE)
+            for (tx = 0; tx < WIDTH; tx += TILESIZE)
+            {
+                if (TIFFReadTile(tif, tile, tx, ty, 0, 0) < 0)
+                {
+                    fprintf(stderr, "Cannot read tile %u,%u\n", tx, ty);
+                    return 1;
+                }
+                for (y = 0; y < TILESIZE; y++)
+                    for (x = 0; x < TILESIZE; x++)
+                        if (tile[y * TILESIZE + x] !=
+                            pixel(tx + x, ty + y, dir))
+                        {
+                            fprintf(stderr,
+                                    "Directory %d: wrong pixel at %u,%u\n",
+                                    dir, tx + x, ty + y);
+                            return 1;
+                        }
+            }
+        return 0;
+    }
+    for (y = 0; y < HEIGHT; y++)
+    {
+        if (TIFFReadScanline(tif, buf, y, 0) < 0)
+        {
+            fprintf(stderr, "Cannot read line %u\n", y);
+            return 1;
+        }
+        for (x = 0; x < WIDTH; x++)
+            if (buf[x] != pixel(x, y, dir))
+            {
+                fprintf(stderr, "Directory %d: wrong pixel at %u,%u\n", dir,
+                        x, y);
+                return 1;
+            }
+    }
+    return 0;
+}
+
+static int check_file(tdir_t ndirs)
+{
+    tdir_t dir;
+    int ret = 0;
+    TIFF *tif = TIFFOpen(filename, "r");
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return 1;
+    }
+    if (TIFFNumberOfDirectories(tif) != ndirs)
+    {
+        fprintf(stderr, "Expected %u directories, got %u\n", (unsigned)ndirs,
+                (unsigned)TIFFNumberOfDirectories(tif));
+        ret = 1;
+    }
+    for (dir = 0; ret == 0 && dir < ndirs; dir++)
+        ret = check_directory(tif, (int)dir);
+    TIFFClose(tif);
+    return ret;
+}
+
+/*
+ * Reserve all the strips of two directories in order, and write their data
+ * in reverse order.  Reserved strips must be contiguous from the end of
+ * the file.
+ */
+static int test_strips(int bigtiff)
+{
+    uint8_t buf[ROWSPERSTRIP * WIDTH];
+    uint64_t offsets[NSTRIPS];
+    const uint64_t size = sizeof(buf);
+    int dir, i;
+    TIFF *tif = open_for_writing(bigtiff);
+    if (!tif)
+        return 1;
+    for (dir = 0; dir < 2; dir++)
+    {
+        set_fields(tif, 0);
+        for (i = 0; i < NSTRIPS; i++)
+        {
+            offsets[i] = TIFFReserveStrile(tif, (uint32_t)i, size);
+            if (offsets[i] == 0 ||
+                (i > 0 && offsets[i] != offsets[i - 1] + size))
+            {
+                fprintf(stderr, "Unexpected offset %" PRIu64 " for strip %d\n",
+                        offsets[i], i);
+                TIFFClose(tif);
+                return 1;
+            }
+        }
+        if (dir == 0 && offsets[0] != (bigtiff ? 16 : 8))
+        {
+            fprintf(stderr, "First strip not right after the header\n");
+            TIFFClose(tif);
+            return 1;
+        }
+        for (i = NSTRIPS - 1; i >= 0; i--)
+        {
+            fill(buf, 0, (uint32_t)i * ROWSPERSTRIP, WIDTH, ROWSPERSTRIP, dir);
+            if (TIFFWriteReservedStrile(tif, (uint32_t)i, buf,
+                                        (tmsize_t)size) != (tmsize_t)size)
+            {
+                fprintf(stderr, "Cannot write strip %d\n", i);
+                TIFFClose(tif);
+                return 1;
+            }
+        }
+        if (!TIFFWriteDirectory(tif))
+        {
+            fprintf(stderr, "Cannot write directory %d\n", dir);
+            TIFFClose(tif);
+            return 1;
+        }
+    }
+    TIFFClose(tif);
+    return check_file(2);
+}
+
+/*
+ * Reserve every other tile, write the remaining ones with
+ * TIFFWriteEncodedTile() in between, then fill the reserved ones.
+ */
+static int test_tiles(void)
+{
+    uint8_t buf[TILESIZE * TILESIZE];
+    const tmsize_t size = (tmsize_t)sizeof(buf);
+    uint32_t tile, ntiles;
+    TIFF *tif = open_for_writing(0);
+    if (!tif)
+        return 1;
+    set_fields(tif, 1);
+    ntiles = TIFFNumberOfTiles(tif);
+    for (tile = 0; tile < ntiles; tile++)
+    {
+        uint32_t tx = (tile % (WIDTH / TILESIZE)) * TILESIZE;
+        uint32_t ty = (tile / (WIDTH / TILESIZE)) * TILESIZE;
+        if (tile % 2 == 0)
+        {
+            if (TIFFReserveStrile(tif, tile, (uint64_t)size) == 0)
+            {
+                fprintf(stderr, "Cannot reserve tile %u\n", tile);
+                TIFFClose(tif);
+                return 1;
+            }
+            continue;
+        }
+        fill(buf, tx, ty, TILESIZE, TILESIZE, 0);
+        if (TIFFWriteEncodedTile(tif, tile, buf, size) != size)
+        {
+            fprintf(stderr, "Cannot write tile %u\n", tile);
+            TIFFClose(tif);
+            return 1;
+        }
+    }
+    for (tile = 0; tile < ntiles; tile += 2)
+    {
+        uint32_t tx = (tile % (WIDTH / TILESIZE)) * TILESIZE;
+        uint32_t ty = (tile / (WIDTH / TILESIZE)) * TILESIZE;
+        fill(buf, tx, ty, TILESIZE, TILESIZE, 0);
+        if (TIFFWriteReservedStrile(tif, tile, buf, size) != size)
+        {
+            fprintf(stderr, "Cannot write reserved tile %u\n", tile);
+            TIFFClose(tif);
+            return 1;
+        }
+    }
+    TIFFClose(tif);
+    return check_file(1);
+}
+
+/*
+ * A strip being written scanline by scanline ends at the end of the file.
+ * Reserving space for another strip meanwhile must not let the strip grow
+ * over it.
+ */
+static int test_reserve_during_scanlines(void)
+{
+    uint8_t buf[ROWSPERSTRIP * WIDTH];
+    uint32_t y;
+    TIFF *tif = open_for_writing(0);
+    if (!tif)
+        return 1;
+    set_fields(tif, 0);
+    /* Flush every scanline to the file */
+    if (!TIFFWriteBufferSetup(tif, NULL, WIDTH))
+    {
+        TIFFClose(tif);
+        return 1;
+    }
+    for (y = 0; y < HEIGHT - ROWSPERSTRIP; y++)
+    {
+        if (y == ROWSPERSTRIP / 2)
+        {
+            if (TIFFReserveStrile(tif, NSTRIPS - 1, sizeof(buf)) == 0)
+            {
+                fprintf(stderr, "Cannot reserve last strip\n");
+                TIFFClose(tif);
+                return 1;
+            }
+        }
+        fill(buf, 0, y, WIDTH, 1, 0);
+        if (TIFFWriteScanline(tif, buf, y, 0) < 0)
+        {
+            fprintf(stderr, "Cannot write line %u\n", y);
+            TIFFClose(tif);
+            return 1;
+        }
+    }
+    fill(buf, 0, HEIGHT - ROWSPERSTRIP, WIDTH, ROWSPERSTRIP, 0);
+    if (TIFFWriteReservedStrile(tif, NSTRIPS - 1, buf, sizeof(buf)) !=
+        (tmsize_t)sizeof(buf))
+    {
+        fprintf(stderr, "Cannot write last strip\n");
+        TIFFClose(tif);
+        return 1;
+    }
+    TIFFClose(tif);
+    return check_file(1);
+}
+
+static int test_errors(void)
+{
+    uint8_t buf[ROWSPERSTRIP * WIDTH];
+    int ret = 0;
+    TIFF *tif = open_for_writing(0);
+    if (!tif)
+        return 1;
+    set_fields(tif, 0);
+    memset(buf, 0, sizeof(buf));
+    nerrors = 0;
+    if (TIFFReserveStrile(tif, NSTRIPS, sizeof(buf)) != 0 ||
+        TIFFReserveStrile(tif, 0, 0) != 0 ||
+        TIFFReserveStrile(tif, 0, (uint64_t)1 << 32) != 0)
+    {
+        fprintf(stderr, "Invalid reservation accepted\n");
+        ret = 1;
+    }
+    if (TIFFWriteReservedStrile(tif, 0, buf, sizeof(buf)) != -1)
+    {
+        fprintf(stderr, "Write to unreserved strip accepted\n");
+        ret = 1;
+    }
+    if (TIFFReserveStrile(tif, 0, sizeof(buf)) == 0 ||
+        TIFFWriteReservedStrile(tif, 0, buf, sizeof(buf) - 1) != -1)
+    {
+        fprintf(stderr, "Write of wrong size accepted\n");
+        ret = 1;
+    }
+    if (nerrors != 5)
+    {
+        fprintf(stderr, "Expected 5 errors, got %d\n", nerrors);
+        ret = 1;
+    }
+    TIFFClose(tif);
+    return ret;
+}
+
+int main(void)
+{
+    int ret = 0;
+    ret |= test_strips(0);
+    ret |= test_strips(1);
+    ret |= test_tiles();
+    ret |= test_reserve_during_scanlines();
+    ret |= test_errors();
+    if (ret == 0)
+        unlink(filename);
+    return ret;
+}
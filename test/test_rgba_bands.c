@@ -0,0 +1,305 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFRGBABandIteratorBegin(): the bands of strip and tile images, of
+ * any height, orientation and format, must put together the raster read
+ * by TIFFReadRGBAImageFormat(), and no strip or tile may be read twice.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 203
+#define HEIGHT 157
+
+static const char filename[] = "test_rgba_bands.tif";
+
+typedef struct
+{
+    FILE *fp;
+    tmsize_t nread; /* bytes read since the last reset */
+} CountingFile;
+
+static tmsize_t count_read(thandle_t h, tdata_t buf, tmsize_t size)
+{
+    CountingFile *f = (CountingFile *)h;
+    size_t n = fread(buf, 1, (size_t)size, f->fp);
+    f->nread += (tmsize_t)n;
+    return (tmsize_t)n;
+}
+
+static tmsize_t count_write(thandle_t h, tdata_t buf, tmsize_t size)
+{
+    (void)h;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+static toff_t count_seek(thandle_t h, toff_t off, int whence)
+{
+    CountingFile *f = (CountingFile *)h;
+    if (fseek(f->fp, (long)off, whence) != 0)
+        return (toff_t)-1;
+    return (toff_t)ftell(f->fp);
+}
+
+static int count_close(thandle_t h)
+{
+    (void)h;
+    return 0;
+}
+
+static toff_t count_size(thandle_t h)
+{
+    CountingFile *f = (CountingFile *)h;
+    long pos = ftell(f->fp), size;
+    fseek(f->fp, 0, SEEK_END);
+    size = ftell(f->fp);
+    fseek(f->fp, pos, SEEK_SET);
+    return (toff_t)size;
+}
+
+static uint8_t sample_value(uint32_t x, uint32_t y, int s)
+{
+    return (uint8_t)(x * (uint32_t)(s + 3) + y * 7 + ((x ^ y) & 8) * 9);
+}
+
+/* 4 samples per pixel, the alpha being unassociated */
+static int write_image(TIFF *tif, int tiled, uint16_t planar,
+                       uint16_t orientation)
+{
+    uint32_t blockw = tiled ? 32 : WIDTH, blockh = tiled ? 16 : 3;
+    uint8_t *buf = (uint8_t *)malloc((size_t)blockw * blockh * 4);
+    uint16_t extra = EXTRASAMPLE_UNASSALPHA;
+    uint32_t bx, by, x, y;
+    int s, nplanes = planar == PLANARCONFIG_CONTIG ? 1 : 4, ok = 1;
+
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 4);
+    TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &extra);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, planar);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    TIFFSetField(tif, TIFFTAG_ORIENTATION, orientation);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+    if (tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, blockw);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, blockh);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, blockh);
+    for (s = 0; ok && s < nplanes; s++)
+    {
+        for (by = 0; ok && by < HEIGHT; by += blockh)
+        {
+            for (bx = 0; ok && bx < WIDTH; bx += blockw)
+            {
+                uint32_t spp = nplanes == 1 ? 4 : 1;
+                uint32_t rows = by + blockh <= HEIGHT ? blockh : HEIGHT - by;
+                uint32_t k;
+                for (y = 0; y < blockh; y++)
+                    for (x = 0; x < blockw; x++)
+                        for (k = 0; k < spp; k++)
+                            buf[(y * blockw + x) * spp + k] = sample_value(
+                                bx + x, by + y, nplanes == 1 ? (int)k : s);
+                if (tiled)
+                    ok = TIFFWriteTile(tif, buf, bx, by, 0, (uint16_t)s) >= 0;
+                else
+                    ok = TIFFWriteEncodedStrip(
+                             tif, TIFFComputeStrip(tif, by, (uint16_t)s), buf,
+                             (tmsize_t)rows * WIDTH * spp) >= 0;
+            }
+        }
+    }
+    free(buf);
+    return ok && TIFFWriteDirectory(tif);
+}
+
+static int read_bands(TIFF *tif, uint32_t bandheight, int orientation,
+                      int format, int nthreads, uint8_t *got, size_t ps)
+{
+    TIFFRGBABandIterator *it = TIFFRGBABandIteratorBegin(
+        tif, bandheight, orientation, format, 1, nthreads);
+    uint8_t *band = (uint8_t *)malloc((size_t)WIDTH * bandheight * ps);
+    uint32_t row = 0, nrows;
+    int ret;
+
+    if (it == NULL || band == NULL)
+    {
+        TIFFRGBABandIteratorEnd(it);
+        free(band);
+        return 0;
+    }
+    while ((ret = TIFFRGBABandIteratorNext(it, band, &nrows)) == 1)
+    {
+        if (nrows == 0 || nrows > bandheight || row + nrows > HEIGHT ||
+            (nrows < bandheight && row + nrows != HEIGHT))
+        {
+            ret = -1;
+            break;
+        }
+        memcpy(got + (size_t)row * WIDTH * ps, band,
+               (size_t)nrows * WIDTH * ps);
+        row += nrows;
+    }
+    /* the iterator stays at the end */
+    if (ret == 0 && (TIFFRGBABandIteratorNext(it, band, &nrows) != 0 ||
+                     nrows != 0))
+        ret = -1;
+    TIFFRGBABandIteratorEnd(it);
+    free(band);
+    return ret == 0 && row == HEIGHT;
+}
+
+static int test_file(int tiled, uint16_t planar, uint16_t orientation)
+{
+    static const uint32_t bandheights[] = {1, 2, 5, 16, 17, 40, HEIGHT,
+                                           HEIGHT + 10};
+    static const int orientations[] = {ORIENTATION_TOPLEFT,
+                                       ORIENTATION_BOTLEFT,
+                                       ORIENTATION_BOTRIGHT};
+    static const int formats[] = {
+        TIFFRGBA_FORMAT_ABGR32, TIFFRGBA_FORMAT_RGB8,
+        TIFFRGBA_FORMAT_RGBA16 | TIFFRGBA_FORMAT_UNASSOCIATED};
+    const size_t maxsize = (size_t)WIDTH * HEIGHT * 8;
+    uint8_t *got = (uint8_t *)malloc(maxsize);
+    uint8_t *expected = (uint8_t *)malloc(maxsize);
+    const char *layout = tiled ? "tiles" : "strips";
+    CountingFile cf = {NULL, 0};
+    TIFF *tif = TIFFOpen(filename, "w");
+    size_t b, o, f;
+    int ret = 1;
+
+    if (!tif || !write_image(tif, tiled, planar, orientation))
+    {
+        fprintf(stderr, "Cannot write %s\n", filename);
+        goto end;
+    }
+    TIFFClose(tif);
+    cf.fp = fopen(filename, "rb");
+    tif = cf.fp ? TIFFClientOpen(filename, "rm", (thandle_t)&cf, count_read,
+                                 count_write, count_seek, count_close,
+                                 count_size, NULL, NULL)
+                : NULL;
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot read %s\n", filename);
+        goto end;
+    }
+
+    for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+    {
+        size_t ps = (formats[f] & TIFFRGBA_FORMAT_MASK) ==
+                            TIFFRGBA_FORMAT_RGB8
+                        ? 3
+                    : (formats[f] & TIFFRGBA_FORMAT_MASK) ==
+                            TIFFRGBA_FORMAT_RGBA16
+                        ? 8
+                        : 4;
+        for (o = 0; o < sizeof(orientations) / sizeof(orientations[0]); o++)
+        {
+            tmsize_t fullread;
+            cf.nread = 0;
+            if (!TIFFReadRGBAImageFormat(tif, WIDTH, HEIGHT, expected,
+                                         orientations[o], formats[f], 1))
+            {
+                fprintf(stderr, "%s: cannot read the image\n", layout);
+                goto end;
+            }
+            fullread = cf.nread;
+            for (b = 0; b < sizeof(bandheights) / sizeof(bandheights[0]);
+                 b++)
+            {
+                int nthreads = b % 2 == 0 ? 1 : 3;
+                memset(got, 0, maxsize);
+                cf.nread = 0;
+                if (!read_bands(tif, bandheights[b], orientations[o],
+                                formats[f], nthreads, got, ps) ||
+                    memcmp(got, expected, (size_t)WIDTH * HEIGHT * ps) != 0)
+                {
+                    fprintf(stderr,
+                            "%s, planar %d, orientation %d: bands of %u "
+                            "rows in format 0x%x to orientation %d, %d "
+                            "threads: wrong raster\n",
+                            layout, planar, orientation, bandheights[b],
+                            formats[f], orientations[o], nthreads);
+                    goto end;
+                }
+                if (nthreads == 1 && cf.nread > fullread)
+                {
+                    fprintf(stderr,
+                            "%s, planar %d: bands of %u rows read %ld "
+                            "bytes, the image %ld\n",
+                            layout, planar, bandheights[b], (long)cf.nread,
+                            (long)fullread);
+                    goto end;
+                }
+            }
+        }
+    }
+
+    if (TIFFRGBABandIteratorBegin(tif, 0, ORIENTATION_TOPLEFT,
+                                  TIFFRGBA_FORMAT_ABGR32, 1, 1) != NULL ||
+        TIFFRGBABandIteratorBegin(
+            tif, 8, ORIENTATION_TOPLEFT,
+            TIFFRGBA_FORMAT_ABGR32 | TIFFRGBA_FORMAT_TRANSPOSE, 1,
+            1) != NULL)
+    {
+        fprintf(stderr, "%s: invalid iterator parameters accepted\n",
+                layout);
+        goto end;
+    }
+    ret = 0;
+end:
+    if (tif)
+        TIFFClose(tif);
+    if (cf.fp)
+        fclose(cf.fp);
+    free(got);
+    free(expected);
+    return ret;
+}
+
+int main(void)
+{
+    int ret = test_file(0, PLANARCONFIG_CONTIG, ORIENTATION_TOPLEFT);
+    ret += test_file(0, PLANARCONFIG_SEPARATE, ORIENTATION_BOTLEFT);
+    ret += test_file(1, PLANARCONFIG_CONTIG, ORIENTATION_BOTRIGHT);
+    ret += test_file(1, PLANARCONFIG_SEPARATE, ORIENTATION_TOPLEFT);
+    if (ret == 0)
+        unlink(filename);
+    return ret;
+}
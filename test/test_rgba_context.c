@@ -0,0 +1,349 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFRGBAImageBeginContext(): the pages of a file of bilevel,
+ * palette, YCbCr, CIE L*a*b* and RGB images, read in turn with one
+ * conversion context, must give the rasters read without it, the tables
+ * being reused between pages of the same photometric parameters only.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+/* large enough for the CIE L*a*b* images to be converted with a LUT */
+#define WIDTH 200
+#define HEIGHT 190
+
+static const char filename[] = "test_rgba_context.tif";
+
+enum
+{
+    PAGE_BILEVEL,
+    PAGE_GREY4,
+    PAGE_PALETTE,
+    PAGE_PALETTE_OTHER, /* same as PAGE_PALETTE with another colormap */
+    PAGE_YCBCR,
+    PAGE_YCBCR_OTHER, /* other ReferenceBlackWhite */
+    PAGE_YCBCR_BAD,   /* invalid YCbCrCoefficients */
+    PAGE_CIELAB,
+    PAGE_CIELAB_OTHER, /* other WhitePoint */
+    PAGE_RGBA16
+};
+
+/* page types of the file, and whether the tables of a page are those of the
+ * previous one */
+static const struct
+{
+    int type;
+    int reused;
+} pages[] = {{PAGE_BILEVEL, 0},       {PAGE_BILEVEL, 1},
+             {PAGE_PALETTE, 0},       {PAGE_PALETTE, 1},
+             {PAGE_PALETTE_OTHER, 0}, {PAGE_YCBCR, 0},
+             {PAGE_YCBCR, 1},         {PAGE_YCBCR_BAD, 0},
+             {PAGE_YCBCR, 0},         {PAGE_YCBCR_OTHER, 0},
+             {PAGE_CIELAB, 0},        {PAGE_CIELAB, 1},
+             {PAGE_CIELAB_OTHER, 0},  {PAGE_GREY4, 0},
+             {PAGE_RGBA16, 0},        {PAGE_RGBA16, 1},
+             {PAGE_BILEVEL, 0}};
+
+#define NPAGES (sizeof(pages) / sizeof(pages[0]))
+
+static int write_page(TIFF *tif, int type)
+{
+    uint16_t bps = 8, spp = 3, photometric = PHOTOMETRIC_RGB;
+    uint16_t cmap[3][256];
+    tmsize_t linesize;
+    uint8_t *line;
+    uint32_t x, y;
+    int i, ok = 1;
+
+    switch (type)
+    {
+        case PAGE_BILEVEL:
+            bps = 1;
+            spp = 1;
+            photometric = PHOTOMETRIC_MINISWHITE;
+            break;
+        case PAGE_GREY4:
+            bps = 4;
+            spp = 1;
+            photometric = PHOTOMETRIC_MINISBLACK;
+            break;
+        case PAGE_PALETTE:
+        case PAGE_PALETTE_OTHER:
+            spp = 1;
+            photometric = PHOTOMETRIC_PALETTE;
+            for (i = 0; i < 256; i++)
+            {
+                cmap[0][i] = (uint16_t)(i * 257);
+                cmap[1][i] = (uint16_t)((255 - i) * 257);
+                cmap[2][i] = (uint16_t)(type == PAGE_PALETTE
+                                            ? (i * 7 % 256) * 257
+                                            : (i * 13 % 256) * 257);
+            }
+            break;
+        case PAGE_YCBCR:
+        case PAGE_YCBCR_OTHER:
+        case PAGE_YCBCR_BAD:
+            photometric = PHOTOMETRIC_YCBCR;
+            break;
+        case PAGE_CIELAB:
+        case PAGE_CIELAB_OTHER:
+            photometric = PHOTOMETRIC_CIELAB;
+            break;
+        case PAGE_RGBA16:
+            bps = 16;
+            spp = 4;
+            break;
+    }
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bps);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, spp);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, photometric);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 16);
+    TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+    if (photometric == PHOTOMETRIC_PALETTE)
+        TIFFSetField(tif, TIFFTAG_COLORMAP, cmap[0], cmap[1], cmap[2]);
+    if (photometric == PHOTOMETRIC_YCBCR)
+    {
+        float luma[3] = {0.299F, 0.587F, 0.114F};
+        float refbw[6] = {0.0F, 255.0F, 128.0F, 255.0F, 128.0F, 255.0F};
+        if (type == PAGE_YCBCR_OTHER)
+        {
+            refbw[0] = 16.0F;
+            refbw[1] = 235.0F;
+        }
+        if (type == PAGE_YCBCR_BAD)
+            luma[1] = 0.0F;
+        TIFFSetField(tif, TIFFTAG_YCBCRSUBSAMPLING, 1, 1);
+        TIFFSetField(tif, TIFFTAG_YCBCRCOEFFICIENTS, luma);
+        TIFFSetField(tif, TIFFTAG_REFERENCEBLACKWHITE, refbw);
+    }
+    if (type == PAGE_CIELAB_OTHER)
+    {
+        float whitepoint[2] = {0.3457F, 0.3585F}; /* D50 */
+        TIFFSetField(tif, TIFFTAG_WHITEPOINT, whitepoint);
+    }
+    if (type == PAGE_RGBA16)
+    {
+        uint16_t extra = EXTRASAMPLE_UNASSALPHA;
+        TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &extra);
+    }
+
+    linesize = TIFFScanlineSize(tif);
+    line = (uint8_t *)malloc((size_t)linesize);
+    for (y = 0; ok && y < HEIGHT; y++)
+    {
+        for (x = 0; x < (uint32_t)linesize; x++)
+            line[x] = (uint8_t)(x * 5 + y * 3 + ((x ^ y) & 16) * 3);
+        ok = TIFFWriteScanline(tif, line, y, 0) >= 0;
+    }
+    free(line);
+    return ok && TIFFWriteDirectory(tif);
+}
+
+/*
+ * Tables of the context, after the image they were used for: a byte of
+ * each one is flipped, which the next image sees if it reuses them, and
+ * which it restores before converting.
+ */
+typedef struct
+{
+    unsigned char *table[5];
+    unsigned char byte[5];
+} Marks;
+
+/* Read the current page with or without ctx; returns 0 if it cannot be
+ * begun, -1 if it cannot be read, and -2 if it does not reuse the tables
+ * of the previous one while it should */
+static int read_page(TIFF *tif, TIFFRGBAContext *ctx, uint32_t *raster,
+                     Marks *marks, int reused)
+{
+    char emsg[1024];
+    TIFFRGBAImage img;
+    unsigned char *tables[5];
+    int k, ok = 1;
+
+    if (ctx == NULL)
+    {
+        if (!TIFFRGBAImageBegin(&img, tif, 1, emsg))
+            return 0;
+        ok = TIFFRGBAImageGet(&img, raster, WIDTH, HEIGHT) ? 1 : -1;
+        TIFFRGBAImageEnd(&img);
+        return ok;
+    }
+
+    if (!TIFFRGBAImageBeginContext(&img, tif, 1, TIFFRGBA_FORMAT_ABGR32, ctx,
+                                   emsg))
+    {
+        memset(marks, 0, sizeof(*marks));
+        return 0;
+    }
+    /* the tables that depend on the photometric parameters, and the alpha
+     * table lent to all images */
+    tables[0] = (unsigned char *)img.BWmap;
+    tables[1] = (unsigned char *)img.PALmap;
+    tables[2] = (unsigned char *)img.ycbcr;
+    tables[3] = (unsigned char *)img.cielab;
+    tables[4] = img.UaToAa;
+    for (k = 0; k < 5; k++)
+    {
+        if (marks->table[k] == NULL || (k < 4 && !reused))
+            continue;
+        if (tables[k] != marks->table[k] ||
+            tables[k][0] != (unsigned char)~marks->byte[k])
+            ok = -2;
+        else
+            tables[k][0] = marks->byte[k];
+    }
+    if (ok == 1 && !TIFFRGBAImageGet(&img, raster, WIDTH, HEIGHT))
+        ok = -1;
+    TIFFRGBAImageEnd(&img);
+    for (k = 0; k < 5; k++)
+    {
+        marks->table[k] = tables[k];
+        if (tables[k] != NULL)
+        {
+            marks->byte[k] = tables[k][0];
+            tables[k][0] = (unsigned char)~tables[k][0];
+        }
+    }
+    return ok;
+}
+
+int main(void)
+{
+    uint32_t *expected = (uint32_t *)malloc(WIDTH * HEIGHT * 4);
+    uint32_t *got = (uint32_t *)malloc(WIDTH * HEIGHT * 4);
+    TIFFRGBAContext *ctx = TIFFRGBAContextAlloc();
+    Marks marks;
+    TIFF *tif = TIFFOpen(filename, "w");
+    size_t i;
+    int pass, ret = 1;
+
+    memset(&marks, 0, sizeof(marks));
+    for (i = 0; tif && i < NPAGES; i++)
+    {
+        if (!write_page(tif, pages[i].type))
+            break;
+    }
+    if (!tif || i < NPAGES || ctx == NULL)
+    {
+        fprintf(stderr, "Cannot write %s\n", filename);
+        goto end;
+    }
+    TIFFClose(tif);
+    tif = NULL;
+
+    /* the second pass goes on with the tables of the first file */
+    for (pass = 0; pass < 2; pass++)
+    {
+        tif = TIFFOpen(filename, "r");
+        if (!tif)
+        {
+            fprintf(stderr, "Cannot read %s\n", filename);
+            goto end;
+        }
+        for (i = 0; i < NPAGES; i++)
+        {
+            /* the last page is of the same type as the first one */
+            int reused = pages[i].reused || (pass > 0 && i == 0);
+            int ok, okctx;
+
+            if (i > 0 && !TIFFReadDirectory(tif))
+            {
+                fprintf(stderr, "Cannot read page %u\n", (unsigned)i);
+                goto end;
+            }
+            ok = read_page(tif, NULL, expected, NULL, 0);
+            memset(got, 0, WIDTH * HEIGHT * 4);
+            okctx = read_page(tif, ctx, got, &marks, reused);
+            if (okctx == -2)
+            {
+                fprintf(stderr, "Pass %d, page %u: tables not reused\n",
+                        pass, (unsigned)i);
+                goto end;
+            }
+            if (okctx != ok ||
+                (ok == 1 && memcmp(got, expected, WIDTH * HEIGHT * 4) != 0))
+            {
+                fprintf(stderr, "Pass %d, page %u: wrong raster\n", pass,
+                        (unsigned)i);
+                goto end;
+            }
+            if ((ok == 1) != (pages[i].type != PAGE_YCBCR_BAD))
+            {
+                fprintf(stderr, "Pass %d, page %u: unexpected result %d\n",
+                        pass, (unsigned)i, ok);
+                goto end;
+            }
+        }
+        TIFFClose(tif);
+        tif = NULL;
+    }
+
+    /* a context in use by an image is not used by another one */
+    tif = TIFFOpen(filename, "r");
+    if (tif)
+    {
+        char emsg[1024];
+        TIFFRGBAImage img1, img2;
+        if (!TIFFRGBAImageBeginContext(&img1, tif, 1, TIFFRGBA_FORMAT_ABGR32,
+                                       ctx, emsg) ||
+            !TIFFRGBAImageBeginContext(&img2, tif, 1, TIFFRGBA_FORMAT_ABGR32,
+                                       ctx, emsg) ||
+            img1.BWmap == NULL || img2.BWmap == img1.BWmap ||
+            img2.context != NULL || !TIFFRGBAImageGet(&img2, got, WIDTH,
+                                                      HEIGHT) ||
+            !TIFFReadRGBAImage(tif, WIDTH, HEIGHT, expected, 1) ||
+            memcmp(got, expected, WIDTH * HEIGHT * 4) != 0)
+        {
+            fprintf(stderr, "Context shared by two images\n");
+            goto end;
+        }
+        TIFFRGBAImageEnd(&img2);
+        TIFFRGBAImageEnd(&img1);
+    }
+    ret = 0;
+end:
+    if (tif)
+        TIFFClose(tif);
+    TIFFRGBAContextFree(ctx);
+    free(expected);
+    free(got);
+    if (ret == 0)
+        unlink(filename);
+    return ret;
+}
@@ -0,0 +1,753 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFRGBAImageBeginFormat() and TIFFReadRGBAImageFormat(): the
+ * raster read in each output pixel format, with and without unassociated
+ * alpha, must match the packed ABGR raster of TIFFReadRGBAImageOriented()
+ * for RGB(A) images converted by the specialized routines and for other
+ * images converted from the packed ABGR routines.
+ *
+ * Also test TIFFRGBA_FORMAT_RGBAF32 on greyscale and RGB images of integer,
+ * half and single precision floating point samples: the color samples
+ * must be mapped from their range (that of the SMinSampleValue and
+ * SMaxSampleValue tags if set, or of TIFFRGBAImage) to [0, 1] and the
+ * alpha ones from that of their type, for any part of the image.
+ */
+
+#include "tif_config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 67
+#define HEIGHT 45
+
+static const char filename[] = "test_rgba_formats.tif";
+
+typedef struct
+{
+    const char *name;
+    uint16_t photometric;
+    uint16_t sampleformat;
+    uint16_t bitspersample;
+    uint16_t samplesperpixel; /* including the alpha sample */
+    uint16_t extrasample;     /* 0 if no alpha */
+    uint16_t planarconfig;
+    int tiled;
+    /* the default raster has the alpha of extrasample premultiplied */
+    int premultiplied;
+    double smin, smax; /* SMinSampleValue and SMaxSampleValue if different */
+} TestCase;
+
+/* Images read in every format */
+static const TestCase cases[] = {
+    {"RGB 8-bit strips", PHOTOMETRIC_RGB, SAMPLEFORMAT_UINT, 8, 3, 0,
+     PLANARCONFIG_CONTIG, 0, 0, 0, 0},
+    {"RGBA 8-bit associated tiles", PHOTOMETRIC_RGB, SAMPLEFORMAT_UINT, 8, 4,
+     EXTRASAMPLE_ASSOCALPHA, PLANARCONFIG_CONTIG, 1, 1, 0, 0},
+    {"RGBA 8-bit unassociated strips", PHOTOMETRIC_RGB, SAMPLEFORMAT_UINT, 8,
+     4, EXTRASAMPLE_UNASSALPHA, PLANARCONFIG_CONTIG, 0, 1, 0, 0},
+    {"RGB 16-bit tiles", PHOTOMETRIC_RGB, SAMPLEFORMAT_UINT, 16, 3, 0,
+     PLANARCONFIG_CONTIG, 1, 0, 0, 0},
+    {"RGBA 16-bit associated strips", PHOTOMETRIC_RGB, SAMPLEFORMAT_UINT, 16,
+     4, EXTRASAMPLE_ASSOCALPHA, PLANARCONFIG_CONTIG, 0, 1, 0, 0},
+    {"RGBA 16-bit unassociated tiles", PHOTOMETRIC_RGB, SAMPLEFORMAT_UINT, 16,
+     4, EXTRASAMPLE_UNASSALPHA, PLANARCONFIG_CONTIG, 1, 1, 0, 0},
+    {"RGB 8-bit separate tiles", PHOTOMETRIC_RGB, SAMPLEFORMAT_UINT, 8, 3, 0,
+     PLANARCONFIG_SEPARATE, 1, 0, 0, 0},
+    {"RGBA 8-bit associated separate strips", PHOTOMETRIC_RGB,
+     SAMPLEFORMAT_UINT, 8, 4, EXTRASAMPLE_ASSOCALPHA, PLANARCONFIG_SEPARATE,
+     0, 1, 0, 0},
+    {"RGBA 8-bit unassociated separate tiles", PHOTOMETRIC_RGB,
+     SAMPLEFORMAT_UINT, 8, 4, EXTRASAMPLE_UNASSALPHA, PLANARCONFIG_SEPARATE,
+     1, 1, 0, 0},
+    {"RGB 16-bit separate strips", PHOTOMETRIC_RGB, SAMPLEFORMAT_UINT, 16, 3,
+     0, PLANARCONFIG_SEPARATE, 0, 0, 0, 0},
+    {"RGBA 16-bit unassociated separate strips", PHOTOMETRIC_RGB,
+     SAMPLEFORMAT_UINT, 16, 4, EXTRASAMPLE_UNASSALPHA, PLANARCONFIG_SEPARATE,
+     0, 1, 0, 0},
+    {"palette 8-bit strips", PHOTOMETRIC_PALETTE, SAMPLEFORMAT_UINT, 8, 1, 0,
+     PLANARCONFIG_CONTIG, 0, 0, 0, 0},
+    {"grey 4-bit tiles", PHOTOMETRIC_MINISBLACK, SAMPLEFORMAT_UINT, 4, 1, 0,
+     PLANARCONFIG_CONTIG, 1, 0, 0, 0},
+    {"grey 16-bit tiles", PHOTOMETRIC_MINISBLACK, SAMPLEFORMAT_UINT, 16, 1, 0,
+     PLANARCONFIG_CONTIG, 1, 0, 0, 0},
+    {"grey+alpha 8-bit associated strips", PHOTOMETRIC_MINISBLACK,
+     SAMPLEFORMAT_UINT, 8, 2, EXTRASAMPLE_ASSOCALPHA, PLANARCONFIG_CONTIG, 0,
+     1, 0, 0},
+    {"grey+alpha 8-bit unassociated tiles", PHOTOMETRIC_MINISBLACK,
+     SAMPLEFORMAT_UINT, 8, 2, EXTRASAMPLE_UNASSALPHA, PLANARCONFIG_CONTIG, 1,
+     0, 0, 0},
+};
+
+/* Images read in TIFFRGBA_FORMAT_RGBAF32, checked against their samples */
+static const TestCase float_cases[] = {
+    {"RGB uint8 strips", PHOTOMETRIC_RGB, SAMPLEFORMAT_UINT, 8, 3, 0,
+     PLANARCONFIG_CONTIG, 0, 0, 0, 0},
+    {"grey uint8 min-is-white tiles", PHOTOMETRIC_MINISWHITE,
+     SAMPLEFORMAT_UINT, 8, 1, 0, PLANARCONFIG_CONTIG, 1, 0, 0, 0},
+    {"RGB uint16 strips", PHOTOMETRIC_RGB, SAMPLEFORMAT_UINT, 16, 3, 0,
+     PLANARCONFIG_CONTIG, 0, 0, 0, 0},
+    {"RGBA uint16 unassociated separate tiles", PHOTOMETRIC_RGB,
+     SAMPLEFORMAT_UINT, 16, 4, EXTRASAMPLE_UNASSALPHA, PLANARCONFIG_SEPARATE,
+     1, 0, 0, 0},
+    {"grey int16 tiles", PHOTOMETRIC_MINISBLACK, SAMPLEFORMAT_INT, 16, 1, 0,
+     PLANARCONFIG_CONTIG, 1, 0, 0, 0},
+    {"grey int16 strips with sample range", PHOTOMETRIC_MINISBLACK,
+     SAMPLEFORMAT_INT, 16, 1, 0, PLANARCONFIG_CONTIG, 0, 0, -1000, 3000},
+    {"RGBA half unassociated strips", PHOTOMETRIC_RGB, SAMPLEFORMAT_IEEEFP,
+     16, 4, EXTRASAMPLE_UNASSALPHA, PLANARCONFIG_CONTIG, 0, 0, 0, 0},
+    {"RGB half separate strips", PHOTOMETRIC_RGB, SAMPLEFORMAT_IEEEFP, 16, 3,
+     0, PLANARCONFIG_SEPARATE, 0, 0, 0, 0},
+    {"grey+alpha float associated strips", PHOTOMETRIC_MINISBLACK,
+     SAMPLEFORMAT_IEEEFP, 32, 2, EXTRASAMPLE_ASSOCALPHA, PLANARCONFIG_CONTIG,
+     0, 0, 0, 0},
+    {"RGB float tiles with sample range", PHOTOMETRIC_RGB,
+     SAMPLEFORMAT_IEEEFP, 32, 3, 0, PLANARCONFIG_CONTIG, 1, 0, -2, 6},
+    {"RGBA float associated separate tiles", PHOTOMETRIC_RGB,
+     SAMPLEFORMAT_IEEEFP, 32, 4, EXTRASAMPLE_ASSOCALPHA,
+     PLANARCONFIG_SEPARATE, 1, 0, 0, 0},
+};
+
+static const int formats[] = {TIFFRGBA_FORMAT_ABGR32, TIFFRGBA_FORMAT_RGBA8,
+                              TIFFRGBA_FORMAT_BGRA8, TIFFRGBA_FORMAT_RGB8,
+                              TIFFRGBA_FORMAT_RGBA16,
+                              TIFFRGBA_FORMAT_RGBAF32};
+
+/* Sample s of pixel (x, y) in 16 bits, not above the alpha sample */
+static uint16_t sample_value(const TestCase *tc, uint32_t x, uint32_t y,
+                             int s)
+{
+    uint32_t a = (x * 2039 + y * 4093 + 17) & 0xffff;
+    uint32_t v;
+
+    if (tc->extrasample != 0 && s == tc->samplesperpixel - 1)
+        return (uint16_t)a;
+    v = (x * (uint32_t)(s * 1031 + 977) + y * 3011 + (x ^ y) * 131) & 0xffff;
+    if (tc->extrasample == EXTRASAMPLE_ASSOCALPHA)
+    {
+        /* keep premultiplied values valid, also once reduced to 8 bits */
+        v = v * (a >> 8) / 255;
+        v &= 0xff00;
+    }
+    return (uint16_t)v;
+}
+
+/* Half precision bits of k / 8, for k in [0, 8] */
+static uint16_t half_eighths(uint32_t k)
+{
+    int e;
+    double m;
+
+    if (k == 0)
+        return 0;
+    m = frexp(k / 8.0, &e);
+    return (uint16_t)(((e - 1 + 15) << 10) | (int)((m * 2 - 1) * 1024));
+}
+
+static double half_value(uint16_t h)
+{
+    int e = (h >> 10) & 0x1f;
+    int m = h & 0x3ff;
+    double v;
+
+    if (e == 0x1f)
+        v = HUGE_VAL; /* no NaNs in the images */
+    else if (e == 0)
+        v = ldexp(m, -24);
+    else
+        v = ldexp(m + 1024, e - 25);
+    return (h & 0x8000) ? -v : v;
+}
+
+static int is_alpha(const TestCase *tc, int s)
+{
+    return tc->extrasample != 0 && s == tc->samplesperpixel - 1;
+}
+
+/* Bits of sample s of pixel (x, y) */
+static uint32_t sample_bits(const TestCase *tc, uint32_t x, uint32_t y,
+                            int s)
+{
+    uint32_t v = x * 2039 + y * 4093 + (uint32_t)s * 1031 + (x ^ y) * 131;
+    uint32_t k = (x + 2 * y) % 9; /* alpha of floating point samples */
+    float f;
+
+    if (tc->sampleformat != SAMPLEFORMAT_IEEEFP)
+        return (uint32_t)sample_value(tc, x, y, s) >>
+               (16 - tc->bitspersample);
+    if (tc->bitspersample == 16)
+    {
+        if (is_alpha(tc, s))
+            return half_eighths(k);
+        if (x == 1 && y == 2 && s == 0)
+            return 0x7c00; /* infinity */
+        v &= 0xffff;
+        /* no other infinities or NaNs; subnormals are kept */
+        return (v & 0x7c00) == 0x7c00 ? v ^ 0x4000 : v;
+    }
+    if (is_alpha(tc, s))
+        f = (float)k / 8;
+    else
+        f = ((float)(v % 20011) - 5000.0F) / 2048.0F;
+    memcpy(&v, &f, sizeof(v));
+    return v;
+}
+
+/* Value of the sample of bits v */
+static double sample_of_bits(const TestCase *tc, uint32_t v)
+{
+    float f;
+
+    switch (tc->sampleformat)
+    {
+        case SAMPLEFORMAT_IEEEFP:
+            if (tc->bitspersample == 16)
+                return half_value((uint16_t)v);
+            memcpy(&f, &v, sizeof(f));
+            return f;
+        case SAMPLEFORMAT_INT:
+            return tc->bitspersample == 8 ? (int8_t)v : (int16_t)v;
+        default:
+            return v;
+    }
+}
+
+static int write_image(const TestCase *tc)
+{
+    TIFF *tif = TIFFOpen(filename, "w");
+    uint32_t blockw = tc->tiled ? 16 : WIDTH, blockh = tc->tiled ? 16 : 7;
+    int nplanes = tc->planarconfig == PLANARCONFIG_SEPARATE
+                      ? tc->samplesperpixel
+                      : 1;
+    int spb = nplanes > 1 ? 1 : tc->samplesperpixel; /* samples per block */
+    size_t rowsize =
+        ((size_t)blockw * (size_t)spb * tc->bitspersample + 7) / 8;
+    uint8_t *buf = (uint8_t *)calloc(rowsize * blockh, 1);
+    uint32_t bx, by, x, y;
+    int p, s, ok = tif != NULL && buf != NULL;
+
+    if (!ok)
+    {
+        fprintf(stderr, "Cannot create %s.\n", filename);
+        if (tif)
+            TIFFClose(tif);
+        free(buf);
+        return 0;
+    }
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, tc->bitspersample);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, tc->samplesperpixel);
+    TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, tc->sampleformat);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, tc->planarconfig);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, tc->photometric);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+    if (tc->extrasample != 0)
+        TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &tc->extrasample);
+    if (tc->photometric == PHOTOMETRIC_PALETTE)
+    {
+        uint16_t map[3][256];
+        int i;
+        for (i = 0; i < 256; i++)
+        {
+            map[0][i] = (uint16_t)(i * 257);
+            map[1][i] = (uint16_t)((255 - i) * 257);
+            map[2][i] = (uint16_t)(((i * 37) & 0xff) * 257);
+        }
+        TIFFSetField(tif, TIFFTAG_COLORMAP, map[0], map[1], map[2]);
+    }
+    if (tc->smin != tc->smax)
+    {
+        TIFFSetField(tif, TIFFTAG_SMINSAMPLEVALUE, tc->smin);
+        TIFFSetField(tif, TIFFTAG_SMAXSAMPLEVALUE, tc->smax);
+    }
+    if (tc->tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, blockw);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, blockh);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, blockh);
+    for (p = 0; ok && p < nplanes; p++)
+    {
+        for (by = 0; ok && by < HEIGHT; by += blockh)
+        {
+            for (bx = 0; ok && bx < WIDTH; bx += blockw)
+            {
+                memset(buf, 0, rowsize * blockh);
+                for (y = 0; y < blockh; y++)
+                {
+                    uint8_t *row = buf + y * rowsize;
+                    for (x = 0; x < blockw; x++)
+                    {
+                        for (s = 0; s < spb; s++)
+                        {
+                            uint32_t v = sample_bits(tc, bx + x, by + y,
+                                                     nplanes > 1 ? p : s);
+                            size_t i = (size_t)x * spb + s;
+                            if (tc->bitspersample == 32)
+                                ((uint32_t *)row)[i] = v;
+                            else if (tc->bitspersample == 16)
+                                ((uint16_t *)row)[i] = (uint16_t)v;
+                            else if (tc->bitspersample == 8)
+                                row[i] = (uint8_t)v;
+                            else
+                                row[i / 2] |=
+                                    (uint8_t)(v << (i % 2 ? 0 : 4));
+                        }
+                    }
+                }
+                if (tc->tiled)
+                    ok = TIFFWriteTile(tif, buf, bx, by, 0, (uint16_t)p) >= 0;
+                else
+                {
+                    uint32_t rows =
+                        by + blockh <= HEIGHT ? blockh : HEIGHT - by;
+                    ok = TIFFWriteEncodedStrip(
+                             tif, TIFFComputeStrip(tif, by, (uint16_t)p), buf,
+                             (tmsize_t)(rows * rowsize)) >= 0;
+                }
+            }
+        }
+    }
+    free(buf);
+    TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "Cannot write %s.\n", filename);
+    return ok;
+}
+
+/*
+ * Check the pixel i of the raster in format against the packed ABGR pixel
+ * ref: the 8 bits of RGBA16 samples of 8-bit images are repeated, those of
+ * 16-bit images are rounded, float samples are scaled to 8 bits and rounded,
+ * and unassociated alpha is premultiplied again.
+ */
+static int check_pixel(const TestCase *tc, int format, const void *raster,
+                       size_t i, uint32_t ref)
+{
+    const uint8_t *p8 = (const uint8_t *)raster;
+    const uint16_t *p16 = (const uint16_t *)raster;
+    uint32_t c[4], e[4];
+    int k, tol = 0;
+
+    e[0] = TIFFGetR(ref);
+    e[1] = TIFFGetG(ref);
+    e[2] = TIFFGetB(ref);
+    e[3] = TIFFGetA(ref);
+    switch (format & TIFFRGBA_FORMAT_MASK)
+    {
+        case TIFFRGBA_FORMAT_ABGR32:
+        {
+            uint32_t v = ((const uint32_t *)raster)[i];
+            c[0] = TIFFGetR(v);
+            c[1] = TIFFGetG(v);
+            c[2] = TIFFGetB(v);
+            c[3] = TIFFGetA(v);
+            break;
+        }
+        case TIFFRGBA_FORMAT_RGBA8:
+            for (k = 0; k < 4; k++)
+                c[k] = p8[i * 4 + k];
+            break;
+        case TIFFRGBA_FORMAT_BGRA8:
+            c[0] = p8[i * 4 + 2];
+            c[1] = p8[i * 4 + 1];
+            c[2] = p8[i * 4];
+            c[3] = p8[i * 4 + 3];
+            break;
+        case TIFFRGBA_FORMAT_RGB8:
+            for (k = 0; k < 3; k++)
+                c[k] = p8[i * 3 + k];
+            c[3] = e[3];
+            break;
+        case TIFFRGBA_FORMAT_RGBAF32:
+            /* premultiplied in float, or exact 16-bit samples */
+            for (k = 0; k < 4; k++)
+                c[k] = (uint32_t)(((const float *)raster)[i * 4 + k] * 255 +
+                                  0.5F);
+            tol = 1;
+            /* unlike in the packed ABGR raster, unassociated alpha of
+             * grey images is premultiplied */
+            if (tc->extrasample == EXTRASAMPLE_UNASSALPHA &&
+                !tc->premultiplied && !(format & TIFFRGBA_FORMAT_UNASSOCIATED))
+            {
+                for (k = 0; k < 3; k++)
+                    e[k] = (e[k] * e[3] + 127) / 255;
+            }
+            break;
+        default:
+            for (k = 0; k < 4; k++)
+            {
+                uint32_t v = p16[i * 4 + k];
+                if (tc->bitspersample == 16 &&
+                    tc->photometric == PHOTOMETRIC_RGB)
+                {
+                    c[k] = (v + 128) / 257;
+                    tol = tc->extrasample == EXTRASAMPLE_UNASSALPHA;
+                }
+                else if (v % 257 != 0)
+                {
+                    fprintf(stderr, "16-bit sample %" PRIu32
+                                    " is not an 8-bit one.\n",
+                            v);
+                    return 0;
+                }
+                else
+                    c[k] = v / 257;
+            }
+            break;
+    }
+    if ((format & TIFFRGBA_FORMAT_UNASSOCIATED) && tc->premultiplied)
+    {
+        for (k = 0; k < 3; k++)
+            c[k] = (c[k] * c[3] + 127) / 255;
+    }
+    for (k = 0; k < 4; k++)
+    {
+        int d = (int)c[k] - (int)e[k];
+        if (d > tol || d < -tol)
+        {
+            fprintf(stderr,
+                    "%s, format 0x%x: pixel %u, sample %d is %" PRIu32
+                    " instead of %" PRIu32 ".\n",
+                    tc->name, (unsigned int)format, (unsigned int)i, k, c[k],
+                    e[k]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int test_case(const TestCase *tc)
+{
+    /* rasters larger than the image, and of its size */
+    static const uint32_t sizes[2][2] = {{WIDTH + 3, HEIGHT + 2},
+                                         {WIDTH, HEIGHT}};
+    static const int orientations[] = {ORIENTATION_TOPLEFT,
+                                       ORIENTATION_BOTLEFT,
+                                       ORIENTATION_TOPRIGHT};
+    size_t maxpixels = (size_t)(WIDTH + 3) * (HEIGHT + 2);
+    uint32_t *ref = (uint32_t *)malloc(maxpixels * sizeof(uint32_t));
+    uint16_t *raster = (uint16_t *)malloc(maxpixels * 16);
+    uint16_t *other = (uint16_t *)malloc(maxpixels * 16);
+    TIFF *tif;
+    int ok = 1;
+    size_t f, o, z, i, u;
+
+    if (!write_image(tc) || ref == NULL || raster == NULL || other == NULL)
+    {
+        free(ref);
+        free(raster);
+        free(other);
+        return 0;
+    }
+    tif = TIFFOpen(filename, "r");
+    if (tif == NULL)
+    {
+        fprintf(stderr, "Cannot open %s.\n", filename);
+        ok = 0;
+    }
+    for (z = 0; ok && z < 2; z++)
+    {
+        uint32_t w = sizes[z][0], h = sizes[z][1];
+        size_t n = (size_t)w * h;
+        for (o = 0; ok && o < sizeof(orientations) / sizeof(int); o++)
+        {
+            memset(ref, 0, n * sizeof(uint32_t));
+            if (!TIFFReadRGBAImageOriented(tif, w, h, ref, orientations[o],
+                                           1))
+            {
+                fprintf(stderr, "%s: TIFFReadRGBAImageOriented failed.\n",
+                        tc->name);
+                ok = 0;
+                break;
+            }
+            for (f = 0; ok && f < sizeof(formats) / sizeof(int); f++)
+            {
+                for (u = 0; ok && u < 2; u++)
+                {
+                    int format =
+                        formats[f] | (u ? TIFFRGBA_FORMAT_UNASSOCIATED : 0);
+                    memset(raster, 0, n * 16);
+                    if (!TIFFReadRGBAImageFormat(tif, w, h, raster,
+                                                 orientations[o], format, 1))
+                    {
+                        fprintf(stderr,
+                                "%s: TIFFReadRGBAImageFormat(0x%x) failed.\n",
+                                tc->name, (unsigned int)format);
+                        ok = 0;
+                        break;
+                    }
+                    for (i = 0; ok && i < n; i++)
+                        ok = check_pixel(tc, format, raster, i, ref[i]);
+                }
+            }
+        }
+    }
+
+    /* Parallel decoding gives the same raster */
+    for (f = 0; ok && f < sizeof(formats) / sizeof(int); f++)
+    {
+        char emsg[1024];
+        TIFFRGBAImage img;
+        size_t n = (size_t)WIDTH * HEIGHT;
+        int format = formats[f] | TIFFRGBA_FORMAT_UNASSOCIATED;
+
+        memset(raster, 0, n * 16);
+        memset(other, 0, n * 16);
+        if (!TIFFRGBAImageBeginFormat(&img, tif, 1, format, emsg))
+        {
+            fprintf(stderr, "%s: %s\n", tc->name, emsg);
+            ok = 0;
+            break;
+        }
+        img.req_orientation = ORIENTATION_TOPLEFT;
+        if (!TIFFRGBAImageGet(&img, (uint32_t *)raster, WIDTH, HEIGHT) ||
+            !TIFFRGBAImageGetParallel(&img, (uint32_t *)other, WIDTH, HEIGHT,
+                                      3) ||
+            memcmp(raster, other, n * 16) != 0)
+        {
+            fprintf(stderr, "%s, format 0x%x: parallel read differs.\n",
+                    tc->name, (unsigned int)format);
+            ok = 0;
+        }
+        TIFFRGBAImageEnd(&img);
+    }
+    if (tif)
+        TIFFClose(tif);
+    free(ref);
+    free(raster);
+    free(other);
+    return ok;
+}
+
+/*
+ * Check the RGBA floats of pixel (x, y) of the image, read with the color
+ * sample range [min, max], with or without unassociated alpha.
+ */
+static int check_float_pixel(const TestCase *tc, const float *c, uint32_t x,
+                             uint32_t y, double min, double max,
+                             int unassociated)
+{
+    int grey = tc->photometric != PHOTOMETRIC_RGB;
+    double e[4], a = 1.0;
+    int k;
+
+    if (tc->extrasample != 0)
+    {
+        a = sample_of_bits(
+            tc, sample_bits(tc, x, y, tc->samplesperpixel - 1));
+        if (tc->sampleformat == SAMPLEFORMAT_UINT)
+            a /= tc->bitspersample == 8 ? 255 : 65535;
+    }
+    for (k = 0; k < 3; k++)
+    {
+        double v =
+            sample_of_bits(tc, sample_bits(tc, x, y, grey ? 0 : k));
+        v = (v - min) / (max - min);
+        if (tc->photometric == PHOTOMETRIC_MINISWHITE)
+            v = 1 - v;
+        if (tc->extrasample == EXTRASAMPLE_UNASSALPHA && !unassociated)
+            v *= a;
+        else if (tc->extrasample == EXTRASAMPLE_ASSOCALPHA && unassociated)
+            v = a != 0 ? v / a : 0;
+        e[k] = v;
+    }
+    e[3] = a;
+    for (k = 0; k < 4; k++)
+    {
+        if (c[k] != e[k] && !(fabs(c[k] - e[k]) <= 2e-6 * fabs(e[k]) + 1e-6))
+        {
+            fprintf(stderr,
+                    "%s: pixel (%u, %u), sample %d is %.9g instead of "
+                    "%.9g.\n",
+                    tc->name, (unsigned int)x, (unsigned int)y, k, c[k],
+                    e[k]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Read the w x h part of the image from (col, row) with the orientation, in
+ * TIFFRGBA_FORMAT_RGBAF32 with the given sample range (that of the image
+ * if min == max), and check it.
+ */
+static int check_float_read(const TestCase *tc, TIFF *tif, float *raster,
+                            uint32_t col, uint32_t row, uint32_t w, uint32_t h,
+                            int orientation, double min, double max,
+                            int unassociated, int nthreads)
+{
+    char emsg[1024];
+    TIFFRGBAImage img;
+    uint32_t x, y;
+    int ok;
+
+    memset(raster, 0, (size_t)w * h * 4 * sizeof(float));
+    if (!TIFFRGBAImageBeginFormat(
+            &img, tif, 1,
+            TIFFRGBA_FORMAT_RGBAF32 |
+                (unassociated ? TIFFRGBA_FORMAT_UNASSOCIATED : 0),
+            emsg))
+    {
+        fprintf(stderr, "%s: %s\n", tc->name, emsg);
+        return 0;
+    }
+    if (min != max)
+    {
+        img.minsamplevalue = min;
+        img.maxsamplevalue = max;
+    }
+    min = img.minsamplevalue;
+    max = img.maxsamplevalue;
+    img.req_orientation = (uint16_t)orientation;
+    img.col_offset = (int)col;
+    img.row_offset = (int)row;
+    ok = TIFFRGBAImageGetParallel(&img, (uint32_t *)raster, w, h, nthreads);
+    TIFFRGBAImageEnd(&img);
+    if (!ok)
+    {
+        fprintf(stderr, "%s: TIFFRGBAImageGet failed.\n", tc->name);
+        return 0;
+    }
+    for (y = 0; ok && y < h; y++)
+    {
+        uint32_t ry = orientation == ORIENTATION_TOPLEFT ? y : h - 1 - y;
+        for (x = 0; ok && x < w; x++)
+            ok = check_float_pixel(tc, raster + ((size_t)ry * w + x) * 4,
+                                   col + x, row + y, min, max, unassociated);
+    }
+    return ok;
+}
+
+static int test_float_case(const TestCase *tc)
+{
+    float *raster =
+        (float *)malloc((size_t)WIDTH * HEIGHT * 4 * sizeof(float));
+    double min = tc->smin, max = tc->smax;
+    TIFF *tif;
+    int ok = 1;
+
+    if (!write_image(tc) || raster == NULL)
+    {
+        free(raster);
+        return 0;
+    }
+    tif = TIFFOpen(filename, "r");
+    if (tif == NULL)
+    {
+        fprintf(stderr, "Cannot open %s.\n", filename);
+        free(raster);
+        return 0;
+    }
+    if (min == max)
+    {
+        /* default range of the sample type */
+        if (tc->sampleformat == SAMPLEFORMAT_IEEEFP)
+            max = 1;
+        else if (tc->sampleformat == SAMPLEFORMAT_INT)
+            max = tc->bitspersample == 8 ? 127 : 32767;
+        else
+            max = tc->bitspersample == 8 ? 255 : 65535;
+    }
+    /* whole image, a part of it at odd offsets, and a given range */
+    ok = check_float_read(tc, tif, raster, 0, 0, WIDTH, HEIGHT,
+                          ORIENTATION_TOPLEFT, min, max, 0, 1) &&
+         check_float_read(tc, tif, raster, 0, 0, WIDTH, HEIGHT,
+                          ORIENTATION_BOTLEFT, min, max, 1, 1) &&
+         check_float_read(tc, tif, raster, 0, 0, WIDTH, HEIGHT,
+                          ORIENTATION_TOPLEFT, min, max, 0, 3) &&
+         check_float_read(tc, tif, raster, 19, 5, WIDTH - 19 - 3,
+                          HEIGHT - 5 - 2, ORIENTATION_TOPLEFT, min, max, 0,
+                          1) &&
+         check_float_read(tc, tif, raster, 3, 1, 37, 29, ORIENTATION_TOPLEFT,
+                          min * 0.5 - 1, max * 2 + 3, 1, 1);
+    TIFFClose(tif);
+    free(raster);
+    return ok;
+}
+
+int main(void)
+{
+    static const TestCase halfimage = {
+        "RGB half", PHOTOMETRIC_RGB, SAMPLEFORMAT_IEEEFP, 16, 3, 0,
+        PLANARCONFIG_CONTIG, 0, 0, 0, 0};
+    char emsg[1024];
+    TIFFRGBAImage img;
+    TIFF *tif;
+    size_t i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        if (!test_case(&cases[i]))
+            return 1;
+    }
+    for (i = 0; i < sizeof(float_cases) / sizeof(float_cases[0]); i++)
+    {
+        if (!test_float_case(&float_cases[i]))
+            return 1;
+    }
+
+    /* Unknown formats are rejected */
+    tif = TIFFOpen(filename, "r");
+    if (tif == NULL)
+        return 1;
+    if (TIFFRGBAImageBeginFormat(&img, tif, 1, 0x7f, emsg) ||
+        TIFFRGBAImageBeginFormat(&img, tif, 1, TIFFRGBA_FORMAT_RGBA8 | 0x800,
+                                 emsg))
+    {
+        fprintf(stderr, "Unknown output format accepted.\n");
+        TIFFClose(tif);
+        return 1;
+    }
+    TIFFClose(tif);
+
+    /* Floating point samples are only read in TIFFRGBA_FORMAT_RGBAF32 */
+    if (!write_image(&halfimage))
+        return 1;
+    tif = TIFFOpen(filename, "r");
+    if (tif == NULL)
+        return 1;
+    if (TIFFRGBAImageOK(tif, emsg))
+    {
+        fprintf(stderr, "Floating point image accepted.\n");
+        TIFFClose(tif);
+        return 1;
+    }
+    TIFFClose(tif);
+    unlink(filename);
+    return 0;
+}
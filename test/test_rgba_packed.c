@@ -0,0 +1,229 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test the expansion of 1, 2, 4 and 8-bit greyscale and palette images by
+ * the TIFFRGBAImage routines: each pixel of the raster, read in both
+ * orientations, must be the value of its sample mapped through the
+ * photometric interpretation or the colormap, for strips and tiles whose
+ * width is not a multiple of the number of samples in a byte.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 45
+#define HEIGHT 21
+
+static const char filename[] = "test_rgba_packed.tif";
+
+static const uint16_t photometrics[] = {
+    PHOTOMETRIC_MINISBLACK, PHOTOMETRIC_MINISWHITE, PHOTOMETRIC_PALETTE};
+static const uint16_t depths[] = {1, 2, 4, 8};
+
+static unsigned sample_value(uint16_t bitspersample, uint32_t x, uint32_t y)
+{
+    return ((x * 7 + y * 13 + x * y) ^ (y >> 1)) &
+           ((1U << bitspersample) - 1);
+}
+
+/* Value of the raster pixel of a sample */
+static uint32_t expected_pixel(uint16_t photometric, uint16_t bitspersample,
+                               unsigned v)
+{
+    unsigned range = (1U << bitspersample) - 1;
+    unsigned r, g, b;
+
+    if (photometric == PHOTOMETRIC_PALETTE)
+    {
+        r = v;
+        g = 255 - v;
+        b = (v * 37) & 0xff;
+    }
+    else
+    {
+        if (photometric == PHOTOMETRIC_MINISWHITE)
+            v = range - v;
+        r = g = b = v * 255 / range;
+    }
+    return r | g << 8 | b << 16 | 0xffU << 24;
+}
+
+static int write_image(uint16_t photometric, uint16_t bitspersample,
+                       int tiled)
+{
+    TIFF *tif = TIFFOpen(filename, "w");
+    uint32_t blockw = tiled ? 16 : WIDTH, blockh = tiled ? 16 : 5;
+    size_t rowsize = ((size_t)blockw * bitspersample + 7) / 8;
+    uint8_t *buf = (uint8_t *)malloc(rowsize * blockh);
+    uint32_t bx, by, x, y;
+    int ok = tif != NULL && buf != NULL;
+
+    if (!ok)
+    {
+        fprintf(stderr, "Cannot create %s.\n", filename);
+        if (tif)
+            TIFFClose(tif);
+        free(buf);
+        return 0;
+    }
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bitspersample);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, photometric);
+    if (photometric == PHOTOMETRIC_PALETTE)
+    {
+        uint16_t map[3][256];
+        int i;
+        for (i = 0; i < 256; i++)
+        {
+            map[0][i] = (uint16_t)(i * 257);
+            map[1][i] = (uint16_t)((255 - i) * 257);
+            map[2][i] = (uint16_t)(((i * 37) & 0xff) * 257);
+        }
+        TIFFSetField(tif, TIFFTAG_COLORMAP, map[0], map[1], map[2]);
+    }
+    if (tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, blockw);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, blockh);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, blockh);
+    for (by = 0; ok && by < HEIGHT; by += blockh)
+    {
+        for (bx = 0; ok && bx < WIDTH; bx += blockw)
+        {
+            memset(buf, 0, rowsize * blockh);
+            for (y = 0; y < blockh; y++)
+            {
+                for (x = 0; x < blockw; x++)
+                {
+                    size_t bit = (size_t)x * bitspersample;
+                    unsigned v = sample_value(bitspersample, bx + x, by + y);
+                    buf[y * rowsize + bit / 8] |=
+                        (uint8_t)(v << (8 - bitspersample - bit % 8));
+                }
+            }
+            if (tiled)
+                ok = TIFFWriteTile(tif, buf, bx, by, 0, 0) >= 0;
+            else
+            {
+                uint32_t rows =
+                    HEIGHT - by < blockh ? HEIGHT - by : blockh;
+                ok = TIFFWriteEncodedStrip(tif, TIFFComputeStrip(tif, by, 0),
+                                           buf, (tmsize_t)(rowsize * rows)) >=
+                     0;
+            }
+        }
+    }
+    free(buf);
+    TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "Cannot write %s.\n", filename);
+    return ok;
+}
+
+static int test_case(uint16_t photometric, uint16_t bitspersample, int tiled)
+{
+    static const int orientations[] = {ORIENTATION_TOPLEFT,
+                                       ORIENTATION_BOTLEFT};
+    uint32_t *raster = (uint32_t *)malloc((size_t)WIDTH * HEIGHT * 4);
+    size_t o;
+    int ok = raster != NULL && write_image(photometric, bitspersample, tiled);
+
+    for (o = 0; ok && o < sizeof(orientations) / sizeof(orientations[0]);
+         o++)
+    {
+        TIFF *tif = TIFFOpen(filename, "r");
+        uint32_t x, y;
+
+        ok = tif != NULL &&
+             TIFFReadRGBAImageOriented(tif, WIDTH, HEIGHT, raster,
+                                       orientations[o], 1);
+        if (tif)
+            TIFFClose(tif);
+        if (!ok)
+        {
+            fprintf(stderr, "Cannot read %s.\n", filename);
+            break;
+        }
+        for (y = 0; ok && y < HEIGHT; y++)
+        {
+            uint32_t ry =
+                orientations[o] == ORIENTATION_TOPLEFT ? y : HEIGHT - 1 - y;
+            for (x = 0; x < WIDTH; x++)
+            {
+                uint32_t expected = expected_pixel(
+                    photometric, bitspersample,
+                    sample_value(bitspersample, x, y));
+                uint32_t got = raster[(size_t)ry * WIDTH + x];
+                if (got != expected)
+                {
+                    fprintf(stderr,
+                            "Photometric %u, %u-bit %s, orientation %d: "
+                            "pixel (%u,%u) is 0x%08x instead of 0x%08x.\n",
+                            photometric, bitspersample,
+                            tiled ? "tiles" : "strips", orientations[o], x, y,
+                            got, expected);
+                    ok = 0;
+                    break;
+                }
+            }
+        }
+    }
+    free(raster);
+    return ok;
+}
+
+int main(void)
+{
+    size_t p, d;
+    int tiled;
+
+    for (p = 0; p < sizeof(photometrics) / sizeof(photometrics[0]); p++)
+    {
+        for (d = 0; d < sizeof(depths) / sizeof(depths[0]); d++)
+        {
+            for (tiled = 0; tiled <= 1; tiled++)
+            {
+                if (!test_case(photometrics[p], depths[d], tiled))
+                    return 1;
+            }
+        }
+    }
+    unlink(filename);
+    return 0;
+}
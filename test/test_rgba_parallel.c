@@ -0,0 +1,235 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFReadRGBAImageParallel() and TIFFRGBAImageGetParallel(): for
+ * strips and tiles, contiguous and separate planes, several codecs
+ * (including JPEG YCbCr decoded to RGB by the codec), orientations, and
+ * rasters smaller or larger than the image or offset within it, the raster
+ * is identical to the one of the sequential functions.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 301
+#define HEIGHT 203
+
+static const char filename[] = "test_rgba_parallel.tif";
+
+typedef struct
+{
+    const char *name;
+    uint16_t compression;
+    uint16_t photometric;
+    uint16_t planarconfig;
+    uint16_t samplesperpixel;
+    int tiled;
+} Layout;
+
+static const Layout layouts[] = {
+    {"LZW RGB strips", COMPRESSION_LZW, PHOTOMETRIC_RGB, PLANARCONFIG_CONTIG,
+     3, 0},
+    {"Deflate RGBA separate strips", COMPRESSION_ADOBE_DEFLATE,
+     PHOTOMETRIC_RGB, PLANARCONFIG_SEPARATE, 4, 0},
+    {"PackBits RGB separate tiles", COMPRESSION_PACKBITS, PHOTOMETRIC_RGB,
+     PLANARCONFIG_SEPARATE, 3, 1},
+    {"None RGBA tiles", COMPRESSION_NONE, PHOTOMETRIC_RGB,
+     PLANARCONFIG_CONTIG, 4, 1},
+    {"LZW gray tiles", COMPRESSION_LZW, PHOTOMETRIC_MINISBLACK,
+     PLANARCONFIG_CONTIG, 1, 1},
+    {"None gray strips", COMPRESSION_NONE, PHOTOMETRIC_MINISBLACK,
+     PLANARCONFIG_CONTIG, 1, 0},
+    {"JPEG YCbCr tiles", COMPRESSION_JPEG, PHOTOMETRIC_YCBCR,
+     PLANARCONFIG_CONTIG, 3, 1},
+    {"JPEG YCbCr strips", COMPRESSION_JPEG, PHOTOMETRIC_YCBCR,
+     PLANARCONFIG_CONTIG, 3, 0},
+};
+
+static uint8_t sample_value(uint32_t x, uint32_t y, uint16_t s)
+{
+    return (uint8_t)(x * (s + 1) + y * 3 + ((x ^ y) & 16) * s);
+}
+
+static int write_file(const Layout *l)
+{
+    TIFF *tif = TIFFOpen(filename, "w");
+    uint16_t nplanes =
+        l->planarconfig == PLANARCONFIG_SEPARATE ? l->samplesperpixel : 1;
+    uint16_t spp = nplanes == 1 ? l->samplesperpixel : 1;
+    uint32_t blockw = l->tiled ? 64 : WIDTH;
+    uint32_t blockh = l->tiled ? 32 : 16;
+    uint8_t *buf;
+    uint32_t bx, by, x, y;
+    uint16_t plane, s;
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, l->samplesperpixel);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, l->planarconfig);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, l->compression);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, l->photometric);
+    if (l->samplesperpixel == 4)
+    {
+        uint16_t extra = EXTRASAMPLE_UNASSALPHA;
+        TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &extra);
+    }
+    if (l->compression == COMPRESSION_JPEG)
+    {
+        /* written as RGB, stored as subsampled YCbCr */
+        TIFFSetField(tif, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+        blockh = l->tiled ? 32 : 16;
+    }
+    if (l->compression == COMPRESSION_LZW)
+        TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    if (l->tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, blockw);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, blockh);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, blockh);
+
+    buf = (uint8_t *)malloc((size_t)blockw * blockh * spp);
+    for (plane = 0; ok && plane < nplanes; plane++)
+    {
+        for (by = 0; ok && by < HEIGHT; by += blockh)
+        {
+            for (bx = 0; ok && bx < WIDTH; bx += blockw)
+            {
+                uint32_t rows = l->tiled || by + blockh <= HEIGHT
+                                    ? blockh
+                                    : HEIGHT - by;
+                for (y = 0; y < rows; y++)
+                    for (x = 0; x < blockw; x++)
+                        for (s = 0; s < spp; s++)
+                            buf[(y * blockw + x) * spp + s] = sample_value(
+                                bx + x, by + y, (uint16_t)(plane + s));
+                if (l->tiled)
+                    ok = TIFFWriteTile(tif, buf, bx, by, 0, plane) >= 0;
+                else
+                    ok = TIFFWriteEncodedStrip(
+                             tif, TIFFComputeStrip(tif, by, plane), buf,
+                             (tmsize_t)rows * blockw * spp) >= 0;
+            }
+        }
+    }
+    free(buf);
+    TIFFClose(tif);
+    return ok;
+}
+
+/* Compare the sequential and parallel rasters of a rw x rh raster */
+static int compare(const Layout *l, uint32_t rw, uint32_t rh, int orientation,
+                   int row_offset, int col_offset, int nthreads)
+{
+    TIFF *tif = TIFFOpen(filename, "r");
+    size_t npixels = (size_t)rw * rh;
+    uint32_t *ref = (uint32_t *)calloc(npixels, sizeof(uint32_t));
+    uint32_t *par = (uint32_t *)calloc(npixels, sizeof(uint32_t));
+    char emsg[1024];
+    int ret = 1, ok1 = 0, ok2 = 0;
+
+    if (!tif || !ref || !par)
+        goto end;
+    if (row_offset == 0 && col_offset == 0)
+    {
+        ok1 = TIFFReadRGBAImageOriented(tif, rw, rh, ref, orientation, 1);
+        ok2 = TIFFReadRGBAImageParallel(tif, rw, rh, par, orientation, 1,
+                                        nthreads);
+    }
+    else
+    {
+        TIFFRGBAImage img;
+        if (TIFFRGBAImageBegin(&img, tif, 1, emsg))
+        {
+            img.req_orientation = (uint16_t)orientation;
+            img.row_offset = row_offset;
+            img.col_offset = col_offset;
+            ok1 = TIFFRGBAImageGet(&img, ref, rw, rh);
+            ok2 = TIFFRGBAImageGetParallel(&img, par, rw, rh, nthreads);
+            TIFFRGBAImageEnd(&img);
+        }
+    }
+    if (!ok1 || !ok2)
+        fprintf(stderr, "%s: read failed\n", l->name);
+    else if (memcmp(ref, par, npixels * sizeof(uint32_t)) != 0)
+        fprintf(stderr, "%s: rasters differ\n", l->name);
+    else
+        ret = 0;
+end:
+    if (ret)
+        fprintf(stderr,
+                "  raster %ux%u, orientation %d, offset %d,%d, %d threads\n",
+                rw, rh, orientation, row_offset, col_offset, nthreads);
+    if (tif)
+        TIFFClose(tif);
+    free(ref);
+    free(par);
+    return ret;
+}
+
+int main(void)
+{
+    size_t i;
+    int ret = 0;
+
+    for (i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++)
+    {
+        const Layout *l = &layouts[i];
+
+        if (!TIFFIsCODECConfigured(l->compression))
+            continue;
+        if (!write_file(l))
+        {
+            fprintf(stderr, "%s: cannot write %s\n", l->name, filename);
+            ret++;
+            continue;
+        }
+        ret += compare(l, WIDTH, HEIGHT, ORIENTATION_BOTLEFT, 0, 0, 3);
+        ret += compare(l, WIDTH, HEIGHT, ORIENTATION_TOPLEFT, 0, 0, 0);
+        ret += compare(l, WIDTH, HEIGHT, ORIENTATION_BOTRIGHT, 0, 0, 2);
+        ret += compare(l, WIDTH + 13, HEIGHT + 7, ORIENTATION_TOPRIGHT, 0, 0,
+                       4);
+        ret += compare(l, 100, 50, ORIENTATION_TOPLEFT, 0, 0, 3);
+        ret += compare(l, 150, 90, ORIENTATION_BOTLEFT, 37, 71, 3);
+        ret += compare(l, WIDTH, HEIGHT, ORIENTATION_TOPLEFT, 0, 0, 1);
+    }
+    if (ret == 0)
+        unlink(filename);
+    return ret;
+}
@@ -0,0 +1,359 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFReadRGBARegion(): windows of strip and tile images read with
+ * the nearest and box filters at several factors and orientations must
+ * match the decimation of the whole image read by
+ * TIFFReadRGBAImageOriented(), and reduced-resolution images stored as
+ * SubIFDs or as following directories must be used when allowed.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 203
+#define HEIGHT 157
+
+static const char filename[] = "test_rgba_region.tif";
+
+static uint8_t sample_value(uint32_t x, uint32_t y, int s, int level)
+{
+    return (uint8_t)(x * (uint32_t)(s + 3) + y * 7 + ((x ^ y) & 8) * 9 +
+                     (uint32_t)level * 50);
+}
+
+static int write_image(TIFF *tif, uint32_t width, uint32_t height, int tiled,
+                       int level, uint16_t nsubifd)
+{
+    uint32_t blockw = tiled ? 32 : width, blockh = tiled ? 16 : 3;
+    uint8_t *buf = (uint8_t *)malloc((size_t)blockw * blockh * 3);
+    uint32_t bx, by, x, y;
+    int s, ok = 1;
+
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+    if (level > 0)
+        TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_REDUCEDIMAGE);
+    if (nsubifd > 0)
+    {
+        uint64_t offsets[2] = {0, 0};
+        TIFFSetField(tif, TIFFTAG_SUBIFD, nsubifd, offsets);
+    }
+    if (tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, blockw);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, blockh);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, blockh);
+    for (by = 0; ok && by < height; by += blockh)
+    {
+        for (bx = 0; ok && bx < width; bx += blockw)
+        {
+            for (y = 0; y < blockh; y++)
+                for (x = 0; x < blockw; x++)
+                    for (s = 0; s < 3; s++)
+                        buf[(y * blockw + x) * 3 + s] =
+                            sample_value(bx + x, by + y, s, level);
+            if (tiled)
+                ok = TIFFWriteTile(tif, buf, bx, by, 0, 0) >= 0;
+            else
+            {
+                uint32_t rows = by + blockh <= height ? blockh : height - by;
+                ok = TIFFWriteEncodedStrip(tif, by / blockh, buf,
+                                           (tmsize_t)rows * width * 3) >= 0;
+            }
+        }
+    }
+    free(buf);
+    return ok && TIFFWriteDirectory(tif);
+}
+
+/* Decimation of a window of a top-left oriented raster of the image */
+static void decimate(const uint32_t *full, uint32_t col, uint32_t row,
+                     uint32_t width, uint32_t height, uint32_t factor,
+                     int box, int orientation, uint32_t *out)
+{
+    uint32_t ow = (width + factor - 1) / factor;
+    uint32_t oh = (height + factor - 1) / factor;
+    uint32_t i, j, x, y;
+
+    for (j = 0; j < oh; j++)
+    {
+        uint32_t y0 = row + j * factor;
+        uint32_t bh = height - j * factor < factor ? height - j * factor
+                                                   : factor;
+        for (i = 0; i < ow; i++)
+        {
+            uint32_t x0 = col + i * factor;
+            uint32_t bw = width - i * factor < factor ? width - i * factor
+                                                      : factor;
+            uint32_t v;
+            uint32_t oi = orientation == ORIENTATION_TOPRIGHT ||
+                                  orientation == ORIENTATION_BOTRIGHT
+                              ? ow - 1 - i
+                              : i;
+            uint32_t oj = orientation == ORIENTATION_BOTLEFT ||
+                                  orientation == ORIENTATION_BOTRIGHT
+                              ? oh - 1 - j
+                              : j;
+            if (box)
+            {
+                uint32_t sum[4] = {0, 0, 0, 0}, n = bw * bh;
+                for (y = y0; y < y0 + bh; y++)
+                {
+                    for (x = x0; x < x0 + bw; x++)
+                    {
+                        uint32_t p = full[y * WIDTH + x];
+                        sum[0] += TIFFGetR(p);
+                        sum[1] += TIFFGetG(p);
+                        sum[2] += TIFFGetB(p);
+                        sum[3] += TIFFGetA(p);
+                    }
+                }
+                v = (sum[0] + n / 2) / n | ((sum[1] + n / 2) / n) << 8 |
+                    ((sum[2] + n / 2) / n) << 16 |
+                    ((sum[3] + n / 2) / n) << 24;
+            }
+            else
+                v = full[(y0 + bh / 2) * WIDTH + x0 + bw / 2];
+            out[oj * ow + oi] = v;
+        }
+    }
+}
+
+static int test_file(int tiled)
+{
+    static const uint32_t windows[][4] = {
+        {0, 0, WIDTH, HEIGHT}, {13, 7, 101, 89}, {200, 150, 3, 7}};
+    static const uint32_t factors[] = {1, 2, 3, 4, 16};
+    static const int orientations[] = {ORIENTATION_TOPLEFT,
+                                       ORIENTATION_BOTLEFT,
+                                       ORIENTATION_TOPRIGHT};
+    uint32_t *full = (uint32_t *)malloc(WIDTH * HEIGHT * sizeof(uint32_t));
+    uint32_t *got = (uint32_t *)malloc(WIDTH * HEIGHT * sizeof(uint32_t));
+    uint32_t *expected =
+        (uint32_t *)malloc(WIDTH * HEIGHT * sizeof(uint32_t));
+    TIFF *tif = TIFFOpen(filename, "w");
+    size_t w, f, o;
+    int box, ret = 1;
+
+    if (!tif || !write_image(tif, WIDTH, HEIGHT, tiled, 0, 0))
+    {
+        fprintf(stderr, "Cannot write %s\n", filename);
+        goto end;
+    }
+    TIFFClose(tif);
+    tif = TIFFOpen(filename, "r");
+    if (!tif || !TIFFReadRGBAImageOriented(tif, WIDTH, HEIGHT, full,
+                                           ORIENTATION_TOPLEFT, 1))
+    {
+        fprintf(stderr, "Cannot read %s\n", filename);
+        goto end;
+    }
+    for (w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+    {
+        const uint32_t *win = windows[w];
+        for (f = 0; f < sizeof(factors) / sizeof(factors[0]); f++)
+        {
+            uint32_t ow = (win[2] + factors[f] - 1) / factors[f];
+            uint32_t oh = (win[3] + factors[f] - 1) / factors[f];
+            for (o = 0; o < sizeof(orientations) / sizeof(orientations[0]);
+                 o++)
+            {
+                for (box = 0; box < 2; box++)
+                {
+                    decimate(full, win[0], win[1], win[2], win[3],
+                             factors[f], box, orientations[o], expected);
+                    memset(got, 0, (size_t)ow * oh * sizeof(uint32_t));
+                    if (!TIFFReadRGBARegion(
+                            tif, win[0], win[1], win[2], win[3], factors[f],
+                            box ? TIFFRGBA_REGION_BOX
+                                : TIFFRGBA_REGION_NEAREST,
+                            got, orientations[o], 1) ||
+                        memcmp(got, expected,
+                               (size_t)ow * oh * sizeof(uint32_t)) != 0)
+                    {
+                        fprintf(stderr,
+                                "%s: window %u,%u %ux%u, factor %u, "
+                                "orientation %d, %s filter: wrong raster\n",
+                                tiled ? "tiles" : "strips", win[0], win[1],
+                                win[2], win[3], factors[f], orientations[o],
+                                box ? "box" : "nearest");
+                        goto end;
+                    }
+                }
+            }
+        }
+    }
+    if (TIFFReadRGBARegion(tif, 100, 0, WIDTH - 99, 10, 1,
+                           TIFFRGBA_REGION_NEAREST, got, ORIENTATION_TOPLEFT,
+                           1))
+    {
+        fprintf(stderr, "A window outside of the image was accepted\n");
+        goto end;
+    }
+    ret = 0;
+end:
+    if (tif)
+        TIFFClose(tif);
+    free(full);
+    free(got);
+    free(expected);
+    return ret;
+}
+
+/*
+ * The full resolution image with, as SubIFDs or as the following
+ * directories, 1/2 and 1/4 scale images of distinct content: a read
+ * allowed to use them must return their pixels.
+ */
+static int test_overviews(int subifds)
+{
+    uint32_t *got = (uint32_t *)malloc(WIDTH * HEIGHT * sizeof(uint32_t));
+    uint32_t *expected =
+        (uint32_t *)malloc(WIDTH * HEIGHT * sizeof(uint32_t));
+    TIFF *tif = TIFFOpen(filename, "w");
+    const char *layout = subifds ? "SubIFD" : "directory";
+    uint32_t x, y;
+    int level, ret = 1;
+
+    if (!tif || !write_image(tif, WIDTH, HEIGHT, 1, 0, subifds ? 2 : 0))
+        goto end;
+    for (level = 1; level <= 2; level++)
+    {
+        uint32_t s = 1U << level;
+        if (!write_image(tif, (WIDTH + s - 1) / s, (HEIGHT + s - 1) / s,
+                         level == 1, level, 0))
+            goto end;
+    }
+    /* a second full resolution page, after the overviews of the first */
+    if (!write_image(tif, WIDTH, HEIGHT, 0, 0, 0))
+        goto end;
+    TIFFClose(tif);
+    tif = TIFFOpen(filename, "r");
+    if (!tif)
+        goto end;
+
+    /* factor 8 from the 1/4 scale image, with factor 2 */
+    if (!TIFFReadRGBARegion(tif, 0, 0, WIDTH, HEIGHT, 8,
+                            TIFFRGBA_REGION_OVERVIEWS, got,
+                            ORIENTATION_TOPLEFT, 1))
+    {
+        fprintf(stderr, "%s overviews: read failed\n", layout);
+        goto end;
+    }
+    for (y = 0; y < (HEIGHT + 7) / 8; y++)
+    {
+        for (x = 0; x < (WIDTH + 7) / 8; x++)
+        {
+            uint32_t ovw = (WIDTH + 3) / 4, ovh = (HEIGHT + 3) / 4;
+            uint32_t bw = ovw - 2 * x < 2 ? ovw - 2 * x : 2;
+            uint32_t bh = ovh - 2 * y < 2 ? ovh - 2 * y : 2;
+            uint32_t sx = 2 * x + bw / 2, sy = 2 * y + bh / 2;
+            expected[y * ((WIDTH + 7) / 8) + x] =
+                sample_value(sx, sy, 0, 2) |
+                (uint32_t)sample_value(sx, sy, 1, 2) << 8 |
+                (uint32_t)sample_value(sx, sy, 2, 2) << 16 | 0xff000000U;
+        }
+    }
+    if (memcmp(got, expected,
+               (size_t)((WIDTH + 7) / 8) * ((HEIGHT + 7) / 8) * 4) != 0)
+    {
+        fprintf(stderr, "%s overviews: factor 8 not read from 1/4 scale\n",
+                layout);
+        goto end;
+    }
+
+    /* factor 2 of a window from the 1/2 scale image */
+    if (!TIFFReadRGBARegion(tif, 20, 10, 100, 60, 2,
+                            TIFFRGBA_REGION_OVERVIEWS, got,
+                            ORIENTATION_TOPLEFT, 1) ||
+        got[0] != (sample_value(10, 5, 0, 1) |
+                   (uint32_t)sample_value(10, 5, 1, 1) << 8 |
+                   (uint32_t)sample_value(10, 5, 2, 1) << 16 | 0xff000000U))
+    {
+        fprintf(stderr, "%s overviews: factor 2 not read from 1/2 scale\n",
+                layout);
+        goto end;
+    }
+
+    /* factor 3 cannot use them */
+    if (!TIFFReadRGBARegion(tif, 0, 0, 3, 3, 3, TIFFRGBA_REGION_OVERVIEWS,
+                            got, ORIENTATION_TOPLEFT, 1) ||
+        got[0] != (sample_value(1, 1, 0, 0) |
+                   (uint32_t)sample_value(1, 1, 1, 0) << 8 |
+                   (uint32_t)sample_value(1, 1, 2, 0) << 16 | 0xff000000U))
+    {
+        fprintf(stderr, "%s overviews: factor 3 not read from full scale\n",
+                layout);
+        goto end;
+    }
+
+    /* the current directory is left unchanged */
+    if (TIFFCurrentDirectory(tif) != 0 || !TIFFGetField(tif, TIFFTAG_IMAGEWIDTH,
+                                                        &x) ||
+        x != WIDTH || !TIFFIsTiled(tif) || !TIFFReadDirectory(tif) ||
+        (!subifds && !TIFFReadDirectory(tif)) ||
+        (!subifds && !TIFFReadDirectory(tif)) || TIFFIsTiled(tif))
+    {
+        fprintf(stderr, "%s overviews: wrong current directory\n", layout);
+        goto end;
+    }
+    ret = 0;
+end:
+    if (ret && !tif)
+        fprintf(stderr, "Cannot write or read %s\n", filename);
+    if (tif)
+        TIFFClose(tif);
+    free(got);
+    free(expected);
+    return ret;
+}
+
+int main(void)
+{
+    int ret = test_file(0);
+    ret += test_file(1);
+    ret += test_overviews(1);
+    ret += test_overviews(0);
+    if (ret == 0)
+        unlink(filename);
+    return ret;
+}
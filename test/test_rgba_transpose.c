@@ -0,0 +1,272 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFRGBA_FORMAT_TRANSPOSE: for each Orientation of the file and
+ * each orientation requested for the raster, in strips and tiles, each
+ * pixel of the raster read by TIFFReadRGBAImageFormat() must be the pixel
+ * of the image displayed as the Orientation tag says, transposed for
+ * Orientation 5 to 8.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 37
+#define HEIGHT 23
+
+static const char filename[] = "test_rgba_transpose.tif";
+
+static const int formats[] = {TIFFRGBA_FORMAT_ABGR32, TIFFRGBA_FORMAT_RGB8,
+                              TIFFRGBA_FORMAT_RGBA16};
+
+static void pixel_value(uint32_t x, uint32_t y, uint8_t rgb[3])
+{
+    rgb[0] = (uint8_t)(x * 5);
+    rgb[1] = (uint8_t)(y * 11);
+    rgb[2] = (uint8_t)(x * y);
+}
+
+static int write_image(uint16_t orientation, int tiled)
+{
+    TIFF *tif = TIFFOpen(filename, "w");
+    uint32_t blockw = tiled ? 16 : WIDTH, blockh = tiled ? 16 : 5;
+    uint8_t *buf = (uint8_t *)malloc((size_t)blockw * blockh * 3);
+    uint32_t bx, by, x, y;
+    int ok = tif != NULL && buf != NULL;
+
+    if (!ok)
+    {
+        fprintf(stderr, "Cannot create %s.\n", filename);
+        if (tif)
+            TIFFClose(tif);
+        free(buf);
+        return 0;
+    }
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    TIFFSetField(tif, TIFFTAG_ORIENTATION, orientation);
+    if (tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, blockw);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, blockh);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, blockh);
+    for (by = 0; ok && by < HEIGHT; by += blockh)
+    {
+        for (bx = 0; ok && bx < WIDTH; bx += blockw)
+        {
+            for (y = 0; y < blockh; y++)
+                for (x = 0; x < blockw; x++)
+                    pixel_value(bx + x, by + y,
+                                buf + ((size_t)y * blockw + x) * 3);
+            if (tiled)
+                ok = TIFFWriteTile(tif, buf, bx, by, 0, 0) >= 0;
+            else
+            {
+                uint32_t rows =
+                    HEIGHT - by < blockh ? HEIGHT - by : blockh;
+                ok = TIFFWriteEncodedStrip(tif, TIFFComputeStrip(tif, by, 0),
+                                           buf,
+                                           (tmsize_t)blockw * rows * 3) >= 0;
+            }
+        }
+    }
+    free(buf);
+    TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "Cannot write %s.\n", filename);
+    return ok;
+}
+
+/*
+ * Position in the file of the pixel at column vx and row vy of the image
+ * as displayed, which is HEIGHT x WIDTH for Orientation 5 to 8.
+ */
+static void file_position(uint16_t orientation, uint32_t vx, uint32_t vy,
+                          uint32_t *x, uint32_t *y)
+{
+    switch (orientation)
+    {
+        case ORIENTATION_TOPRIGHT:
+            *x = WIDTH - 1 - vx;
+            *y = vy;
+            break;
+        case ORIENTATION_BOTRIGHT:
+            *x = WIDTH - 1 - vx;
+            *y = HEIGHT - 1 - vy;
+            break;
+        case ORIENTATION_BOTLEFT:
+            *x = vx;
+            *y = HEIGHT - 1 - vy;
+            break;
+        case ORIENTATION_LEFTTOP:
+            *x = vy;
+            *y = vx;
+            break;
+        case ORIENTATION_RIGHTTOP:
+            *x = vy;
+            *y = HEIGHT - 1 - vx;
+            break;
+        case ORIENTATION_RIGHTBOT:
+            *x = WIDTH - 1 - vy;
+            *y = HEIGHT - 1 - vx;
+            break;
+        case ORIENTATION_LEFTBOT:
+            *x = WIDTH - 1 - vy;
+            *y = vx;
+            break;
+        default:
+            *x = vx;
+            *y = vy;
+            break;
+    }
+}
+
+static int check_raster(uint16_t orientation, int tiled, int req, int format,
+                        const uint8_t *raster)
+{
+    int transposed = orientation >= ORIENTATION_LEFTTOP;
+    uint32_t rw = transposed ? HEIGHT : WIDTH;
+    uint32_t rh = transposed ? WIDTH : HEIGHT;
+    uint32_t rx, ry;
+
+    for (ry = 0; ry < rh; ry++)
+    {
+        for (rx = 0; rx < rw; rx++)
+        {
+            uint32_t vx = req == ORIENTATION_TOPRIGHT ||
+                                  req == ORIENTATION_BOTRIGHT
+                              ? rw - 1 - rx
+                              : rx;
+            uint32_t vy = req == ORIENTATION_BOTLEFT ||
+                                  req == ORIENTATION_BOTRIGHT
+                              ? rh - 1 - ry
+                              : ry;
+            size_t i = (size_t)ry * rw + rx;
+            uint32_t x, y;
+            uint8_t expected[3], got[3];
+
+            file_position(orientation, vx, vy, &x, &y);
+            pixel_value(x, y, expected);
+            if (format == TIFFRGBA_FORMAT_RGB8)
+                memcpy(got, raster + i * 3, 3);
+            else if (format == TIFFRGBA_FORMAT_RGBA16)
+            {
+                const uint16_t *p = (const uint16_t *)raster + i * 4;
+                got[0] = (uint8_t)(p[0] >> 8);
+                got[1] = (uint8_t)(p[1] >> 8);
+                got[2] = (uint8_t)(p[2] >> 8);
+            }
+            else
+            {
+                uint32_t v = ((const uint32_t *)raster)[i];
+                got[0] = (uint8_t)TIFFGetR(v);
+                got[1] = (uint8_t)TIFFGetG(v);
+                got[2] = (uint8_t)TIFFGetB(v);
+            }
+            if (memcmp(got, expected, 3) != 0)
+            {
+                fprintf(stderr,
+                        "Orientation %u, %s, raster orientation %d, format "
+                        "%d: pixel (%u,%u) is %u,%u,%u instead of pixel "
+                        "(%u,%u) %u,%u,%u.\n",
+                        orientation, tiled ? "tiles" : "strips", req, format,
+                        rx, ry, got[0], got[1], got[2], x, y, expected[0],
+                        expected[1], expected[2]);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int main(void)
+{
+    static const int reqs[] = {ORIENTATION_TOPLEFT, ORIENTATION_TOPRIGHT,
+                               ORIENTATION_BOTRIGHT, ORIENTATION_BOTLEFT};
+    uint8_t *raster = (uint8_t *)malloc((size_t)WIDTH * HEIGHT * 8);
+    uint16_t orientation;
+    int tiled;
+    size_t r, f;
+
+    if (raster == NULL)
+        return 1;
+    for (orientation = ORIENTATION_TOPLEFT;
+         orientation <= ORIENTATION_LEFTBOT; orientation++)
+    {
+        for (tiled = 0; tiled <= 1; tiled++)
+        {
+            if (!write_image(orientation, tiled))
+                goto failure;
+            for (r = 0; r < sizeof(reqs) / sizeof(reqs[0]); r++)
+            {
+                for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++)
+                {
+                    int transposed = orientation >= ORIENTATION_LEFTTOP;
+                    TIFF *tif = TIFFOpen(filename, "r");
+                    int ok;
+
+                    if (tif == NULL)
+                        goto failure;
+                    memset(raster, 0, (size_t)WIDTH * HEIGHT * 8);
+                    ok = TIFFReadRGBAImageFormat(
+                        tif, transposed ? HEIGHT : WIDTH,
+                        transposed ? WIDTH : HEIGHT, raster, reqs[r],
+                        formats[f] | TIFFRGBA_FORMAT_TRANSPOSE, 1);
+                    TIFFClose(tif);
+                    if (!ok)
+                    {
+                        fprintf(stderr, "Cannot read %s.\n", filename);
+                        goto failure;
+                    }
+                    if (!check_raster(orientation, tiled, reqs[r],
+                                      formats[f], raster))
+                        goto failure;
+                }
+            }
+        }
+    }
+    free(raster);
+    unlink(filename);
+    return 0;
+
+failure:
+    free(raster);
+    return 1;
+}
@@ -0,0 +1,412 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFSetFields(): fields given in any order and with other integer
+ * or floating point types than the ones of the fields are set as with
+ * TIFFSetField(), in the main directory and in an EXIF directory, and a
+ * batch with an invalid value sets nothing, including Compression and the
+ * settings of the previous codec.
+ */
+
+#include "tif_config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 64
+#define HEIGHT 16
+
+static const char filename[] = "test_set_fields.tif";
+static const char description[] = "set with TIFFSetFields";
+static const char datetime[] = "2024:01:02 03:04:05";
+static const uint8_t xmp[] = "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\"/>";
+
+#ifdef LZW_SUPPORT
+#define COMPRESSION COMPRESSION_LZW
+#define PREDICTOR PREDICTOR_HORIZONTAL
+#else
+#define COMPRESSION COMPRESSION_NONE
+#endif
+
+static uint16_t colormap[3 * 256];
+static uint8_t image[WIDTH * HEIGHT];
+
+#define NVALUES(a) ((uint32_t)(sizeof(a) / sizeof((a)[0])))
+
+/* Each of these batches must fail without setting Artist */
+static int check_errors(TIFF *tif)
+{
+    static const char artist[] = "nobody";
+    static const char nonul[3] = {'a', 'b', 'c'};
+    static const int16_t minus1 = -1;
+    static const double width = 64;
+    static const double whitepoint[3] = {0.3127, 0.329, 0};
+    static const uint64_t bigoffset = (uint64_t)1 << 32;
+    const TIFFFieldValue twice[] = {
+        {TIFFTAG_ARTIST, TIFF_ASCII, sizeof(artist), artist},
+        {TIFFTAG_ARTIST, TIFF_ASCII, sizeof(artist), artist}};
+    const TIFFFieldValue range[] = {
+        {TIFFTAG_ARTIST, TIFF_ASCII, sizeof(artist), artist},
+        {TIFFTAG_ORIENTATION, TIFF_SSHORT, 1, &minus1}};
+    const TIFFFieldValue ascii[] = {
+        {TIFFTAG_ARTIST, TIFF_ASCII, sizeof(nonul), nonul}};
+    const TIFFFieldValue type[] = {
+        {TIFFTAG_ARTIST, TIFF_ASCII, sizeof(artist), artist},
+        {TIFFTAG_IMAGEWIDTH, TIFF_DOUBLE, 1, &width}};
+    const TIFFFieldValue count[] = {
+        {TIFFTAG_ARTIST, TIFF_ASCII, sizeof(artist), artist},
+        {TIFFTAG_WHITEPOINT, TIFF_DOUBLE, 3, whitepoint}};
+    const TIFFFieldValue cmap[] = {
+        {TIFFTAG_ARTIST, TIFF_ASCII, sizeof(artist), artist},
+        {TIFFTAG_COLORMAP, TIFF_SHORT, 256, colormap}};
+    static const uint16_t badplanar = 3;
+    const TIFFFieldValue planar[] = {
+        {TIFFTAG_ARTIST, TIFF_ASCII, sizeof(artist), artist},
+        {TIFFTAG_PLANARCONFIG, TIFF_SHORT, 1, &badplanar}};
+    const TIFFFieldValue classic[] = {
+        {TIFFTAG_ARTIST, TIFF_ASCII, sizeof(artist), artist},
+        {TIFFTAG_EXIFIFD, TIFF_LONG8, 1, &bigoffset}};
+    /* Compression is set before the other fields are checked */
+    static const uint16_t packbits = COMPRESSION_PACKBITS;
+    static const uint16_t orientation[2] = {ORIENTATION_TOPLEFT,
+                                            ORIENTATION_TOPLEFT};
+    const TIFFFieldValue compression[] = {
+        {TIFFTAG_COMPRESSION, TIFF_SHORT, 1, &packbits},
+        {TIFFTAG_ORIENTATION, TIFF_SHORT, 2, orientation}};
+    /* SampleFormat is rejected when set, after the other fields, some of
+     * them sharing a field bit */
+    static const uint16_t sixteen = 16;
+    static const uint16_t badformat = 99;
+    static const uint16_t botright = ORIENTATION_BOTRIGHT;
+    const TIFFFieldValue late[] = {
+        {TIFFTAG_ARTIST, TIFF_ASCII, sizeof(artist), artist},
+        {TIFFTAG_IMAGEWIDTH, TIFF_SHORT, 1, &sixteen},
+        {TIFFTAG_IMAGELENGTH, TIFF_SHORT, 1, &sixteen},
+        {TIFFTAG_BITSPERSAMPLE, TIFF_SHORT, 1, &sixteen},
+        {TIFFTAG_ORIENTATION, TIFF_SHORT, 1, &botright},
+        {TIFFTAG_TILEWIDTH, TIFF_SHORT, 1, &sixteen},
+        {TIFFTAG_TILELENGTH, TIFF_SHORT, 1, &sixteen},
+        {TIFFTAG_SAMPLEFORMAT, TIFF_SHORT, 1, &badformat}};
+    uint16_t v16 = 0;
+    uint32_t v32 = 0;
+    char *s;
+
+    if (TIFFSetFields(tif, twice, NVALUES(twice)) ||
+        TIFFSetFields(tif, range, NVALUES(range)) ||
+        TIFFSetFields(tif, ascii, NVALUES(ascii)) ||
+        TIFFSetFields(tif, type, NVALUES(type)) ||
+        TIFFSetFields(tif, count, NVALUES(count)) ||
+        TIFFSetFields(tif, cmap, NVALUES(cmap)) ||
+        TIFFSetFields(tif, planar, NVALUES(planar)))
+    {
+        fprintf(stderr, "Invalid batch accepted\n");
+        return 1;
+    }
+    if (!TIFFIsBigTIFF(tif) && TIFFSetFields(tif, classic, NVALUES(classic)))
+    {
+        fprintf(stderr, "Invalid ClassicTIFF batch accepted\n");
+        return 1;
+    }
+    if (TIFFSetFields(tif, compression, NVALUES(compression)) ||
+        !TIFFGetField(tif, TIFFTAG_COMPRESSION, &v16) ||
+        v16 != COMPRESSION_NONE)
+    {
+        fprintf(stderr, "Compression set by a failed batch\n");
+        return 1;
+    }
+#ifdef LZW_SUPPORT
+    /* The previous codec is set back with its settings */
+    if (!TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW) ||
+        !TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR) ||
+        TIFFSetFields(tif, compression, NVALUES(compression)) ||
+        !TIFFGetField(tif, TIFFTAG_COMPRESSION, &v16) ||
+        v16 != COMPRESSION_LZW ||
+        !TIFFGetField(tif, TIFFTAG_PREDICTOR, &v16) || v16 != PREDICTOR)
+    {
+        fprintf(stderr, "Codec not restored after a failed batch\n");
+        return 1;
+    }
+#endif
+    if (TIFFSetFields(tif, late, NVALUES(late)) ||
+        TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &v16) ||
+        !TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &v16) ||
+        v16 != 1)
+    {
+        fprintf(stderr, "BitsPerSample set by a failed batch\n");
+        return 1;
+    }
+    if (TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &v32) ||
+        TIFFGetField(tif, TIFFTAG_TILEWIDTH, &v32) || TIFFIsTiled(tif) ||
+        !TIFFGetFieldDefaulted(tif, TIFFTAG_ORIENTATION, &v16) ||
+        v16 != ORIENTATION_TOPLEFT)
+    {
+        fprintf(stderr, "Fields set by a failed batch\n");
+        return 1;
+    }
+    if (TIFFGetField(tif, TIFFTAG_ARTIST, &s))
+    {
+        fprintf(stderr, "Field set by a failed batch\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int write_file(const char *mode)
+{
+    static const float fnumber = 2.8f;
+    static const double exposure = 1.0 / 125;
+    static const uint16_t iso[1] = {200};
+    static const uint16_t bitspersample = 8;
+    static const uint32_t samplesperpixel = 1;
+    static const uint16_t width = WIDTH;
+    static const uint32_t height = HEIGHT;
+    static const uint64_t rowsperstrip = HEIGHT;
+    static const int compression = COMPRESSION;
+#ifdef LZW_SUPPORT
+    static const uint16_t predictor = PREDICTOR;
+#endif
+    static const uint8_t photometric = PHOTOMETRIC_PALETTE;
+    static const uint16_t planarconfig = PLANARCONFIG_CONTIG;
+    static const double xres = 300;
+    static const float yres = 150;
+    static const uint16_t resunit = RESUNIT_INCH;
+    static const uint16_t pagenumber[2] = {0, 1};
+    static const double whitepoint[2] = {0.3127, 0.329};
+    static const uint8_t dngversion[4] = {1, 4, 0, 0};
+    static const char software[] = "test_set_fields";
+    uint64_t exifoff = 0;
+    TIFF *tif;
+
+    const TIFFFieldValue exif[] = {
+        {EXIFTAG_FNUMBER, TIFF_FLOAT, 1, &fnumber},
+        {EXIFTAG_EXPOSURETIME, TIFF_DOUBLE, 1, &exposure},
+        {EXIFTAG_ISOSPEEDRATINGS, TIFF_SHORT, 1, iso},
+        {EXIFTAG_DATETIMEORIGINAL, TIFF_ASCII, sizeof(datetime), datetime}};
+    /* Not in tag order, e.g. ColorMap before BitsPerSample, and with a
+     * field of the codec */
+    const TIFFFieldValue fields[] = {
+#ifdef LZW_SUPPORT
+        {TIFFTAG_PREDICTOR, TIFF_SHORT, 1, &predictor},
+#endif
+        {TIFFTAG_COLORMAP, TIFF_SHORT, 3 * 256, colormap},
+        {TIFFTAG_XMLPACKET, TIFF_BYTE, sizeof(xmp), xmp},
+        {TIFFTAG_IMAGEDESCRIPTION, TIFF_ASCII, sizeof(description),
+         description},
+        {TIFFTAG_SOFTWARE, TIFF_ASCII, sizeof(software), software},
+        {TIFFTAG_EXIFIFD, TIFF_LONG8, 1, &exifoff},
+        {TIFFTAG_IMAGEWIDTH, TIFF_SHORT, 1, &width},
+        {TIFFTAG_IMAGELENGTH, TIFF_LONG, 1, &height},
+        {TIFFTAG_BITSPERSAMPLE, TIFF_SHORT, 1, &bitspersample},
+        {TIFFTAG_SAMPLESPERPIXEL, TIFF_LONG, 1, &samplesperpixel},
+        {TIFFTAG_ROWSPERSTRIP, TIFF_LONG8, 1, &rowsperstrip},
+        {TIFFTAG_COMPRESSION, TIFF_SLONG, 1, &compression},
+        {TIFFTAG_PHOTOMETRIC, TIFF_BYTE, 1, &photometric},
+        {TIFFTAG_PLANARCONFIG, TIFF_SHORT, 1, &planarconfig},
+        {TIFFTAG_XRESOLUTION, TIFF_DOUBLE, 1, &xres},
+        {TIFFTAG_YRESOLUTION, TIFF_FLOAT, 1, &yres},
+        {TIFFTAG_RESOLUTIONUNIT, TIFF_SHORT, 1, &resunit},
+        {TIFFTAG_PAGENUMBER, TIFF_SHORT, 2, pagenumber},
+        {TIFFTAG_WHITEPOINT, TIFF_DOUBLE, 2, whitepoint},
+        {TIFFTAG_DNGVERSION, TIFF_BYTE, 4, dngversion}};
+
+    tif = TIFFOpen(filename, mode);
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        return 1;
+    }
+
+    if (TIFFCreateEXIFDirectory(tif) != 0 ||
+        !TIFFSetFields(tif, exif, NVALUES(exif)) ||
+        !TIFFWriteCustomDirectory(tif, &exifoff))
+    {
+        fprintf(stderr, "Cannot write EXIF directory\n");
+        goto bad;
+    }
+    if (TIFFCreateDirectory(tif) != 0 || check_errors(tif))
+        goto bad;
+    if (!TIFFSetFields(tif, fields, NVALUES(fields)))
+    {
+        fprintf(stderr, "TIFFSetFields() failed\n");
+        goto bad;
+    }
+    /* Values stored by TIFFSetFields() can be replaced or unset */
+    if (!TIFFSetField(tif, TIFFTAG_SOFTWARE, "replaced") ||
+        !TIFFUnsetField(tif, TIFFTAG_DNGVERSION))
+        goto bad;
+    if (TIFFWriteEncodedStrip(tif, 0, image, sizeof(image)) < 0 ||
+        !TIFFWriteDirectory(tif))
+    {
+        fprintf(stderr, "Cannot write image\n");
+        goto bad;
+    }
+    TIFFClose(tif);
+    return 0;
+bad:
+    TIFFClose(tif);
+    return 1;
+}
+
+static int check_file(void)
+{
+    uint32_t w = 0, h = 0, rows = 0, xmpcount = 0;
+    uint16_t bps = 0, spp = 0, compression = 0, photometric = 0, unit = 0;
+    uint16_t predictor = 0;
+    uint16_t page = 0, npages = 0, isocount = 0;
+    uint16_t *red, *green, *blue, *iso;
+    float xres = 0, yres = 0, fnumber = 0, exposure = 0;
+    float *whitepoint;
+    uint8_t *dngversion;
+    void *xmpdata;
+    char *s;
+    uint64_t exifoff = 0;
+    uint8_t buf[WIDTH * HEIGHT];
+    TIFF *tif = TIFFOpen(filename, "r");
+
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return 1;
+    }
+    if (!TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &w) ||
+        !TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &h) ||
+        !TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bps) ||
+        !TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &spp) ||
+        !TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &rows) ||
+        !TIFFGetField(tif, TIFFTAG_COMPRESSION, &compression) ||
+        !TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric) ||
+        w != WIDTH || h != HEIGHT || bps != 8 || spp != 1 ||
+        rows != HEIGHT || compression != COMPRESSION ||
+        photometric != PHOTOMETRIC_PALETTE)
+    {
+        fprintf(stderr, "Bad image fields\n");
+        goto bad;
+    }
+#ifdef LZW_SUPPORT
+    if (!TIFFGetField(tif, TIFFTAG_PREDICTOR, &predictor) ||
+        predictor != PREDICTOR)
+    {
+        fprintf(stderr, "Bad Predictor\n");
+        goto bad;
+    }
+#else
+    (void)predictor;
+#endif
+    if (!TIFFGetField(tif, TIFFTAG_COLORMAP, &red, &green, &blue) ||
+        memcmp(red, colormap, 256 * sizeof(uint16_t)) != 0 ||
+        memcmp(green, colormap + 256, 256 * sizeof(uint16_t)) != 0 ||
+        memcmp(blue, colormap + 512, 256 * sizeof(uint16_t)) != 0)
+    {
+        fprintf(stderr, "Bad ColorMap\n");
+        goto bad;
+    }
+    if (!TIFFGetField(tif, TIFFTAG_XRESOLUTION, &xres) ||
+        !TIFFGetField(tif, TIFFTAG_YRESOLUTION, &yres) ||
+        !TIFFGetField(tif, TIFFTAG_RESOLUTIONUNIT, &unit) ||
+        !TIFFGetField(tif, TIFFTAG_PAGENUMBER, &page, &npages) ||
+        xres != 300 || yres != 150 || unit != RESUNIT_INCH || page != 0 ||
+        npages != 1)
+    {
+        fprintf(stderr, "Bad resolution or page number\n");
+        goto bad;
+    }
+    if (!TIFFGetField(tif, TIFFTAG_IMAGEDESCRIPTION, &s) ||
+        strcmp(s, description) != 0 ||
+        !TIFFGetField(tif, TIFFTAG_SOFTWARE, &s) ||
+        strcmp(s, "replaced") != 0)
+    {
+        fprintf(stderr, "Bad ImageDescription or Software\n");
+        goto bad;
+    }
+    if (!TIFFGetField(tif, TIFFTAG_WHITEPOINT, &whitepoint) ||
+        fabs(whitepoint[0] - 0.3127) > 1e-6 ||
+        fabs(whitepoint[1] - 0.329) > 1e-6 ||
+        TIFFGetField(tif, TIFFTAG_DNGVERSION, &dngversion) ||
+        !TIFFGetField(tif, TIFFTAG_XMLPACKET, &xmpcount, &xmpdata) ||
+        xmpcount != sizeof(xmp) || memcmp(xmpdata, xmp, sizeof(xmp)) != 0)
+    {
+        fprintf(stderr, "Bad custom fields\n");
+        goto bad;
+    }
+    if (TIFFReadEncodedStrip(tif, 0, buf, sizeof(buf)) != sizeof(buf) ||
+        memcmp(buf, image, sizeof(buf)) != 0)
+    {
+        fprintf(stderr, "Bad image data\n");
+        goto bad;
+    }
+
+    if (!TIFFGetField(tif, TIFFTAG_EXIFIFD, &exifoff) ||
+        !TIFFReadEXIFDirectory(tif, exifoff))
+    {
+        fprintf(stderr, "Cannot read EXIF directory\n");
+        goto bad;
+    }
+    if (!TIFFGetField(tif, EXIFTAG_FNUMBER, &fnumber) ||
+        !TIFFGetField(tif, EXIFTAG_EXPOSURETIME, &exposure) ||
+        !TIFFGetField(tif, EXIFTAG_ISOSPEEDRATINGS, &isocount, &iso) ||
+        !TIFFGetField(tif, EXIFTAG_DATETIMEORIGINAL, &s) ||
+        fabs(fnumber - 2.8) > 1e-6 || fabs(exposure - 1.0 / 125) > 1e-6 ||
+        isocount != 1 || iso[0] != 200 || strcmp(s, datetime) != 0)
+    {
+        fprintf(stderr, "Bad EXIF fields\n");
+        goto bad;
+    }
+    TIFFClose(tif);
+    return 0;
+bad:
+    TIFFClose(tif);
+    return 1;
+}
+
+int main(void)
+{
+    static const char *const modes[] = {"w", "w8"};
+    size_t i;
+
+    for (i = 0; i < 3 * 256; i++)
+        colormap[i] = (uint16_t)(i * 257);
+    for (i = 0; i < sizeof(image); i++)
+        image[i] = (uint8_t)(i * 7);
+
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        if (write_file(modes[i]) || check_file())
+        {
+            fprintf(stderr, "Failed with mode %s\n", modes[i]);
+            return 1;
+        }
+    }
+    unlink(filename);
+    return 0;
+}
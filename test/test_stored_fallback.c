@@ -0,0 +1,238 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFTAG_STOREDFALLBACK: with the Deflate, LZW and ZSTD codecs,
+ * strips and tiles of random data must be stored and the others
+ * compressed, the statistics returned by TIFFGetStoredFallbackCounts()
+ * must reflect that, and everything must read back unchanged.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 512
+#define ROWS 16
+#define NSTRIPS 4
+#define STRIPSIZE (WIDTH * ROWS)
+#define TILESIZE 64
+#define WIDE 8192
+
+static const char filename[] = "test_stored_fallback.tif";
+
+static uint32_t seed = 1;
+
+/* strips / tiles of even index are random, the others a gradient */
+static void fill(uint8_t *buf, tmsize_t size, int random)
+{
+    tmsize_t i;
+    for (i = 0; i < size; i++)
+    {
+        seed = seed * 1103515245U + 12345U;
+        buf[i] = random ? (uint8_t)(seed >> 16) : (uint8_t)(i / 64);
+    }
+}
+
+static int check_counts(TIFF *tif, uint32_t striles, uint32_t stored)
+{
+    uint32_t n, m;
+    TIFFGetStoredFallbackCounts(tif, &n, &m);
+    if (n != striles || m != stored)
+    {
+        fprintf(stderr,
+                "Got %u striles / %u stored, expected %u / %u\n",
+                n, m, striles, stored);
+        return 0;
+    }
+    return 1;
+}
+
+static void set_fields(TIFF *tif, uint16_t compression, uint32_t width,
+                       uint32_t length)
+{
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, length);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+}
+
+static int test(uint16_t compression, int fallback)
+{
+    static uint8_t strips[NSTRIPS][STRIPSIZE];
+    static uint8_t tiles[2][TILESIZE * TILESIZE];
+    static uint8_t rows[2][WIDE];
+    static uint8_t buf[STRIPSIZE];
+    uint16_t value;
+    uint32_t i;
+    TIFF *tif = TIFFOpen(filename, "w");
+
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        return 0;
+    }
+
+    /* strips written with TIFFWriteEncodedStrip() */
+    set_fields(tif, compression, WIDTH, ROWS * NSTRIPS);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWS);
+    if (fallback)
+        TIFFSetField(tif, TIFFTAG_STOREDFALLBACK, STOREDFALLBACK_AUTO);
+    if (!TIFFGetField(tif, TIFFTAG_STOREDFALLBACK, &value) ||
+        value != (fallback ? STOREDFALLBACK_AUTO : STOREDFALLBACK_NONE))
+    {
+        fprintf(stderr, "Cannot get TIFFTAG_STOREDFALLBACK\n");
+        goto failure;
+    }
+    for (i = 0; i < NSTRIPS; i++)
+    {
+        fill(strips[i], STRIPSIZE, i % 2 == 0);
+        memcpy(buf, strips[i], STRIPSIZE);
+        if (TIFFWriteEncodedStrip(tif, i, buf, STRIPSIZE) != STRIPSIZE)
+            goto failure;
+    }
+    if (!check_counts(tif, fallback ? NSTRIPS : 0, fallback ? NSTRIPS / 2 : 0))
+        goto failure;
+    if (!TIFFWriteDirectory(tif))
+        goto failure;
+
+    /* tiles */
+    set_fields(tif, compression, 2 * TILESIZE, TILESIZE);
+    TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+    TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    for (i = 0; i < 2; i++)
+    {
+        fill(tiles[i], TILESIZE * TILESIZE, i == 0);
+        if (TIFFWriteEncodedTile(tif, i, tiles[i], TILESIZE * TILESIZE) !=
+            TILESIZE * TILESIZE)
+            goto failure;
+    }
+    if (!check_counts(tif, fallback ? 2 : 0, fallback ? 1 : 0))
+        goto failure;
+    if (!TIFFWriteDirectory(tif))
+        goto failure;
+
+    /* a strip written row by row, decided on its first row */
+    set_fields(tif, compression, WIDE, 2);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 2);
+    for (i = 0; i < 2; i++)
+    {
+        fill(rows[i], WIDE, 1);
+        memcpy(buf, rows[i], WIDE);
+        if (TIFFWriteScanline(tif, buf, i, 0) < 0)
+            goto failure;
+    }
+    TIFFClose(tif);
+
+    tif = TIFFOpen(filename, "r");
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        return 0;
+    }
+    for (i = 0; i < NSTRIPS; i++)
+    {
+        uint64_t size = TIFFGetStrileByteCount(tif, i);
+        if (TIFFReadEncodedStrip(tif, i, buf, STRIPSIZE) != STRIPSIZE ||
+            memcmp(buf, strips[i], STRIPSIZE) != 0)
+        {
+            fprintf(stderr, "Strip %u differs\n", i);
+            goto failure;
+        }
+        /* stored data of Deflate and ZSTD has little overhead */
+        if (fallback && i % 2 == 0 && compression != COMPRESSION_LZW &&
+            size > STRIPSIZE + 16)
+        {
+            fprintf(stderr, "Strip %u is not stored\n", i);
+            goto failure;
+        }
+        if (fallback && i % 2 == 1 && size >= STRIPSIZE / 4)
+        {
+            fprintf(stderr, "Strip %u is not compressed\n", i);
+            goto failure;
+        }
+    }
+    if (!TIFFReadDirectory(tif))
+        goto failure;
+    for (i = 0; i < 2; i++)
+    {
+        if (TIFFReadEncodedTile(tif, i, buf, TILESIZE * TILESIZE) !=
+                TILESIZE * TILESIZE ||
+            memcmp(buf, tiles[i], TILESIZE * TILESIZE) != 0)
+        {
+            fprintf(stderr, "Tile %u differs\n", i);
+            goto failure;
+        }
+    }
+    if (!TIFFReadDirectory(tif))
+        goto failure;
+    for (i = 0; i < 2; i++)
+    {
+        if (TIFFReadScanline(tif, buf, i, 0) < 0 ||
+            memcmp(buf, rows[i], WIDE) != 0)
+        {
+            fprintf(stderr, "Row %u differs\n", i);
+            goto failure;
+        }
+    }
+    TIFFClose(tif);
+    return 1;
+
+failure:
+    fprintf(stderr, "Failed for compression %u, fallback %d\n", compression,
+            fallback);
+    TIFFClose(tif);
+    return 0;
+}
+
+int main(void)
+{
+    static const uint16_t schemes[] = {COMPRESSION_ADOBE_DEFLATE,
+                                       COMPRESSION_LZW, COMPRESSION_ZSTD};
+    size_t i;
+    int fallback;
+
+    for (i = 0; i < sizeof(schemes) / sizeof(schemes[0]); i++)
+    {
+        if (!TIFFIsCODECConfigured(schemes[i]))
+            continue;
+        for (fallback = 0; fallback <= 1; fallback++)
+        {
+            if (!test(schemes[i], fallback))
+                return 1;
+        }
+    }
+    unlink(filename);
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test TIFFOpenOptionsSetStreamingWrite(): a tall single strip image written
+ * with TIFFWriteScanline() needs a buffer of the size of the strip, beyond
+ * the memory limit set, unless streaming is enabled.  With streaming, each
+ * row oriented codec writes the image within the limit, including when the
+ * image length is not known in advance, and it reads back identical.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 8192
+#define HEIGHT 2048
+#define MEM_LIMIT (2 * 1024 * 1024)
+#define STREAMING_SIZE (64 * 1024)
+
+static const char filename[] = "test_streaming_write.tif";
+
+/* Compressible but not trivially, and valid as 1 bit per sample */
+static uint8_t pixel(uint32_t x, uint32_t y)
+{
+    return (uint8_t)(((x / 64 + y / 32) & 1) ? 0xff : (x * 3 + y) >> 4);
+}
+
+static void fill_row(uint8_t *buf, uint16_t bps, uint32_t y)
+{
+    uint32_t x;
+
+    if (bps == 1)
+    {
+        for (x = 0; x < WIDTH / 8; x++)
+            buf[x] = pixel(x * 8, y);
+    }
+    else
+    {
+        for (x = 0; x < WIDTH; x++)
+            buf[x] = pixel(x, y);
+    }
+}
+
+static int write_file(uint16_t compression, int streaming, int known_length)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    uint16_t bps = compression == COMPRESSION_CCITTFAX4 ? 1 : 8;
+    uint8_t *buf = (uint8_t *)malloc(WIDTH);
+    TIFF *tif;
+    uint32_t y;
+    int ok = 0;
+
+    TIFFOpenOptionsSetMaxCumulatedMemAlloc(opts, MEM_LIMIT);
+    if (streaming)
+        TIFFOpenOptionsSetStreamingWrite(opts, STREAMING_SIZE);
+    tif = TIFFOpenExt(filename, "w", opts);
+    TIFFOpenOptionsFree(opts);
+    if (!tif || !buf)
+    {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        free(buf);
+        return 0;
+    }
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    if (known_length)
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bps);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+    if (compression == COMPRESSION_ADOBE_DEFLATE ||
+        compression == COMPRESSION_LZW)
+        TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32_t)-1);
+    for (y = 0; y < HEIGHT; y++)
+    {
+        fill_row(buf, bps, y);
+        if (TIFFWriteScanline(tif, buf, y, 0) < 0)
+            break;
+    }
+    if (y == HEIGHT && TIFFWriteDirectory(tif))
+        ok = 1;
+    TIFFClose(tif);
+    free(buf);
+    return ok;
+}
+
+static int check_file(uint16_t compression)
+{
+    TIFF *tif = TIFFOpen(filename, "rc"); /* no strip chopping */
+    uint16_t bps = compression == COMPRESSION_CCITTFAX4 ? 1 : 8;
+    uint8_t *buf = (uint8_t *)malloc(WIDTH);
+    uint8_t *expected = (uint8_t *)malloc(WIDTH);
+    uint32_t length = 0, y;
+    tmsize_t rowsize = bps == 1 ? WIDTH / 8 : WIDTH;
+    int ret = 0;
+
+    if (!tif || !buf || !expected)
+    {
+        fprintf(stderr, "Cannot read %s\n", filename);
+        ret = 1;
+        goto end;
+    }
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &length);
+    if (length != HEIGHT || TIFFNumberOfStrips(tif) != 1)
+    {
+        fprintf(stderr, "Got %u rows in %u strips\n", length,
+                TIFFNumberOfStrips(tif));
+        ret = 1;
+        goto end;
+    }
+    for (y = 0; y < HEIGHT; y++)
+    {
+        fill_row(expected, bps, y);
+        if (TIFFReadScanline(tif, buf, y, 0) < 0 ||
+            memcmp(buf, expected, (size_t)rowsize) != 0)
+        {
+            fprintf(stderr, "Wrong row %u\n", y);
+            ret = 1;
+            break;
+        }
+    }
+end:
+    if (tif)
+        TIFFClose(tif);
+    free(buf);
+    free(expected);
+    return ret;
+}
+
+int main(void)
+{
+    static const uint16_t schemes[] = {
+        COMPRESSION_NONE,          COMPRESSION_PACKBITS,
+        COMPRESSION_LZW,           COMPRESSION_ADOBE_DEFLATE,
+        COMPRESSION_ZSTD,          COMPRESSION_CCITTFAX4,
+    };
+    size_t i;
+    int ret = 0;
+
+    /* Without streaming, the buffer for the whole strip is beyond the limit */
+    if (write_file(COMPRESSION_LZW, 0, 1))
+    {
+        fprintf(stderr, "Unexpected success without streaming\n");
+        ret++;
+    }
+
+    for (i = 0; i < sizeof(schemes) / sizeof(schemes[0]); i++)
+    {
+        int known_length;
+
+        if (!TIFFIsCODECConfigured(schemes[i]))
+            continue;
+        for (known_length = 0; known_length <= 1; known_length++)
+        {
+            if (!write_file(schemes[i], 1, known_length))
+            {
+                fprintf(stderr, "Streaming write failed for compression %u\n",
+                        schemes[i]);
+                ret++;
+            }
+            else if (check_file(schemes[i]))
+            {
+                fprintf(stderr, "Wrong data for compression %u\n", schemes[i]);
+                ret++;
+            }
+        }
+    }
+    if (ret == 0)
+        unlink(filename);
+    return ret;
+}
@@ -0,0 +1,222 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test the byte swapping and bit reversal primitives against reference
+ * implementations, for lengths and alignments covering the vectorized bodies
+ * and the scalar tails, and the round trip of the horizontal predictor on
+ * files of the non native byte order, which byte swaps the samples while
+ * differencing / accumulating them.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define MAXLEN 70
+
+static const char filename[] = "test_swab.tif";
+
+static uint32_t seed = 1;
+
+static uint8_t next_random(void)
+{
+    seed = seed * 1103515245U + 12345U;
+    return (uint8_t)(seed >> 16);
+}
+
+static void fill_random(uint8_t *buf, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++)
+        buf[i] = next_random();
+}
+
+/* Reverse the bytes of each of the n values of size bytes */
+static void swab_reference(uint8_t *buf, size_t n, size_t size)
+{
+    size_t i, j;
+    for (i = 0; i < n; i++, buf += size)
+    {
+        for (j = 0; j < size / 2; j++)
+        {
+            uint8_t t = buf[j];
+            buf[j] = buf[size - 1 - j];
+            buf[size - 1 - j] = t;
+        }
+    }
+}
+
+static uint8_t reverse_reference(uint8_t b)
+{
+    uint8_t r = 0;
+    int i;
+    for (i = 0; i < 8; i++)
+        if (b & (1 << i))
+            r |= (uint8_t)(0x80 >> i);
+    return r;
+}
+
+static int test_primitives(void)
+{
+    /* with guard bytes around the data to check for overruns */
+    uint8_t buf[8 * MAXLEN + 32], expected[8 * MAXLEN + 32];
+    size_t len, offset, size, i;
+
+    for (len = 0; len <= MAXLEN; len++)
+    {
+        for (offset = 0; offset < 8; offset++)
+        {
+            for (size = 1; size <= 8; size *= 2)
+            {
+                uint8_t *p = buf + offset;
+                fill_random(buf, sizeof(buf));
+                memcpy(expected, buf, sizeof(buf));
+                if (size == 1)
+                {
+                    for (i = 0; i < len; i++)
+                        expected[offset + i] =
+                            reverse_reference(expected[offset + i]);
+                    TIFFReverseBits(p, (tmsize_t)len);
+                }
+                else
+                {
+                    swab_reference(expected + offset, len, size);
+                    /* the array functions accept unaligned arrays */
+                    if (size == 2)
+                        TIFFSwabArrayOfShort((uint16_t *)(void *)p,
+                                             (tmsize_t)len);
+                    else if (size == 4)
+                        TIFFSwabArrayOfLong((uint32_t *)(void *)p,
+                                            (tmsize_t)len);
+                    else
+                        TIFFSwabArrayOfLong8((uint64_t *)(void *)p,
+                                             (tmsize_t)len);
+                }
+                if (memcmp(buf, expected, sizeof(buf)) != 0)
+                {
+                    fprintf(stderr,
+                            "Mismatch for size=%u, length=%u, offset=%u\n",
+                            (unsigned)size, (unsigned)len, (unsigned)offset);
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+static int test_predictor(uint16_t bps, uint16_t spp, uint32_t width)
+{
+    const uint32_t height = 3;
+    tmsize_t size = (tmsize_t)width * height * spp * (bps / 8);
+    uint8_t *buf = (uint8_t *)malloc((size_t)size);
+    uint8_t *copy = (uint8_t *)malloc((size_t)size);
+    uint8_t *out = (uint8_t *)malloc((size_t)size);
+    int ok = 0;
+    /* use the non native byte order, so that samples get swapped */
+#ifdef WORDS_BIGENDIAN
+    TIFF *tif = TIFFOpen(filename, "wl");
+#else
+    TIFF *tif = TIFFOpen(filename, "wb");
+#endif
+
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot create %s\n", filename);
+        goto end;
+    }
+    fill_random(buf, (size_t)size);
+    memcpy(copy, buf, (size_t)size);
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bps);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, spp);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, height);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    /* the encoder may modify the data in place */
+    if (TIFFWriteEncodedStrip(tif, 0, copy, size) != size)
+    {
+        fprintf(stderr, "TIFFWriteEncodedStrip() failed\n");
+        TIFFClose(tif);
+        goto end;
+    }
+    TIFFClose(tif);
+
+    tif = TIFFOpen(filename, "r");
+    if (!tif)
+    {
+        fprintf(stderr, "Cannot open %s\n", filename);
+        goto end;
+    }
+    if (TIFFReadEncodedStrip(tif, 0, out, size) != size)
+        fprintf(stderr, "TIFFReadEncodedStrip() failed\n");
+    else if (memcmp(buf, out, (size_t)size) != 0)
+        fprintf(stderr, "Round trip mismatch\n");
+    else
+        ok = 1;
+    TIFFClose(tif);
+end:
+    if (!ok)
+        fprintf(stderr, "Failed for bps=%u, spp=%u, width=%u\n", bps, spp,
+                width);
+    free(buf);
+    free(copy);
+    free(out);
+    return ok;
+}
+
+int main(void)
+{
+    static const uint32_t widths[] = {1, 2, 7, 33};
+    uint16_t bps, spp;
+    size_t i;
+
+    if (!test_primitives())
+        return 1;
+    for (bps = 16; bps <= 64; bps *= 2)
+    {
+        for (spp = 1; spp <= 4; spp++)
+        {
+            for (i = 0; i < sizeof(widths) / sizeof(widths[0]); i++)
+            {
+                if (!test_predictor(bps, spp, widths[i]))
+                    return 1;
+            }
+        }
+    }
+    unlink(filename);
+    return 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test the write-combining buffer (TIFFOpenOptionsSetWriteBufferSize()):
+ * files written through it, whatever its size, must be identical to those
+ * written without it.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 100
+#define HEIGHT 60
+
+static const char reffile[] = "test_write_buffer_ref.tif";
+static const char testfile[] = "test_write_buffer.tif";
+
+static TIFF *open_file(const char *filename, const char *mode,
+                       tmsize_t bufsize)
+{
+    TIFF *tif;
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    if (!opts)
+        return NULL;
+    TIFFOpenOptionsSetWriteBufferSize(opts, bufsize);
+    tif = TIFFOpenExt(filename, mode, opts);
+    TIFFOpenOptionsFree(opts);
+    if (!tif)
+        fprintf(stderr, "Cannot open %s\n", filename);
+    return tif;
+}
+
+static void set_fields(TIFF *tif, int dir)
+{
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_XRESOLUTION, 72.0 + dir);
+    TIFFSetField(tif, TIFFTAG_YRESOLUTION, 72.0);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION,
+                 dir == 1 ? COMPRESSION_LZW : COMPRESSION_NONE);
+    if (dir == 2)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, 16);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, 16);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
+}
+
+/*
+ * Write three directories: one-row strips written by scanline and
+ * checkpointed halfway, LZW strips with a description too large to be
+ * serialized in memory with the directory, and tiles.
+ */
+static int write_file(const char *filename, tmsize_t bufsize)
+{
+    uint8_t buf[WIDTH * 16];
+    char *description;
+    uint32_t x, y, tile;
+    int dir;
+    TIFF *tif = open_file(filename, "w", bufsize);
+    if (!tif)
+        return 1;
+
+    description = (char *)malloc(100000);
+    if (!description)
+    {
+        TIFFClose(tif);
+        return 1;
+    }
+    memset(description, 'a', 99999);
+    description[99999] = '\0';
+
+    for (dir = 0; dir < 3; dir++)
+    {
+        set_fields(tif, dir);
+        if (dir == 1)
+            TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, description);
+        if (dir == 2)
+        {
+            for (tile = 0; tile < TIFFNumberOfTiles(tif); tile++)
+            {
+                for (x = 0; x < 16 * 16; x++)
+                    buf[x] = (uint8_t)(x + tile);
+                if (TIFFWriteEncodedTile(tif, tile, buf, 16 * 16) < 0)
+                    goto bad;
+            }
+        }
+        else
+        {
+            for (y = 0; y < HEIGHT; y++)
+            {
+                for (x = 0; x < WIDTH; x++)
+                    buf[x] = (uint8_t)(x * y + dir);
+                if (TIFFWriteScanline(tif, buf, y, 0) < 0)
+                    goto bad;
+                if (dir == 0 && y == HEIGHT / 2 &&
+                    !TIFFCheckpointDirectory(tif))
+                    goto bad;
+            }
+        }
+        if (!TIFFWriteDirectory(tif))
+            goto bad;
+    }
+    free(description);
+    TIFFClose(tif);
+    return 0;
+
+bad:
+    fprintf(stderr, "Error writing %s (buffer size %ld)\n", filename,
+            (long)bufsize);
+    free(description);
+    TIFFClose(tif);
+    return 1;
+}
+
+/*
+ * Update the file in place: change a tag of the first directory, which then
+ * has to be moved to the end of the file, and rewrite a strip of the
+ * second one.
+ */
+static int update_file(const char *filename, tmsize_t bufsize)
+{
+    uint8_t buf[WIDTH];
+    TIFF *tif = open_file(filename, "r+", bufsize);
+    if (!tif)
+        return 1;
+    memset(buf, 0x55, sizeof(buf));
+    if (!TIFFSetField(tif, TIFFTAG_SOFTWARE, "test_write_buffer") ||
+        !TIFFRewriteDirectory(tif) || !TIFFSetDirectory(tif, 1) ||
+        TIFFWriteEncodedStrip(tif, 3, buf, sizeof(buf)) < 0 ||
+        !TIFFFlush(tif))
+    {
+        fprintf(stderr, "Error updating %s (buffer size %ld)\n", filename,
+                (long)bufsize);
+        TIFFClose(tif);
+        return 1;
+    }
+    TIFFClose(tif);
+    return 0;
+}
+
+static int compare_files(tmsize_t bufsize, const char *step)
+{
+    int ret = 0;
+    FILE *a = fopen(reffile, "rb");
+    FILE *b = fopen(testfile, "rb");
+    if (a && b)
+    {
+        int ca, cb;
+        do
+        {
+            ca = getc(a);
+            cb = getc(b);
+        } while (ca == cb && ca != EOF);
+        ret = ca != cb;
+    }
+    else
+        ret = 1;
+    if (a)
+        fclose(a);
+    if (b)
+        fclose(b);
+    if (ret)
+        fprintf(stderr, "Files differ after %s with buffer size %ld\n", step,
+                (long)bufsize);
+    return ret;
+}
+
+/* Read the file back, to check it is well-formed */
+static int read_file(const char *filename)
+{
+    uint8_t buf[WIDTH * 16];
+    uint32_t y;
+    tdir_t dir;
+    TIFF *tif = TIFFOpen(filename, "r");
+    if (!tif)
+        return 1;
+    if (TIFFNumberOfDirectories(tif) != 3)
+    {
+        fprintf(stderr, "Wrong number of directories\n");
+        TIFFClose(tif);
+        return 1;
+    }
+    for (dir = 0; dir < 2; dir++)
+    {
+        if (!TIFFSetDirectory(tif, dir))
+        {
+            TIFFClose(tif);
+            return 1;
+        }
+        for (y = 0; y < HEIGHT; y++)
+        {
+            uint8_t expected =
+                (dir == 1 && y == 3) ? 0x55 : (uint8_t)(WIDTH / 2 * y + dir);
+            if (TIFFReadScanline(tif, buf, y, 0) < 0 ||
+                buf[WIDTH / 2] != expected)
+            {
+                fprintf(stderr, "Wrong data at line %u of directory %u\n", y,
+                        (unsigned)dir);
+                TIFFClose(tif);
+                return 1;
+            }
+        }
+    }
+    TIFFClose(tif);
+    return 0;
+}
+
+int main(void)
+{
+    static const tmsize_t sizes[] = {1, 7, 100, 4096, 1 << 20};
+    size_t i;
+    int ret = 0;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        if (write_file(reffile, 0) || write_file(testfile, sizes[i]))
+            return 1;
+        ret |= compare_files(sizes[i], "writing");
+        if (update_file(reffile, 0) || update_file(testfile, sizes[i]))
+            return 1;
+        ret |= compare_files(sizes[i], "updating");
+        ret |= read_file(testfile);
+    }
+    if (ret == 0)
+    {
+        unlink(reffile);
+        unlink(testfile);
+    }
+    return ret;
+}
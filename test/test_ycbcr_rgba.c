@@ -0,0 +1,216 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Test the YCbCr to RGB conversion of TIFFReadRGBAImage() for 8-bit
+ * contiguous data with each supported subsampling, in strips and tiles,
+ * with image sizes that are multiples of the subsampling or not, and with
+ * the default and a non-trivial ReferenceBlackWhite: each pixel must be
+ * the one given by TIFFYCbCrtoRGB().
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+static const char filename[] = "test_ycbcr_rgba.tif";
+
+static const uint16_t subsamplings[][2] = {{1, 1}, {2, 1}, {2, 2}, {4, 1},
+                                           {4, 2}, {4, 4}, {1, 2}};
+
+static uint8_t luma(uint32_t x, uint32_t y)
+{
+    return (uint8_t)(x * 5 + y * 3 + ((x * y) & 32));
+}
+
+static uint8_t chroma(uint32_t bx, uint32_t by, int c)
+{
+    /* cover the extremes, where the conversion clamps */
+    return (uint8_t)((bx * 37 + by * 11) * (uint32_t)(c + 1) + (bx & 8) * 15);
+}
+
+static int write_file(uint32_t width, uint32_t height, uint16_t hs,
+                      uint16_t vs, int tiled, float *refbw)
+{
+    TIFF *tif = TIFFOpen(filename, "w");
+    uint32_t blockw = tiled ? 32 : width;
+    uint32_t blockh = 16;
+    uint32_t nbx, bx, by, x, y, i, j;
+    tmsize_t size;
+    uint8_t *buf;
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_YCBCR);
+    TIFFSetField(tif, TIFFTAG_YCBCRSUBSAMPLING, hs, vs);
+    if (refbw)
+        TIFFSetField(tif, TIFFTAG_REFERENCEBLACKWHITE, refbw);
+    if (tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, blockw);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, blockh);
+        size = TIFFTileSize(tif);
+    }
+    else
+    {
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, blockh);
+        size = TIFFStripSize(tif);
+    }
+    nbx = (blockw + hs - 1) / hs;
+    buf = (uint8_t *)malloc((size_t)nbx * (hs * vs + 2) * (blockh / vs));
+    for (by = 0; ok && by < height; by += blockh)
+    {
+        for (bx = 0; ok && bx < width; bx += blockw)
+        {
+            uint8_t *p = buf;
+            /* packed blocks of hs x vs luma samples followed by Cb, Cr */
+            for (y = 0; y < blockh; y += vs)
+            {
+                for (x = 0; x < nbx * hs; x += hs)
+                {
+                    for (j = 0; j < vs; j++)
+                        for (i = 0; i < hs; i++)
+                            *p++ = luma(bx + x + i, by + y + j);
+                    *p++ = chroma((bx + x) / hs, (by + y) / vs, 0);
+                    *p++ = chroma((bx + x) / hs, (by + y) / vs, 1);
+                }
+            }
+            if (tiled)
+                ok = TIFFWriteEncodedTile(
+                         tif, TIFFComputeTile(tif, bx, by, 0, 0), buf,
+                         size) >= 0;
+            else
+                ok = TIFFWriteEncodedStrip(
+                         tif, TIFFComputeStrip(tif, by, 0), buf,
+                         by + blockh <= height
+                             ? size
+                             : TIFFVStripSize(tif, height - by)) >= 0;
+        }
+    }
+    free(buf);
+    TIFFClose(tif);
+    return ok;
+}
+
+static int check_file(uint32_t width, uint32_t height, uint16_t hs,
+                      uint16_t vs, int tiled, float *refbw)
+{
+    static float default_refbw[6] = {0, 255, 128, 255, 128, 255};
+    static float luma_coefs[3] = {0.299f, 0.587f, 0.114f};
+    TIFF *tif = TIFFOpen(filename, "r");
+    uint32_t *raster =
+        (uint32_t *)malloc((size_t)width * height * sizeof(uint32_t));
+    TIFFYCbCrToRGB *ycbcr = (TIFFYCbCrToRGB *)malloc(
+        (sizeof(TIFFYCbCrToRGB) + sizeof(long) - 1) / sizeof(long) *
+            sizeof(long) +
+        4 * 256 * sizeof(TIFFRGBValue) + 2 * 256 * sizeof(int) +
+        3 * 256 * sizeof(int32_t));
+    uint32_t x, y;
+    int ret = 1;
+
+    if (!tif || !raster || !ycbcr ||
+        !TIFFReadRGBAImageOriented(tif, width, height, raster,
+                                   ORIENTATION_TOPLEFT, 1))
+    {
+        fprintf(stderr, "Cannot read %s\n", filename);
+        goto end;
+    }
+    TIFFYCbCrToRGBInit(ycbcr, luma_coefs, refbw ? refbw : default_refbw);
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            uint32_t r, g, b, expected;
+            TIFFYCbCrtoRGB(ycbcr, luma(x, y), chroma(x / hs, y / vs, 0),
+                           chroma(x / hs, y / vs, 1), &r, &g, &b);
+            expected = r | (g << 8) | (b << 16) | 0xff000000U;
+            if (raster[y * width + x] != expected)
+            {
+                fprintf(stderr,
+                        "%ux%u %s, subsampling %u,%u: pixel (%u,%u) is "
+                        "%08x instead of %08x\n",
+                        width, height, tiled ? "tiles" : "strips", hs, vs, x,
+                        y, raster[y * width + x], expected);
+                goto end;
+            }
+        }
+    }
+    ret = 0;
+end:
+    if (tif)
+        TIFFClose(tif);
+    free(raster);
+    free(ycbcr);
+    return ret;
+}
+
+int main(void)
+{
+    static const uint32_t sizes[][2] = {{64, 32}, {301, 203}, {7, 5}};
+    float refbw[6] = {16, 235, 128, 240, 128, 240};
+    size_t i, j;
+    int tiled, k, ret = 0;
+
+    for (i = 0; i < sizeof(subsamplings) / sizeof(subsamplings[0]); i++)
+    {
+        uint16_t hs = subsamplings[i][0];
+        uint16_t vs = subsamplings[i][1];
+        for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++)
+        {
+            for (tiled = 0; tiled < 2; tiled++)
+            {
+                for (k = 0; k < 2; k++)
+                {
+                    float *rbw = k ? refbw : NULL;
+                    if (!write_file(sizes[j][0], sizes[j][1], hs, vs, tiled,
+                                    rbw))
+                    {
+                        fprintf(stderr, "Cannot write %s\n", filename);
+                        ret++;
+                    }
+                    else
+                        ret += check_file(sizes[j][0], sizes[j][1], hs, vs,
+                                          tiled, rbw);
+                }
+            }
+        }
+    }
+    if (ret == 0)
+        unlink(filename);
+    return ret;
+}
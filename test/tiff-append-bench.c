@@ -0,0 +1,331 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Page append benchmark.
+ *
+ * Builds multi-page files of increasing page counts, then measures the
+ * cost of appending one page per session (TIFFOpen() in "a" mode,
+ * TIFFWriteDirectory(), TIFFClose()), with and without the trailer enabled
+ * by TIFFOpenOptionsSetAppendTrailer(). Files are kept in memory, and the
+ * number of read calls is reported along with the time, as it is what
+ * grows with the number of pages on a real file system. The results are
+ * emitted as JSON:
+ *
+ *   tiff-append-bench -p 50000 -o results.json
+ */
+
+#include "libport.h"
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "tiffio.h"
+
+#define PAGE_SIZE 16
+
+/* In-memory file, counting the read calls */
+typedef struct
+{
+    uint8_t *data;
+    toff_t size;
+    toff_t alloc;
+    toff_t pos;
+    uint64_t nreads;
+} MemFile;
+
+static uint32_t maxpages = 10000;
+static int nappends = 20;
+static int bigtiff = 0;
+static FILE *out;
+static int nresults = 0;
+
+static tmsize_t mem_read(thandle_t h, void *buf, tmsize_t size)
+{
+    MemFile *m = (MemFile *)h;
+    m->nreads++;
+    if (m->pos >= m->size)
+        return 0;
+    if ((toff_t)size > m->size - m->pos)
+        size = (tmsize_t)(m->size - m->pos);
+    memcpy(buf, m->data + m->pos, (size_t)size);
+    m->pos += (toff_t)size;
+    return size;
+}
+
+static tmsize_t mem_write(thandle_t h, void *buf, tmsize_t size)
+{
+    MemFile *m = (MemFile *)h;
+    toff_t end = m->pos + (toff_t)size;
+    if (end > m->alloc)
+    {
+        toff_t alloc = m->alloc ? m->alloc : 65536;
+        uint8_t *data;
+        while (alloc < end)
+            alloc *= 2;
+        data = (uint8_t *)realloc(m->data, (size_t)alloc);
+        if (!data)
+            return -1;
+        m->data = data;
+        m->alloc = alloc;
+    }
+    if (m->pos > m->size)
+        memset(m->data + m->size, 0, (size_t)(m->pos - m->size));
+    memcpy(m->data + m->pos, buf, (size_t)size);
+    m->pos = end;
+    if (end > m->size)
+        m->size = end;
+    return size;
+}
+
+static toff_t mem_seek(thandle_t h, toff_t off, int whence)
+{
+    MemFile *m = (MemFile *)h;
+    switch (whence)
+    {
+        case SEEK_SET:
+            m->pos = off;
+            break;
+        case SEEK_CUR:
+            m->pos += off;
+            break;
+        case SEEK_END:
+            m->pos = m->size + off;
+            break;
+    }
+    return m->pos;
+}
+
+static int mem_close(thandle_t h)
+{
+    (void)h;
+    return 0;
+}
+
+static toff_t mem_size(thandle_t h) { return ((MemFile *)h)->size; }
+
+static int mem_map(thandle_t h, void **base, toff_t *size)
+{
+    (void)h;
+    (void)base;
+    (void)size;
+    return 0;
+}
+
+static void mem_unmap(thandle_t h, void *base, toff_t size)
+{
+    (void)h;
+    (void)base;
+    (void)size;
+}
+
+static TIFF *mem_open(MemFile *m, const char *mode, int trailer)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    TIFF *tif;
+
+    if (!opts)
+        return NULL;
+    TIFFOpenOptionsSetAppendTrailer(opts, trailer);
+    m->pos = 0;
+    if (mode[0] == 'w')
+        m->size = 0;
+    tif = TIFFClientOpenExt("tiff-append-bench", mode, (thandle_t)m, mem_read,
+                            mem_write, mem_seek, mem_close, mem_size, mem_map,
+                            mem_unmap, opts);
+    TIFFOpenOptionsFree(opts);
+    return tif;
+}
+
+static double now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static int write_page(TIFF *tif, uint32_t page)
+{
+    uint8_t buf[PAGE_SIZE * PAGE_SIZE];
+
+    memset(buf, (int)(page & 0xff), sizeof(buf));
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, PAGE_SIZE);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, PAGE_SIZE);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, PAGE_SIZE);
+    TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+    return TIFFWriteEncodedStrip(tif, 0, buf, sizeof(buf)) >= 0 &&
+           TIFFWriteDirectory(tif);
+}
+
+static void bench(uint32_t npages, int trailer)
+{
+    MemFile m;
+    TIFF *tif;
+    double start, best = -1, total = 0;
+    uint64_t reads = 0;
+    uint32_t page;
+    int i;
+
+    memset(&m, 0, sizeof(m));
+    tif = mem_open(&m, bigtiff ? "w8" : "w", trailer);
+    if (!tif)
+        exit(1);
+    for (page = 0; page < npages; page++)
+    {
+        if (!write_page(tif, page))
+        {
+            fprintf(stderr, "Cannot write page %u\n", page);
+            exit(1);
+        }
+    }
+    TIFFClose(tif);
+
+    for (i = 0; i < nappends; i++)
+    {
+        double t;
+
+        m.nreads = 0;
+        start = now();
+        tif = mem_open(&m, "a", trailer);
+        if (!tif || !write_page(tif, npages + (uint32_t)i))
+        {
+            fprintf(stderr, "Cannot append page %d\n", i);
+            exit(1);
+        }
+        TIFFClose(tif);
+        t = now() - start;
+        total += t;
+        reads += m.nreads;
+        if (best < 0 || t < best)
+            best = t;
+    }
+
+    fprintf(out, "%s\n    {\"pages\": %u, \"trailer\": %s, ",
+            nresults++ ? "," : "", npages, trailer ? "true" : "false");
+    fprintf(out, "\"appends\": %d, \"file_bytes\": %" PRIu64 ", ", nappends,
+            (uint64_t)m.size);
+    fprintf(out, "\"reads_per_append\": %.1f, ",
+            (double)reads / (double)nappends);
+    fprintf(out, "\"best_us\": %.1f, \"mean_us\": %.1f}", best * 1e6,
+            total / nappends * 1e6);
+    free(m.data);
+}
+
+static void usage(int code)
+{
+    FILE *f = code == 0 ? stdout : stderr;
+    fprintf(f, "usage: tiff-append-bench [options]\n");
+    fprintf(f, " -o file   write the JSON results to file (default stdout)\n");
+    fprintf(f, " -p count  largest number of pages of the files (default "
+               "10000)\n");
+    fprintf(f, " -n count  number of pages appended to each file (default "
+               "20)\n");
+    fprintf(f, " -8        write BigTIFF files\n");
+    exit(code);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outname = NULL;
+    uint32_t npages;
+    int trailer, c;
+
+#if !HAVE_DECL_OPTARG
+    extern char *optarg;
+#endif
+
+    while ((c = getopt(argc, argv, "o:p:n:8h")) != -1)
+    {
+        switch (c)
+        {
+            case 'o':
+                outname = optarg;
+                break;
+            case 'p':
+                maxpages = (uint32_t)atoi(optarg);
+                break;
+            case 'n':
+                nappends = atoi(optarg);
+                break;
+            case '8':
+                bigtiff = 1;
+                break;
+            case 'h':
+                usage(0);
+                break;
+            default:
+                usage(1);
+                break;
+        }
+    }
+    if (maxpages == 0 || nappends <= 0)
+        usage(1);
+    out = outname ? fopen(outname, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Cannot create %s\n", outname);
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"libtiff\": \"%s\",\n",
+            TIFFLIB_VERSION_STR_MAJ_MIN_MIC);
+    fprintf(out, "  \"bigtiff\": %s,\n  \"results\": [",
+            bigtiff ? "true" : "false");
+    /* 10, 100, 1000... pages, up to maxpages */
+    for (npages = 10;; npages *= 10)
+    {
+        if (npages > maxpages)
+            npages = maxpages;
+        for (trailer = 0; trailer <= 1; trailer++)
+            bench(npages, trailer);
+        if (npages == maxpages || npages > UINT32_MAX / 10)
+            break;
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
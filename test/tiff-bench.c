@@ -0,0 +1,652 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * Codec throughput benchmark.
+ *
+ * Synthesizes gray, RGB and floating point images, organized in strips and
+ * in tiles, and measures the encoding and decoding throughput of every
+ * configured codec able to encode them, with each predictor it supports,
+ * for the main read interfaces. Files are written to and read from memory,
+ * so that only libtiff itself is measured. The results are emitted as JSON,
+ * so that they can be compared between builds:
+ *
+ *   tiff-bench -o results.json
+ *
+ * Throughputs are in MB/s (10^6 bytes per second) of uncompressed data, for
+ * the fastest of the iterations.
+ */
+
+#include "libport.h"
+#include "tif_config.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "tiffio.h"
+
+#define TILE_SIZE 256
+#define ROWS_PER_STRIP 32
+
+typedef struct
+{
+    const char *name;
+    uint16_t bitspersample;
+    uint16_t samplesperpixel;
+    uint16_t sampleformat;
+    uint16_t photometric;
+} BenchImage;
+
+static const BenchImage images[] = {
+    {"gray8", 8, 1, SAMPLEFORMAT_UINT, PHOTOMETRIC_MINISBLACK},
+    {"gray16", 16, 1, SAMPLEFORMAT_UINT, PHOTOMETRIC_MINISBLACK},
+    {"rgb8", 8, 3, SAMPLEFORMAT_UINT, PHOTOMETRIC_RGB},
+    {"rgb16", 16, 3, SAMPLEFORMAT_UINT, PHOTOMETRIC_RGB},
+    {"float32", 32, 1, SAMPLEFORMAT_IEEEFP, PHOTOMETRIC_MINISBLACK},
+};
+
+/* Image data ready to be written: strips or tiles, one after the other */
+typedef struct
+{
+    const BenchImage *image;
+    int tiled;
+    uint32_t width;
+    uint32_t height;
+    uint32_t nchunks;
+    tmsize_t chunksize; /* size of a full strip or tile */
+    tmsize_t size;      /* total size of the strips or tiles */
+    uint8_t *data;
+} BenchData;
+
+/* In-memory file, so that I/O does not disturb the measures */
+typedef struct
+{
+    uint8_t *data;
+    toff_t size;
+    toff_t alloc;
+    toff_t pos;
+} MemFile;
+
+static uint32_t width = 1024;
+static uint32_t height = 1024;
+static int iterations = 3;
+static const char *codec_filter = NULL;
+static const char *image_filter = NULL;
+static FILE *out;
+static int nresults = 0;
+static int verbose = 0;
+static int nerrors = 0;
+
+static tmsize_t mem_read(thandle_t h, void *buf, tmsize_t size)
+{
+    MemFile *m = (MemFile *)h;
+    if (m->pos >= m->size)
+        return 0;
+    if ((toff_t)size > m->size - m->pos)
+        size = (tmsize_t)(m->size - m->pos);
+    memcpy(buf, m->data + m->pos, (size_t)size);
+    m->pos += (toff_t)size;
+    return size;
+}
+
+static tmsize_t mem_write(thandle_t h, void *buf, tmsize_t size)
+{
+    MemFile *m = (MemFile *)h;
+    toff_t end = m->pos + (toff_t)size;
+    if (end > m->alloc)
+    {
+        toff_t alloc = m->alloc ? m->alloc : 65536;
+        uint8_t *data;
+        while (alloc < end)
+            alloc *= 2;
+        data = (uint8_t *)realloc(m->data, (size_t)alloc);
+        if (!data)
+            return -1;
+        m->data = data;
+        m->alloc = alloc;
+    }
+    if (m->pos > m->size)
+        memset(m->data + m->size, 0, (size_t)(m->pos - m->size));
+    memcpy(m->data + m->pos, buf, (size_t)size);
+    m->pos = end;
+    if (end > m->size)
+        m->size = end;
+    return size;
+}
+
+static toff_t mem_seek(thandle_t h, toff_t off, int whence)
+{
+    MemFile *m = (MemFile *)h;
+    switch (whence)
+    {
+        case SEEK_SET:
+            m->pos = off;
+            break;
+        case SEEK_CUR:
+            m->pos += off;
+            break;
+        case SEEK_END:
+            m->pos = m->size + off;
+            break;
+    }
+    return m->pos;
+}
+
+static int mem_close(thandle_t h)
+{
+    (void)h;
+    return 0;
+}
+
+static toff_t mem_size(thandle_t h) { return ((MemFile *)h)->size; }
+
+static int mem_map(thandle_t h, void **base, toff_t *size)
+{
+    MemFile *m = (MemFile *)h;
+    *base = m->data;
+    *size = m->size;
+    return 1;
+}
+
+static void mem_unmap(thandle_t h, void *base, toff_t size)
+{
+    (void)h;
+    (void)base;
+    (void)size;
+}
+
+static TIFF *mem_open(MemFile *m, const char *mode)
+{
+    m->pos = 0;
+    if (mode[0] == 'w')
+        m->size = 0;
+    return TIFFClientOpen("tiff-bench", mode, (thandle_t)m, mem_read,
+                          mem_write, mem_seek, mem_close, mem_size, mem_map,
+                          mem_unmap);
+}
+
+/*
+ * Some codecs only have a decoder, and their encoding functions report an
+ * error without making TIFFWriteEncodedStrip() fail, so errors are counted.
+ */
+static void error_handler(const char *module, const char *fmt, va_list ap)
+{
+    nerrors++;
+    if (verbose)
+    {
+        if (module)
+            fprintf(stderr, "%s: ", module);
+        vfprintf(stderr, fmt, ap);
+        fprintf(stderr, "\n");
+    }
+}
+
+static double now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/*
+ * Smooth gradients with some noise, to get compression ratios closer to
+ * those of real images than with purely random or constant data.
+ */
+static double sample_value(uint32_t x, uint32_t y, uint16_t s, uint32_t *seed)
+{
+    uint32_t v = (x * (s + 2U) + y * 3U + ((x * y) >> 8)) % 1024U;
+    *seed = *seed * 1103515245U + 12345U;
+    return ((double)v + (double)((*seed >> 16) & 7)) / 1032.0;
+}
+
+static void store_sample(const BenchImage *img, uint8_t *p, double v)
+{
+    switch (img->bitspersample)
+    {
+        case 8:
+            *p = (uint8_t)(v * 255.0);
+            break;
+        case 16:
+        {
+            uint16_t w = (uint16_t)(v * 65535.0);
+            memcpy(p, &w, sizeof(w));
+            break;
+        }
+        default:
+        {
+            float f = (float)(v * 100.0 - 10.0);
+            memcpy(p, &f, sizeof(f));
+            break;
+        }
+    }
+}
+
+/* Synthesize the image as strips or tiles of the given geometry */
+static int synthesize(BenchData *d, const BenchImage *img, int tiled)
+{
+    size_t bps = img->bitspersample / 8;
+    size_t pixelsize = bps * img->samplesperpixel;
+    uint32_t cw = tiled ? TILE_SIZE : width;
+    uint32_t ch = tiled ? TILE_SIZE : ROWS_PER_STRIP;
+    uint32_t across = (width + cw - 1) / cw;
+    uint32_t down = (height + ch - 1) / ch;
+    uint32_t seed = 1;
+    uint32_t x, y;
+    uint16_t s;
+
+    d->image = img;
+    d->tiled = tiled;
+    d->width = width;
+    d->height = height;
+    d->nchunks = across * down;
+    d->chunksize = (tmsize_t)(cw * ch * pixelsize);
+    /* the last strip is shorter, while tiles are padded */
+    d->size = tiled ? d->chunksize * d->nchunks
+                    : (tmsize_t)(width * height * pixelsize);
+    d->data = (uint8_t *)calloc(1, (size_t)d->chunksize * d->nchunks);
+    if (!d->data)
+        return 0;
+    for (y = 0; y < height; y++)
+    {
+        for (x = 0; x < width; x++)
+        {
+            size_t chunk = (size_t)(y / ch) * across + x / cw;
+            uint8_t *p = d->data + chunk * (size_t)d->chunksize +
+                         ((size_t)(y % ch) * cw + x % cw) * pixelsize;
+            for (s = 0; s < img->samplesperpixel; s++)
+                store_sample(img, p + s * bps, sample_value(x, y, s, &seed));
+        }
+    }
+    return 1;
+}
+
+static tmsize_t chunk_length(const BenchData *d, uint32_t i)
+{
+    if (i + 1 == d->nchunks)
+        return d->size - d->chunksize * i;
+    return d->chunksize;
+}
+
+static int setup_fields(TIFF *tif, const BenchData *d, uint16_t compression,
+                        uint16_t predictor)
+{
+    const BenchImage *img = d->image;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, d->width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, d->height);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, img->bitspersample);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, img->samplesperpixel);
+    TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, img->sampleformat);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, img->photometric);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    if (d->tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILE_SIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILE_SIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWS_PER_STRIP);
+    if (!TIFFSetField(tif, TIFFTAG_COMPRESSION, compression))
+        return 0;
+    /* fails for codecs without predictor support */
+    if (predictor != PREDICTOR_NONE &&
+        !TIFFSetField(tif, TIFFTAG_PREDICTOR, predictor))
+        return 0;
+    return 1;
+}
+
+/*
+ * Write the image to a memory file, returning the time spent in the
+ * encoding functions and TIFFClose(), or a negative value if the codec does
+ * not support the image. The encoders are allowed to modify the data, so
+ * each iteration works on a fresh copy.
+ */
+static double encode(const BenchData *d, uint8_t *scratch, uint16_t compression,
+                     uint16_t predictor, MemFile *m)
+{
+    TIFF *tif;
+    double start;
+    uint32_t i;
+
+    memcpy(scratch, d->data, (size_t)d->chunksize * d->nchunks);
+    nerrors = 0;
+    tif = mem_open(m, "w");
+    if (!tif)
+        return -1;
+    if (!setup_fields(tif, d, compression, predictor))
+    {
+        TIFFClose(tif);
+        return -1;
+    }
+    start = now();
+    for (i = 0; i < d->nchunks; i++)
+    {
+        uint8_t *p = scratch + (size_t)d->chunksize * i;
+        tmsize_t n = chunk_length(d, i);
+        if ((d->tiled ? TIFFWriteEncodedTile(tif, i, p, n)
+                      : TIFFWriteEncodedStrip(tif, i, p, n)) != n)
+        {
+            TIFFClose(tif);
+            return -1;
+        }
+    }
+    TIFFClose(tif);
+    return nerrors ? -1 : now() - start;
+}
+
+typedef enum
+{
+    READ_ENCODED,
+    READ_SCANLINE,
+    READ_RGBA
+} ReadMethod;
+
+/*
+ * Read the image back from the memory file with the given interface,
+ * returning the time spent or a negative value on failure. *lossless is
+ * set when the decoded strips / tiles match the original data.
+ */
+static double decode(const BenchData *d, uint8_t *scratch, ReadMethod method,
+                     MemFile *m, int *lossless)
+{
+    TIFF *tif = mem_open(m, "r");
+    double start, elapsed = -1;
+    uint32_t i;
+
+    if (!tif)
+        return -1;
+    nerrors = 0;
+    start = now();
+    switch (method)
+    {
+        case READ_ENCODED:
+            for (i = 0; i < d->nchunks; i++)
+            {
+                uint8_t *p = scratch + (size_t)d->chunksize * i;
+                tmsize_t n = chunk_length(d, i);
+                if ((d->tiled ? TIFFReadEncodedTile(tif, i, p, n)
+                              : TIFFReadEncodedStrip(tif, i, p, n)) != n)
+                    goto end;
+            }
+            break;
+        case READ_SCANLINE:
+        {
+            tmsize_t linesize = TIFFScanlineSize(tif);
+            for (i = 0; i < d->height; i++)
+            {
+                if (TIFFReadScanline(tif, scratch + linesize * i, i, 0) < 0)
+                    goto end;
+            }
+            break;
+        }
+        case READ_RGBA:
+            if (!TIFFReadRGBAImage(tif, d->width, d->height,
+                                   (uint32_t *)(void *)scratch, 0))
+                goto end;
+            break;
+    }
+    if (nerrors)
+        goto end;
+    elapsed = now() - start;
+    if (lossless)
+        *lossless = memcmp(scratch, d->data, (size_t)d->size) == 0;
+end:
+    TIFFClose(tif);
+    return elapsed;
+}
+
+static void emit_result(const BenchData *d, const char *codec,
+                        uint16_t predictor, const char *function,
+                        double seconds, const MemFile *m, int lossless)
+{
+    fprintf(out, "%s\n    {\"image\": \"%s\", \"layout\": \"%s\", ",
+            nresults++ ? "," : "", d->image->name,
+            d->tiled ? "tiles" : "strips");
+    fprintf(out, "\"codec\": \"%s\", \"predictor\": %u, ", codec, predictor);
+    fprintf(out, "\"function\": \"%s\", \"bytes\": %" PRId64 ", ", function,
+            (int64_t)d->size);
+    fprintf(out, "\"file_bytes\": %" PRIu64 ", ", (uint64_t)m->size);
+    if (lossless >= 0)
+        fprintf(out, "\"lossless\": %s, ", lossless ? "true" : "false");
+    fprintf(out, "\"seconds\": %.6f, \"mbps\": %.2f}", seconds,
+            seconds > 0 ? (double)d->size / seconds / 1e6 : 0.0);
+}
+
+static void bench_codec(const BenchData *d, const TIFFCodec *codec,
+                        uint16_t predictor, uint8_t *scratch, MemFile *m)
+{
+    static const ReadMethod methods[] = {READ_ENCODED, READ_SCANLINE,
+                                         READ_RGBA};
+    double best = -1;
+    int lossless = 0;
+    size_t i;
+    int k;
+
+    for (k = 0; k < iterations; k++)
+    {
+        double t = encode(d, scratch, codec->scheme, predictor, m);
+        if (t < 0)
+            return;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    emit_result(d, codec->name, predictor,
+                d->tiled ? "TIFFWriteEncodedTile" : "TIFFWriteEncodedStrip",
+                best, m, -1);
+
+    for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++)
+    {
+        const char *function;
+        if (methods[i] == READ_SCANLINE && d->tiled)
+            continue;
+        if (methods[i] == READ_RGBA)
+        {
+            char emsg[1024];
+            TIFF *tif = mem_open(m, "r");
+            int ok = tif && TIFFRGBAImageOK(tif, emsg);
+            if (tif)
+                TIFFClose(tif);
+            if (!ok)
+                continue;
+            function = "TIFFReadRGBAImage";
+        }
+        else if (methods[i] == READ_SCANLINE)
+            function = "TIFFReadScanline";
+        else
+            function = d->tiled ? "TIFFReadEncodedTile"
+                                : "TIFFReadEncodedStrip";
+        best = -1;
+        for (k = 0; k < iterations; k++)
+        {
+            double t = decode(d, scratch, methods[i], m,
+                              methods[i] == READ_ENCODED ? &lossless : NULL);
+            if (t < 0)
+                break;
+            if (best < 0 || t < best)
+                best = t;
+        }
+        if (best >= 0)
+            emit_result(d, codec->name, predictor, function, best, m,
+                        methods[i] == READ_ENCODED ? lossless : -1);
+    }
+}
+
+static void bench_image(const BenchImage *img, int tiled,
+                        const TIFFCodec *codecs)
+{
+    static const uint16_t predictors[] = {
+        PREDICTOR_NONE, PREDICTOR_HORIZONTAL, PREDICTOR_FLOATINGPOINT};
+    BenchData d;
+    MemFile m;
+    uint8_t *scratch;
+    const TIFFCodec *c, *prev;
+    size_t i;
+
+    if (!synthesize(&d, img, tiled))
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    /* large enough for the RGBA raster as well */
+    scratch = (uint8_t *)malloc((size_t)d.chunksize * d.nchunks +
+                                (size_t)width * height * 4);
+    memset(&m, 0, sizeof(m));
+    if (!scratch)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    for (c = codecs; c->name; c++)
+    {
+        if (codec_filter && strcasecmp(codec_filter, c->name) != 0)
+            continue;
+        /* skip aliases, such as Deflate for AdobeDeflate */
+        for (prev = codecs; prev != c; prev++)
+            if (prev->init == c->init)
+                break;
+        if (prev != c)
+            continue;
+        for (i = 0; i < sizeof(predictors) / sizeof(predictors[0]); i++)
+        {
+            if (predictors[i] == PREDICTOR_FLOATINGPOINT &&
+                img->sampleformat != SAMPLEFORMAT_IEEEFP)
+                continue;
+            bench_codec(&d, c, predictors[i], scratch, &m);
+        }
+    }
+    free(m.data);
+    free(scratch);
+    free(d.data);
+}
+
+static void usage(int code)
+{
+    FILE *f = code == 0 ? stdout : stderr;
+    fprintf(f, "usage: tiff-bench [options]\n");
+    fprintf(f, " -o file   write the JSON results to file (default stdout)\n");
+    fprintf(f, " -s size   width and height of the images (default 1024)\n");
+    fprintf(f, " -n count  number of iterations of each measure (default 3)\n");
+    fprintf(f, " -c codec  only benchmark the codec with that name\n");
+    fprintf(f, " -i image  only benchmark that image: gray8, gray16, rgb8,\n"
+               "           rgb16 or float32\n");
+    fprintf(f, " -v        report libtiff errors and warnings\n");
+    exit(code);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outname = NULL;
+    TIFFCodec *codecs;
+    size_t i;
+    int tiled, c;
+
+#if !HAVE_DECL_OPTARG
+    extern char *optarg;
+#endif
+
+    while ((c = getopt(argc, argv, "o:s:n:c:i:vh")) != -1)
+    {
+        switch (c)
+        {
+            case 'o':
+                outname = optarg;
+                break;
+            case 's':
+                width = height = (uint32_t)atoi(optarg);
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'c':
+                codec_filter = optarg;
+                break;
+            case 'i':
+                image_filter = optarg;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            case 'h':
+                usage(0);
+                break;
+            default:
+                usage(1);
+                break;
+        }
+    }
+    if (width == 0 || iterations <= 0)
+        usage(1);
+    /* unsupported combinations of codec and image are expected */
+    TIFFSetErrorHandler(error_handler);
+    if (!verbose)
+        TIFFSetWarningHandler(NULL);
+    out = outname ? fopen(outname, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Cannot create %s\n", outname);
+        return 1;
+    }
+    codecs = TIFFGetConfiguredCODECs();
+    if (!codecs)
+        return 1;
+
+    fprintf(out, "{\n  \"libtiff\": \"%s\",\n",
+            TIFFLIB_VERSION_STR_MAJ_MIN_MIC);
+    fprintf(out, "  \"width\": %u,\n  \"height\": %u,\n", width, height);
+    fprintf(out, "  \"iterations\": %d,\n  \"results\": [", iterations);
+    for (i = 0; i < sizeof(images) / sizeof(images[0]); i++)
+    {
+        if (image_filter && strcmp(image_filter, images[i].name) != 0)
+            continue;
+        for (tiled = 0; tiled <= 1; tiled++)
+            bench_image(&images[i], tiled, codecs);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    _TIFFfree(codecs);
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,336 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+
+/*
+ * TIFF Library
+ *
+ * CIE L*a*b* conversion benchmark.
+ *
+ * Reads 8-bit and 16-bit CIE L*a*b* images with TIFFReadRGBAImageFormat(),
+ * with the exact conversion of each pixel and through tables of several
+ * grid sizes (selected with TIFFRGBA_FORMAT_CIELAB_LUT_BITS()),
+ * and reports the throughput of each read along with the error of the
+ * table conversions against the exact one.  Images are synthesized, or
+ * given on the command line.  The results are emitted as JSON:
+ *
+ *   tiff-cielab-bench -o results.json [file.tif...]
+ *
+ * Errors are in 8-bit RGB values: the largest one, the mean one, and the
+ * share of the samples off by more than 1.
+ */
+
+#include "libport.h"
+#include "tif_config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "tiffio.h"
+
+static const char tmpname[] = "tiff-cielab-bench.tif";
+static const int lut_bits[] = {4, 5, 6};
+
+static uint32_t size = 1024;
+static int iterations = 3;
+static FILE *out;
+static int nresults = 0;
+
+static double now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+/*
+ * Write a size x size image sweeping L* along the rows, and a* and b*
+ * around the hue circle, with chroma growing along the columns.
+ */
+static int synthesize(uint16_t bitspersample)
+{
+    TIFF *tif = TIFFOpen(tmpname, "w");
+    tmsize_t rowsize = (tmsize_t)size * 3 * (bitspersample / 8);
+    uint8_t *row = (uint8_t *)malloc((size_t)rowsize);
+    uint32_t x, y;
+    int ok = tif != NULL && row != NULL;
+
+    if (ok)
+    {
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, size);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, size);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bitspersample);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 3);
+        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_CIELAB);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 64);
+    }
+    for (y = 0; ok && y < size; y++)
+    {
+        double L = 100.0 * y / (size > 1 ? size - 1 : 1);
+        for (x = 0; x < size; x++)
+        {
+            double hue = 6.2831853 * (x % 256) / 256.0;
+            double chroma = 127.0 * x / (size > 1 ? size - 1 : 1);
+            double a = chroma * cos(hue), b = chroma * sin(hue);
+            if (bitspersample == 8)
+            {
+                row[x * 3] = (uint8_t)(L * 255.0 / 100.0 + 0.5);
+                row[x * 3 + 1] = (uint8_t)(int8_t)floor(a + 0.5);
+                row[x * 3 + 2] = (uint8_t)(int8_t)floor(b + 0.5);
+            }
+            else
+            {
+                uint16_t *wrow = (uint16_t *)row;
+                wrow[x * 3] = (uint16_t)(L * 65535.0 / 100.0 + 0.5);
+                wrow[x * 3 + 1] = (uint16_t)(int16_t)floor(a * 256.0 + 0.5);
+                wrow[x * 3 + 2] = (uint16_t)(int16_t)floor(b * 256.0 + 0.5);
+            }
+        }
+        ok = TIFFWriteScanline(tif, row, y, 0) >= 0;
+    }
+    free(row);
+    if (tif)
+        TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "Cannot write %s\n", tmpname);
+    return ok;
+}
+
+/*
+ * Read the image with the conversion selected by bits into raster, and
+ * return the time of the fastest of the iterations, or a negative value on
+ * error.
+ */
+static double read_image(const char *filename, int bits, uint32_t *raster,
+                         uint32_t width, uint32_t height)
+{
+    int format = bits > 0 ? TIFFRGBA_FORMAT_CIELAB_LUT |
+                                TIFFRGBA_FORMAT_CIELAB_LUT_BITS(bits)
+                          : TIFFRGBA_FORMAT_ABGR32;
+    double best = -1.0;
+    int i;
+
+    for (i = 0; i < iterations; i++)
+    {
+        TIFF *tif = TIFFOpen(filename, "r");
+        double start, elapsed;
+        int ok;
+
+        if (tif == NULL)
+            return -1.0;
+        start = now();
+        ok = TIFFReadRGBAImageFormat(tif, width, height, raster,
+                                     ORIENTATION_BOTLEFT, format, 1);
+        elapsed = now() - start;
+        TIFFClose(tif);
+        if (!ok)
+            return -1.0;
+        if (best < 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+static void emit_result(const char *name, uint16_t bitspersample, int bits,
+                        uint64_t npixels, double seconds, int maxerr,
+                        double meanerr, double over1)
+{
+    fprintf(out, "%s\n    {\"image\": \"%s\", \"bits_per_sample\": %u, ",
+            nresults++ ? "," : "", name, bitspersample);
+    if (bits > 0)
+        fprintf(out, "\"grid\": %d, ", (1 << bits) + 1);
+    else
+        fprintf(out, "\"grid\": \"exact\", ");
+    fprintf(out, "\"seconds\": %.6f, \"mpixels_per_s\": %.2f", seconds,
+            seconds > 0 ? (double)npixels / seconds / 1e6 : 0.0);
+    if (bits > 0)
+        fprintf(out,
+                ", \"max_error\": %d, \"mean_error\": %.4f, "
+                "\"over_1\": %.6f",
+                maxerr, meanerr, over1);
+    fprintf(out, "}");
+}
+
+static int bench_file(const char *filename, const char *name)
+{
+    TIFF *tif = TIFFOpen(filename, "r");
+    uint32_t width = 0, height = 0;
+    uint16_t photometric = 0, bitspersample = 0;
+    uint32_t *exact, *raster;
+    uint64_t npixels;
+    double seconds;
+    size_t b;
+
+    if (tif == NULL)
+        return 0;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+    TIFFGetField(tif, TIFFTAG_PHOTOMETRIC, &photometric);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bitspersample);
+    TIFFClose(tif);
+    if (photometric != PHOTOMETRIC_CIELAB)
+    {
+        fprintf(stderr, "%s: not a CIE L*a*b* image\n", filename);
+        return 0;
+    }
+    npixels = (uint64_t)width * height;
+    exact = (uint32_t *)_TIFFmalloc((tmsize_t)(npixels * sizeof(uint32_t)));
+    raster = (uint32_t *)_TIFFmalloc((tmsize_t)(npixels * sizeof(uint32_t)));
+    if (exact == NULL || raster == NULL)
+    {
+        fprintf(stderr, "%s: out of memory\n", filename);
+        _TIFFfree(exact);
+        _TIFFfree(raster);
+        return 0;
+    }
+    seconds = read_image(filename, 0, exact, width, height);
+    if (seconds < 0)
+    {
+        _TIFFfree(exact);
+        _TIFFfree(raster);
+        return 0;
+    }
+    emit_result(name, bitspersample, 0, npixels, seconds, 0, 0.0, 0.0);
+    for (b = 0; b < sizeof(lut_bits) / sizeof(lut_bits[0]); b++)
+    {
+        uint64_t sum = 0, nover = 0, i;
+        int maxerr = 0, s;
+
+        seconds = read_image(filename, lut_bits[b], raster, width, height);
+        if (seconds < 0)
+            break;
+        for (i = 0; i < npixels; i++)
+        {
+            for (s = 0; s < 24; s += 8)
+            {
+                int d = (int)((raster[i] >> s) & 0xff) -
+                        (int)((exact[i] >> s) & 0xff);
+                if (d < 0)
+                    d = -d;
+                sum += (uint64_t)d;
+                nover += d > 1;
+                if (d > maxerr)
+                    maxerr = d;
+            }
+        }
+        emit_result(name, bitspersample, lut_bits[b], npixels, seconds,
+                    maxerr, npixels ? (double)sum / (3.0 * npixels) : 0.0,
+                    npixels ? (double)nover / (3.0 * npixels) : 0.0);
+    }
+    _TIFFfree(exact);
+    _TIFFfree(raster);
+    return 1;
+}
+
+static void usage(int code)
+{
+    FILE *f = code == 0 ? stdout : stderr;
+    fprintf(f, "usage: tiff-cielab-bench [options] [file.tif...]\n");
+    fprintf(f, " -o file   write the JSON results to file (default stdout)\n");
+    fprintf(f, " -s size   width and height of the synthesized images "
+               "(default 1024)\n");
+    fprintf(f, " -n count  number of iterations (default 3)\n");
+    exit(code);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *outname = NULL;
+    int c, ret = 0;
+
+#if !HAVE_DECL_OPTARG
+    extern int optind;
+    extern char *optarg;
+#endif
+
+    while ((c = getopt(argc, argv, "o:s:n:h")) != -1)
+    {
+        switch (c)
+        {
+            case 'o':
+                outname = optarg;
+                break;
+            case 's':
+                size = (uint32_t)atoi(optarg);
+                break;
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'h':
+                usage(0);
+                break;
+            default:
+                usage(1);
+                break;
+        }
+    }
+    if (size == 0 || iterations <= 0)
+        usage(1);
+    out = outname ? fopen(outname, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Cannot create %s\n", outname);
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"libtiff\": \"%s\",\n",
+            TIFFLIB_VERSION_STR_MAJ_MIN_MIC);
+    fprintf(out, "  \"iterations\": %d,\n  \"results\": [", iterations);
+    if (optind < argc)
+    {
+        for (; optind < argc; optind++)
+        {
+            if (!bench_file(argv[optind], argv[optind]))
+                ret = 1;
+        }
+    }
+    else
+    {
+        if (!synthesize(8) || !bench_file(tmpname, "lab8") ||
+            !synthesize(16) || !bench_file(tmpname, "lab16"))
+            ret = 1;
+        unlink(tmpname);
+    }
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+    return ret;
+}
@@ -392,7 +392,10 @@ int copyFaxFile(TIFF *tifin, TIFF *tifout)
     uint16_t badrun;
     int ok;
 
-    tifin->tif_rawdatasize = (tmsize_t)TIFFGetFileSize(tifin);
+    /* Direct calls to the I/O procedures: the macros of tiffiop.h may use
+     * functions that are internal to the library. */
+    tifin->tif_rawdatasize =
+        (tmsize_t)(*tifin->tif_sizeproc)(tifin->tif_clientdata);
     if (tifin->tif_rawdatasize == 0)
     {
         TIFFError(tifin->tif_name, "Empty input file");
@@ -404,7 +407,9 @@ int copyFaxFile(TIFF *tifin, TIFF *tifout)
         TIFFError(tifin->tif_name, "Not enough memory");
         return (0);
     }
-    if (!ReadOK(tifin, tifin->tif_rawdata, tifin->tif_rawdatasize))
+    if ((*tifin->tif_readproc)(tifin->tif_clientdata, tifin->tif_rawdata,
+                               tifin->tif_rawdatasize) !=
+        tifin->tif_rawdatasize)
     {
         TIFFError(tifin->tif_name, "Read error at scanline 0");
         _TIFFfree(tifin->tif_rawdata);
@@ -0,0 +1,115 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that (i) the above copyright notices and this permission notice appear in
+ * all copies of the software and related documentation, and (ii) the names of
+ * Sam Leffler and Silicon Graphics may not be used in any advertising or
+ * publicity relating to the software without the specific, prior written
+ * permission of Sam Leffler and Silicon Graphics.
+ *
+ * THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+ * WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+ * ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+ * OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+ * WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+ * LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include "libport.h"
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tiffio.h"
+
+#ifndef EXIT_SUCCESS
+#define EXIT_SUCCESS 0
+#endif
+#ifndef EXIT_FAILURE
+#define EXIT_FAILURE 1
+#endif
+
+static void usage(int code)
+{
+    FILE *out = (code == EXIT_SUCCESS) ? stdout : stderr;
+
+    fprintf(out, "%s\n\n", TIFFGetVersion());
+    fprintf(out, "Usage: tiffcompact [-q] src.tif dst.tif\n\n");
+    fprintf(out,
+            "Copy src.tif to dst.tif without the space left unused by\n"
+            "rewritten directories and strips/tiles.\n\n");
+    fprintf(out, " -q  do not report the number of bytes reclaimed\n");
+    exit(code);
+}
+
+int main(int argc, char *argv[])
+{
+    TIFF *in, *out;
+    char mode[4];
+    uint64_t reclaimed = 0;
+    int quiet = 0;
+    int ok;
+    int c;
+#if !HAVE_DECL_OPTARG
+    extern int optind;
+#endif
+
+    while ((c = getopt(argc, argv, "qh")) != -1)
+    {
+        switch (c)
+        {
+            case 'q':
+                quiet = 1;
+                break;
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            case '?':
+            default:
+                usage(EXIT_FAILURE);
+                break;
+        }
+    }
+    if (argc - optind != 2)
+        usage(EXIT_FAILURE);
+    if (strcmp(argv[optind], argv[optind + 1]) == 0)
+    {
+        fprintf(stderr, "tiffcompact: Error: Cannot compact a file in place\n");
+        return EXIT_FAILURE;
+    }
+
+    in = TIFFOpen(argv[optind], "r");
+    if (in == NULL)
+        return EXIT_FAILURE;
+
+    /* same byte order and format as the source */
+    mode[0] = 'w';
+    mode[1] = TIFFIsBigEndian(in) ? 'b' : 'l';
+    mode[2] = TIFFIsBigTIFF(in) ? '8' : '\0';
+    mode[3] = '\0';
+    out = TIFFOpen(argv[optind + 1], mode);
+    if (out == NULL)
+    {
+        TIFFClose(in);
+        return EXIT_FAILURE;
+    }
+
+    ok = TIFFCompact(in, out, &reclaimed);
+    TIFFClose(in);
+    TIFFClose(out);
+    if (!ok)
+    {
+        fprintf(stderr, "tiffcompact: Error: Could not compact %s\n",
+                argv[optind]);
+        return EXIT_FAILURE;
+    }
+    if (!quiet)
+        printf("%s: %" PRIu64 " bytes reclaimed\n", argv[optind], reclaimed);
+    return EXIT_SUCCESS;
+}